@@ -3,6 +3,14 @@
 
 #include <math.h>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LINMATH_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define LINMATH_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef _MSC_VER
 #define inline __inline
 #endif
@@ -142,8 +150,35 @@ static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, floa
 		M[3][i] = a[3][i];
 	}
 }
+/* Column c of the product is the sum of the columns of a, weighted by the
+   elements of column c of b. All columns are computed before any is stored,
+   so M may alias a or b. */
 static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 {
+#if defined(LINMATH_SSE)
+	__m128 const a0 = _mm_loadu_ps(a[0]), a1 = _mm_loadu_ps(a[1]), a2 = _mm_loadu_ps(a[2]), a3 = _mm_loadu_ps(a[3]);
+	__m128 temp[4];
+	int c;
+	for(c=0; c<4; ++c)
+		temp[c] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[c][0])), _mm_mul_ps(a1, _mm_set1_ps(b[c][1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[c][2])), _mm_mul_ps(a3, _mm_set1_ps(b[c][3]))));
+	for(c=0; c<4; ++c)
+		_mm_storeu_ps(M[c], temp[c]);
+#elif defined(LINMATH_NEON)
+	float32x4_t const a0 = vld1q_f32(a[0]), a1 = vld1q_f32(a[1]), a2 = vld1q_f32(a[2]), a3 = vld1q_f32(a[3]);
+	float32x4_t temp[4];
+	int c;
+	for(c=0; c<4; ++c) {
+		float32x4_t const bc = vld1q_f32(b[c]);
+		temp[c] = vmulq_lane_f32(a0, vget_low_f32(bc), 0);
+		temp[c] = vmlaq_lane_f32(temp[c], a1, vget_low_f32(bc), 1);
+		temp[c] = vmlaq_lane_f32(temp[c], a2, vget_high_f32(bc), 0);
+		temp[c] = vmlaq_lane_f32(temp[c], a3, vget_high_f32(bc), 1);
+	}
+	for(c=0; c<4; ++c)
+		vst1q_f32(M[c], temp[c]);
+#else
 	mat4x4 temp;
 	int k, r, c;
 	for(c=0; c<4; ++c) for(r=0; r<4; ++r) {
@@ -152,15 +187,34 @@ static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 			temp[c][r] += a[k][r] * b[c][k];
 	}
 	mat4x4_dup(M, temp);
+#endif
 }
+/* r may alias v */
 static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
 {
+#if defined(LINMATH_SSE)
+	__m128 const p = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(M[0]), _mm_set1_ps(v[0])), _mm_mul_ps(_mm_loadu_ps(M[1]), _mm_set1_ps(v[1]))),
+		_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(M[2]), _mm_set1_ps(v[2])), _mm_mul_ps(_mm_loadu_ps(M[3]), _mm_set1_ps(v[3]))));
+	_mm_storeu_ps(r, p);
+#elif defined(LINMATH_NEON)
+	float32x4_t const w = vld1q_f32(v);
+	float32x4_t p = vmulq_lane_f32(vld1q_f32(M[0]), vget_low_f32(w), 0);
+	p = vmlaq_lane_f32(p, vld1q_f32(M[1]), vget_low_f32(w), 1);
+	p = vmlaq_lane_f32(p, vld1q_f32(M[2]), vget_high_f32(w), 0);
+	p = vmlaq_lane_f32(p, vld1q_f32(M[3]), vget_high_f32(w), 1);
+	vst1q_f32(r, p);
+#else
+	vec4 temp;
 	int i, j;
 	for(j=0; j<4; ++j) {
-		r[j] = 0.f;
+		temp[j] = 0.f;
 		for(i=0; i<4; ++i)
-			r[j] += M[i][j] * v[i];
+			temp[j] += M[i][j] * v[i];
 	}
+	for(j=0; j<4; ++j)
+		r[j] = temp[j];
+#endif
 }
 static inline void mat4x4_translate(mat4x4 T, float x, float y, float z)
 {
@@ -675,6 +675,7 @@ extern "C" {
 #define GLFW_CURSOR                 0x00033001
 #define GLFW_STICKY_KEYS            0x00033002
 #define GLFW_STICKY_MOUSE_BUTTONS   0x00033003
+#define GLFW_BATCHED_MOUSE_INPUT    0x00033101
 
 #define GLFW_CURSOR_NORMAL          0x00034001
 #define GLFW_CURSOR_HIDDEN          0x00034002
@@ -729,6 +730,52 @@ extern "C" {
 #define GLFW_CONNECTED              0x00040001
 #define GLFW_DISCONNECTED           0x00040002
 
+/*! @defgroup input_events Input event types
+ *
+ *  See [input event queue](@ref glfwSetInputEventQueue).
+ *
+ *  @ingroup input
+ *  @{ */
+/*! @brief A key was pressed, repeated or released.
+ */
+#define GLFW_EVENT_KEY              0x00050001
+/*! @brief A Unicode character was input.
+ */
+#define GLFW_EVENT_CHAR             0x00050002
+/*! @brief A mouse button was pressed or released.
+ */
+#define GLFW_EVENT_MOUSE_BUTTON     0x00050003
+/*! @brief The cursor moved.
+ */
+#define GLFW_EVENT_CURSOR_POS       0x00050004
+/*! @brief The cursor entered or left the client area.
+ */
+#define GLFW_EVENT_CURSOR_ENTER     0x00050005
+/*! @brief A scroll device was used.
+ */
+#define GLFW_EVENT_SCROLL           0x00050006
+/*! @} */
+
+/*! @defgroup timer_sources Timer sources
+ *
+ *  See [timer source](@ref glfwGetTimerSource).
+ *
+ *  @ingroup input
+ *  @{ */
+/*! @brief A clock with no Vulkan time domain, e.g. `gettimeofday`.
+ */
+#define GLFW_TIMER_OTHER            0x00060001
+/*! @brief `QueryPerformanceCounter`, `VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT`.
+ */
+#define GLFW_TIMER_QUERY_PERFORMANCE_COUNTER 0x00060002
+/*! @brief `CLOCK_MONOTONIC`, `VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT`.
+ */
+#define GLFW_TIMER_CLOCK_MONOTONIC  0x00060003
+/*! @brief `CLOCK_MONOTONIC_RAW`, `VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_EXT`.
+ */
+#define GLFW_TIMER_CLOCK_MONOTONIC_RAW 0x00060004
+/*! @} */
+
 #define GLFW_DONT_CARE              -1
 
 
@@ -1203,6 +1250,52 @@ typedef struct GLFWimage
     unsigned char* pixels;
 } GLFWimage;
 
+/*! @brief Timestamped input event.
+ *
+ *  An input event as queued by the [input event queue](@ref
+ *  glfwSetInputEventQueue).  Members that do not apply to the event type
+ *  are zero.
+ *
+ *  @sa glfwSetInputEventQueue
+ *  @sa glfwGetInputEvents
+ *
+ *  @ingroup input
+ */
+typedef struct GLFWinputevent
+{
+    /*! One of the [input event types](@ref input_events).
+     */
+    int type;
+    /*! The window that received the event.
+     */
+    GLFWwindow* window;
+    /*! The [raw timer](@ref glfwGetTimerValue) value when GLFW processed
+     *  the event.
+     */
+    uint64_t time;
+    /*! The key of a key event, the button of a mouse button event.
+     */
+    int key;
+    /*! The platform-specific scancode of a key event.
+     */
+    int scancode;
+    /*! `GLFW_PRESS`, `GLFW_RELEASE` or `GLFW_REPEAT`; `GLFW_TRUE` or
+     *  `GLFW_FALSE` for cursor enter events.
+     */
+    int action;
+    /*! The modifier key bits of key, character and mouse button events.
+     */
+    int mods;
+    /*! The Unicode code point of a character event.
+     */
+    unsigned int codepoint;
+    /*! The cursor position of cursor position events, the offsets of
+     *  scroll events.
+     */
+    double x;
+    double y;
+} GLFWinputevent;
+
 
 /*************************************************************************
  * GLFW API functions
@@ -2928,6 +3021,14 @@ GLFWAPI int glfwGetInputMode(GLFWwindow* window, int mode);
  *  you are only interested in whether mouse buttons have been pressed but not
  *  when or in which order.
  *
+ *  If the mode is `GLFW_BATCHED_MOUSE_INPUT`, the value must be either
+ *  `GLFW_TRUE` to enable batched mouse input, or `GLFW_FALSE` to disable it.
+ *  With batched mouse input, consecutive cursor movements are reported once
+ *  per event poll with the latest position, and a disabled cursor reports the
+ *  sum of the raw mouse motion read since the last poll.  This is useful for
+ *  high polling rate mice, whose every movement would otherwise be dispatched.
+ *  It is implemented on Windows; X11 always coalesces cursor movements.
+ *
  *  @param[in] window The window whose input mode to set.
  *  @param[in] mode One of `GLFW_CURSOR`, `GLFW_STICKY_KEYS` or
  *  `GLFW_STICKY_MOUSE_BUTTONS`.
@@ -3806,6 +3907,94 @@ GLFWAPI uint64_t glfwGetTimerValue(void);
  */
 GLFWAPI uint64_t glfwGetTimerFrequency(void);
 
+/*! @brief Returns the clock read by the raw timer.
+ *
+ *  This function returns the system clock that @ref glfwGetTimerValue reads.
+ *  Values of the raw timer can be correlated with the timestamps of other APIs
+ *  that read the same clock, e.g. Vulkan device timestamps calibrated with
+ *  `VK_EXT_calibrated_timestamps` in the matching time domain.
+ *
+ *  Where available, the raw timer reads a clock that is not slewed by time
+ *  synchronization, `CLOCK_MONOTONIC_RAW` on Linux.
+ *
+ *  @return One of the [timer sources](@ref timer_sources), or zero if an
+ *  [error](@ref error_handling) occurred.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED.
+ *
+ *  @thread_safety This function may be called from any thread.
+ *
+ *  @sa @ref time
+ *  @sa glfwGetTimerValue
+ *
+ *  @since Added in version 3.2.
+ *
+ *  @ingroup input
+ */
+GLFWAPI int glfwGetTimerSource(void);
+
+/*! @brief Enables or disables the input event queue.
+ *
+ *  This function enables a bounded, lock-free queue that key, character,
+ *  mouse button, cursor position, cursor enter and scroll events are pushed
+ *  into as they are processed, each with the [raw timer](@ref
+ *  glfwGetTimerValue) value at that time.  Another thread, for example a
+ *  render thread, drains it with @ref glfwGetInputEvents without taking a
+ *  lock.  Callbacks are still called.
+ *
+ *  Events processed while the queue is full are dropped and counted, see
+ *  @ref glfwGetDroppedInputEventCount.  Any queued events are discarded when
+ *  the queue is replaced or disabled.
+ *
+ *  @param[in] capacity The number of events the queue holds, rounded up to a
+ *  power of two, or zero to disable the queue.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED, @ref
+ *  GLFW_INVALID_VALUE and @ref GLFW_OUT_OF_MEMORY.
+ *
+ *  @thread_safety This function must only be called from the main thread,
+ *  while no thread calls @ref glfwGetInputEvents.
+ *
+ *  @sa glfwGetInputEvents
+ *
+ *  @ingroup input
+ */
+GLFWAPI void glfwSetInputEventQueue(int capacity);
+
+/*! @brief Removes events from the input event queue.
+ *
+ *  This function moves up to `count` of the oldest events of the [input
+ *  event queue](@ref glfwSetInputEventQueue) into `events`.
+ *
+ *  @param[out] events Where to store the events.
+ *  @param[in] count The maximum number of events to store.
+ *  @return The number of events stored, or zero if the queue is empty,
+ *  disabled or an [error](@ref error_handling) occurred.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED.
+ *
+ *  @thread_safety This function may be called from any thread, but only
+ *  from one thread at a time.
+ *
+ *  @sa glfwSetInputEventQueue
+ *
+ *  @ingroup input
+ */
+GLFWAPI int glfwGetInputEvents(GLFWinputevent* events, int count);
+
+/*! @brief Returns the number of events the input event queue dropped.
+ *
+ *  @return The number of events dropped because the queue was full since it
+ *  was enabled.
+ *
+ *  @errors Possible errors include @ref GLFW_NOT_INITIALIZED.
+ *
+ *  @thread_safety This function must only be called from the main thread.
+ *
+ *  @ingroup input
+ */
+GLFWAPI unsigned int glfwGetDroppedInputEventCount(void);
+
 /*! @brief Makes the context of the specified window current for the calling
  *  thread.
  *
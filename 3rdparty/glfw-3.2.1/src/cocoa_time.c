@@ -58,3 +58,8 @@ uint64_t _glfwPlatformGetTimerFrequency(void)
     return _glfw.ns_time.frequency;
 }
 
+int _glfwPlatformGetTimerSource(void)
+{
+    return GLFW_TIMER_OTHER;
+}
+
@@ -134,6 +134,7 @@ GLFWAPI int glfwInit(void)
     _glfwInitialized = GLFW_TRUE;
 
     _glfw.timerOffset = _glfwPlatformGetTimerValue();
+    _glfw.timerResolution = 1.0 / _glfwPlatformGetTimerFrequency();
 
     // Not all window hints have zero as their default value
     glfwDefaultWindowHints();
@@ -171,6 +172,8 @@ GLFWAPI void glfwTerminate(void)
 
     _glfwPlatformTerminate();
 
+    free(_glfw.inputQueue.events);
+
     memset(&_glfw, 0, sizeof(_glfw));
     _glfwInitialized = GLFW_FALSE;
 }
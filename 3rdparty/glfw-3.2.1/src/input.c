@@ -30,11 +30,61 @@
 #include <assert.h>
 #include <float.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+ #include <intrin.h>
+#endif
 
 // Internal key state used for sticky keys
 #define _GLFW_STICK 3
 
 
+// Loads an input queue index, nothing after it is reordered before it
+//
+static unsigned long loadAcquire(volatile long* index)
+{
+#if defined(_MSC_VER)
+    return (unsigned long) _InterlockedOr(index, 0);
+#else
+    return (unsigned long) __atomic_load_n(index, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Stores an input queue index, nothing before it is reordered after it
+//
+static void storeRelease(volatile long* index, unsigned long value)
+{
+#if defined(_MSC_VER)
+    _InterlockedExchange(index, (long) value);
+#else
+    __atomic_store_n(index, (long) value, __ATOMIC_RELEASE);
+#endif
+}
+
+// Pushes an event into the input queue, if it is enabled
+//
+static void pushEvent(GLFWinputevent* event)
+{
+    unsigned long tail;
+
+    if (!_glfw.inputQueue.events)
+        return;
+
+    // Only the main thread writes the tail
+    tail = (unsigned long) _glfw.inputQueue.tail;
+    if (tail - loadAcquire(&_glfw.inputQueue.head) > _glfw.inputQueue.mask)
+    {
+        _glfw.inputQueue.dropped++;
+        return;
+    }
+
+    event->time = _glfwPlatformGetTimerValue();
+    _glfw.inputQueue.events[tail & _glfw.inputQueue.mask] = *event;
+    storeRelease(&_glfw.inputQueue.tail, tail + 1);
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //////                         GLFW event API                       //////
 //////////////////////////////////////////////////////////////////////////
@@ -60,6 +110,19 @@ void _glfwInputKey(_GLFWwindow* window, int key, int scancode, int action, int m
             action = GLFW_REPEAT;
     }
 
+    if (_glfw.inputQueue.events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_KEY;
+        event.window = (GLFWwindow*) window;
+        event.key = key;
+        event.scancode = scancode;
+        event.action = action;
+        event.mods = mods;
+        pushEvent(&event);
+    }
+
     if (window->callbacks.key)
         window->callbacks.key((GLFWwindow*) window, key, scancode, action, mods);
 }
@@ -69,6 +132,17 @@ void _glfwInputChar(_GLFWwindow* window, unsigned int codepoint, int mods, GLFWb
     if (codepoint < 32 || (codepoint > 126 && codepoint < 160))
         return;
 
+    if (_glfw.inputQueue.events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_CHAR;
+        event.window = (GLFWwindow*) window;
+        event.mods = mods;
+        event.codepoint = codepoint;
+        pushEvent(&event);
+    }
+
     if (window->callbacks.charmods)
         window->callbacks.charmods((GLFWwindow*) window, codepoint, mods);
 
@@ -81,6 +155,17 @@ void _glfwInputChar(_GLFWwindow* window, unsigned int codepoint, int mods, GLFWb
 
 void _glfwInputScroll(_GLFWwindow* window, double xoffset, double yoffset)
 {
+    if (_glfw.inputQueue.events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_SCROLL;
+        event.window = (GLFWwindow*) window;
+        event.x = xoffset;
+        event.y = yoffset;
+        pushEvent(&event);
+    }
+
     if (window->callbacks.scroll)
         window->callbacks.scroll((GLFWwindow*) window, xoffset, yoffset);
 }
@@ -96,6 +181,18 @@ void _glfwInputMouseClick(_GLFWwindow* window, int button, int action, int mods)
     else
         window->mouseButtons[button] = (char) action;
 
+    if (_glfw.inputQueue.events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_MOUSE_BUTTON;
+        event.window = (GLFWwindow*) window;
+        event.key = button;
+        event.action = action;
+        event.mods = mods;
+        pushEvent(&event);
+    }
+
     if (window->callbacks.mouseButton)
         window->callbacks.mouseButton((GLFWwindow*) window, button, action, mods);
 }
@@ -108,12 +205,33 @@ void _glfwInputCursorPos(_GLFWwindow* window, double xpos, double ypos)
     window->virtualCursorPosX = xpos;
     window->virtualCursorPosY = ypos;
 
+    if (_glfw.inputQueue.events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_CURSOR_POS;
+        event.window = (GLFWwindow*) window;
+        event.x = xpos;
+        event.y = ypos;
+        pushEvent(&event);
+    }
+
     if (window->callbacks.cursorPos)
         window->callbacks.cursorPos((GLFWwindow*) window, xpos, ypos);
 }
 
 void _glfwInputCursorEnter(_GLFWwindow* window, GLFWbool entered)
 {
+    if (_glfw.inputQueue.events)
+    {
+        GLFWinputevent event;
+        memset(&event, 0, sizeof(event));
+        event.type = GLFW_EVENT_CURSOR_ENTER;
+        event.window = (GLFWwindow*) window;
+        event.action = entered;
+        pushEvent(&event);
+    }
+
     if (window->callbacks.cursorEnter)
         window->callbacks.cursorEnter((GLFWwindow*) window, entered);
 }
@@ -162,6 +280,8 @@ GLFWAPI int glfwGetInputMode(GLFWwindow* handle, int mode)
             return window->stickyKeys;
         case GLFW_STICKY_MOUSE_BUTTONS:
             return window->stickyMouseButtons;
+        case GLFW_BATCHED_MOUSE_INPUT:
+            return window->batchedMouseInput;
         default:
             _glfwInputError(GLFW_INVALID_ENUM, "Invalid input mode %i", mode);
             return 0;
@@ -245,6 +365,13 @@ GLFWAPI void glfwSetInputMode(GLFWwindow* handle, int mode, int value)
             window->stickyMouseButtons = value ? GLFW_TRUE : GLFW_FALSE;
             return;
         }
+
+        case GLFW_BATCHED_MOUSE_INPUT:
+        {
+            // The platform picks this up at the next event poll
+            window->batchedMouseInput = value ? GLFW_TRUE : GLFW_FALSE;
+            return;
+        }
     }
 
     _glfwInputError(GLFW_INVALID_ENUM, "Invalid input mode %i", mode);
@@ -627,8 +754,8 @@ GLFWAPI const char* glfwGetClipboardString(GLFWwindow* handle)
 GLFWAPI double glfwGetTime(void)
 {
     _GLFW_REQUIRE_INIT_OR_RETURN(0.0);
-    return (double) (_glfwPlatformGetTimerValue() - _glfw.timerOffset) /
-        _glfwPlatformGetTimerFrequency();
+    return (double) (_glfwPlatformGetTimerValue() - _glfw.timerOffset) *
+        _glfw.timerResolution;
 }
 
 GLFWAPI void glfwSetTime(double time)
@@ -657,3 +784,73 @@ GLFWAPI uint64_t glfwGetTimerFrequency(void)
     return _glfwPlatformGetTimerFrequency();
 }
 
+GLFWAPI int glfwGetTimerSource(void)
+{
+    _GLFW_REQUIRE_INIT_OR_RETURN(0);
+    return _glfwPlatformGetTimerSource();
+}
+
+GLFWAPI void glfwSetInputEventQueue(int capacity)
+{
+    GLFWinputevent* events = NULL;
+    unsigned int size = 0;
+
+    _GLFW_REQUIRE_INIT();
+
+    if (capacity < 0 || capacity > (1 << 24))
+    {
+        _glfwInputError(GLFW_INVALID_VALUE, "Invalid input queue capacity %i", capacity);
+        return;
+    }
+
+    if (capacity)
+    {
+        size = 1;
+        while (size < (unsigned int) capacity)
+            size <<= 1;
+
+        events = calloc(size, sizeof(GLFWinputevent));
+        if (!events)
+        {
+            _glfwInputError(GLFW_OUT_OF_MEMORY, NULL);
+            return;
+        }
+    }
+
+    free(_glfw.inputQueue.events);
+    _glfw.inputQueue.events = events;
+    _glfw.inputQueue.mask = size ? size - 1 : 0;
+    _glfw.inputQueue.dropped = 0;
+    _glfw.inputQueue.head = 0;
+    _glfw.inputQueue.tail = 0;
+}
+
+GLFWAPI int glfwGetInputEvents(GLFWinputevent* events, int count)
+{
+    unsigned long head, tail;
+    int i;
+
+    assert(events != NULL || count == 0);
+
+    _GLFW_REQUIRE_INIT_OR_RETURN(0);
+
+    if (!_glfw.inputQueue.events || count <= 0)
+        return 0;
+
+    // Only the consumer writes the head
+    head = (unsigned long) _glfw.inputQueue.head;
+    tail = loadAcquire(&_glfw.inputQueue.tail);
+
+    for (i = 0;  i < count && head != tail;  i++, head++)
+        events[i] = _glfw.inputQueue.events[head & _glfw.inputQueue.mask];
+
+    storeRelease(&_glfw.inputQueue.head, head);
+    return i;
+}
+
+GLFWAPI unsigned int glfwGetDroppedInputEventCount(void)
+{
+    _GLFW_REQUIRE_INIT_OR_RETURN(0);
+    return _glfw.inputQueue.dropped;
+}
+
@@ -363,6 +363,7 @@ struct _GLFWwindow
 
     GLFWbool            stickyKeys;
     GLFWbool            stickyMouseButtons;
+    GLFWbool            batchedMouseInput;
     int                 cursorMode;
     char                mouseButtons[GLFW_MOUSE_BUTTON_LAST + 1];
     char                keys[GLFW_KEY_LAST + 1];
@@ -445,6 +446,8 @@ struct _GLFWlibrary
     int                 monitorCount;
 
     uint64_t            timerOffset;
+    // Seconds per raw timer tick, saves a division per glfwGetTime
+    double              timerResolution;
 
     struct {
         GLFWbool        available;
@@ -468,6 +471,16 @@ struct _GLFWlibrary
         GLFWjoystickfun joystick;
     } callbacks;
 
+    // Single producer (the main thread), single consumer ring of input events
+    struct {
+        GLFWinputevent* events;
+        unsigned int    mask;
+        unsigned int    dropped;
+        // Free-running indices, written by the consumer and producer respectively
+        volatile long   head;
+        volatile long   tail;
+    } inputQueue;
+
     // This is defined in the window API's platform.h
     _GLFW_PLATFORM_LIBRARY_WINDOW_STATE;
     // This is defined in the context API's context.h
@@ -625,6 +638,11 @@ uint64_t _glfwPlatformGetTimerValue(void);
  */
 uint64_t _glfwPlatformGetTimerFrequency(void);
 
+/*! @copydoc glfwGetTimerSource
+ *  @ingroup platform
+ */
+int _glfwPlatformGetTimerSource(void);
+
 /*! @ingroup platform
  */
 int _glfwPlatformCreateWindow(_GLFWwindow* window,
@@ -32,6 +32,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -42,6 +43,32 @@
 #include <unistd.h>
 #endif // __linux__
 
+// The epoll data of the inotify descriptor, joysticks use their index
+#define _GLFW_JOYSTICK_INOTIFY (GLFW_JOYSTICK_LAST + 1)
+
+
+// Adds a descriptor to the epoll set, its events are reported with the data
+//
+#if defined(__linux__)
+static void watchDescriptor(int fd, uint32_t data)
+{
+    struct epoll_event event;
+
+    if (_glfw.linux_js.epoll == -1)
+        return;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = data;
+
+    if (epoll_ctl(_glfw.linux_js.epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Linux: Failed to watch joystick descriptor: %s",
+                        strerror(errno));
+    }
+}
+#endif // __linux__
 
 // Attempt to open the specified joystick device
 //
@@ -101,32 +128,33 @@ static GLFWbool openJoystickDevice(const char* path)
     js->buttonCount = (int) buttonCount;
     js->buttons = calloc(buttonCount, 1);
 
+    // The driver queues the initial state, so the device is read right away
+    watchDescriptor(fd, (uint32_t) joy);
+
     _glfwInputJoystickChange(joy, GLFW_CONNECTED);
     return GLFW_TRUE;
 }
 #endif // __linux__
 
-// Polls for and processes events the specified joystick
+// Reads all queued events of the specified joystick (non-blocking)
 //
-static GLFWbool pollJoystickEvents(_GLFWjoystickLinux* js)
-{
 #if defined(__linux__)
-    _glfwPollJoystickEvents();
-
-    if (!js->present)
-        return GLFW_FALSE;
-
-    // Read all queued events (non-blocking)
+static void readJoystickEvents(_GLFWjoystickLinux* js)
+{
     for (;;)
     {
-        struct js_event e;
+        struct js_event events[64];
+        ssize_t size, i;
 
         errno = 0;
-        if (read(js->fd, &e, sizeof(e)) < 0)
+        size = read(js->fd, events, sizeof(events));
+        if (size < 0)
         {
             // Reset the joystick slot if the device was disconnected
             if (errno == ENODEV)
             {
+                // Closing the descriptor also removes it from the epoll set
+                close(js->fd);
                 free(js->axes);
                 free(js->buttons);
                 free(js->name);
@@ -138,17 +166,60 @@ static GLFWbool pollJoystickEvents(_GLFWjoystickLinux* js)
                                          GLFW_DISCONNECTED);
             }
 
-            break;
+            return;
         }
 
-        // Clear the initial-state bit
-        e.type &= ~JS_EVENT_INIT;
+        for (i = 0;  i < size / (ssize_t) sizeof(struct js_event);  i++)
+        {
+            struct js_event e = events[i];
+
+            // Clear the initial-state bit
+            e.type &= ~JS_EVENT_INIT;
+
+            if (e.type == JS_EVENT_AXIS && e.number < js->axisCount)
+                js->axes[e.number] = (float) e.value / 32767.0f;
+            else if (e.type == JS_EVENT_BUTTON && e.number < js->buttonCount)
+                js->buttons[e.number] = e.value ? GLFW_PRESS : GLFW_RELEASE;
+        }
 
-        if (e.type == JS_EVENT_AXIS)
-            js->axes[e.number] = (float) e.value / 32767.0f;
-        else if (e.type == JS_EVENT_BUTTON)
-            js->buttons[e.number] = e.value ? GLFW_PRESS : GLFW_RELEASE;
+        // A short read means the queue is drained
+        if (size < (ssize_t) sizeof(events))
+            return;
     }
+}
+
+// Opens the joystick devices inotify reported as created
+//
+static void readConnectionEvents(void)
+{
+    ssize_t offset = 0;
+    char buffer[16384];
+
+    const ssize_t size = read(_glfw.linux_js.inotify, buffer, sizeof(buffer));
+
+    while (size > offset)
+    {
+        regmatch_t match;
+        const struct inotify_event* e = (struct inotify_event*) (buffer + offset);
+
+        if (regexec(&_glfw.linux_js.regex, e->name, 1, &match, 0) == 0)
+        {
+            char path[20];
+            snprintf(path, sizeof(path), "/dev/input/%s", e->name);
+            openJoystickDevice(path);
+        }
+
+        offset += sizeof(struct inotify_event) + e->len;
+    }
+}
+#endif // __linux__
+
+// Polls for and processes events the specified joystick
+//
+static GLFWbool pollJoystickEvents(_GLFWjoystickLinux* js)
+{
+#if defined(__linux__)
+    _glfwPollJoystickEvents();
 #endif // __linux__
     return js->present;
 }
@@ -175,9 +246,18 @@ GLFWbool _glfwInitJoysticksLinux(void)
 {
 #if defined(__linux__)
     DIR* dir;
-    int count = 0;
+    int count = 0, joy;
     const char* dirname = "/dev/input";
 
+    _glfw.linux_js.epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (_glfw.linux_js.epoll == -1)
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Linux: Failed to create epoll instance: %s",
+                        strerror(errno));
+        return GLFW_FALSE;
+    }
+
     _glfw.linux_js.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (_glfw.linux_js.inotify == -1)
     {
@@ -187,6 +267,8 @@ GLFWbool _glfwInitJoysticksLinux(void)
         return GLFW_FALSE;
     }
 
+    watchDescriptor(_glfw.linux_js.inotify, _GLFW_JOYSTICK_INOTIFY);
+
     // HACK: Register for IN_ATTRIB as well to get notified when udev is done
     //       This works well in practice but the true way is libudev
 
@@ -238,6 +320,18 @@ GLFWbool _glfwInitJoysticksLinux(void)
     }
 
     qsort(_glfw.linux_js.js, count, sizeof(_GLFWjoystickLinux), compareJoysticks);
+
+    // Sorting moved the joysticks between slots, the epoll data is the slot
+    for (joy = 0;  joy < count;  joy++)
+    {
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t) joy;
+        epoll_ctl(_glfw.linux_js.epoll, EPOLL_CTL_MOD,
+                  _glfw.linux_js.js[joy].fd, &event);
+    }
 #endif // __linux__
 
     return GLFW_TRUE;
@@ -271,34 +365,48 @@ void _glfwTerminateJoysticksLinux(void)
 
         close(_glfw.linux_js.inotify);
     }
+
+    if (_glfw.linux_js.epoll > 0)
+        close(_glfw.linux_js.epoll);
 #endif // __linux__
 }
 
+// Reads the devices that have queued events and the connection events, one
+// system call when nothing changed however many joysticks are open
+//
 void _glfwPollJoystickEvents(void)
 {
 #if defined(__linux__)
-    ssize_t offset = 0;
-    char buffer[16384];
+    struct epoll_event events[GLFW_JOYSTICK_LAST + 2];
+    int count, i;
 
-    const ssize_t size = read(_glfw.linux_js.inotify, buffer, sizeof(buffer));
+    count = epoll_wait(_glfw.linux_js.epoll, events,
+                       sizeof(events) / sizeof(events[0]), 0);
 
-    while (size > offset)
+    for (i = 0;  i < count;  i++)
     {
-        regmatch_t match;
-        const struct inotify_event* e = (struct inotify_event*) (buffer + offset);
+        const uint32_t data = events[i].data.u32;
 
-        if (regexec(&_glfw.linux_js.regex, e->name, 1, &match, 0) == 0)
-        {
-            char path[20];
-            snprintf(path, sizeof(path), "/dev/input/%s", e->name);
-            openJoystickDevice(path);
-        }
-
-        offset += sizeof(struct inotify_event) + e->len;
+        if (data == _GLFW_JOYSTICK_INOTIFY)
+            readConnectionEvents();
+        else if (data <= GLFW_JOYSTICK_LAST && _glfw.linux_js.js[data].present)
+            readJoystickEvents(_glfw.linux_js.js + data);
     }
 #endif
 }
 
+// Returns a descriptor that is readable while joystick events are queued, so
+// event waits can include it
+//
+int _glfwJoystickEventFdLinux(void)
+{
+#if defined(__linux__)
+    return _glfw.linux_js.epoll;
+#else
+    return -1;
+#endif
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                       GLFW platform API                      //////
@@ -56,6 +56,9 @@ typedef struct _GLFWjoylistLinux
     int             inotify;
     int             watch;
     regex_t         regex;
+    // Reports the joystick devices with queued events and the inotify
+    // descriptor, readable itself whenever any of them is
+    int             epoll;
 #endif /*__linux__*/
 } _GLFWjoylistLinux;
 
@@ -64,5 +67,6 @@ GLFWbool _glfwInitJoysticksLinux(void);
 void _glfwTerminateJoysticksLinux(void);
 
 void _glfwPollJoystickEvents(void);
+int _glfwJoystickEventFdLinux(void);
 
 #endif // _glfw3_linux_joystick_h_
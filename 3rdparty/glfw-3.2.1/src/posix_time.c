@@ -42,15 +42,29 @@ void _glfwInitTimerPOSIX(void)
 #if defined(CLOCK_MONOTONIC)
     struct timespec ts;
 
+#if defined(CLOCK_MONOTONIC_RAW)
+    // Not slewed by NTP, and read by the vDSO without a system call
+    if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) == 0)
+    {
+        _glfw.posix_time.monotonic = GLFW_TRUE;
+        _glfw.posix_time.clock = CLOCK_MONOTONIC_RAW;
+        _glfw.posix_time.source = GLFW_TIMER_CLOCK_MONOTONIC_RAW;
+        _glfw.posix_time.frequency = 1000000000;
+    }
+    else
+#endif
     if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
     {
         _glfw.posix_time.monotonic = GLFW_TRUE;
+        _glfw.posix_time.clock = CLOCK_MONOTONIC;
+        _glfw.posix_time.source = GLFW_TIMER_CLOCK_MONOTONIC;
         _glfw.posix_time.frequency = 1000000000;
     }
     else
 #endif
     {
         _glfw.posix_time.monotonic = GLFW_FALSE;
+        _glfw.posix_time.source = GLFW_TIMER_OTHER;
         _glfw.posix_time.frequency = 1000000;
     }
 }
@@ -66,7 +80,7 @@ uint64_t _glfwPlatformGetTimerValue(void)
     if (_glfw.posix_time.monotonic)
     {
         struct timespec ts;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
+        clock_gettime(_glfw.posix_time.clock, &ts);
         return (uint64_t) ts.tv_sec * (uint64_t) 1000000000 + (uint64_t) ts.tv_nsec;
     }
     else
@@ -83,3 +97,8 @@ uint64_t _glfwPlatformGetTimerFrequency(void)
     return _glfw.posix_time.frequency;
 }
 
+int _glfwPlatformGetTimerSource(void)
+{
+    return _glfw.posix_time.source;
+}
+
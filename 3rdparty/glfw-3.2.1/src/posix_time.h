@@ -31,6 +31,7 @@
 #define _GLFW_PLATFORM_LIBRARY_TIME_STATE _GLFWtimePOSIX posix_time
 
 #include <stdint.h>
+#include <time.h>
 
 
 // POSIX-specific global timer data
@@ -38,6 +39,8 @@
 typedef struct _GLFWtimePOSIX
 {
     GLFWbool    monotonic;
+    clockid_t   clock;
+    int         source;
     uint64_t    frequency;
 
 } _GLFWtimePOSIX;
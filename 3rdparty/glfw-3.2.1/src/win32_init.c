@@ -444,6 +444,7 @@ void _glfwPlatformTerminate(void)
                           SPIF_SENDCHANGE);
 
     free(_glfw.win32.clipboardString);
+    free(_glfw.win32.rawInput.buffer);
 
     _glfwTerminateWGL();
     _glfwTerminateEGL();
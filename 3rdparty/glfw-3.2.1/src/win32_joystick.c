@@ -31,8 +31,9 @@
 
 #include <initguid.h>
 
-#define _GLFW_PRESENCE_ONLY 1
-#define _GLFW_UPDATE_STATE  2
+// How often the polling thread reads the devices, in milliseconds; the wait
+// is rounded up to the system timer resolution
+#define _GLFW_JOYSTICK_POLL_INTERVAL 4
 
 #define _GLFW_TYPE_AXIS     0
 #define _GLFW_TYPE_SLIDER   1
@@ -249,10 +250,10 @@ static void closeJoystick(_GLFWjoystickWin32* js)
     free(js->name);
     free(js->axes);
     free(js->buttons);
+    free(js->polledAxes);
+    free(js->polledButtons);
     free(js->objects);
     memset(js, 0, sizeof(_GLFWjoystickWin32));
-
-    _glfwInputJoystickChange((int) (js - _glfw.win32_js), GLFW_DISCONNECTED);
 }
 
 // DirectInput device object enumeration callback
@@ -433,12 +434,14 @@ static BOOL CALLBACK deviceCallback(const DIDEVICEINSTANCE* di, void* user)
     js->axes = calloc(js->axisCount, sizeof(float));
     js->buttonCount += data.buttonCount + data.povCount * 4;
     js->buttons = calloc(js->buttonCount, 1);
+    js->polledAxes = calloc(js->axisCount, sizeof(float));
+    js->polledButtons = calloc(js->buttonCount, 1);
     js->objects = data.objects;
     js->objectCount = data.objectCount;
     js->name = _glfwCreateUTF8FromWideStringWin32(di->tszInstanceName);
     js->present = GLFW_TRUE;
 
-    _glfwInputJoystickChange(joy, GLFW_CONNECTED);
+    // The main thread reports the connection
     return DIENUM_CONTINUE;
 }
 
@@ -478,20 +481,22 @@ static GLFWbool openXinputDevice(DWORD index)
     js->axes = calloc(js->axisCount, sizeof(float));
     js->buttonCount = 14;
     js->buttons = calloc(js->buttonCount, 1);
+    js->polledAxes = calloc(js->axisCount, sizeof(float));
+    js->polledButtons = calloc(js->buttonCount, 1);
     js->present = GLFW_TRUE;
     js->name = strdup(getDeviceDescription(&xic));
     js->index = index;
 
-    _glfwInputJoystickChange(joy, GLFW_CONNECTED);
-
+    // The main thread reports the connection
     return GLFW_TRUE;
 }
 
-// Polls for and processes events the specified joystick
+// Polls the state of the specified joystick on the polling thread and
+// publishes it, or marks it lost if the device is gone
 //
-static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
+static GLFWbool pollJoystickState(_GLFWjoystickWin32* js)
 {
-    if (!js->present)
+    if (!js->present || js->lost)
         return GLFW_FALSE;
 
     if (js->device)
@@ -515,12 +520,12 @@ static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
 
         if (FAILED(result))
         {
-            closeJoystick(js);
+            InterlockedExchange(&js->lost, TRUE);
             return GLFW_FALSE;
         }
 
-        if (mode == _GLFW_PRESENCE_ONLY)
-            return GLFW_TRUE;
+        // Odd while the state is written
+        InterlockedIncrement(&js->sequence);
 
         for (i = 0;  i < js->objectCount;  i++)
         {
@@ -531,16 +536,16 @@ static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
                 case _GLFW_TYPE_AXIS:
                 case _GLFW_TYPE_SLIDER:
                 {
-                    js->axes[ai++] = (*((LONG*) data) + 0.5f) / 32767.5f;
+                    js->polledAxes[ai++] = (*((LONG*) data) + 0.5f) / 32767.5f;
                     break;
                 }
 
                 case _GLFW_TYPE_BUTTON:
                 {
                     if (*((BYTE*) data) & 0x80)
-                        js->buttons[bi++] = GLFW_PRESS;
+                        js->polledButtons[bi++] = GLFW_PRESS;
                     else
-                        js->buttons[bi++] = GLFW_RELEASE;
+                        js->polledButtons[bi++] = GLFW_RELEASE;
 
                     break;
                 }
@@ -556,9 +561,9 @@ static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
                     for (j = 0;  j < 4;  j++)
                     {
                         if (directions[value] & (1 << j))
-                            js->buttons[bi++] = GLFW_PRESS;
+                            js->polledButtons[bi++] = GLFW_PRESS;
                         else
-                            js->buttons[bi++] = GLFW_RELEASE;
+                            js->polledButtons[bi++] = GLFW_RELEASE;
                     }
 
                     break;
@@ -566,6 +571,7 @@ static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
             }
         }
 
+        InterlockedIncrement(&js->sequence);
         return GLFW_TRUE;
     }
     else
@@ -595,58 +601,174 @@ static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
         if (result != ERROR_SUCCESS)
         {
             if (result == ERROR_DEVICE_NOT_CONNECTED)
-                closeJoystick(js);
+                InterlockedExchange(&js->lost, TRUE);
 
             return GLFW_FALSE;
         }
 
-        if (mode == _GLFW_PRESENCE_ONLY)
-            return GLFW_TRUE;
+        // Odd while the state is written
+        InterlockedIncrement(&js->sequence);
 
         if (sqrt((double) (xis.Gamepad.sThumbLX * xis.Gamepad.sThumbLX +
                            xis.Gamepad.sThumbLY * xis.Gamepad.sThumbLY)) >
             (double) XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE)
         {
-            js->axes[0] = (xis.Gamepad.sThumbLX + 0.5f) / 32767.f;
-            js->axes[1] = (xis.Gamepad.sThumbLY + 0.5f) / 32767.f;
+            js->polledAxes[0] = (xis.Gamepad.sThumbLX + 0.5f) / 32767.f;
+            js->polledAxes[1] = (xis.Gamepad.sThumbLY + 0.5f) / 32767.f;
         }
         else
         {
-            js->axes[0] = 0.f;
-            js->axes[1] = 0.f;
+            js->polledAxes[0] = 0.f;
+            js->polledAxes[1] = 0.f;
         }
 
         if (sqrt((double) (xis.Gamepad.sThumbRX * xis.Gamepad.sThumbRX +
                            xis.Gamepad.sThumbRY * xis.Gamepad.sThumbRY)) >
             (double) XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE)
         {
-            js->axes[2] = (xis.Gamepad.sThumbRX + 0.5f) / 32767.f;
-            js->axes[3] = (xis.Gamepad.sThumbRY + 0.5f) / 32767.f;
+            js->polledAxes[2] = (xis.Gamepad.sThumbRX + 0.5f) / 32767.f;
+            js->polledAxes[3] = (xis.Gamepad.sThumbRY + 0.5f) / 32767.f;
         }
         else
         {
-            js->axes[2] = 0.f;
-            js->axes[3] = 0.f;
+            js->polledAxes[2] = 0.f;
+            js->polledAxes[3] = 0.f;
         }
 
         if (xis.Gamepad.bLeftTrigger > XINPUT_GAMEPAD_TRIGGER_THRESHOLD)
-            js->axes[4] = xis.Gamepad.bLeftTrigger / 127.5f - 1.f;
+            js->polledAxes[4] = xis.Gamepad.bLeftTrigger / 127.5f - 1.f;
         else
-            js->axes[4] = -1.f;
+            js->polledAxes[4] = -1.f;
 
         if (xis.Gamepad.bRightTrigger > XINPUT_GAMEPAD_TRIGGER_THRESHOLD)
-            js->axes[5] = xis.Gamepad.bRightTrigger / 127.5f - 1.f;
+            js->polledAxes[5] = xis.Gamepad.bRightTrigger / 127.5f - 1.f;
         else
-            js->axes[5] = -1.f;
+            js->polledAxes[5] = -1.f;
 
         for (i = 0;  i < 14;  i++)
-            js->buttons[i] = (xis.Gamepad.wButtons & buttons[i]) ? 1 : 0;
+            js->polledButtons[i] = (xis.Gamepad.wButtons & buttons[i]) ? 1 : 0;
 
+        InterlockedIncrement(&js->sequence);
         return GLFW_TRUE;
     }
 }
 
 
+// Copies the last published state of the specified joystick into the arrays
+// returned to the application, without waiting on the polling thread
+//
+static void readPolledState(_GLFWjoystickWin32* js)
+{
+    for (;;)
+    {
+        const LONG sequence = js->sequence;
+        MemoryBarrier();
+
+        if (sequence & 1)
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        memcpy(js->axes, js->polledAxes, js->axisCount * sizeof(float));
+        memcpy(js->buttons, js->polledButtons, js->buttonCount);
+
+        MemoryBarrier();
+        if (js->sequence == sequence)
+            return;
+    }
+}
+
+// Returns whether the specified joystick is visible to the joystick API
+//
+static GLFWbool isJoystickAvailable(const _GLFWjoystickWin32* js)
+{
+    return js->announced && !js->lost;
+}
+
+// Opens the connected XInput and DirectInput devices not yet in a slot
+// Called with the polling lock held
+//
+static void detectConnections(void)
+{
+    if (_glfw.win32.xinput.instance)
+    {
+        DWORD i;
+
+        for (i = 0;  i < XUSER_MAX_COUNT;  i++)
+            openXinputDevice(i);
+    }
+
+    if (_glfw.win32.dinput8.api)
+    {
+        if (FAILED(IDirectInput8_EnumDevices(_glfw.win32.dinput8.api,
+                                             DI8DEVCLASS_GAMECTRL,
+                                             deviceCallback,
+                                             NULL,
+                                             DIEDFL_ALLDEVICES)))
+        {
+            _glfwInputError(GLFW_PLATFORM_ERROR,
+                            "Failed to enumerate DirectInput8 devices");
+        }
+    }
+}
+
+// Returns whether any slot changed in a way the main thread has to report
+// Called with the polling lock held
+//
+static GLFWbool hasUnreportedChanges(void)
+{
+    int joy;
+
+    for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
+    {
+        const _GLFWjoystickWin32* js = _glfw.win32_js + joy;
+        if ((js->present && !js->announced) || (js->announced && js->lost))
+            return GLFW_TRUE;
+    }
+
+    return GLFW_FALSE;
+}
+
+// Entry point of the polling thread
+// XInputGetState and DirectInput polling may block for milliseconds, so the
+// main thread only ever reads the states this thread published
+//
+static DWORD WINAPI pollJoysticks(LPVOID parameter)
+{
+    const HANDLE handles[2] = { _glfw.win32_jspoll.stop,
+                                _glfw.win32_jspoll.detect };
+
+    for (;;)
+    {
+        int joy;
+        GLFWbool changed;
+        const DWORD result = WaitForMultipleObjects(2, handles, FALSE,
+                                                    _GLFW_JOYSTICK_POLL_INTERVAL);
+        if (result == WAIT_OBJECT_0 || result == WAIT_FAILED)
+            break;
+
+        EnterCriticalSection(&_glfw.win32_jspoll.lock);
+
+        if (result == WAIT_OBJECT_0 + 1)
+            detectConnections();
+
+        for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
+            pollJoystickState(_glfw.win32_js + joy);
+
+        changed = hasUnreportedChanges();
+
+        LeaveCriticalSection(&_glfw.win32_jspoll.lock);
+
+        // Wakes glfwWaitEvents so the change is reported
+        if (changed)
+            PostMessageW(_glfw.win32.helperWindowHandle, WM_NULL, 0, 0);
+    }
+
+    return 0;
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //////                       GLFW internal API                      //////
 //////////////////////////////////////////////////////////////////////////
@@ -655,6 +777,8 @@ static GLFWbool pollJoystickState(_GLFWjoystickWin32* js, int mode)
 //
 void _glfwInitJoysticksWin32(void)
 {
+    int joy;
+
     if (_glfw.win32.dinput8.instance)
     {
         if (FAILED(_glfw_DirectInput8Create(GetModuleHandle(NULL),
@@ -668,7 +792,28 @@ void _glfwInitJoysticksWin32(void)
         }
     }
 
-    _glfwDetectJoystickConnectionWin32();
+    InitializeCriticalSection(&_glfw.win32_jspoll.lock);
+    _glfw.win32_jspoll.initialized = GLFW_TRUE;
+
+    // The joysticks connected at initialization are available right away
+    detectConnections();
+    for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
+        pollJoystickState(_glfw.win32_js + joy);
+    _glfwUpdateJoysticksWin32();
+
+    _glfw.win32_jspoll.stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    _glfw.win32_jspoll.detect = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (_glfw.win32_jspoll.stop && _glfw.win32_jspoll.detect)
+    {
+        _glfw.win32_jspoll.thread = CreateThread(NULL, 0, pollJoysticks,
+                                                 NULL, 0, NULL);
+    }
+
+    if (!_glfw.win32_jspoll.thread)
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Win32: Failed to create joystick polling thread");
+    }
 }
 
 // Close all opened joystick handles
@@ -677,9 +822,25 @@ void _glfwTerminateJoysticksWin32(void)
 {
     int joy;
 
+    if (_glfw.win32_jspoll.thread)
+    {
+        SetEvent(_glfw.win32_jspoll.stop);
+        WaitForSingleObject(_glfw.win32_jspoll.thread, INFINITE);
+        CloseHandle(_glfw.win32_jspoll.thread);
+    }
+
+    if (_glfw.win32_jspoll.stop)
+        CloseHandle(_glfw.win32_jspoll.stop);
+    if (_glfw.win32_jspoll.detect)
+        CloseHandle(_glfw.win32_jspoll.detect);
+
     for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
         closeJoystick(_glfw.win32_js + joy);
 
+    if (_glfw.win32_jspoll.initialized)
+        DeleteCriticalSection(&_glfw.win32_jspoll.lock);
+    memset(&_glfw.win32_jspoll, 0, sizeof(_glfw.win32_jspoll));
+
     if (_glfw.win32.dinput8.api)
         IDirectInput8_Release(_glfw.win32.dinput8.api);
 }
@@ -688,37 +849,65 @@ void _glfwTerminateJoysticksWin32(void)
 //
 void _glfwDetectJoystickConnectionWin32(void)
 {
-    if (_glfw.win32.xinput.instance)
-    {
-        DWORD i;
-
-        for (i = 0;  i < XUSER_MAX_COUNT;  i++)
-            openXinputDevice(i);
-    }
-
-    if (_glfw.win32.dinput8.api)
-    {
-        if (FAILED(IDirectInput8_EnumDevices(_glfw.win32.dinput8.api,
-                                             DI8DEVCLASS_GAMECTRL,
-                                             deviceCallback,
-                                             NULL,
-                                             DIEDFL_ALLDEVICES)))
-        {
-            _glfwInputError(GLFW_PLATFORM_ERROR,
-                            "Failed to enumerate DirectInput8 devices");
-            return;
-        }
-    }
+    // Enumerating takes milliseconds per empty XInput slot, the polling
+    // thread does it and the main thread reports what it found
+    if (_glfw.win32_jspoll.detect)
+        SetEvent(_glfw.win32_jspoll.detect);
 }
 
 // Checks for joystick disconnection after DBT_DEVICEREMOVECOMPLETE
 //
 void _glfwDetectJoystickDisconnectionWin32(void)
 {
-    int joy;
+    // The polling thread marks removed devices lost within a poll interval
+    _glfwUpdateJoysticksWin32();
+}
+
+// Reports the connections and disconnections the polling thread saw, on the
+// main thread where the callback is expected
+//
+void _glfwUpdateJoysticksWin32(void)
+{
+    int joy, count = 0;
+    int joysticks[GLFW_JOYSTICK_LAST + 1], events[GLFW_JOYSTICK_LAST + 1];
+
+    // Events are polled once during initialization, before joysticks
+    if (!_glfw.win32_jspoll.initialized)
+        return;
+
+    // The polling thread holds the lock while it enumerates devices, which
+    // takes milliseconds; the changes stay unreported until a later poll then,
+    // and the polling thread keeps waking the main thread until they are
+    if (!TryEnterCriticalSection(&_glfw.win32_jspoll.lock))
+        return;
 
     for (joy = GLFW_JOYSTICK_1;  joy <= GLFW_JOYSTICK_LAST;  joy++)
-        pollJoystickState(_glfw.win32_js + joy, _GLFW_PRESENCE_ONLY);
+    {
+        _GLFWjoystickWin32* js = _glfw.win32_js + joy;
+
+        if (js->present && !js->announced && !js->lost)
+        {
+            js->announced = GLFW_TRUE;
+            joysticks[count] = joy;
+            events[count++] = GLFW_CONNECTED;
+        }
+        else if (js->present && js->lost)
+        {
+            // Connections lost before they were reported are never reported
+            if (js->announced)
+            {
+                joysticks[count] = joy;
+                events[count++] = GLFW_DISCONNECTED;
+            }
+
+            closeJoystick(js);
+        }
+    }
+
+    LeaveCriticalSection(&_glfw.win32_jspoll.lock);
+
+    for (joy = 0;  joy < count;  joy++)
+        _glfwInputJoystickChange(joysticks[joy], events[joy]);
 }
 
 
@@ -729,15 +918,17 @@ void _glfwDetectJoystickDisconnectionWin32(void)
 int _glfwPlatformJoystickPresent(int joy)
 {
     _GLFWjoystickWin32* js = _glfw.win32_js + joy;
-    return pollJoystickState(js, _GLFW_PRESENCE_ONLY);
+    return isJoystickAvailable(js);
 }
 
 const float* _glfwPlatformGetJoystickAxes(int joy, int* count)
 {
     _GLFWjoystickWin32* js = _glfw.win32_js + joy;
-    if (!pollJoystickState(js, _GLFW_UPDATE_STATE))
+    if (!isJoystickAvailable(js))
         return NULL;
 
+    readPolledState(js);
+
     *count = js->axisCount;
     return js->axes;
 }
@@ -745,9 +936,11 @@ const float* _glfwPlatformGetJoystickAxes(int joy, int* count)
 const unsigned char* _glfwPlatformGetJoystickButtons(int joy, int* count)
 {
     _GLFWjoystickWin32* js = _glfw.win32_js + joy;
-    if (!pollJoystickState(js, _GLFW_UPDATE_STATE))
+    if (!isJoystickAvailable(js))
         return NULL;
 
+    readPolledState(js);
+
     *count = js->buttonCount;
     return js->buttons;
 }
@@ -755,9 +948,8 @@ const unsigned char* _glfwPlatformGetJoystickButtons(int joy, int* count)
 const char* _glfwPlatformGetJoystickName(int joy)
 {
     _GLFWjoystickWin32* js = _glfw.win32_js + joy;
-    if (!pollJoystickState(js, _GLFW_PRESENCE_ONLY))
+    if (!isJoystickAvailable(js))
         return NULL;
 
     return js->name;
 }
-
@@ -28,7 +28,8 @@
 #define _glfw3_win32_joystick_h_
 
 #define _GLFW_PLATFORM_LIBRARY_JOYSTICK_STATE \
-    _GLFWjoystickWin32 win32_js[GLFW_JOYSTICK_LAST + 1]
+    _GLFWjoystickWin32 win32_js[GLFW_JOYSTICK_LAST + 1]; \
+    _GLFWjoypollerWin32 win32_jspoll
 
 // Joystick element (axis, button or slider)
 //
@@ -53,12 +54,39 @@ typedef struct _GLFWjoystickWin32
     IDirectInputDevice8W*   device;
     DWORD                   index;
     GUID                    guid;
+
+    // Set by the main thread once it reported the connection, only then
+    // the slot is visible to the joystick API
+    GLFWbool                announced;
+    // Written by the polling thread: the state read from the device, odd
+    // sequence numbers while it is being written
+    volatile LONG           sequence;
+    float*                  polledAxes;
+    unsigned char*          polledButtons;
+    // The device failed to poll, the main thread closes the slot
+    volatile LONG           lost;
 } _GLFWjoystickWin32;
 
+// Win32-specific joystick polling thread data
+//
+typedef struct _GLFWjoypollerWin32
+{
+    GLFWbool                initialized;
+    HANDLE                  thread;
+    // Ends the thread
+    HANDLE                  stop;
+    // Asks the thread to enumerate devices, after DBT_DEVICEARRIVAL
+    HANDLE                  detect;
+    // Held by the thread while it opens and polls devices and by the main
+    // thread while it announces and closes them, never by state queries
+    CRITICAL_SECTION        lock;
+} _GLFWjoypollerWin32;
+
 
 void _glfwInitJoysticksWin32(void);
 void _glfwTerminateJoysticksWin32(void);
 void _glfwDetectJoystickConnectionWin32(void);
 void _glfwDetectJoystickDisconnectionWin32(void);
+void _glfwUpdateJoysticksWin32(void);
 
 #endif // _glfw3_win32_joystick_h_
@@ -239,6 +239,11 @@ typedef struct _GLFWwindowWin32
     // The last received cursor position, regardless of source
     int                 lastCursorPosX, lastCursorPosY;
 
+    // The last WM_MOUSEMOVE of a run, dispatched before the next other
+    // message or at the end of the poll
+    GLFWbool            movePending;
+    LPARAM              pendingMove;
+
 } _GLFWwindowWin32;
 
 // Win32-specific global data
@@ -256,6 +261,16 @@ typedef struct _GLFWlibraryWin32
     // The window whose disabled cursor mode is active
     _GLFWwindow*        disabledCursorWindow;
 
+    // Raw mouse input of a disabled cursor with batched mouse input
+    struct {
+        // The window raw mouse input is registered for, if any
+        HWND            target;
+        RAWINPUT*       buffer;
+        UINT            size;
+        // Relative motion read since the last poll
+        LONG            dx, dy;
+    } rawInput;
+
     struct {
         HINSTANCE       instance;
         TIMEGETTIME_T   timeGetTime;
@@ -72,3 +72,11 @@ uint64_t _glfwPlatformGetTimerFrequency(void)
     return _glfw.win32_time.frequency;
 }
 
+int _glfwPlatformGetTimerSource(void)
+{
+    if (_glfw.win32_time.hasPC)
+        return GLFW_TIMER_QUERY_PERFORMANCE_COUNTER;
+    else
+        return GLFW_TIMER_OTHER;
+}
+
@@ -420,6 +420,111 @@ static void releaseMonitor(_GLFWwindow* window)
     _glfwRestoreVideoModeWin32(window->monitor);
 }
 
+// Makes the raw input buffer hold at least the specified number of bytes
+//
+static GLFWbool reserveRawInput(UINT size)
+{
+    RAWINPUT* buffer;
+
+    if (size <= _glfw.win32.rawInput.size)
+        return GLFW_TRUE;
+
+    buffer = realloc(_glfw.win32.rawInput.buffer, size);
+    if (!buffer)
+    {
+        _glfwInputError(GLFW_OUT_OF_MEMORY, NULL);
+        return GLFW_FALSE;
+    }
+
+    _glfw.win32.rawInput.buffer = buffer;
+    _glfw.win32.rawInput.size = size;
+    return GLFW_TRUE;
+}
+
+// Adds relative mouse motion to what the next poll reports
+//
+static void addRawMotion(const RAWINPUT* raw)
+{
+    if (raw->header.dwType != RIM_TYPEMOUSE)
+        return;
+
+    // Tablets and remote sessions report absolute positions, which the
+    // cursor position messages already cover
+    if (raw->data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE)
+        return;
+
+    _glfw.win32.rawInput.dx += raw->data.mouse.lLastX;
+    _glfw.win32.rawInput.dy += raw->data.mouse.lLastY;
+}
+
+// Registers raw mouse input for the disabled cursor window if it uses batched
+// mouse input, or removes the registration once it does not
+//
+static void updateRawInput(void)
+{
+    RAWINPUTDEVICE rid;
+    _GLFWwindow* window = _glfw.win32.disabledCursorWindow;
+    HWND target = NULL;
+
+    if (window && window->batchedMouseInput)
+        target = window->win32.handle;
+
+    if (target == _glfw.win32.rawInput.target)
+        return;
+
+    // Generic desktop page, mouse usage
+    rid.usUsagePage = 0x01;
+    rid.usUsage = 0x02;
+    rid.dwFlags = target ? 0 : RIDEV_REMOVE;
+    rid.hwndTarget = target;
+
+    if (!RegisterRawInputDevices(&rid, 1, sizeof(rid)))
+    {
+        _glfwInputError(GLFW_PLATFORM_ERROR,
+                        "Win32: Failed to register raw input device");
+        return;
+    }
+
+    _glfw.win32.rawInput.target = target;
+    _glfw.win32.rawInput.dx = 0;
+    _glfw.win32.rawInput.dy = 0;
+}
+
+// Reads all buffered raw input in batches instead of one WM_INPUT at a time
+//
+static void readRawInputBuffer(void)
+{
+    for (;;)
+    {
+        UINT size = 0, count, i;
+        RAWINPUT* raw;
+
+        // This returns the size of the largest single buffered input
+        if (GetRawInputBuffer(NULL, &size, sizeof(RAWINPUTHEADER)) != 0 ||
+            size == 0)
+        {
+            return;
+        }
+
+        size *= 64;
+        if (!reserveRawInput(size))
+            return;
+
+        size = _glfw.win32.rawInput.size;
+        count = GetRawInputBuffer(_glfw.win32.rawInput.buffer,
+                                  &size, sizeof(RAWINPUTHEADER));
+        if (count == 0 || count == (UINT) -1)
+            return;
+
+        raw = _glfw.win32.rawInput.buffer;
+        for (i = 0;  i < count;  i++)
+        {
+            addRawMotion(raw);
+            raw = NEXTRAWINPUTBLOCK(raw);
+        }
+    }
+}
+
 // Window callback function (handles window messages)
 //
 static LRESULT CALLBACK windowProc(HWND hWnd, UINT uMsg,
@@ -624,9 +729,14 @@ static LRESULT CALLBACK windowProc(HWND hWnd, UINT uMsg,
                 if (_glfw.win32.disabledCursorWindow != window)
                     break;
 
-                _glfwInputCursorPos(window,
-                                    window->virtualCursorPosX + dx,
-                                    window->virtualCursorPosY + dy);
+                // Batched input reports the raw motion instead, at the end of
+                // the poll
+                if (_glfw.win32.rawInput.target != window->win32.handle)
+                {
+                    _glfwInputCursorPos(window,
+                                        window->virtualCursorPosX + dx,
+                                        window->virtualCursorPosY + dy);
+                }
             }
             else
                 _glfwInputCursorPos(window, x, y);
@@ -650,6 +760,27 @@ static LRESULT CALLBACK windowProc(HWND hWnd, UINT uMsg,
             return 0;
         }
 
+        case WM_INPUT:
+        {
+            // Raw input that arrived after the batched read of this poll
+            UINT size = 0;
+
+            GetRawInputData((HRAWINPUT) lParam, RID_INPUT, NULL, &size,
+                            sizeof(RAWINPUTHEADER));
+            if (!reserveRawInput(size))
+                break;
+
+            size = _glfw.win32.rawInput.size;
+            if (GetRawInputData((HRAWINPUT) lParam, RID_INPUT,
+                                _glfw.win32.rawInput.buffer, &size,
+                                sizeof(RAWINPUTHEADER)) != (UINT) -1)
+            {
+                addRawMotion(_glfw.win32.rawInput.buffer);
+            }
+
+            break;
+        }
+
         case WM_MOUSELEAVE:
         {
             window->win32.cursorTracked = GLFW_FALSE;
@@ -1347,14 +1478,52 @@ int _glfwPlatformWindowMaximized(_GLFWwindow* window)
     return IsZoomed(window->win32.handle);
 }
 
+// Dispatches the coalesced cursor movements of batched mouse input windows
+//
+static void dispatchPendingMoves(void)
+{
+    _GLFWwindow* window;
+
+    for (window = _glfw.windowListHead;  window;  window = window->next)
+    {
+        if (window->win32.movePending)
+        {
+            window->win32.movePending = GLFW_FALSE;
+            windowProc(window->win32.handle, WM_MOUSEMOVE, 0,
+                       window->win32.pendingMove);
+        }
+    }
+}
+
 void _glfwPlatformPollEvents(void)
 {
     MSG msg;
     HWND handle;
     _GLFWwindow* window;
 
+    updateRawInput();
+    if (_glfw.win32.rawInput.target)
+        readRawInputBuffer();
+
+    _glfwUpdateJoysticksWin32();
+
     while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
     {
+        if (msg.message == WM_MOUSEMOVE)
+        {
+            window = GetPropW(msg.hwnd, L"GLFW");
+            if (window && window->batchedMouseInput)
+            {
+                // Only the latest position of a run of movements is reported
+                window->win32.movePending = GLFW_TRUE;
+                window->win32.pendingMove = msg.lParam;
+                continue;
+            }
+        }
+
+        // Keeps movements in order with clicks and other input
+        dispatchPendingMoves();
+
         if (msg.message == WM_QUIT)
         {
             // Treat WM_QUIT as a close on all windows
@@ -1375,6 +1544,22 @@ void _glfwPlatformPollEvents(void)
         }
     }
 
+    dispatchPendingMoves();
+
+    window = _glfw.win32.disabledCursorWindow;
+    if (window && _glfw.win32.rawInput.target == window->win32.handle)
+    {
+        if (_glfw.win32.rawInput.dx || _glfw.win32.rawInput.dy)
+        {
+            _glfwInputCursorPos(window,
+                                window->virtualCursorPosX + _glfw.win32.rawInput.dx,
+                                window->virtualCursorPosY + _glfw.win32.rawInput.dy);
+        }
+    }
+
+    _glfw.win32.rawInput.dx = 0;
+    _glfw.win32.rawInput.dy = 0;
+
     handle = GetActiveWindow();
     if (handle)
     {
@@ -31,6 +31,7 @@
 #include <X11/Xmd.h>
 
 #include <sys/select.h>
+#include <poll.h>
 
 #include <string.h>
 #include <stdio.h>
@@ -49,6 +50,23 @@
 #define Button7            7
 
 
+// Returns whether joystick events are queued, without waiting
+//
+static GLFWbool joystickEventsQueued(void)
+{
+#if defined(__linux__)
+    struct pollfd pfd;
+
+    pfd.fd = _glfwJoystickEventFdLinux();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    return pfd.fd != -1 && poll(&pfd, 1, 0) > 0;
+#else
+    return GLFW_FALSE;
+#endif
+}
+
 // Wait for data to arrive using select
 // This avoids blocking other threads via the per-display Xlib lock that also
 // covers GLX functions
@@ -62,10 +80,15 @@ static GLFWbool waitForEvent(double* timeout)
     FD_ZERO(&fds);
     FD_SET(fd, &fds);
 #if defined(__linux__)
-    FD_SET(_glfw.linux_js.inotify, &fds);
+    // Joystick input and connections wake the wait as well
+    const int joystickFd = _glfwJoystickEventFdLinux();
+    if (joystickFd != -1)
+    {
+        FD_SET(joystickFd, &fds);
 
-    if (fd < _glfw.linux_js.inotify)
-        count = _glfw.linux_js.inotify + 1;
+        if (fd < joystickFd)
+            count = joystickFd + 1;
+    }
 #endif
     for (;;)
     {
@@ -154,6 +177,61 @@ static Bool isFrameExtentsEvent(Display* display, XEvent* event, XPointer pointe
            event->xproperty.atom == _glfw.x11.NET_FRAME_EXTENTS;
 }
 
+// Matches the next queued ConfigureNotify that supersedes the one passed in,
+// stopping at the first one for the same window that does not
+//
+typedef struct
+{
+    const XConfigureEvent* event;
+    GLFWbool blocked;
+} _GLFWconfigurematch;
+
+static Bool isLaterConfigureEvent(Display* display, XEvent* event, XPointer pointer)
+{
+    _GLFWconfigurematch* match = (_GLFWconfigurematch*) pointer;
+
+    if (match->blocked ||
+        event->type != ConfigureNotify ||
+        event->xconfigure.window != match->event->window)
+    {
+        return False;
+    }
+
+    // Synthetic events carry root coordinates and real ones do not, so the
+    // position of one must not be replaced by the other
+    if (event->xconfigure.send_event != match->event->send_event)
+    {
+        match->blocked = GLFW_TRUE;
+        return False;
+    }
+
+    return True;
+}
+
+// Returns whether the motion event is superseded by the next queued event
+//
+static GLFWbool isSupersededMotion(const _GLFWwindow* window, const XMotionEvent* event)
+{
+    XEvent next;
+
+    // Warp motion updates the last cursor position used for disabled cursor
+    // deltas, so it is never dropped
+    if (event->x == window->x11.warpCursorPosX &&
+        event->y == window->x11.warpCursorPosY)
+    {
+        return GLFW_FALSE;
+    }
+
+    // Only look at events already read, this never reads from the connection
+    if (!XEventsQueued(_glfw.x11.display, QueuedAlready))
+        return GLFW_FALSE;
+
+    XPeekEvent(_glfw.x11.display, &next);
+    return next.type == MotionNotify &&
+           next.xmotion.window == event->window &&
+           next.xmotion.state == event->state;
+}
+
 // Translates a GLFW standard cursor to a font cursor shape
 //
 static int translateCursorShape(int shape)
@@ -1214,6 +1292,12 @@ static void processEvent(XEvent *event)
             const int x = event->xmotion.x;
             const int y = event->xmotion.y;
 
+            // High rate mice queue many motion events per poll, only the last
+            // of a consecutive run is reported; disabled cursor deltas add up
+            // to the same offset
+            if (isSupersededMotion(window, &event->xmotion))
+                return;
+
             if (x != window->x11.warpCursorPosX || y != window->x11.warpCursorPosY)
             {
                 // The cursor was moved by something other than GLFW
@@ -1241,6 +1325,17 @@ static void processEvent(XEvent *event)
 
         case ConfigureNotify:
         {
+            // Interactive resizing queues a configure event per step, only the
+            // latest size and position of the window are reported
+            _GLFWconfigurematch match = { &event->xconfigure, GLFW_FALSE };
+            XEvent later;
+            while (XCheckIfEvent(_glfw.x11.display, &later,
+                                 isLaterConfigureEvent, (XPointer) &match))
+            {
+                *event = later;
+                match.event = &event->xconfigure;
+            }
+
             if (event->xconfigure.width != window->x11.width ||
                 event->xconfigure.height != window->x11.height)
             {
@@ -2052,8 +2147,14 @@ void _glfwPlatformPollEvents(void)
 {
     _glfwPollJoystickEvents();
 
-    int count = XPending(_glfw.x11.display);
-    while (count--)
+    // One read pulls in everything the connection has, the batch is then
+    // processed from Xlib's queue without further reads
+    XFlush(_glfw.x11.display);
+    int count = XEventsQueued(_glfw.x11.display, QueuedAfterReading);
+
+    // Coalescing removes later configure events, so the queue may run out
+    // before the count does
+    while (count-- > 0 && XEventsQueued(_glfw.x11.display, QueuedAlready))
     {
         XEvent event;
         XNextEvent(_glfw.x11.display, &event);
@@ -2068,7 +2169,8 @@ void _glfwPlatformPollEvents(void)
 
 void _glfwPlatformWaitEvents(void)
 {
-    while (!XPending(_glfw.x11.display))
+    // Joystick input ends the wait too, the poll reads it
+    while (!XPending(_glfw.x11.display) && !joystickEventsQueued())
         waitForEvent(NULL);
 
     _glfwPlatformPollEvents();
@@ -2076,7 +2178,7 @@ void _glfwPlatformWaitEvents(void)
 
 void _glfwPlatformWaitEventsTimeout(double timeout)
 {
-    while (!XPending(_glfw.x11.display))
+    while (!XPending(_glfw.x11.display) && !joystickEventsQueued())
     {
         if (!waitForEvent(&timeout))
             break;
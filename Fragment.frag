@@ -1,10 +1,13 @@
 #version 460
 
+// iterations of the loop below, 0 never leaves it; Scene specializes it from SceneConfig::fragment_loop_iterations
+layout (constant_id = 0) const uint loop_iterations = 0;
+
 layout (location = 0) out vec4 color;
 
 void main()
 {
-	// this endless lopp results in a device lost error on the host
-	while (true)
+	// left at 0 this endless lopp results in a device lost error on the host
+	for (uint i = 0; loop_iterations == 0 || i < loop_iterations; ++i)
 		color = vec4(1, 0, 0, 1);
 }
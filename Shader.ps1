@@ -0,0 +1,175 @@
+# Compiles one GLSL shader for Shader.targets: glslangValidator, optionally spirv-opt, then either a .spv
+# binary or a constexpr header, plus a reflection header with the descriptor bindings, push constants and the
+# vertex inputs.
+param(
+	[Parameter(Mandatory = $true)][string]$Source,
+	# output path without extension, e.g. <folder>\Vertex.vert
+	[Parameter(Mandatory = $true)][string]$Output,
+	[Parameter(Mandatory = $true)][string]$Name,
+	[ValidateSet("0", "1")][string]$OutputType = "1",
+	# semicolon separated, NAME or NAME=VALUE
+	[string]$Defines = "",
+	# builds a specialized variant with the name defined, suffixed to the outputs and the array name
+	[string]$Variant = "",
+	[ValidateSet("None", "Performance", "Size")][string]$Optimization = "None",
+	[string]$AdditionalOptions = ""
+)
+
+$ErrorActionPreference = "Stop"
+
+$bin = Join-Path $env:VULKAN_SDK "Bin"
+$glslang = Join-Path $bin "glslangValidator.exe"
+$spirv_opt = Join-Path $bin "spirv-opt.exe"
+$spirv_cross = Join-Path $bin "spirv-cross.exe"
+
+function Invoke-Tool([string]$tool, [string[]]$arguments)
+{
+	& $tool @arguments
+	if ($LASTEXITCODE -ne 0) { throw "$(Split-Path -Leaf $tool) failed on $Source with exit code $LASTEXITCODE" }
+}
+
+$define_args = @($Defines -split ";" | Where-Object { $_ } | ForEach-Object { "-D$_" })
+if ($Variant)
+{
+	$define_args += "-D$Variant"
+	$Output = "$Output.$Variant"
+	$Name = "${Name}_$Variant"
+}
+$extra_args = @($AdditionalOptions -split " " | Where-Object { $_ })
+
+$tmp = Join-Path ([System.IO.Path]::GetTempPath()) ([System.Guid]::NewGuid().ToString())
+$spv = "$tmp.spv"
+$opt_spv = "$tmp.opt.spv"
+$reflect_json = "$tmp.json"
+try
+{
+	Invoke-Tool $glslang (@("-V") + $define_args + $extra_args + @("-o", $spv, $Source))
+
+	switch ($Optimization)
+	{
+		"Performance" { Invoke-Tool $spirv_opt @("-O", $spv, "-o", $opt_spv); $spv = $opt_spv }
+		"Size" { Invoke-Tool $spirv_opt @("-Os", $spv, "-o", $opt_spv); $spv = $opt_spv }
+	}
+
+	$bytes = [System.IO.File]::ReadAllBytes($spv)
+	if ($OutputType -eq "0")
+	{
+		[System.IO.File]::WriteAllBytes("$Output.spv", $bytes)
+	}
+	else
+	{
+		$words = New-Object System.Collections.Generic.List[string]
+		for ($i = 0; $i -lt $bytes.Length; $i += 4)
+		{
+			$words.Add("0x{0:x8}" -f [System.BitConverter]::ToUInt32($bytes, $i))
+		}
+		$lines = New-Object System.Collections.Generic.List[string]
+		for ($i = 0; $i -lt $words.Count; $i += 8)
+		{
+			$lines.Add("`t" + (($words[$i..([Math]::Min($i + 8, $words.Count) - 1)]) -join ",") + ",")
+		}
+		$header = @(
+			"// generated from $(Split-Path -Leaf $Source) by Shader.ps1, do not edit"
+			"#pragma once"
+			""
+			"#include <cstdint>"
+			""
+			"constexpr uint32_t $Name[] = {"
+		) + $lines + @("};", "")
+		[System.IO.File]::WriteAllLines("$Output.h", $header)
+	}
+
+	# reflection -------------------------------------------------------------------------------------------
+	Invoke-Tool $spirv_cross @($spv, "--reflect", "--output", $reflect_json)
+	$reflection = Get-Content -Raw $reflect_json | ConvertFrom-Json
+
+	$stages = @{
+		vert = "eVertex"; tesc = "eTessellationControl"; tese = "eTessellationEvaluation"
+		geom = "eGeometry"; frag = "eFragment"; comp = "eCompute"
+	}
+	$stage = $stages[$reflection.entryPoints[0].mode]
+	if (-not $stage) { throw "Unsupported shader stage '$($reflection.entryPoints[0].mode)' in $Source" }
+
+	$bindings = New-Object System.Collections.Generic.List[string]
+	function Add-Bindings($resources, [string]$type, [string]$texel_type)
+	{
+		foreach ($res in @($resources))
+		{
+			if ($null -eq $res) { continue }
+			# 0 marks a runtime-sized array
+			$count = 1
+			foreach ($size in @($res.array)) { if ($null -ne $size) { $count *= [int]$size } }
+			$descriptor_type = if ($texel_type -and $res.type -like "*Buffer") { $texel_type } else { $type }
+			$bindings.Add("`t{ $([int]$res.set), $([int]$res.binding), vk::DescriptorType::$descriptor_type, $count }, // $($res.name)")
+		}
+	}
+	Add-Bindings $reflection.ubos "eUniformBuffer" ""
+	Add-Bindings $reflection.ssbos "eStorageBuffer" ""
+	Add-Bindings $reflection.textures "eCombinedImageSampler" "eUniformTexelBuffer"
+	Add-Bindings $reflection.separate_images "eSampledImage" "eUniformTexelBuffer"
+	Add-Bindings $reflection.separate_samplers "eSampler" ""
+	Add-Bindings $reflection.images "eStorageImage" "eStorageTexelBuffer"
+	Add-Bindings $reflection.subpass_inputs "eInputAttachment" ""
+	Add-Bindings $reflection.acceleration_structures "eAccelerationStructureKHR" ""
+
+	$push_constant_size = 0
+	foreach ($block in @($reflection.push_constants))
+	{
+		if ($null -ne $block) { $push_constant_size = [Math]::Max($push_constant_size, [int]$block.block_size) }
+	}
+
+	# one entry per location, matrices take a location per column
+	$inputs = New-Object System.Collections.Generic.List[string]
+	if ($stage -eq "eVertex")
+	{
+		$formats = @{
+			float = "eR32Sfloat"; vec2 = "eR32G32Sfloat"; vec3 = "eR32G32B32Sfloat"; vec4 = "eR32G32B32A32Sfloat"
+			int = "eR32Sint"; ivec2 = "eR32G32Sint"; ivec3 = "eR32G32B32Sint"; ivec4 = "eR32G32B32A32Sint"
+			uint = "eR32Uint"; uvec2 = "eR32G32Uint"; uvec3 = "eR32G32B32Uint"; uvec4 = "eR32G32B32A32Uint"
+		}
+		foreach ($vertex_input in @($reflection.inputs))
+		{
+			if ($null -eq $vertex_input) { continue }
+			$type = $vertex_input.type
+			$columns = 1
+			if ($type -match "^mat(\d)(?:x(\d))?$")
+			{
+				$columns = [int]$Matches[1]
+				$type = if ($Matches[2]) { "vec$($Matches[2])" } else { "vec$columns" }
+			}
+			foreach ($size in @($vertex_input.array)) { if ($null -ne $size) { $columns *= [int]$size } }
+			$format = $formats[$type]
+			if (-not $format) { throw "Unsupported vertex input type '$($vertex_input.type)' of $($vertex_input.name) in $Source" }
+			for ($column = 0; $column -lt $columns; $column++)
+			{
+				$inputs.Add("`t{ $([int]$vertex_input.location + $column), vk::Format::$format }, // $($vertex_input.name)")
+			}
+		}
+	}
+
+	$reflect_header = @(
+		"// generated from $(Split-Path -Leaf $Source) by Shader.ps1, do not edit"
+		"#pragma once"
+		""
+		"#include `"shader_reflection.h`""
+		""
+	)
+	$bindings_name = "nullptr"
+	if ($bindings.Count -gt 0)
+	{
+		$reflect_header += @("constexpr ShaderBinding ${Name}_bindings[] = {") + $bindings + @("};")
+		$bindings_name = "${Name}_bindings"
+	}
+	$inputs_name = "nullptr"
+	if ($inputs.Count -gt 0)
+	{
+		$reflect_header += @("constexpr ShaderInput ${Name}_inputs[] = {") + $inputs + @("};")
+		$inputs_name = "${Name}_inputs"
+	}
+	$reflect_header += "constexpr ShaderReflection ${Name}_reflection{ vk::ShaderStageFlagBits::$stage, $bindings_name, $($bindings.Count), $push_constant_size, $inputs_name, $($inputs.Count) };"
+	[System.IO.File]::WriteAllLines("$Output.reflect.h", $reflect_header + @(""))
+}
+finally
+{
+	Remove-Item -ErrorAction SilentlyContinue "$tmp.spv", $opt_spv, $reflect_json
+}
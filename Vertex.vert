@@ -1,7 +1,13 @@
 #version 460
 
+// per instance, from the SceneStorage instance buffer; first_instance of a draw selects its object
+layout (location = 0) in mat4 world;
+layout (location = 4) in uint material;
+
+// per vertex, from the MeshPool vertex buffer
+layout (location = 5) in vec3 position;
+
 void main()
 {
-	// quad on the lower right
-	gl_Position = vec4((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2, 0, 1);
+	gl_Position = world * vec4(position, 1);
 }
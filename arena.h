@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Heap allocations made by the calling thread, counted by the replacement operator new in scene.cpp. The
+// difference between two reads is what the code in between allocated.
+class HeapCounter
+{
+public:
+	static uint64_t count() { return slot(); }
+	static void add() { ++slot(); }
+
+private:
+	static uint64_t& slot()
+	{
+		thread_local uint64_t count = 0;
+		return count;
+	}
+};
+
+// Bump allocator for temporaries that all die at the same point, a frame or an initialization. Deallocation is
+// a no-op, reset() makes all memory reusable at once. Blocks are kept across resets and merged into one when a
+// cycle needed several, so a steady workload allocates from the heap only while the arena is still growing.
+// As a pmr memory resource it backs std::pmr containers; HostAllocator also puts the command scope allocations of
+// Vulkan calls into the calling thread's current arena (see Scope).
+class LinearArena : public std::pmr::memory_resource
+{
+public:
+	// synchronized: allocations may come from several threads at once
+	explicit LinearArena(size_t block_size = 64 * 1024, bool synchronized = false)
+		: m_block_size(block_size)
+		, m_synchronized(synchronized)
+	{}
+
+	~LinearArena() override
+	{
+		for (auto const& block : m_blocks)
+			::operator delete(block.data);
+	}
+
+	LinearArena(LinearArena const&) = delete;
+	LinearArena& operator=(LinearArena const&) = delete;
+
+	// nothing allocated before may be used any more
+	void reset()
+	{
+		auto const lock = this->lock();
+		if (m_blocks.size() > 1)
+		{
+			size_t capacity = 0;
+			for (auto const& block : m_blocks)
+			{
+				capacity += block.size;
+				::operator delete(block.data);
+			}
+			m_blocks.clear();
+			m_blocks.push_back({ static_cast<std::byte*>(::operator new(capacity)), capacity });
+		}
+		m_current = 0;
+		m_offset = 0;
+		m_used = 0;
+	}
+
+	// bytes handed out since the last reset, the most there ever were, and what the blocks hold
+	size_t used() const { return m_used; }
+	size_t highWater() const { return m_high_water; }
+	size_t capacity() const
+	{
+		size_t capacity = 0;
+		for (auto const& block : m_blocks)
+			capacity += block.size;
+		return capacity;
+	}
+
+	// makes the arena the calling thread's current one for its lifetime, scopes nest
+	class Scope
+	{
+	public:
+		explicit Scope(LinearArena& arena)
+			: m_previous(std::exchange(currentSlot(), &arena))
+		{}
+		~Scope() { currentSlot() = m_previous; }
+
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+
+	private:
+		LinearArena* m_previous;
+	};
+
+	static LinearArena* current() { return currentSlot(); }
+
+private:
+	struct Block
+	{
+		std::byte* data;
+		size_t size;
+	};
+
+	std::unique_lock<std::mutex> lock()
+	{
+		return m_synchronized ? std::unique_lock<std::mutex>(m_mutex) : std::unique_lock<std::mutex>();
+	}
+
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		auto const lock = this->lock();
+		while (true)
+		{
+			if (m_current == m_blocks.size())
+				m_blocks.push_back({ static_cast<std::byte*>(::operator new(std::max(m_block_size, bytes + alignment))), std::max(m_block_size, bytes + alignment) });
+			auto const& block = m_blocks[m_current];
+			auto const base = reinterpret_cast<uintptr_t>(block.data);
+			auto const offset = ((base + m_offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+			if (offset + bytes <= block.size)
+			{
+				m_offset = offset + bytes;
+				m_used += bytes;
+				m_high_water = std::max(m_high_water, m_used);
+				return block.data + offset;
+			}
+			++m_current;
+			m_offset = 0;
+		}
+	}
+
+	void do_deallocate(void*, size_t, size_t) override {}
+
+	bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override { return this == &other; }
+
+	static LinearArena*& currentSlot()
+	{
+		thread_local LinearArena* arena = nullptr;
+		return arena;
+	}
+
+	size_t m_block_size;
+	bool m_synchronized;
+	std::mutex m_mutex;
+	std::vector<Block> m_blocks;
+	// the block allocations come from and the offset into it
+	size_t m_current = 0;
+	size_t m_offset = 0;
+	size_t m_used = 0;
+	size_t m_high_water = 0;
+};
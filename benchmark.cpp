@@ -0,0 +1,114 @@
+/*
+Benchmarks of the Scene, each suite writes its results as JSON so runs on different drivers and driver versions can be compared.
+startup: cycles of initialize(), device loss, recoverDevice() and shutdown(), with the latency of every step.
+frame: frames/s and CPU time per frame of the render loop, swept over its configuration.
+*/
+
+#include "frame_benchmark.h"
+#include "startup_benchmark.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static int usage()
+{
+	std::cerr << "usage: Benchmark startup [--cycles N] [--frames N] [--output FILE] [--headless]" << std::endl;
+	std::cerr << "       Benchmark frame [--images 2,3] [--latency vsync,uncapped] [--frames-in-flight 1,2] [--record re-record,cached,secondary]" << std::endl;
+	std::cerr << "                       [--warmup N] [--frames N] [--output FILE] [--headless]" << std::endl;
+	return 1;
+}
+
+// comma separated values, each one converted by parse; throws on values parse does not know
+template<typename T, typename Parse>
+static std::vector<T> parseList(std::string const& list, Parse parse)
+{
+	std::vector<T> values;
+	std::istringstream is(list);
+	for (std::string item; std::getline(is, item, ',');)
+		values.push_back(parse(item));
+	return values;
+}
+
+// by the names toString() gives them, e.g. "low latency"
+template<typename E>
+static E parseEnum(std::string const& name, std::initializer_list<E> values)
+{
+	for (auto const value : values)
+		if (name == toString(value))
+			return value;
+	throw std::runtime_error("unknown value \"" + name + "\"");
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+	SetProcessDPIAware();
+#endif
+
+	if (argc < 2)
+		return usage();
+	const std::string suite = argv[1];
+	if (suite == "startup")
+	{
+		StartupBenchmarkConfig config;
+		for (int i = 2; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (arg == "--cycles" && i + 1 < argc)
+				config.cycles = static_cast<uint32_t>(std::stoul(argv[++i]));
+			else if (arg == "--frames" && i + 1 < argc)
+				config.frames = std::stoull(argv[++i]);
+			else if (arg == "--output" && i + 1 < argc)
+				config.output = argv[++i];
+			else if (arg == "--headless")
+				config.scene.headless = true;
+			else
+				return usage();
+		}
+		return StartupBenchmark(config).run();
+	}
+	if (suite == "frame")
+	{
+		FrameBenchmarkConfig config;
+		try
+		{
+			for (int i = 2; i < argc; ++i)
+			{
+				const std::string arg = argv[i];
+				auto const number = [](std::string const& s) { return static_cast<uint32_t>(std::stoul(s)); };
+				if (arg == "--images" && i + 1 < argc)
+					config.swapchain_images = parseList<uint32_t>(argv[++i], number);
+				else if (arg == "--latency" && i + 1 < argc)
+					config.latency_modes = parseList<LatencyMode>(argv[++i], [](std::string const& s)
+					{
+						return parseEnum(s, { LatencyMode::LowLatency, LatencyMode::Uncapped, LatencyMode::Adaptive, LatencyMode::VSync });
+					});
+				else if (arg == "--frames-in-flight" && i + 1 < argc)
+					config.frames_in_flight = parseList<uint32_t>(argv[++i], number);
+				else if (arg == "--record" && i + 1 < argc)
+					config.record_modes = parseList<RecordMode>(argv[++i], [](std::string const& s)
+					{
+						return parseEnum(s, { RecordMode::ReRecord, RecordMode::Cached, RecordMode::Secondary });
+					});
+				else if (arg == "--warmup" && i + 1 < argc)
+					config.warmup_frames = std::stoull(argv[++i]);
+				else if (arg == "--frames" && i + 1 < argc)
+					config.frames = std::stoull(argv[++i]);
+				else if (arg == "--output" && i + 1 < argc)
+					config.output = argv[++i];
+				else if (arg == "--headless")
+					config.scene.headless = true;
+				else
+					return usage();
+			}
+		}
+		catch (std::exception const& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return usage();
+		}
+		return FrameBenchmark(config).run();
+	}
+	return usage();
+}
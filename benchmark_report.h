@@ -0,0 +1,299 @@
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// samples of one measurement, e.g. a step's latency in milliseconds
+class SampleSet
+{
+public:
+	void add(double value)
+	{
+		m_values.push_back(value);
+		m_sorted = false;
+	}
+
+	size_t count() const { return m_values.size(); }
+	bool empty() const { return m_values.empty(); }
+
+	double min() const { return empty() ? 0.0 : sorted().front(); }
+	double max() const { return empty() ? 0.0 : sorted().back(); }
+
+	double mean() const
+	{
+		double sum = 0.0;
+		for (auto const value : m_values)
+			sum += value;
+		return empty() ? 0.0 : sum / m_values.size();
+	}
+
+	// nearest rank, p in [0, 100]
+	double percentile(double p) const
+	{
+		if (empty())
+			return 0.0;
+		auto const& values = sorted();
+		auto const rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+		return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+	}
+
+	// counts per bucket with doubling upper bounds from first_bound up to the first bound above max()
+	std::vector<std::pair<double, size_t>> histogram(double first_bound) const
+	{
+		std::vector<std::pair<double, size_t>> buckets;
+		if (empty())
+			return buckets;
+		auto const& values = sorted();
+		size_t i = 0;
+		for (double bound = first_bound; i < values.size(); bound *= 2.0)
+		{
+			size_t count = 0;
+			for (; i < values.size() && values[i] <= bound; ++i)
+				++count;
+			buckets.emplace_back(bound, count);
+		}
+		return buckets;
+	}
+
+	std::vector<double> const& values() const { return m_values; }
+
+private:
+	std::vector<double> const& sorted() const
+	{
+		if (!m_sorted)
+		{
+			m_sorted_values = m_values;
+			std::sort(m_sorted_values.begin(), m_sorted_values.end());
+			m_sorted = true;
+		}
+		return m_sorted_values;
+	}
+
+	// in add() order
+	std::vector<double> m_values;
+	mutable std::vector<double> m_sorted_values;
+	mutable bool m_sorted = true;
+};
+
+// peak working set on Windows, maximum resident set size elsewhere; 0 where it is unknown
+inline uint64_t peakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage{};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	// kilobytes on Linux
+	return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// user and kernel time of all threads of the process
+inline double processCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation{}, exit{}, kernel{}, user{};
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+	auto const ticks = [](FILETIME const& t) { return (uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+	// 100 ns units
+	return (ticks(kernel) + ticks(user)) * 1e-7;
+#else
+	rusage usage{};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+	auto const seconds = [](timeval const& t) { return t.tv_sec + t.tv_usec * 1e-6; };
+	return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+}
+
+// Streams JSON in call order without building a document. Keys and values are written as they come,
+// commas are placed between the members of the innermost object or array.
+class JsonWriter
+{
+public:
+	explicit JsonWriter(std::ostream& os)
+		: m_os(os)
+	{
+		m_os << std::setprecision(9);
+	}
+
+	JsonWriter& beginObject() { return open('{'); }
+	JsonWriter& endObject() { return close('}'); }
+	JsonWriter& beginArray() { return open('['); }
+	JsonWriter& endArray() { return close(']'); }
+
+	JsonWriter& key(std::string_view name)
+	{
+		separate();
+		string(name);
+		m_os << ':';
+		m_after_key = true;
+		return *this;
+	}
+
+	JsonWriter& value(std::string_view text)
+	{
+		separate();
+		string(text);
+		return *this;
+	}
+
+	JsonWriter& value(char const* text) { return value(std::string_view(text)); }
+	JsonWriter& value(std::string const& text) { return value(std::string_view(text)); }
+
+	JsonWriter& value(bool flag)
+	{
+		separate();
+		m_os << (flag ? "true" : "false");
+		return *this;
+	}
+
+	JsonWriter& value(double number)
+	{
+		separate();
+		// JSON has no infinity or NaN
+		if (std::isfinite(number))
+			m_os << number;
+		else
+			m_os << "null";
+		return *this;
+	}
+
+	template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+	JsonWriter& value(T number)
+	{
+		separate();
+		if constexpr (std::is_signed_v<T>)
+			m_os << static_cast<long long>(number);
+		else
+			m_os << static_cast<unsigned long long>(number);
+		return *this;
+	}
+
+	template<typename T>
+	JsonWriter& field(std::string_view name, T const& v)
+	{
+		key(name);
+		return value(v);
+	}
+
+private:
+	JsonWriter& open(char bracket)
+	{
+		separate();
+		m_os << bracket;
+		m_first.push_back(true);
+		return *this;
+	}
+
+	JsonWriter& close(char bracket)
+	{
+		m_first.pop_back();
+		m_os << bracket;
+		return *this;
+	}
+
+	// a value right after its key needs no comma
+	void separate()
+	{
+		if (m_after_key)
+		{
+			m_after_key = false;
+			return;
+		}
+		if (m_first.empty())
+			return;
+		if (!m_first.back())
+			m_os << ',';
+		m_first.back() = false;
+	}
+
+	void string(std::string_view text)
+	{
+		m_os << '"';
+		for (auto const c : text)
+		{
+			switch (c)
+			{
+			case '"': m_os << "\\\""; break;
+			case '\\': m_os << "\\\\"; break;
+			case '\n': m_os << "\\n"; break;
+			case '\r': m_os << "\\r"; break;
+			case '\t': m_os << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+					m_os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec << std::setfill(' ');
+				else
+					m_os << c;
+			}
+		}
+		m_os << '"';
+	}
+
+	std::ostream& m_os;
+	// per open object or array, whether no member was written yet
+	std::vector<bool> m_first;
+	bool m_after_key = false;
+};
+
+// count, min, percentiles, max and mean of the samples, in the samples' unit
+inline void writeSummary(JsonWriter& json, SampleSet const& samples, std::string_view unit, double first_bucket)
+{
+	auto const suffixed = [&](char const* name) { return std::string(name) + "_" + std::string(unit); };
+	json.beginObject()
+		.field("count", samples.count())
+		.field(suffixed("min"), samples.min())
+		.field(suffixed("p50"), samples.percentile(50.0))
+		.field(suffixed("p90"), samples.percentile(90.0))
+		.field(suffixed("p99"), samples.percentile(99.0))
+		.field(suffixed("max"), samples.max())
+		.field(suffixed("mean"), samples.mean());
+	json.key("histogram").beginArray();
+	for (auto const& [bound, count] : samples.histogram(first_bucket))
+		json.beginObject().field(suffixed("le"), bound).field("count", count).endObject();
+	json.endArray();
+	json.endObject();
+}
+
+// identifies the driver a result was measured on, so results can be compared across driver versions
+inline void writeDevice(JsonWriter& json, vk::PhysicalDeviceProperties const& props, vk::PhysicalDeviceDriverProperties const& driver)
+{
+	auto const version = [](uint32_t v)
+	{
+		return std::to_string(VK_VERSION_MAJOR(v)) + "." + std::to_string(VK_VERSION_MINOR(v)) + "." + std::to_string(VK_VERSION_PATCH(v));
+	};
+	json.beginObject()
+		.field("name", std::string(&props.deviceName[0]))
+		.field("vendor_id", props.vendorID)
+		.field("device_id", props.deviceID)
+		.field("api_version", version(props.apiVersion))
+		// vendor specific encoding
+		.field("driver_version", props.driverVersion)
+		.field("driver_id", vk::to_string(driver.driverID))
+		.field("driver_name", std::string(&driver.driverName[0]))
+		.field("driver_info", std::string(&driver.driverInfo[0]))
+		.endObject();
+}
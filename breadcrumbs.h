@@ -0,0 +1,268 @@
+#pragma once
+
+#include "device_allocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstring>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Shows where the GPU was when the device was lost. Command buffers wrap every workload (a pass, a dispatch,
+// a draw) in begin and end markers. With VK_NV_device_diagnostic_checkpoints they are checkpoints the driver
+// reports per queue. With VK_AMD_buffer_marker they are written into a host-visible buffer at the top and the
+// bottom of the pipe. After a loss the last workload each queue started and the last one it completed are
+// known. VK_EXT_device_fault adds the driver's own description where the device has it.
+class Breadcrumbs
+{
+public:
+	enum class Mode
+	{
+		// markers are not recorded, workloads are still registered by name
+		None,
+		Checkpoints,
+		BufferMarkers
+	};
+
+	// 0 is never a workload
+	using WorkloadId = uint32_t;
+
+	struct QueueReport
+	{
+		std::string queue;
+		// empty if no marker of the queue was reached
+		std::string last_started;
+		std::string last_completed;
+		// last_started did not complete; decided from the markers, a workload may run several times
+		bool in_flight = false;
+
+		// started and not completed, the workload the loss is blamed on
+		bool inFlight() const { return in_flight && !last_started.empty(); }
+	};
+
+	// What the last checkpoints that passed the top and the bottom of the pipe tell, as marker values, 0 for
+	// none. Checkpoints pass every stage, so a begin marker also reaches the bottom of the pipe while its workload
+	// still runs: only an end marker there completes a workload. The top one is the newer of the two.
+	struct CheckpointState
+	{
+		WorkloadId started = 0;
+		WorkloadId completed = 0;
+		bool in_flight = false;
+	};
+
+	static constexpr CheckpointState decodeCheckpoints(uintptr_t top, uintptr_t bottom)
+	{
+		auto const top_id = static_cast<WorkloadId>(top >> 1);
+		auto const bottom_id = static_cast<WorkloadId>(bottom >> 1);
+		bool const top_end = (top & 1) != 0;
+		bool const bottom_end = (bottom & 1) != 0;
+		CheckpointState state{};
+		if (bottom != 0 && bottom_end)
+			state.completed = bottom_id;
+		if (top != 0)
+		{
+			state.started = top_id;
+			// the end of the newest workload passed the top and the bottom, nothing runs after it
+			state.in_flight = !(top == bottom && top_end);
+		}
+		else if (bottom != 0 && !bottom_end)
+		{
+			state.started = bottom_id;
+			state.in_flight = true;
+		}
+		return state;
+	}
+
+	// queue_names gives the order of the queues passed to begin(), end() and report()
+	Breadcrumbs(vk::Device device, DeviceAllocator& allocator, vk::DispatchLoaderDynamic const& dispatch, Mode mode,
+		std::vector<std::string> queue_names, bool device_fault)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_dispatch(&dispatch)
+		, m_mode(mode)
+		, m_queue_names(std::move(queue_names))
+		, m_device_fault(device_fault)
+	{
+		m_names.emplace_back();
+		if (m_mode != Mode::BufferMarkers)
+			return;
+
+		// one slot for the top and one for the bottom of the pipe per queue
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = m_queue_names.size() * 2 * sizeof(uint32_t);
+		buf_ci.usage = vk::BufferUsageFlagBits::eTransferDst;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+		m_buffer = device.createBufferUnique(buf_ci);
+
+		auto const host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		m_memory = allocator.allocateFor(*m_buffer, host_flags, host_flags, AllocationStrategy::Linear);
+		std::memset(m_memory.mapped, 0, static_cast<size_t>(buf_ci.size));
+	}
+
+	~Breadcrumbs()
+	{
+		m_buffer.reset();
+		if (m_memory)
+			m_allocator.free(m_memory);
+	}
+
+	Breadcrumbs(Breadcrumbs const&) = delete;
+	Breadcrumbs& operator=(Breadcrumbs const&) = delete;
+
+	Mode mode() const { return m_mode; }
+
+	// registers once and returns the same id on every later call; not thread safe, workers only record
+	WorkloadId workload(std::string const& name)
+	{
+		for (size_t i = 1; i < m_names.size(); ++i)
+			if (m_names[i] == name)
+				return static_cast<WorkloadId>(i);
+		m_names.push_back(name);
+		return static_cast<WorkloadId>(m_names.size() - 1);
+	}
+
+	std::string const& name(WorkloadId id) const { return m_names.at(id); }
+
+	void begin(vk::CommandBuffer cmd, uint32_t queue, WorkloadId id) const
+	{
+		if (m_mode == Mode::Checkpoints)
+			cmd.setCheckpointNV(marker(id, false), *m_dispatch);
+		else if (m_mode == Mode::BufferMarkers)
+			cmd.writeBufferMarkerAMD(vk::PipelineStageFlagBits::eTopOfPipe, *m_buffer, slot(queue, false), id, *m_dispatch);
+	}
+
+	void end(vk::CommandBuffer cmd, uint32_t queue, WorkloadId id) const
+	{
+		if (m_mode == Mode::Checkpoints)
+			cmd.setCheckpointNV(marker(id, true), *m_dispatch);
+		else if (m_mode == Mode::BufferMarkers)
+			cmd.writeBufferMarkerAMD(vk::PipelineStageFlagBits::eBottomOfPipe, *m_buffer, slot(queue, true), id, *m_dispatch);
+	}
+
+	// only meaningful after a device loss; queues in the order of the queue names
+	std::vector<QueueReport> report(std::vector<vk::Queue> const& queues) const
+	{
+		std::vector<QueueReport> reports;
+		for (size_t i = 0; i < queues.size() && i < m_queue_names.size(); ++i)
+		{
+			QueueReport report{};
+			report.queue = m_queue_names[i];
+			if (m_mode == Mode::Checkpoints)
+			{
+				// the last checkpoint that passed each stage
+				uintptr_t top = 0;
+				uintptr_t bottom = 0;
+				for (auto const& data : queues[i].getCheckpointDataNV(*m_dispatch))
+				{
+					if (data.stage == vk::PipelineStageFlagBits::eTopOfPipe)
+						top = reinterpret_cast<uintptr_t>(data.pCheckpointMarker);
+					else if (data.stage == vk::PipelineStageFlagBits::eBottomOfPipe)
+						bottom = reinterpret_cast<uintptr_t>(data.pCheckpointMarker);
+				}
+				auto const state = decodeCheckpoints(top, bottom);
+				report.last_started = nameOrEmpty(state.started);
+				report.last_completed = nameOrEmpty(state.completed);
+				report.in_flight = state.in_flight;
+			}
+			else if (m_mode == Mode::BufferMarkers)
+			{
+				auto const* const slots = static_cast<uint32_t const*>(m_memory.mapped);
+				report.last_started = nameOrEmpty(slots[2 * i]);
+				report.last_completed = nameOrEmpty(slots[2 * i + 1]);
+				// the top slot only takes begins and the bottom one only ends
+				report.in_flight = slots[2 * i] != slots[2 * i + 1];
+			}
+			reports.push_back(std::move(report));
+		}
+		return reports;
+	}
+
+	// the first queue's in-flight workload
+	static std::optional<std::string> suspect(std::vector<QueueReport> const& reports)
+	{
+		for (auto const& report : reports)
+			if (report.inFlight())
+				return report.last_started;
+		return std::nullopt;
+	}
+
+	// the driver's description of the fault, empty without VK_EXT_device_fault or when it reports nothing
+	std::string faultDescription() const
+	{
+		std::ostringstream os;
+#ifdef VK_EXT_DEVICE_FAULT_EXTENSION_NAME
+		if (!m_device_fault || !m_dispatch->vkGetDeviceFaultInfoEXT)
+			return {};
+
+		VkDeviceFaultCountsEXT counts{};
+		counts.sType = VK_STRUCTURE_TYPE_DEVICE_FAULT_COUNTS_EXT;
+		if (m_dispatch->vkGetDeviceFaultInfoEXT(m_device, &counts, nullptr) != VK_SUCCESS)
+			return {};
+		std::vector<VkDeviceFaultAddressInfoEXT> addresses(counts.addressInfoCount);
+		std::vector<VkDeviceFaultVendorInfoEXT> vendor_infos(counts.vendorInfoCount);
+		// the vendor binary dump is not requested
+		counts.vendorBinarySize = 0;
+
+		VkDeviceFaultInfoEXT info{};
+		info.sType = VK_STRUCTURE_TYPE_DEVICE_FAULT_INFO_EXT;
+		info.pAddressInfos = addresses.data();
+		info.pVendorInfos = vendor_infos.data();
+		auto const result = m_dispatch->vkGetDeviceFaultInfoEXT(m_device, &counts, &info);
+		if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+			return {};
+
+		os << info.description;
+		for (uint32_t i = 0; i < counts.addressInfoCount; ++i)
+			os << "\n  " << vk::to_string(static_cast<vk::DeviceFaultAddressTypeEXT>(addresses[i].addressType))
+				<< " at 0x" << std::hex << addresses[i].reportedAddress << std::dec;
+		for (uint32_t i = 0; i < counts.vendorInfoCount; ++i)
+			os << "\n  " << vendor_infos[i].description << " (code " << vendor_infos[i].vendorFaultCode << ")";
+#endif
+		return os.str();
+	}
+
+private:
+	// ids start at 1, so a marker is never null; the low bit tells begin from end
+	static void* marker(WorkloadId id, bool end)
+	{
+		return reinterpret_cast<void*>(static_cast<uintptr_t>(id) << 1 | (end ? 1 : 0));
+	}
+
+	vk::DeviceSize slot(uint32_t queue, bool end) const
+	{
+		return (vk::DeviceSize(queue) * 2 + (end ? 1 : 0)) * sizeof(uint32_t);
+	}
+
+	std::string nameOrEmpty(WorkloadId id) const
+	{
+		return id != 0 && id < m_names.size() ? m_names[id] : std::string{};
+	}
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	vk::DispatchLoaderDynamic const* m_dispatch;
+	Mode m_mode;
+	std::vector<std::string> m_queue_names;
+	bool m_device_fault;
+
+	// indexed by WorkloadId, the first entry is unused
+	std::vector<std::string> m_names;
+	vk::UniqueBuffer m_buffer;
+	Allocation m_memory;
+};
+
+// checkpoint decoding, marker values are id << 1 | end
+// the hung workload's begin passed the bottom of the pipe, its end never did
+static_assert(Breadcrumbs::decodeCheckpoints(2 << 1, 2 << 1).in_flight && Breadcrumbs::decodeCheckpoints(2 << 1, 2 << 1).started == 2
+	&& Breadcrumbs::decodeCheckpoints(2 << 1, 2 << 1).completed == 0, "a begin at the bottom of the pipe does not complete a workload");
+// the end of the hung workload was issued but did not retire
+static_assert(Breadcrumbs::decodeCheckpoints(2 << 1 | 1, 1 << 1 | 1).in_flight && Breadcrumbs::decodeCheckpoints(2 << 1 | 1, 1 << 1 | 1).started == 2
+	&& Breadcrumbs::decodeCheckpoints(2 << 1 | 1, 1 << 1 | 1).completed == 1, "an end at the top only completes at the bottom");
+// a second run of a workload that completed before
+static_assert(Breadcrumbs::decodeCheckpoints(2 << 1, 2 << 1 | 1).in_flight, "a new begin after the same workload's end is in flight");
+// everything retired
+static_assert(!Breadcrumbs::decodeCheckpoints(2 << 1 | 1, 2 << 1 | 1).in_flight, "an end at both stages leaves nothing in flight");
+static_assert(!Breadcrumbs::decodeCheckpoints(0, 0).in_flight, "no checkpoints blame nothing");
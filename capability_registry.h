@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+using DeviceUuid = std::array<uint8_t, VK_UUID_SIZE>;
+
+inline std::string toString(DeviceUuid const& uuid)
+{
+	std::ostringstream str;
+	str << std::hex << std::setfill('0');
+	for (auto const byte : uuid)
+		str << std::setw(2) << static_cast<uint32_t>(byte);
+	return str.str();
+}
+
+// accepts 32 hex digits, dashes are ignored
+inline std::optional<DeviceUuid> parseDeviceUuid(std::string const& text)
+{
+	std::string digits;
+	for (auto const c : text)
+		if (c != '-')
+			digits.push_back(c);
+	if (digits.size() != 2 * VK_UUID_SIZE || digits.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+		return std::nullopt;
+
+	DeviceUuid uuid{};
+	for (size_t i = 0; i < uuid.size(); ++i)
+		uuid[i] = static_cast<uint8_t>(std::stoul(digits.substr(2 * i, 2), nullptr, 16));
+	return uuid;
+}
+
+// Names enumerated from the loader or a driver, each stored once and looked up by hash.
+class NameSet
+{
+public:
+	void insert(std::string_view name)
+	{
+		if (contains(name))
+			return;
+		m_storage.emplace_back(name);
+		m_names.insert(m_storage.back());
+	}
+
+	bool contains(std::string_view name) const { return m_names.count(name) != 0; }
+	size_t size() const { return m_names.size(); }
+
+private:
+	// deque keeps the strings in place, the set only holds views
+	std::deque<std::string> m_storage;
+	std::unordered_set<std::string_view> m_names;
+};
+
+struct DeviceCapabilities
+{
+	DeviceUuid uuid{};
+	vk::PhysicalDeviceProperties properties;
+	NameSet extensions;
+	// features11() and features12() are zero on devices below Vulkan 1.2
+	vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan11Features, vk::PhysicalDeviceVulkan12Features> features;
+
+	bool hasExtension(std::string_view name) const { return extensions.contains(name); }
+	vk::PhysicalDeviceFeatures const& features10() const { return features.get<vk::PhysicalDeviceFeatures2>().features; }
+	vk::PhysicalDeviceVulkan11Features const& features11() const { return features.get<vk::PhysicalDeviceVulkan11Features>(); }
+	vk::PhysicalDeviceVulkan12Features const& features12() const { return features.get<vk::PhysicalDeviceVulkan12Features>(); }
+};
+
+// Process-wide cache of instance layers and extensions and of per-device extensions and features.
+// Every list is enumerated once, so re-initialization after a device loss skips the loader and driver queries.
+// Devices are keyed by their UUID, which stays valid across instances.
+class CapabilityRegistry
+{
+public:
+	static CapabilityRegistry& get()
+	{
+		static CapabilityRegistry registry;
+		return registry;
+	}
+
+	CapabilityRegistry(CapabilityRegistry const&) = delete;
+	CapabilityRegistry& operator=(CapabilityRegistry const&) = delete;
+
+	bool hasInstanceExtension(std::string_view name) const { return m_instance_extensions.contains(name); }
+	bool hasInstanceLayer(std::string_view name) const { return m_instance_layers.contains(name); }
+
+	DeviceCapabilities const& device(vk::PhysicalDevice phys_dev)
+	{
+		auto const id_props = phys_dev.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+		DeviceUuid uuid{};
+		auto const& device_uuid = id_props.get<vk::PhysicalDeviceIDProperties>().deviceUUID;
+		std::copy(std::begin(device_uuid), std::end(device_uuid), uuid.begin());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& entry = m_devices[uuid];
+		if (!entry)
+		{
+			entry = std::make_unique<DeviceCapabilities>();
+			entry->uuid = uuid;
+			entry->properties = id_props.get<vk::PhysicalDeviceProperties2>().properties;
+			for (auto const& ext : phys_dev.enumerateDeviceExtensionProperties())
+				entry->extensions.insert(static_cast<char const*>(ext.extensionName));
+			// the Vulkan 1.1 and 1.2 feature structs may only be chained on 1.2 devices, below that they stay zero
+			if (entry->properties.apiVersion >= VK_MAKE_VERSION(1, 2, 0))
+				entry->features = phys_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan11Features, vk::PhysicalDeviceVulkan12Features>();
+			else
+				entry->features.get<vk::PhysicalDeviceFeatures2>().features = phys_dev.getFeatures();
+		}
+		return *entry;
+	}
+
+private:
+	CapabilityRegistry()
+	{
+		for (auto const& ext : vk::enumerateInstanceExtensionProperties())
+			m_instance_extensions.insert(static_cast<char const*>(ext.extensionName));
+		for (auto const& layer : vk::enumerateInstanceLayerProperties())
+			m_instance_layers.insert(static_cast<char const*>(layer.layerName));
+	}
+
+	NameSet m_instance_extensions;
+	NameSet m_instance_layers;
+
+	std::mutex m_mutex;
+	std::map<DeviceUuid, std::unique_ptr<DeviceCapabilities>> m_devices;
+};
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "device_group.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// the platform's opaque handle for exporting device memory to other processes or APIs
+#if defined(_WIN32) && defined(VK_KHR_external_memory_win32)
+using ExternalMemoryHandle = HANDLE;
+constexpr auto external_memory_handle_type = vk::ExternalMemoryHandleTypeFlagBits::eOpaqueWin32;
+constexpr char const* external_memory_extension = VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME;
+#else
+using ExternalMemoryHandle = int;
+constexpr auto external_memory_handle_type = vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd;
+constexpr char const* external_memory_extension = VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME;
+#endif
+
+class CaptureRing;
+
+// A completed capture. The pixels are the readback buffer itself, mapped and tightly packed; nothing writes
+// them until release().
+struct CaptureFrame
+{
+	void const* pixels = nullptr;
+	vk::Extent2D extent;
+	vk::Format format = vk::Format::eUndefined;
+	uint32_t row_pitch = 0;
+	vk::DeviceSize size = 0;
+	// value the frame signaled on the graphics timeline
+	uint64_t serial = 0;
+	CaptureRing* ring = nullptr;
+	uint32_t slot = 0;
+
+	// from any thread
+	void release() const;
+};
+
+// Host memory the slots of a ring are imported from instead of allocated, see VK_EXT_external_memory_host, e.g.
+// memory shared with another process that reads the frames in place. Only for headless scenes, whose extent never
+// changes, so no two rings import the same memory.
+struct CaptureHostMemory
+{
+	// one per slot, aligned to the device's minImportedHostPointerAlignment
+	std::vector<void*> slots;
+	// bytes per slot, a multiple of that alignment
+	vk::DeviceSize slot_size = 0;
+	// false for slots the other side still reads, record() skips them; called with the ring's lock held
+	std::function<bool(uint32_t slot)> writable;
+};
+
+struct CaptureConfig
+{
+	// called on the render thread with every captured frame of the main output, in frame order once it completed;
+	// setting it enables capture. Frames not released when the device is destroyed lose their pixels.
+	std::function<void(CaptureFrame const& frame)> on_frame;
+	// readback buffers; frames are dropped while the consumer holds or the GPU still fills all of them
+	uint32_t slots = 3;
+	// allocate the buffers exportable as external memory where the device supports it, see CaptureRing::exportMemory()
+	bool export_memory = false;
+	// how long destroying the device waits for held frames
+	std::chrono::milliseconds release_timeout{ 1000 };
+	// where the device can import it, the slots are this memory and slots is ignored; otherwise frames are
+	// captured into the ring's own buffers as usual
+	CaptureHostMemory host_memory;
+};
+
+// Ring of host-cached readback buffers that frames copy an image into after their render pass. A copy is handed
+// to the consumer once the timeline value of its frame is reached and is not reused before the consumer releases
+// it, so the consumer reads the mapped memory in place. Recording and take() are render thread only.
+class CaptureRing
+{
+public:
+	// exportable: buffers get dedicated memory that exportMemory() can share, the device has external_memory_extension;
+	// host_memory: the buffers are bound to that memory instead, the device has VK_EXT_external_memory_host
+	CaptureRing(vk::Device device, DeviceAllocator& allocator, vk::DispatchLoaderDynamic const& dispatch, vk::Format format,
+		vk::Extent2D extent, uint32_t slot_count, bool exportable, CaptureHostMemory const* host_memory = nullptr)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_dispatch(&dispatch)
+		, m_format(format)
+		, m_extent(extent)
+		, m_row_pitch(extent.width * bytesPerPixel(format))
+		, m_exportable(exportable && !host_memory)
+	{
+		vk::ExternalMemoryBufferCreateInfo external_ci{ external_memory_handle_type };
+		vk::ExternalMemoryBufferCreateInfo host_ci{ vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT };
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.pNext = host_memory ? &host_ci : m_exportable ? &external_ci : nullptr;
+		buf_ci.size = vk::DeviceSize(m_row_pitch) * extent.height;
+		buf_ci.usage = vk::BufferUsageFlagBits::eTransferDst;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+
+		// cached, the consumer reads every byte from the CPU
+		auto const host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		auto const preferred = host_flags | vk::MemoryPropertyFlagBits::eHostCached;
+		if (host_memory)
+		{
+			m_writable = host_memory->writable;
+			m_slots.resize(host_memory->slots.size());
+			for (size_t i = 0; i < m_slots.size(); ++i)
+			{
+				auto& slot = m_slots[i];
+				slot.buffer = device.createBufferUnique(buf_ci);
+				slot.pixels = host_memory->slots[i];
+				auto mem_req = device.getBufferMemoryRequirements(*slot.buffer);
+				mem_req.memoryTypeBits &= device.getMemoryHostPointerPropertiesEXT(vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT,
+					slot.pixels, dispatch).memoryTypeBits;
+				if (mem_req.size > host_memory->slot_size)
+					throw std::runtime_error("Capture host memory slots are too small!");
+				vk::ImportMemoryHostPointerInfoEXT import_ai{ vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT, slot.pixels };
+				vk::MemoryAllocateInfo mem_ai{ host_memory->slot_size, allocator.selectMemoryType(mem_req, preferred, host_flags) };
+				mem_ai.pNext = &import_ai;
+				slot.dedicated = device.allocateMemoryUnique(mem_ai);
+				device.bindBufferMemory(*slot.buffer, *slot.dedicated, 0);
+			}
+			return;
+		}
+		m_slots.resize(std::max(slot_count, 1u));
+		for (auto& slot : m_slots)
+		{
+			slot.buffer = device.createBufferUnique(buf_ci);
+			if (!m_exportable)
+			{
+				slot.memory = allocator.allocateFor(*slot.buffer, preferred, host_flags, AllocationStrategy::Linear);
+				slot.pixels = slot.memory.mapped;
+				continue;
+			}
+			auto const mem_req = device.getBufferMemoryRequirements(*slot.buffer);
+			vk::MemoryDedicatedAllocateInfo dedicated_ai{ {}, *slot.buffer };
+			vk::ExportMemoryAllocateInfo export_ai{ external_memory_handle_type };
+			export_ai.pNext = &dedicated_ai;
+			vk::MemoryAllocateInfo mem_ai{ mem_req.size, allocator.selectMemoryType(mem_req, preferred, host_flags) };
+			mem_ai.pNext = &export_ai;
+			slot.dedicated = device.allocateMemoryUnique(mem_ai);
+			device.bindBufferMemory(*slot.buffer, *slot.dedicated, 0);
+			slot.pixels = device.mapMemory(*slot.dedicated, 0, VK_WHOLE_SIZE);
+		}
+	}
+
+	~CaptureRing()
+	{
+		for (auto& slot : m_slots)
+		{
+			slot.buffer.reset();
+			if (slot.memory)
+				m_allocator.free(slot.memory);
+		}
+	}
+
+	CaptureRing(CaptureRing const&) = delete;
+	CaptureRing& operator=(CaptureRing const&) = delete;
+
+	vk::Format format() const { return m_format; }
+	vk::Extent2D extent() const { return m_extent; }
+	bool exportable() const { return m_exportable; }
+
+	// records the copy of image, which the pass before left in layout and gets back in it; false drops the frame
+	// for want of a free slot. serial is the timeline value the command buffer's submission signals, split-frame
+	// device areas have every device copy its own.
+	bool record(vk::CommandBuffer cmd, vk::Image image, vk::ImageLayout layout, uint64_t serial, std::vector<vk::Rect2D> const& device_areas = {})
+	{
+		Slot* free = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (uint32_t i = 0; i < m_slots.size() && !free; ++i)
+				if (m_slots[i].state == State::Free && (!m_writable || m_writable(i)))
+					free = &m_slots[i];
+			if (!free)
+			{
+				++m_dropped;
+				return false;
+			}
+			free->state = State::Pending;
+			free->serial = serial;
+		}
+
+		const vk::ImageSubresourceRange range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+		vk::ImageMemoryBarrier to_copy{};
+		to_copy.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+		to_copy.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+		to_copy.oldLayout = layout;
+		to_copy.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+		to_copy.image = image;
+		to_copy.subresourceRange = range;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_copy);
+
+		copyImageBands(cmd, image, *free->buffer, m_extent, m_row_pitch, device_areas);
+
+		vk::BufferMemoryBarrier to_host{};
+		to_host.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		to_host.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		to_host.buffer = *free->buffer;
+		to_host.size = VK_WHOLE_SIZE;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, to_host, nullptr);
+
+		if (layout != vk::ImageLayout::eTransferSrcOptimal)
+		{
+			// presentation waits on the frame's semaphore, which covers the transition
+			vk::ImageMemoryBarrier back{};
+			back.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+			back.newLayout = layout;
+			back.image = image;
+			back.subresourceRange = range;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, back);
+		}
+		return true;
+	}
+
+	// the oldest capture whose frame reached completed, held until released
+	std::optional<CaptureFrame> take(uint64_t completed)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Slot* oldest = nullptr;
+		for (auto& slot : m_slots)
+			if (slot.state == State::Pending && slot.serial <= completed && (!oldest || slot.serial < oldest->serial))
+				oldest = &slot;
+		if (!oldest)
+			return std::nullopt;
+		oldest->state = State::Held;
+		++m_captured;
+
+		CaptureFrame frame;
+		frame.pixels = oldest->pixels;
+		frame.extent = m_extent;
+		frame.format = m_format;
+		frame.row_pitch = m_row_pitch;
+		frame.size = vk::DeviceSize(m_row_pitch) * m_extent.height;
+		frame.serial = oldest->serial;
+		frame.ring = this;
+		frame.slot = static_cast<uint32_t>(oldest - m_slots.data());
+		return frame;
+	}
+
+	void release(uint32_t slot)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_slots.at(slot).state != State::Held)
+				return;
+			m_slots[slot].state = State::Free;
+		}
+		m_released.notify_all();
+	}
+
+	// no copy pending and no capture held, the ring can go
+	bool idle() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto const& slot : m_slots)
+			if (slot.state != State::Free)
+				return false;
+		return true;
+	}
+
+	// false if the consumer still holds captures after timeout; copies that never complete are not waited for
+	bool waitReleased(std::chrono::milliseconds timeout) const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_released.wait_for(lock, timeout, [this]
+		{
+			for (auto const& slot : m_slots)
+				if (slot.state == State::Held)
+					return false;
+			return true;
+		});
+	}
+
+	uint64_t captured() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_captured;
+	}
+	uint64_t dropped() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_dropped;
+	}
+
+	// a new handle to the slot's memory, owned by the caller; the memory is the whole buffer at offset 0
+	ExternalMemoryHandle exportMemory(uint32_t slot) const
+	{
+		if (!m_exportable)
+			throw std::runtime_error("Capture memory is not exportable!");
+#if defined(_WIN32) && defined(VK_KHR_external_memory_win32)
+		return m_device.getMemoryWin32HandleKHR(vk::MemoryGetWin32HandleInfoKHR{ *m_slots.at(slot).dedicated, external_memory_handle_type }, *m_dispatch);
+#else
+		return m_device.getMemoryFdKHR(vk::MemoryGetFdInfoKHR{ *m_slots.at(slot).dedicated, external_memory_handle_type }, *m_dispatch);
+#endif
+	}
+
+private:
+	enum class State
+	{
+		Free,
+		// the copy is recorded, its frame may not have completed
+		Pending,
+		Held
+	};
+
+	struct Slot
+	{
+		vk::UniqueBuffer buffer;
+		// from the allocator, or dedicated: exportable or imported host memory
+		Allocation memory;
+		vk::UniqueDeviceMemory dedicated;
+		void* pixels = nullptr;
+		State state = State::Free;
+		uint64_t serial = 0;
+	};
+
+	static uint32_t bytesPerPixel(vk::Format format)
+	{
+		switch (format)
+		{
+		case vk::Format::eR16G16B16A16Sfloat: return 8;
+		case vk::Format::eR32G32B32A32Sfloat: return 16;
+		default: return 4;
+		}
+	}
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	vk::DispatchLoaderDynamic const* m_dispatch;
+	vk::Format m_format;
+	vk::Extent2D m_extent;
+	uint32_t m_row_pitch;
+	bool m_exportable;
+	std::function<bool(uint32_t slot)> m_writable;
+	std::vector<Slot> m_slots;
+	mutable std::mutex m_mutex;
+	mutable std::condition_variable m_released;
+	uint64_t m_captured = 0;
+	uint64_t m_dropped = 0;
+};
+
+inline void CaptureFrame::release() const
+{
+	if (ring)
+		ring->release(slot);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+
+// Everything a recorded pass depends on; a command buffer recorded with one state can be resubmitted
+// unchanged as long as the state stays equal.
+struct RecordState
+{
+	vk::RenderPass render_pass;
+	vk::Framebuffer framebuffer;
+	vk::Pipeline pipeline;
+	std::array<float, 4> clear_color{};
+	// viewport and scissor are dynamic state recorded into the buffer
+	vk::Extent2D extent;
+
+	bool operator==(RecordState const& rhs) const
+	{
+		return render_pass == rhs.render_pass && framebuffer == rhs.framebuffer
+			&& pipeline == rhs.pipeline && clear_color == rhs.clear_color && extent == rhs.extent;
+	}
+	bool operator!=(RecordState const& rhs) const { return !(*this == rhs); }
+};
+
+// A primary or secondary command buffer that is only re-recorded when its RecordState changes.
+// The caller must make sure the buffer is not pending execution when update() re-records it.
+class CachedCommandBuffer
+{
+public:
+	CachedCommandBuffer() = default;
+	explicit CachedCommandBuffer(vk::UniqueCommandBuffer cmd) : m_cmd(std::move(cmd)) {}
+
+	vk::CommandBuffer get() const { return *m_cmd; }
+	bool dirty(RecordState const& state) const { return !m_valid || m_state != state; }
+	void invalidate() { m_valid = false; }
+
+	// secondary buffers pass a begin info with inheritance info and eRenderPassContinue
+	template<typename F>
+	bool update(RecordState const& state, vk::CommandBufferBeginInfo const& begin_info, F&& record)
+	{
+		if (!dirty(state))
+			return false;
+		m_valid = false;
+		m_cmd->begin(begin_info);
+		record(*m_cmd);
+		m_cmd->end();
+		m_state = state;
+		m_valid = true;
+		return true;
+	}
+
+private:
+	vk::UniqueCommandBuffer m_cmd;
+	RecordState m_state;
+	bool m_valid = false;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "compute_scheduler.h"
+#include "device_allocator.h"
+#include "device_selector.h"
+#include "submit_batcher.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <memory>
+#include <string>
+
+// A logical device of its own on a GPU the scene does not render with, for compute jobs that share no resources with
+// the frames: their buffers come from allocator(), results reach the scene through host memory, e.g. mapped buffers
+// read once the job's timeline value is reached. Jobs run on the device's compute queue through scheduler(), so they
+// do not compete with rendering, and a loss of this device leaves the scene's alone.
+// Render thread only.
+class ComputeOffload
+{
+public:
+	// device was created on candidate.device with one queue of candidate.compute_family and timeline semaphores
+	ComputeOffload(vk::Instance instance, DeviceCandidate const& candidate, vk::UniqueDevice device)
+		: m_phys_dev(candidate.device)
+		, m_name(std::string(candidate.properties.deviceName))
+		, m_device(std::move(device))
+	{
+		m_dispatch.init(instance, vkGetInstanceProcAddr, *m_device);
+		auto const queue = m_device->getQueue(candidate.compute_family, 0);
+		m_allocator = std::make_unique<DeviceAllocator>(*m_device, m_phys_dev);
+		m_batcher = std::make_unique<SubmitBatcher>(m_dispatch, false);
+		m_scheduler = std::make_unique<ComputeScheduler>(*m_device, *m_batcher, queue, candidate.compute_family, queue, candidate.compute_family);
+	}
+
+	~ComputeOffload()
+	{
+		// the scheduler waits for its submissions, the memory goes after them
+		m_scheduler.reset();
+		m_batcher.reset();
+		m_allocator.reset();
+	}
+
+	ComputeOffload(ComputeOffload const&) = delete;
+	ComputeOffload& operator=(ComputeOffload const&) = delete;
+
+	vk::PhysicalDevice physicalDevice() const { return m_phys_dev; }
+	std::string const& name() const { return m_name; }
+	vk::Device device() const { return *m_device; }
+	DeviceAllocator& allocator() { return *m_allocator; }
+	// submissions without a graphics dependency, the device has no graphics queue
+	ComputeScheduler& scheduler() { return *m_scheduler; }
+
+	// flushes the queued submissions and recycles the completed ones
+	void pump()
+	{
+		m_batcher->flushAll();
+		m_scheduler->collect();
+	}
+
+private:
+	vk::PhysicalDevice m_phys_dev;
+	std::string m_name;
+	vk::UniqueDevice m_device;
+	vk::DispatchLoaderDynamic m_dispatch;
+	std::unique_ptr<DeviceAllocator> m_allocator;
+	std::unique_ptr<SubmitBatcher> m_batcher;
+	std::unique_ptr<ComputeScheduler> m_scheduler;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "submit_batcher.h"
+#include "timeline.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// Submits compute work to the async compute queue, or to the graphics queue when the device has no separate
+// compute family. Every submission signals the scheduler's timeline semaphore and may wait on timeline values of
+// other queues, so dependencies in both directions are semaphores and never stall the CPU.
+// Resources shared with the graphics queue need concurrent sharing or a release/acquire barrier pair
+// recorded by the caller, as with UploadEngine. Submissions are queued on the batcher and reach the GPU with its
+// next flush of the queue.
+class ComputeScheduler
+{
+public:
+	struct Wait
+	{
+		vk::Semaphore semaphore;
+		uint64_t value = 0;
+		vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eComputeShader;
+	};
+
+	ComputeScheduler(vk::Device device, SubmitBatcher& batcher, vk::Queue compute_queue, uint32_t compute_family, vk::Queue graphics_queue, uint32_t graphics_family)
+		: m_device(device)
+		, m_batcher(batcher)
+		, m_async(compute_family != graphics_family)
+		, m_queue(m_async ? compute_queue : graphics_queue)
+		, m_family(m_async ? compute_family : graphics_family)
+		, m_timeline(device)
+	{
+		vk::CommandPoolCreateInfo cmd_pool_ci{};
+		cmd_pool_ci.queueFamilyIndex = m_family;
+		cmd_pool_ci.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+		m_pool = device.createCommandPoolUnique(cmd_pool_ci);
+	}
+
+	~ComputeScheduler()
+	{
+		// command buffers must not be freed while they execute
+		if (m_timeline.submitted() != 0)
+		{
+			try
+			{
+				wait(m_timeline.submitted());
+			}
+			catch (...)
+			{}
+		}
+	}
+
+	ComputeScheduler(ComputeScheduler const&) = delete;
+	ComputeScheduler& operator=(ComputeScheduler const&) = delete;
+
+	// false if the work shares the graphics queue and only overlaps within it
+	bool async() const { return m_async; }
+	uint32_t family() const { return m_family; }
+	vk::Semaphore timeline() const { return m_timeline.semaphore(); }
+
+	// records into a fresh command buffer and submits it; returns the timeline value it signals. Background work
+	// the next graphics submission does not depend on passes graphics_dependency = false.
+	uint64_t submit(std::function<void(vk::CommandBuffer)> const& record, std::vector<Wait> const& waits = {}, bool graphics_dependency = true)
+	{
+		auto const cmd = commandBuffer();
+		vk::CommandBufferBeginInfo begin_info{};
+		begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		cmd.begin(begin_info);
+		record(cmd);
+		cmd.end();
+
+		std::vector<SubmitBatcher::Semaphore> batch_waits;
+		for (auto const& wait : waits)
+			batch_waits.push_back({ wait.semaphore, wait.value, wait.stage });
+		const uint64_t value = m_timeline.next();
+		m_batcher.add(m_queue, { cmd }, batch_waits, { { m_timeline.semaphore(), value } });
+		m_timeline.advance();
+
+		m_in_flight.push_back({ cmd, value });
+		if (graphics_dependency)
+			m_graphics_wait = value;
+		return value;
+	}
+
+	// the newest submission the graphics queue has not waited for yet
+	std::optional<Wait> takeGraphicsWait()
+	{
+		if (m_graphics_wait == 0)
+			return std::nullopt;
+		Wait wait{ m_timeline.semaphore(), m_graphics_wait, vk::PipelineStageFlagBits::eAllCommands };
+		m_graphics_wait = 0;
+		return wait;
+	}
+
+	// recycles the command buffers of completed submissions
+	void collect()
+	{
+		if (m_in_flight.empty())
+			return;
+		while (!m_in_flight.empty() && m_timeline.reached(m_in_flight.front().value))
+		{
+			m_free_cmds.push_back(m_in_flight.front().cmd);
+			m_in_flight.pop_front();
+		}
+	}
+
+	bool reached(uint64_t value) { return m_timeline.reached(value); }
+
+	// false on timeout
+	bool wait(uint64_t value, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max())
+	{
+		// the batch signaling the value may still be queued
+		if (!m_timeline.reached(value))
+			m_batcher.flush(m_queue);
+		return m_timeline.wait(value, timeout);
+	}
+
+private:
+	struct Submission
+	{
+		vk::CommandBuffer cmd;
+		uint64_t value = 0;
+	};
+
+	vk::CommandBuffer commandBuffer()
+	{
+		if (m_free_cmds.empty())
+		{
+			vk::CommandBufferAllocateInfo cmd_b_ai{};
+			cmd_b_ai.commandPool = *m_pool;
+			cmd_b_ai.commandBufferCount = 1;
+			cmd_b_ai.level = vk::CommandBufferLevel::ePrimary;
+			m_free_cmds.push_back(m_device.allocateCommandBuffers(cmd_b_ai).front());
+		}
+		auto const cmd = m_free_cmds.back();
+		m_free_cmds.pop_back();
+		return cmd;
+	}
+
+	vk::Device m_device;
+	SubmitBatcher& m_batcher;
+	bool m_async;
+	vk::Queue m_queue;
+	uint32_t m_family;
+
+	Timeline m_timeline;
+	vk::UniqueCommandPool m_pool;
+	uint64_t m_graphics_wait = 0;
+
+	std::deque<Submission> m_in_flight;
+	std::vector<vk::CommandBuffer> m_free_cmds;
+};
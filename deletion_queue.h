@@ -0,0 +1,95 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Owns objects the GPU may still use: each is retired against the timeline value of the last submission
+// that could reference it and destroyed by collect() once the timeline completed that value. Unique handles,
+// structs of them and custom deleters (e.g. freeing an Allocation) can all be retired, so hot swaps never
+// wait for the queue to go idle. Values must be retired in non-decreasing order of one timeline.
+class DeletionQueue
+{
+public:
+	DeletionQueue() = default;
+	DeletionQueue(DeletionQueue const&) = delete;
+	DeletionQueue& operator=(DeletionQueue const&) = delete;
+
+	~DeletionQueue()
+	{
+		clear();
+	}
+
+	// object is moved in
+	template<typename T>
+	void retire(uint64_t value, T&& object)
+	{
+		static_assert(!std::is_lvalue_reference<T>::value, "retire takes ownership, move the object in");
+		push(value, std::make_unique<Holder<std::decay_t<T>>>(std::forward<T>(object)));
+	}
+
+	// runs deleter once value completed
+	void defer(uint64_t value, std::function<void()> deleter)
+	{
+		push(value, std::make_unique<Deleter>(std::move(deleter)));
+	}
+
+	void collect(uint64_t completed)
+	{
+		while (!m_entries.empty() && m_entries.front().value <= completed)
+			m_entries.pop_front();
+	}
+
+	// everything at once, the caller guarantees the GPU is idle or lost
+	void clear()
+	{
+		// in retirement order, as collect() would
+		while (!m_entries.empty())
+			m_entries.pop_front();
+	}
+
+	bool empty() const { return m_entries.empty(); }
+	size_t size() const { return m_entries.size(); }
+
+private:
+	struct Retired
+	{
+		virtual ~Retired() = default;
+	};
+
+	template<typename T>
+	struct Holder : Retired
+	{
+		explicit Holder(T&& object) : object(std::move(object)) {}
+		T object;
+	};
+
+	struct Deleter : Retired
+	{
+		explicit Deleter(std::function<void()> deleter) : deleter(std::move(deleter)) {}
+		~Deleter() override
+		{
+			if (deleter)
+				deleter();
+		}
+		std::function<void()> deleter;
+	};
+
+	struct Entry
+	{
+		uint64_t value;
+		std::unique_ptr<Retired> object;
+	};
+
+	void push(uint64_t value, std::unique_ptr<Retired> object)
+	{
+		if (!m_entries.empty() && value < m_entries.back().value)
+			throw std::logic_error("DeletionQueue values must not decrease!");
+		m_entries.push_back({ value, std::move(object) });
+	}
+
+	std::deque<Entry> m_entries;
+};
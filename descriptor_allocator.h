@@ -0,0 +1,340 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Deduplicates descriptor set layouts: pipelines with the same set interface share one layout object.
+// Layouts live as long as the cache, so the handles it returns never have to be destroyed by the caller.
+class DescriptorLayoutCache
+{
+public:
+	explicit DescriptorLayoutCache(vk::Device device)
+		: m_device(device)
+	{}
+
+	DescriptorLayoutCache(DescriptorLayoutCache const&) = delete;
+	DescriptorLayoutCache& operator=(DescriptorLayoutCache const&) = delete;
+
+	// binding_flags is empty or has one entry per binding
+	vk::DescriptorSetLayout get(std::vector<vk::DescriptorSetLayoutBinding> bindings, vk::DescriptorSetLayoutCreateFlags flags = {},
+		std::vector<vk::DescriptorBindingFlags> binding_flags = {})
+	{
+		if (!binding_flags.empty() && binding_flags.size() != bindings.size())
+			throw std::runtime_error("Descriptor binding flags do not match the bindings!");
+		for (auto const& binding : bindings)
+			if (binding.pImmutableSamplers)
+				throw std::runtime_error("Immutable samplers are not supported by the layout cache!");
+
+		// the same interface declared in a different order is the same layout
+		Key key{ flags, {}, {} };
+		std::vector<size_t> order(bindings.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return bindings[a].binding < bindings[b].binding; });
+		for (auto const i : order)
+		{
+			key.bindings.push_back(bindings[i]);
+			key.binding_flags.push_back(binding_flags.empty() ? vk::DescriptorBindingFlags{} : binding_flags[i]);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& layout = m_layouts[key];
+		if (!layout)
+		{
+			vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_ci{};
+			flags_ci.bindingCount = static_cast<uint32_t>(key.binding_flags.size());
+			flags_ci.pBindingFlags = key.binding_flags.data();
+
+			vk::DescriptorSetLayoutCreateInfo dsl_ci{};
+			dsl_ci.flags = flags;
+			dsl_ci.bindingCount = static_cast<uint32_t>(key.bindings.size());
+			dsl_ci.pBindings = key.bindings.data();
+			if (!binding_flags.empty())
+				dsl_ci.pNext = &flags_ci;
+			layout = m_device.createDescriptorSetLayoutUnique(dsl_ci);
+		}
+		return *layout;
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_layouts.size();
+	}
+
+private:
+	struct Key
+	{
+		vk::DescriptorSetLayoutCreateFlags flags;
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		std::vector<vk::DescriptorBindingFlags> binding_flags;
+
+		bool operator==(Key const& rhs) const
+		{
+			return flags == rhs.flags && bindings == rhs.bindings && binding_flags == rhs.binding_flags;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(Key const& key) const
+		{
+			size_t hash = std::hash<uint32_t>{}(static_cast<uint32_t>(key.flags));
+			auto const combine = [&hash](uint32_t value) { hash ^= std::hash<uint32_t>{}(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+			for (size_t i = 0; i < key.bindings.size(); ++i)
+			{
+				auto const& binding = key.bindings[i];
+				combine(binding.binding);
+				combine(static_cast<uint32_t>(binding.descriptorType));
+				combine(binding.descriptorCount);
+				combine(static_cast<uint32_t>(binding.stageFlags));
+				combine(static_cast<uint32_t>(key.binding_flags[i]));
+			}
+			return hash;
+		}
+	};
+
+	vk::Device m_device;
+	mutable std::mutex m_mutex;
+	std::unordered_map<Key, vk::UniqueDescriptorSetLayout, KeyHash> m_layouts;
+};
+
+// Transient descriptor sets from pools owned by a frame in flight. Sets are never freed one by one;
+// beginFrame() resets all pools of the frame in one call once its fence signaled, so allocation is
+// a pool bump in the common case and the pools grow to the largest frame seen.
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(vk::Device device, uint32_t frames_in_flight, uint32_t sets_per_pool = 256)
+		: m_device(device)
+		, m_sets_per_pool(sets_per_pool)
+		, m_frames(frames_in_flight)
+	{}
+
+	DescriptorAllocator(DescriptorAllocator const&) = delete;
+	DescriptorAllocator& operator=(DescriptorAllocator const&) = delete;
+
+	// the frame's fence must have signaled, every set allocated for it becomes invalid
+	void beginFrame(uint32_t frame_index)
+	{
+		m_frame = &m_frames[frame_index % m_frames.size()];
+		for (auto& pool : m_frame->pools)
+			m_device.resetDescriptorPool(*pool);
+		m_frame->current = 0;
+	}
+
+	// valid until the current frame's slot is reused
+	vk::DescriptorSet allocate(vk::DescriptorSetLayout layout)
+	{
+		if (!m_frame)
+			throw std::runtime_error("DescriptorAllocator::allocate called before beginFrame!");
+
+		vk::DescriptorSetAllocateInfo ds_ai{};
+		ds_ai.descriptorSetCount = 1;
+		ds_ai.pSetLayouts = &layout;
+		while (true)
+		{
+			const bool fresh = m_frame->current == m_frame->pools.size();
+			if (fresh)
+				m_frame->pools.push_back(createPool());
+			ds_ai.descriptorPool = *m_frame->pools[m_frame->current];
+
+			vk::DescriptorSet set;
+			auto const result = m_device.allocateDescriptorSets(&ds_ai, &set);
+			if (result == vk::Result::eSuccess)
+				return set;
+			if (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)
+				vk::throwResultException(result, "vkAllocateDescriptorSets");
+			if (fresh)
+				throw std::runtime_error("Descriptor set layout does not fit into an empty descriptor pool!");
+			++m_frame->current;
+		}
+	}
+
+private:
+	struct Frame
+	{
+		std::vector<vk::UniqueDescriptorPool> pools;
+		// pools before this one are full
+		size_t current = 0;
+	};
+
+	vk::UniqueDescriptorPool createPool() const
+	{
+		// descriptors per set, roughly what typical material and pass sets use
+		static constexpr std::pair<vk::DescriptorType, float> ratios[] = {
+			{ vk::DescriptorType::eUniformBuffer, 2.0f },
+			{ vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+			{ vk::DescriptorType::eStorageBuffer, 2.0f },
+			{ vk::DescriptorType::eCombinedImageSampler, 4.0f },
+			{ vk::DescriptorType::eSampledImage, 2.0f },
+			{ vk::DescriptorType::eSampler, 1.0f },
+			{ vk::DescriptorType::eStorageImage, 1.0f },
+			{ vk::DescriptorType::eUniformTexelBuffer, 0.5f },
+			{ vk::DescriptorType::eStorageTexelBuffer, 0.5f },
+			{ vk::DescriptorType::eInputAttachment, 0.5f },
+		};
+		std::vector<vk::DescriptorPoolSize> sizes;
+		for (auto const& [type, ratio] : ratios)
+			sizes.emplace_back(type, static_cast<uint32_t>(ratio * m_sets_per_pool));
+
+		vk::DescriptorPoolCreateInfo pool_ci{};
+		pool_ci.maxSets = m_sets_per_pool;
+		pool_ci.poolSizeCount = static_cast<uint32_t>(sizes.size());
+		pool_ci.pPoolSizes = sizes.data();
+		return m_device.createDescriptorPoolUnique(pool_ci);
+	}
+
+	vk::Device m_device;
+	uint32_t m_sets_per_pool;
+	std::vector<Frame> m_frames;
+	Frame* m_frame = nullptr;
+};
+
+// One update-after-bind descriptor set with large partially bound arrays of textures and storage buffers.
+// It is bound once per command buffer and shaders index it with the handles returned by add*(), so
+// per-draw descriptor writes and allocations disappear. Slots are recycled once the GPU finished
+// every frame that could still read them.
+class BindlessTable
+{
+public:
+	enum Binding : uint32_t
+	{
+		Textures = 0,
+		StorageBuffers = 1,
+		BindingCount
+	};
+
+	// clamps the capacities to the device's update-after-bind limits
+	BindlessTable(vk::Device device, vk::PhysicalDevice phys_dev, DescriptorLayoutCache& layouts, uint32_t set, uint32_t texture_capacity, uint32_t buffer_capacity)
+		: m_device(device)
+		, m_set_index(set)
+	{
+		auto const props = phys_dev.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+		auto const& limits = props.get<vk::PhysicalDeviceVulkan12Properties>();
+		auto const resources = limits.maxPerStageUpdateAfterBindResources;
+		m_capacity[Textures] = std::min({ texture_capacity, limits.maxDescriptorSetUpdateAfterBindSampledImages,
+			limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSamplers, resources / 2 });
+		m_capacity[StorageBuffers] = std::min({ buffer_capacity, limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+			limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers, resources / 2 });
+
+		const std::vector<vk::DescriptorSetLayoutBinding> bindings = {
+			{ Textures, descriptorType(Textures), m_capacity[Textures], vk::ShaderStageFlagBits::eAll },
+			{ StorageBuffers, descriptorType(StorageBuffers), m_capacity[StorageBuffers], vk::ShaderStageFlagBits::eAll },
+		};
+		// unused slots stay unwritten and free slots may be rewritten while older frames are in flight
+		auto const binding_flags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+			| vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+		m_layout = layouts.get(bindings, vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, { binding_flags, binding_flags });
+
+		const std::vector<vk::DescriptorPoolSize> sizes = {
+			{ descriptorType(Textures), m_capacity[Textures] },
+			{ descriptorType(StorageBuffers), m_capacity[StorageBuffers] },
+		};
+		vk::DescriptorPoolCreateInfo pool_ci{};
+		pool_ci.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+		pool_ci.maxSets = 1;
+		pool_ci.poolSizeCount = static_cast<uint32_t>(sizes.size());
+		pool_ci.pPoolSizes = sizes.data();
+		m_pool = device.createDescriptorPoolUnique(pool_ci);
+
+		vk::DescriptorSetAllocateInfo ds_ai{};
+		ds_ai.descriptorPool = *m_pool;
+		ds_ai.descriptorSetCount = 1;
+		ds_ai.pSetLayouts = &m_layout;
+		m_set = device.allocateDescriptorSets(ds_ai).front();
+	}
+
+	BindlessTable(BindlessTable const&) = delete;
+	BindlessTable& operator=(BindlessTable const&) = delete;
+
+	static vk::DescriptorType descriptorType(Binding binding)
+	{
+		return binding == Textures ? vk::DescriptorType::eCombinedImageSampler : vk::DescriptorType::eStorageBuffer;
+	}
+
+	// set number the table occupies in every pipeline layout
+	uint32_t setIndex() const { return m_set_index; }
+	vk::DescriptorSetLayout layout() const { return m_layout; }
+	vk::DescriptorSet descriptorSet() const { return m_set; }
+	uint32_t capacity(Binding binding) const { return m_capacity[binding]; }
+
+	uint32_t addTexture(vk::ImageView view, vk::Sampler sampler, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal)
+	{
+		vk::DescriptorImageInfo image_info{ sampler, view, layout };
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const index = allocateSlot(Textures);
+		vk::WriteDescriptorSet write{ m_set, Textures, index, 1, descriptorType(Textures), &image_info };
+		m_device.updateDescriptorSets(write, nullptr);
+		return index;
+	}
+
+	uint32_t addStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE)
+	{
+		vk::DescriptorBufferInfo buffer_info{ buffer, offset, range };
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const index = allocateSlot(StorageBuffers);
+		vk::WriteDescriptorSet write{ m_set, StorageBuffers, index, 1, descriptorType(StorageBuffers), nullptr, &buffer_info };
+		m_device.updateDescriptorSets(write, nullptr);
+		return index;
+	}
+
+	// the slot is reused once frame serial retire_serial completed
+	void remove(Binding binding, uint32_t index, uint64_t retire_serial)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_retired.push_back({ retire_serial, binding, index });
+	}
+
+	void collect(uint64_t completed_serial)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const done = std::stable_partition(m_retired.begin(), m_retired.end(),
+			[completed_serial](RetiredSlot const& slot) { return slot.serial <= completed_serial; });
+		for (auto it = m_retired.begin(); it != done; ++it)
+			m_free[it->binding].push_back(it->index);
+		m_retired.erase(m_retired.begin(), done);
+	}
+
+private:
+	struct RetiredSlot
+	{
+		uint64_t serial;
+		Binding binding;
+		uint32_t index;
+	};
+
+	uint32_t allocateSlot(Binding binding)
+	{
+		auto& free = m_free[binding];
+		if (!free.empty())
+		{
+			auto const index = free.back();
+			free.pop_back();
+			return index;
+		}
+		if (m_used[binding] == m_capacity[binding])
+			throw std::runtime_error("Bindless descriptor table is full!");
+		return m_used[binding]++;
+	}
+
+	vk::Device m_device;
+	uint32_t m_set_index;
+	uint32_t m_capacity[BindingCount] = {};
+	vk::DescriptorSetLayout m_layout;
+	vk::UniqueDescriptorPool m_pool;
+	vk::DescriptorSet m_set;
+
+	std::mutex m_mutex;
+	// slots below are written or retired, the ones above were never handed out
+	uint32_t m_used[BindingCount] = {};
+	std::vector<uint32_t> m_free[BindingCount];
+	std::vector<RetiredSlot> m_retired;
+};
@@ -0,0 +1,582 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+inline uint32_t selectMemoryTypeIndex(
+	vk::PhysicalDeviceMemoryProperties const& mem_props,
+	vk::MemoryRequirements mem_req,
+	vk::MemoryPropertyFlags preferred,
+	vk::MemoryPropertyFlags required)
+{
+	for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i)
+		if ((mem_req.memoryTypeBits & (1 << i)) && (mem_props.memoryTypes[i].propertyFlags & preferred) == preferred)
+			return i;
+	if (required != preferred)
+		for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i)
+			if ((mem_req.memoryTypeBits & (1 << i)) && (mem_props.memoryTypes[i].propertyFlags & required) == required)
+				return i;
+
+	throw std::runtime_error{ "required memory type not available" };
+}
+
+inline uint32_t selectMemoryTypeIndex(
+	vk::PhysicalDevice phys_dev,
+	vk::MemoryRequirements mem_req,
+	vk::MemoryPropertyFlags preferred,
+	vk::MemoryPropertyFlags required)
+{
+	return selectMemoryTypeIndex(phys_dev.getMemoryProperties(), mem_req, preferred, required);
+}
+
+enum class AllocationStrategy
+{
+	// bump allocation, a block is recycled once all of its allocations are freed; for streaming and per-frame data
+	Linear,
+	// power-of-two buddy system with immediate reuse; for long-lived resources of mixed sizes
+	Buddy
+};
+
+// linear resources (buffers, linear images) and optimal images must not share a bufferImageGranularity page
+enum class ResourceKind
+{
+	Linear,
+	Optimal
+};
+
+// called by DeviceAllocator::defragment() when old_alloc's contents have to move to new_alloc; the owner
+// recreates/rebinds its resource and copies the data, old_alloc is freed afterwards
+struct Allocation;
+using AllocationMoveCallback = std::function<void(Allocation const& old_alloc, Allocation const& new_alloc)>;
+struct MemoryBlock;
+
+struct Allocation
+{
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	uint32_t memory_type = 0;
+	// null unless the memory is host visible, it stays mapped for the allocation's lifetime
+	void* mapped = nullptr;
+
+	explicit operator bool() const { return memory != vk::DeviceMemory{}; }
+
+private:
+	friend class DeviceAllocator;
+	MemoryBlock* block = nullptr;
+};
+
+struct LiveAllocation
+{
+	vk::DeviceSize size = 0;
+	vk::DeviceSize alignment = 1;
+	uint32_t order = 0;
+	ResourceKind kind = ResourceKind::Linear;
+	AllocationMoveCallback on_move;
+};
+
+struct MemoryBlock
+{
+	vk::DeviceMemory memory;
+	vk::DeviceSize size = 0;
+	vk::DeviceSize used = 0;
+	uint32_t memory_type = 0;
+	AllocationStrategy strategy = AllocationStrategy::Linear;
+	bool dedicated = false;
+	bool frozen = false;
+	// allocator tick of the last allocation or free, empty blocks are released least recently used first
+	uint64_t last_used = 0;
+	// set when the block is restricted to one resource kind
+	std::optional<ResourceKind> only_kind;
+	uint8_t* mapped = nullptr;
+	std::map<vk::DeviceSize, LiveAllocation> live;
+
+	// linear strategy
+	vk::DeviceSize linear_head = 0;
+	std::optional<ResourceKind> last_kind;
+
+	// buddy strategy, free node offsets per order, order 0 is min_buddy_size
+	vk::DeviceSize min_node = 0;
+	std::vector<std::set<vk::DeviceSize>> free_nodes;
+
+	bool accepts(ResourceKind kind) const { return !frozen && (!only_kind || *only_kind == kind); }
+
+	vk::DeviceSize nodeSize(uint32_t order) const { return min_node << order; }
+
+	std::optional<vk::DeviceSize> buddyAllocate(uint32_t order)
+	{
+		uint32_t found = order;
+		while (found < free_nodes.size() && free_nodes[found].empty())
+			++found;
+		if (found == free_nodes.size())
+			return std::nullopt;
+
+		auto const offset = *free_nodes[found].begin();
+		free_nodes[found].erase(free_nodes[found].begin());
+		// split down, the upper halves become free buddies
+		while (found > order)
+		{
+			--found;
+			free_nodes[found].insert(offset + nodeSize(found));
+		}
+		return offset;
+	}
+
+	void buddyFree(vk::DeviceSize offset, uint32_t order)
+	{
+		while (order + 1 < free_nodes.size())
+		{
+			auto const buddy = offset ^ nodeSize(order);
+			auto const it = free_nodes[order].find(buddy);
+			if (it == free_nodes[order].end())
+				break;
+			free_nodes[order].erase(it);
+			offset = std::min(offset, buddy);
+			++order;
+		}
+		free_nodes[order].insert(offset);
+	}
+};
+
+struct DeviceAllocatorConfig
+{
+	vk::DeviceSize block_size = vk::DeviceSize(64) << 20;
+	// requests above this get their own VkDeviceMemory
+	vk::DeviceSize dedicated_threshold = vk::DeviceSize(32) << 20;
+	vk::DeviceSize min_buddy_size = 256;
+	// the device spans a device group, whose heaps may have an instance per device
+	bool linked_devices = false;
+};
+
+// Sub-allocates device memory from large per-memory-type blocks so resources stay far below
+// maxMemoryAllocationCount. Empty blocks are kept for reuse until a heap budget asks for their memory back.
+// A new block that would exceed its heap's budget, or that the driver refuses, goes to another memory type
+// the request allows (e.g. host-visible system memory for a resource that only prefers device-local), so
+// heap pressure slows resources down instead of failing them. Not thread safe.
+class DeviceAllocator
+{
+public:
+	struct Stats
+	{
+		uint32_t device_memory_count = 0;
+		vk::DeviceSize reserved = 0;
+		vk::DeviceSize used = 0;
+	};
+
+	using Config = DeviceAllocatorConfig;
+	using MoveCallback = AllocationMoveCallback;
+
+	DeviceAllocator(vk::Device device, vk::PhysicalDevice phys_dev, Config const& config = {})
+		: m_device(device)
+		, m_config(config)
+		, m_mem_props(phys_dev.getMemoryProperties())
+		, m_granularity(phys_dev.getProperties().limits.bufferImageGranularity)
+		, m_max_allocations(phys_dev.getProperties().limits.maxMemoryAllocationCount)
+		, m_heap_reserved(m_mem_props.memoryHeapCount, 0)
+		, m_heap_budget(m_mem_props.memoryHeapCount, VK_WHOLE_SIZE)
+	{
+		// buddy nodes are naturally aligned to their size, keep the block size a power of two
+		vk::DeviceSize size = 1;
+		while (size < m_config.block_size)
+			size <<= 1;
+		m_config.block_size = size;
+	}
+
+	~DeviceAllocator()
+	{
+		for (auto& block : m_blocks)
+			m_device.freeMemory(block->memory);
+	}
+
+	DeviceAllocator(DeviceAllocator const&) = delete;
+	DeviceAllocator& operator=(DeviceAllocator const&) = delete;
+
+	vk::PhysicalDeviceMemoryProperties const& memoryProperties() const { return m_mem_props; }
+
+	uint32_t selectMemoryType(vk::MemoryRequirements mem_req, vk::MemoryPropertyFlags preferred, vk::MemoryPropertyFlags required) const
+	{
+		mem_req.memoryTypeBits &= allowedTypes();
+		return selectMemoryTypeIndex(m_mem_props, mem_req, preferred, required);
+	}
+
+	Allocation allocate(
+		vk::MemoryRequirements mem_req,
+		vk::MemoryPropertyFlags preferred,
+		vk::MemoryPropertyFlags required,
+		ResourceKind kind = ResourceKind::Linear,
+		AllocationStrategy strategy = AllocationStrategy::Buddy,
+		MoveCallback const& on_move = {})
+	{
+		mem_req.memoryTypeBits &= allowedTypes();
+		auto type = selectMemoryType(mem_req, preferred, required);
+		auto const dedicated = mem_req.size > m_config.dedicated_threshold;
+		if (!dedicated)
+			if (auto alloc = allocateFromBlocks(type, mem_req, strategy, kind, on_move))
+				return alloc;
+
+		auto const block_size = dedicated ? mem_req.size : m_config.block_size;
+		auto const block_strategy = dedicated ? AllocationStrategy::Linear : strategy;
+		if (!fitsBudget(type, block_size))
+			if (auto const fallback = fallbackType(mem_req, type, required, block_size))
+			{
+				type = *fallback;
+				if (!dedicated)
+					if (auto alloc = allocateFromBlocks(type, mem_req, strategy, kind, on_move))
+						return alloc;
+			}
+
+		MemoryBlock* block = nullptr;
+		try
+		{
+			block = &createBlock(type, block_size, block_strategy, kind, dedicated);
+		}
+		catch (vk::OutOfDeviceMemoryError const&)
+		{
+			// over budget after all, the driver knows better than the last budget query
+			auto const fallback = fallbackType(mem_req, type, required, block_size);
+			if (!fallback)
+				throw;
+			block = &createBlock(*fallback, block_size, block_strategy, kind, dedicated);
+		}
+		if (dedicated)
+			return finish(*block, mem_req, kind, on_move);
+		auto alloc = tryAllocate(*block, mem_req, kind, on_move);
+		if (!alloc)
+			throw std::runtime_error{ "allocation does not fit into a fresh memory block" };
+		return alloc;
+	}
+
+	void free(Allocation const& alloc)
+	{
+		if (!alloc.block)
+			return;
+		auto& block = *alloc.block;
+		auto const it = block.live.find(alloc.offset);
+		if (it == block.live.end())
+			throw std::logic_error{ "freeing an allocation twice" };
+
+		block.used -= it->second.size;
+		block.last_used = ++m_tick;
+		if (block.strategy == AllocationStrategy::Buddy)
+			block.buddyFree(alloc.offset, it->second.order);
+		block.live.erase(it);
+		if (block.live.empty())
+		{
+			block.linear_head = 0;
+			block.last_kind.reset();
+		}
+
+		if (block.dedicated)
+			releaseBlock(block);
+	}
+
+	// allocate and bind in one call
+	Allocation allocateFor(vk::Buffer buffer, vk::MemoryPropertyFlags preferred, vk::MemoryPropertyFlags required,
+		AllocationStrategy strategy = AllocationStrategy::Buddy)
+	{
+		auto alloc = allocate(m_device.getBufferMemoryRequirements(buffer), preferred, required, ResourceKind::Linear, strategy);
+		m_device.bindBufferMemory(buffer, alloc.memory, alloc.offset);
+		return alloc;
+	}
+
+	Allocation allocateFor(vk::Image image, vk::MemoryPropertyFlags preferred, vk::MemoryPropertyFlags required,
+		ResourceKind kind = ResourceKind::Optimal)
+	{
+		auto alloc = allocate(m_device.getImageMemoryRequirements(image), preferred, required, kind);
+		m_device.bindImageMemory(image, alloc.memory, alloc.offset);
+		return alloc;
+	}
+
+	// moves movable allocations out of the emptiest block of every pool and releases blocks that became
+	// empty; returns the number of moved allocations
+	uint32_t defragment()
+	{
+		uint32_t moved = 0;
+		for (auto* source : defragmentationCandidates())
+		{
+			std::vector<std::pair<vk::DeviceSize, LiveAllocation>> movable;
+			for (auto const& live : source->live)
+				if (live.second.on_move)
+					movable.push_back(live);
+			if (movable.size() != source->live.size())
+				continue;
+
+			source->frozen = true;
+			for (auto& [offset, live] : movable)
+			{
+				vk::MemoryRequirements mem_req{};
+				mem_req.size = live.size;
+				mem_req.alignment = live.alignment;
+				mem_req.memoryTypeBits = 1u << source->memory_type;
+
+				auto const props = m_mem_props.memoryTypes[source->memory_type].propertyFlags;
+				auto new_alloc = allocate(mem_req, props, props, live.kind, source->strategy, live.on_move);
+				live.on_move(handle(*source, offset, live), new_alloc);
+				free(handle(*source, offset, live));
+				++moved;
+			}
+			source->frozen = false;
+			if (source->live.empty())
+				releaseBlock(*source);
+		}
+		return moved;
+	}
+
+	Stats stats() const
+	{
+		Stats stats{};
+		for (auto const& block : m_blocks)
+		{
+			++stats.device_memory_count;
+			stats.reserved += block->size;
+			stats.used += block->used;
+		}
+		return stats;
+	}
+
+	// heap usage as seen by this allocator, index by memory heap
+	std::vector<vk::DeviceSize> heapUsage() const
+	{
+		return m_heap_reserved;
+	}
+
+	// bytes of device memory the allocator may hold in heap, VK_WHOLE_SIZE for no limit; releases empty
+	// blocks of the heap until it is back under it, if it can
+	void setHeapBudget(uint32_t heap, vk::DeviceSize budget)
+	{
+		m_heap_budget[heap] = budget;
+		if (m_heap_reserved[heap] > budget)
+			releaseEmptyBlocks(heap, m_heap_reserved[heap] - budget);
+	}
+
+	vk::DeviceSize heapBudget(uint32_t heap) const { return m_heap_budget[heap]; }
+
+	// releases empty blocks of heap, least recently used first, until at least bytes are released;
+	// returns the bytes released
+	vk::DeviceSize releaseEmptyBlocks(uint32_t heap, vk::DeviceSize bytes)
+	{
+		std::vector<MemoryBlock*> empty;
+		for (auto const& block : m_blocks)
+			if (block->live.empty() && !block->frozen && m_mem_props.memoryTypes[block->memory_type].heapIndex == heap)
+				empty.push_back(block.get());
+		std::sort(empty.begin(), empty.end(), [](MemoryBlock const* a, MemoryBlock const* b) { return a->last_used < b->last_used; });
+
+		vk::DeviceSize released = 0;
+		for (auto* block : empty)
+		{
+			if (released >= bytes)
+				break;
+			released += block->size;
+			releaseBlock(*block);
+		}
+		return released;
+	}
+
+private:
+	static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	Allocation allocateFromBlocks(uint32_t type, vk::MemoryRequirements const& mem_req, AllocationStrategy strategy, ResourceKind kind, MoveCallback const& on_move)
+	{
+		for (auto& block : m_blocks)
+			if (block->memory_type == type && block->strategy == strategy && !block->dedicated && block->accepts(kind))
+				if (auto alloc = tryAllocate(*block, mem_req, kind, on_move))
+					return alloc;
+		return {};
+	}
+
+	// host-visible blocks are mapped, which memory with an instance per device does not allow
+	uint32_t allowedTypes() const
+	{
+		uint32_t types = ~0u;
+		if (!m_config.linked_devices)
+			return types;
+		for (uint32_t i = 0; i < m_mem_props.memoryTypeCount; ++i)
+		{
+			auto const& type = m_mem_props.memoryTypes[i];
+			if ((type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) && (m_mem_props.memoryHeaps[type.heapIndex].flags & vk::MemoryHeapFlagBits::eMultiInstance))
+				types &= ~(1u << i);
+		}
+		return types;
+	}
+
+	// a new block of size in type's heap stays within the heap budget, after releasing empty blocks if needed
+	bool fitsBudget(uint32_t type, vk::DeviceSize size)
+	{
+		auto const heap = m_mem_props.memoryTypes[type].heapIndex;
+		if (m_heap_budget[heap] == VK_WHOLE_SIZE)
+			return true;
+		if (m_heap_reserved[heap] + size > m_heap_budget[heap])
+			releaseEmptyBlocks(heap, m_heap_reserved[heap] + size - m_heap_budget[heap]);
+		return m_heap_reserved[heap] + size <= m_heap_budget[heap];
+	}
+
+	// another type the request allows in a heap with room for size, host-visible ones first
+	std::optional<uint32_t> fallbackType(vk::MemoryRequirements const& mem_req, uint32_t type, vk::MemoryPropertyFlags required, vk::DeviceSize size)
+	{
+		auto const heap = m_mem_props.memoryTypes[type].heapIndex;
+		std::optional<uint32_t> fallback;
+		for (uint32_t i = 0; i < m_mem_props.memoryTypeCount; ++i)
+		{
+			auto const& candidate = m_mem_props.memoryTypes[i];
+			if (!(mem_req.memoryTypeBits & (1u << i)) || (candidate.propertyFlags & required) != required || candidate.heapIndex == heap)
+				continue;
+			if (!fitsBudget(i, size))
+				continue;
+			if (!fallback || ((candidate.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+				&& !(m_mem_props.memoryTypes[*fallback].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)))
+				fallback = i;
+		}
+		return fallback;
+	}
+
+	Allocation handle(MemoryBlock& block, vk::DeviceSize offset, LiveAllocation const& live) const
+	{
+		Allocation alloc{};
+		alloc.memory = block.memory;
+		alloc.offset = offset;
+		alloc.size = live.size;
+		alloc.memory_type = block.memory_type;
+		alloc.mapped = block.mapped ? block.mapped + offset : nullptr;
+		alloc.block = &block;
+		return alloc;
+	}
+
+	MemoryBlock& createBlock(uint32_t type, vk::DeviceSize size, AllocationStrategy strategy, ResourceKind kind, bool dedicated)
+	{
+		if (m_blocks.size() >= m_max_allocations)
+			throw std::runtime_error{ "maxMemoryAllocationCount reached" };
+
+		vk::MemoryAllocateInfo mem_ai{};
+		mem_ai.allocationSize = size;
+		mem_ai.memoryTypeIndex = type;
+
+		auto block = std::make_unique<MemoryBlock>();
+		block->memory = m_device.allocateMemory(mem_ai);
+		block->size = size;
+		block->memory_type = type;
+		block->strategy = strategy;
+		block->dedicated = dedicated;
+		block->last_used = ++m_tick;
+		// the linear strategy pads between kinds itself, buddy blocks are segregated
+		if (strategy == AllocationStrategy::Buddy && m_granularity > 1)
+			block->only_kind = kind;
+		if (m_mem_props.memoryTypes[type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+			block->mapped = static_cast<uint8_t*>(m_device.mapMemory(block->memory, 0, VK_WHOLE_SIZE));
+		if (strategy == AllocationStrategy::Buddy)
+		{
+			block->min_node = m_config.min_buddy_size;
+			uint32_t orders = 1;
+			while (block->nodeSize(orders - 1) < size)
+				++orders;
+			block->free_nodes.resize(orders);
+			block->free_nodes.back().insert(0);
+		}
+
+		m_heap_reserved[m_mem_props.memoryTypes[type].heapIndex] += size;
+		m_blocks.push_back(std::move(block));
+		return *m_blocks.back();
+	}
+
+	void releaseBlock(MemoryBlock& block)
+	{
+		m_heap_reserved[m_mem_props.memoryTypes[block.memory_type].heapIndex] -= block.size;
+		m_device.freeMemory(block.memory);
+		m_blocks.erase(std::find_if(m_blocks.begin(), m_blocks.end(), [&](auto const& b) { return b.get() == &block; }));
+	}
+
+	Allocation tryAllocate(MemoryBlock& block, vk::MemoryRequirements const& mem_req, ResourceKind kind, MoveCallback const& on_move)
+	{
+		LiveAllocation live{};
+		live.size = mem_req.size;
+		live.alignment = std::max<vk::DeviceSize>(mem_req.alignment, 1);
+		live.kind = kind;
+		live.on_move = on_move;
+
+		vk::DeviceSize offset = 0;
+		if (block.strategy == AllocationStrategy::Linear)
+		{
+			auto alignment = live.alignment;
+			if (block.last_kind && *block.last_kind != kind)
+				alignment = std::max(alignment, m_granularity);
+			offset = alignUp(block.linear_head, alignment);
+			if (offset + live.size > block.size)
+				return {};
+			block.linear_head = offset + live.size;
+			block.last_kind = kind;
+		}
+		else
+		{
+			auto const needed = std::max(live.size, live.alignment);
+			uint32_t order = 0;
+			while (block.nodeSize(order) < needed)
+				++order;
+			if (order >= block.free_nodes.size())
+				return {};
+			auto const node = block.buddyAllocate(order);
+			if (!node)
+				return {};
+			offset = *node;
+			live.order = order;
+		}
+
+		block.used += live.size;
+		block.last_used = ++m_tick;
+		auto const& inserted = block.live.emplace(offset, std::move(live)).first->second;
+		return handle(block, offset, inserted);
+	}
+
+	Allocation finish(MemoryBlock& block, vk::MemoryRequirements const& mem_req, ResourceKind kind, MoveCallback const& on_move)
+	{
+		auto alloc = tryAllocate(block, mem_req, kind, on_move);
+		if (!alloc)
+			throw std::runtime_error{ "dedicated allocation failed" };
+		return alloc;
+	}
+
+	std::vector<MemoryBlock*> defragmentationCandidates()
+	{
+		// per pool (type, strategy, kind) the least used non-empty block, if the pool has another block to move into
+		std::vector<MemoryBlock*> candidates;
+		for (auto& block : m_blocks)
+		{
+			if (block->dedicated || block->live.empty())
+				continue;
+			uint32_t pool_size = 0;
+			MemoryBlock* emptiest = nullptr;
+			for (auto& other : m_blocks)
+			{
+				if (other->dedicated || other->memory_type != block->memory_type || other->strategy != block->strategy || other->only_kind != block->only_kind)
+					continue;
+				++pool_size;
+				if (!other->live.empty() && (!emptiest || other->used < emptiest->used))
+					emptiest = other.get();
+			}
+			if (pool_size > 1 && emptiest == block.get())
+				candidates.push_back(block.get());
+		}
+		return candidates;
+	}
+
+	vk::Device m_device;
+	Config m_config;
+	vk::PhysicalDeviceMemoryProperties m_mem_props;
+	vk::DeviceSize m_granularity;
+	uint32_t m_max_allocations;
+	std::vector<std::unique_ptr<MemoryBlock>> m_blocks;
+	// per heap, the size of all blocks and the limit set by setHeapBudget()
+	std::vector<vk::DeviceSize> m_heap_reserved;
+	std::vector<vk::DeviceSize> m_heap_budget;
+	uint64_t m_tick = 0;
+};
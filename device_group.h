@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+enum class MultiGpuMode
+{
+	// one physical device renders, linked ones idle
+	Single,
+	// frames go round robin to the linked devices, each renders and presents whole frames
+	AlternateFrame,
+	// every device renders its band of every frame; headless only, presenting the bands would need peer copies
+	SplitFrame
+};
+
+inline char const* toString(MultiGpuMode mode)
+{
+	switch (mode)
+	{
+	case MultiGpuMode::Single: return "single";
+	case MultiGpuMode::AlternateFrame: return "alternate frame";
+	case MultiGpuMode::SplitFrame: return "split frame";
+	}
+	return "unknown";
+}
+
+struct MultiGpuConfig
+{
+	// falls back to Single where the selected device is not linked with others
+	MultiGpuMode mode = MultiGpuMode::Single;
+	// a GPU the scene does not render with gets a device of its own for compute jobs, see ComputeOffload
+	bool compute_offload = false;
+};
+
+// The physical devices of the selected device's group, see VkDeviceGroupDeviceCreateInfo. Device index 0 is the
+// selected device, the others follow in the order the instance reports them. Memory without a device mask is
+// allocated on every device, device-local heaps get one instance per device.
+class DeviceGroup
+{
+public:
+	// a group of one
+	DeviceGroup() = default;
+	explicit DeviceGroup(vk::PhysicalDevice phys_dev)
+		: m_devices{ phys_dev }
+	{}
+
+	// the group the instance reports phys_dev in
+	static DeviceGroup of(vk::Instance instance, vk::PhysicalDevice phys_dev)
+	{
+		DeviceGroup group(phys_dev);
+		for (auto const& props : instance.enumeratePhysicalDeviceGroups())
+		{
+			auto const begin = props.physicalDevices;
+			auto const end = begin + props.physicalDeviceCount;
+			if (std::find(begin, end, phys_dev) == end)
+				continue;
+			for (auto it = begin; it != end; ++it)
+				if (*it != phys_dev)
+					group.m_devices.push_back(*it);
+		}
+		return group;
+	}
+
+	uint32_t size() const { return static_cast<uint32_t>(m_devices.size()); }
+	bool linked() const { return m_devices.size() > 1; }
+	std::vector<vk::PhysicalDevice> const& devices() const { return m_devices; }
+	bool contains(vk::PhysicalDevice phys_dev) const { return std::find(m_devices.begin(), m_devices.end(), phys_dev) != m_devices.end(); }
+	uint32_t allMask() const { return size() >= 32 ? ~0u : (1u << size()) - 1; }
+
+	// which devices have presentation engines and whose images they show, valid for the device created with the group
+	void queryPresentCapabilities(vk::Device device, vk::DispatchLoaderDynamic const& dispatch)
+	{
+		auto const caps = device.getGroupPresentCapabilitiesKHR(dispatch);
+		std::copy(std::begin(caps.presentMask), std::end(caps.presentMask), m_present_masks.begin());
+		m_present_modes = caps.modes;
+	}
+
+	vk::DeviceGroupPresentModeFlagsKHR presentModes() const { return m_present_modes; }
+
+	// how device index's instance of a swapchain image is shown on a surface with surface_modes, nullopt if it can't be
+	std::optional<vk::DeviceGroupPresentModeFlagBitsKHR> presentModeFor(uint32_t index, vk::DeviceGroupPresentModeFlagsKHR surface_modes) const
+	{
+		auto const modes = m_present_modes & surface_modes;
+		// the device's own presentation engine
+		if ((modes & vk::DeviceGroupPresentModeFlagBitsKHR::eLocal) && (m_present_masks[index] & (1u << index)))
+			return vk::DeviceGroupPresentModeFlagBitsKHR::eLocal;
+		// another device's presentation engine reads the image from the rendering device's memory
+		if (modes & vk::DeviceGroupPresentModeFlagBitsKHR::eRemote)
+			for (uint32_t i = 0; i < size(); ++i)
+				if (m_present_masks[i] & (1u << index))
+					return vk::DeviceGroupPresentModeFlagBitsKHR::eRemote;
+		return std::nullopt;
+	}
+
+	// split-frame render areas, horizontal bands of equal height in device order
+	std::vector<vk::Rect2D> splitAreas(vk::Extent2D extent) const
+	{
+		std::vector<vk::Rect2D> areas;
+		for (uint32_t i = 0; i < size(); ++i)
+		{
+			auto const top = extent.height * i / size();
+			auto const bottom = extent.height * (i + 1) / size();
+			areas.push_back(vk::Rect2D{ { 0, static_cast<int32_t>(top) }, { extent.width, bottom - top } });
+		}
+		return areas;
+	}
+
+private:
+	std::vector<vk::PhysicalDevice> m_devices;
+	std::array<uint32_t, VK_MAX_DEVICE_GROUP_SIZE> m_present_masks{};
+	vk::DeviceGroupPresentModeFlagsKHR m_present_modes;
+};
+
+// Copies a color image into a tightly packed buffer. Under split-frame rendering every device's instance of the
+// image holds only its band, so each device copies that band into the buffer, whose memory is shared.
+inline void copyImageBands(vk::CommandBuffer cmd, vk::Image image, vk::Buffer buffer, vk::Extent2D extent, uint32_t row_pitch,
+	std::vector<vk::Rect2D> const& device_areas)
+{
+	vk::BufferImageCopy region{};
+	region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+	region.imageExtent = vk::Extent3D{ extent.width, extent.height, 1 };
+	if (device_areas.empty())
+	{
+		cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, buffer, region);
+		return;
+	}
+	for (uint32_t i = 0; i < device_areas.size(); ++i)
+	{
+		auto const& area = device_areas[i];
+		region.bufferOffset = vk::DeviceSize(row_pitch) * area.offset.y;
+		region.imageOffset = vk::Offset3D{ area.offset.x, area.offset.y, 0 };
+		region.imageExtent = vk::Extent3D{ area.extent.width, area.extent.height, 1 };
+		cmd.setDeviceMask(1u << i);
+		cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, buffer, region);
+	}
+	cmd.setDeviceMask(device_areas.size() >= 32 ? ~0u : (1u << device_areas.size()) - 1);
+}
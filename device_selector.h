@@ -0,0 +1,187 @@
+#pragma once
+
+#include "capability_registry.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A physical device together with the queue families the scene would use on it.
+struct DeviceCandidate
+{
+	vk::PhysicalDevice device;
+	vk::PhysicalDeviceProperties properties;
+	DeviceUuid uuid{};
+	vk::DeviceSize device_local_size = 0;
+	uint32_t graphics_family = -1;
+	// dedicated families if the device has them, otherwise the graphics family
+	uint32_t transfer_family = -1;
+	uint32_t compute_family = -1;
+	uint64_t score = 0;
+	// empty if the device can run the scene
+	std::string rejection;
+	bool blacklisted = false;
+
+	bool suitable() const { return rejection.empty(); }
+};
+
+// Ranks the physical devices of an instance: discrete before integrated before virtual and CPU devices,
+// then by device-local heap size and dedicated transfer/compute queues. Devices that cannot present to
+// the surface or lack required features are rejected, blacklisted devices (e.g. after a device loss)
+// are only chosen when nothing else is left.
+class DeviceSelector
+{
+public:
+	static constexpr char const* uuid_environment_variable = "BUGEXAMPLE_DEVICE_UUID";
+
+	static std::optional<DeviceUuid> uuidFromEnvironment()
+	{
+		char const* value = std::getenv(uuid_environment_variable);
+		if (!value || !*value)
+			return std::nullopt;
+		auto const uuid = parseDeviceUuid(value);
+		if (!uuid)
+			throw std::runtime_error(std::string(uuid_environment_variable) + " is not a valid device UUID!");
+		return uuid;
+	}
+
+	void blacklist(DeviceUuid const& uuid)
+	{
+		if (!isBlacklisted(uuid))
+			m_blacklist.push_back(uuid);
+	}
+
+	bool isBlacklisted(DeviceUuid const& uuid) const
+	{
+		return std::find(m_blacklist.begin(), m_blacklist.end(), uuid) != m_blacklist.end();
+	}
+
+	// all devices, best first; rejected devices come last
+	std::vector<DeviceCandidate> rank(vk::Instance instance, vk::SurfaceKHR surface) const
+	{
+		std::vector<DeviceCandidate> candidates;
+		for (auto const phys_dev : instance.enumeratePhysicalDevices())
+			candidates.push_back(evaluate(phys_dev, surface));
+
+		std::stable_sort(candidates.begin(), candidates.end(), [](DeviceCandidate const& a, DeviceCandidate const& b)
+		{
+			if (a.suitable() != b.suitable())
+				return a.suitable();
+			if (a.blacklisted != b.blacklisted)
+				return !a.blacklisted;
+			return a.score > b.score;
+		});
+		return candidates;
+	}
+
+	// the preferred device is taken whenever it is suitable, even if it was blacklisted
+	DeviceCandidate select(vk::Instance instance, vk::SurfaceKHR surface, std::optional<DeviceUuid> const& preferred = {}) const
+	{
+		auto const candidates = rank(instance, surface);
+		if (preferred)
+		{
+			auto const it = std::find_if(candidates.begin(), candidates.end(), [&](DeviceCandidate const& c) { return c.uuid == *preferred; });
+			if (it == candidates.end())
+				throw std::runtime_error("No physical device with UUID " + toString(*preferred) + "!");
+			if (!it->suitable())
+				throw std::runtime_error("Physical device " + std::string(it->properties.deviceName) + " can not be used: " + it->rejection);
+			return *it;
+		}
+
+		if (candidates.empty())
+			throw std::runtime_error("No physical device available!");
+		if (!candidates.front().suitable())
+			throw std::runtime_error("No suitable physical device, best candidate " + std::string(candidates.front().properties.deviceName) + ": " + candidates.front().rejection);
+		return candidates.front();
+	}
+
+private:
+	DeviceCandidate evaluate(vk::PhysicalDevice phys_dev, vk::SurfaceKHR surface) const
+	{
+		DeviceCandidate candidate{};
+		candidate.device = phys_dev;
+
+		auto const& caps = CapabilityRegistry::get().device(phys_dev);
+		candidate.properties = caps.properties;
+		candidate.uuid = caps.uuid;
+		candidate.blacklisted = isBlacklisted(candidate.uuid);
+
+		auto const mem_props = phys_dev.getMemoryProperties();
+		for (uint32_t i = 0; i < mem_props.memoryHeapCount; ++i)
+			if (mem_props.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+				candidate.device_local_size += mem_props.memoryHeaps[i].size;
+
+		if (candidate.properties.apiVersion < VK_MAKE_VERSION(1, 2, 0))
+			return reject(candidate, "Vulkan 1.2 is not supported");
+		if (!caps.features12().timelineSemaphore)
+			return reject(candidate, "timeline semaphores are not supported");
+
+		// without a surface the scene renders headless and needs neither swapchains nor presentation
+		if (surface && !caps.hasExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+			return reject(candidate, std::string(VK_KHR_SWAPCHAIN_EXTENSION_NAME) + " is not supported");
+
+		auto const queue_fam_props = phys_dev.getQueueFamilyProperties();
+		// returns the family with all of the wanted and the fewest other capabilities
+		auto const find_family = [&](vk::QueueFlags wanted, vk::QueueFlags unwanted, bool present) -> std::optional<uint32_t>
+		{
+			std::optional<uint32_t> best;
+			uint32_t best_extra = ~0u;
+			for (uint32_t i = 0; i < queue_fam_props.size(); ++i)
+			{
+				auto const prop = queue_fam_props[i];
+				if ((prop.queueFlags & wanted) != wanted || (prop.queueFlags & unwanted) || prop.queueCount == 0)
+					continue;
+				if (present && !phys_dev.getSurfaceSupportKHR(i, surface))
+					continue;
+				auto const extra = static_cast<uint32_t>(prop.queueFlags & ~wanted & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer));
+				if (!best || extra < best_extra)
+				{
+					best = i;
+					best_extra = extra;
+				}
+			}
+			return best;
+		};
+
+		auto const graphics = find_family(vk::QueueFlagBits::eGraphics, {}, static_cast<bool>(surface));
+		if (!graphics)
+			return reject(candidate, "no graphics queue family can present to the surface");
+		candidate.graphics_family = *graphics;
+		auto const transfer = find_family(vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics, false);
+		auto const compute = find_family(vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics, false);
+		candidate.transfer_family = transfer.value_or(candidate.graphics_family);
+		candidate.compute_family = compute.value_or(candidate.graphics_family);
+
+		// device type dominates, heap size in MiB breaks ties within a type, dedicated queues within equal heaps
+		candidate.score = (uint64_t(typeRank(candidate.properties.deviceType)) << 48)
+			+ (std::min<uint64_t>(candidate.device_local_size >> 20, (uint64_t(1) << 40) - 1) << 8)
+			+ (transfer ? 2 : 0) + (compute ? 1 : 0);
+		return candidate;
+	}
+
+	static DeviceCandidate reject(DeviceCandidate candidate, std::string reason)
+	{
+		candidate.rejection = std::move(reason);
+		return candidate;
+	}
+
+	static uint32_t typeRank(vk::PhysicalDeviceType type)
+	{
+		switch (type)
+		{
+		case vk::PhysicalDeviceType::eDiscreteGpu: return 4;
+		case vk::PhysicalDeviceType::eIntegratedGpu: return 3;
+		case vk::PhysicalDeviceType::eVirtualGpu: return 2;
+		case vk::PhysicalDeviceType::eCpu: return 1;
+		default: return 0;
+		}
+	}
+
+	std::vector<DeviceUuid> m_blacklist;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "breadcrumbs.h"
+#include "device_group.h"
+#include "device_selector.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <optional>
+#include <utility>
+#include <vector>
+
+struct StandbyConfig
+{
+	// a second device is kept ready while the scene renders, after a device loss the scene switches over to it
+	// instead of creating one, see Scene::failover()
+	bool enabled = false;
+	// the standby goes on another suitable GPU where there is one, so a loss of the whole GPU leaves it alone;
+	// true keeps it on the rendering GPU
+	bool same_gpu = false;
+};
+
+// What the scene creates a logical device with on one physical device: the queue families, the extensions and
+// the features the device supports of those the scene wants. Derived once per device, so a standby device can
+// be created ahead with exactly what the scene enables when it takes the device over.
+struct DeviceSetup
+{
+	DeviceCandidate candidate;
+	// graphics first, each family once
+	std::vector<uint32_t> families;
+	// string literals only, the pointers stay valid on the watchdog worker
+	std::vector<const char*> extensions;
+	bool dynamic_rendering = false;
+	bool extended_dynamic_state = false;
+	bool descriptor_indexing = false;
+	bool draw_indirect_count = false;
+	Breadcrumbs::Mode breadcrumbs_mode = Breadcrumbs::Mode::None;
+	bool device_fault = false;
+	bool synchronization2 = false;
+	bool graphics_pipeline_library = false;
+	bool calibrated_timestamps = false;
+	bool memory_budget = false;
+	bool present_wait = false;
+	bool capture_export = false;
+	bool capture_import = false;
+	vk::PhysicalDeviceFeatures features{};
+	std::optional<uint32_t> sparse_family;
+	DeviceGroup device_group;
+	MultiGpuMode multi_gpu = MultiGpuMode::Single;
+};
+
+// A device created ahead, with a pipeline cache started from the shared cache's contents so the driver has
+// taken them in before the switch-over.
+struct StandbyDevice
+{
+	DeviceSetup setup;
+	vk::UniqueDevice device;
+	vk::UniquePipelineCache pipeline_cache;
+};
+
+// Builds the standby device on a background thread while the scene renders; a vkCreateDevice that is slow or
+// never returns after a device loss then delays nothing but the next standby. The build runs under the
+// watchdog's device creation deadline, so waiting for it is bounded too.
+class DeviceStandby
+{
+public:
+	using Build = std::function<StandbyDevice()>;
+
+	DeviceStandby() = default;
+	DeviceStandby(DeviceStandby const&) = delete;
+	DeviceStandby& operator=(DeviceStandby const&) = delete;
+
+	// drops the previous standby, waiting for its build
+	void start(Build build)
+	{
+		reset();
+		m_build = std::async(std::launch::async, std::move(build));
+	}
+
+	// a standby is built or being built
+	bool pending() const { return m_build.valid(); }
+
+	bool ready() const { return m_build.valid() && m_build.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+	// waits for the build and hands the device over, rethrows what the build failed with
+	StandbyDevice take()
+	{
+		return std::exchange(m_build, {}).get();
+	}
+
+	void reset()
+	{
+		if (!m_build.valid())
+			return;
+		try
+		{
+			std::exchange(m_build, {}).get();
+		}
+		catch (...)
+		{}
+	}
+
+private:
+	std::future<StandbyDevice> m_build;
+};
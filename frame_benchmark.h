@@ -0,0 +1,244 @@
+#pragma once
+
+#include "benchmark_report.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct FrameBenchmarkConfig
+{
+	std::vector<uint32_t> swapchain_images{ 2, 3, 4 };
+	// picks the present mode, swept only with a window
+	std::vector<LatencyMode> latency_modes{ LatencyMode::VSync, LatencyMode::Adaptive, LatencyMode::LowLatency, LatencyMode::Uncapped };
+	std::vector<uint32_t> frames_in_flight{ 1, 2, 3 };
+	std::vector<RecordMode> record_modes{ RecordMode::ReRecord, RecordMode::Cached, RecordMode::Secondary };
+	// not measured, covers first-use pipeline waits and caches filling up
+	uint64_t warmup_frames = 60;
+	uint64_t frames = 600;
+	std::filesystem::path output = "frame_benchmark.json";
+	SceneConfig scene;
+};
+
+// Measures the render loop of Scene::run() for every combination of swapchain image count, latency mode,
+// frames in flight and record mode, each on a new Scene. The scene draw is skipped: it runs the endless
+// loop of Fragment.frag, and the loop around it is what is measured. Passes, barriers, submits and presents
+// are still recorded. Reports frames per second, process CPU time per frame and the time of every frame
+// phase. The JSON output is rewritten after every combination.
+class FrameBenchmark
+{
+public:
+	explicit FrameBenchmark(FrameBenchmarkConfig config)
+		: m_config(std::move(config))
+	{
+		m_config.scene.disabled_workloads.push_back("scene draw");
+		m_config.scene.max_frames = m_config.warmup_frames + m_config.frames;
+		// measured at full rate whether or not the window has the focus
+		m_config.scene.background_fps = 0.0;
+		// without a window the present mode has no effect
+		if (m_config.scene.headless && !m_config.latency_modes.empty())
+			m_config.latency_modes.resize(1);
+	}
+
+	// the exit code: 0 if every combination was measured, 2 after a hang, 1 otherwise
+	int run()
+	{
+		for (auto const images : m_config.swapchain_images)
+			for (auto const latency_mode : m_config.latency_modes)
+				for (auto const frames_in_flight : m_config.frames_in_flight)
+					for (auto const record_mode : m_config.record_modes)
+					{
+						Point point{};
+						point.swapchain_images = images;
+						point.latency_mode = latency_mode;
+						point.frames_in_flight = frames_in_flight;
+						point.record_mode = record_mode;
+						m_points.push_back(point);
+						const bool hung = !measure(m_points.back());
+						write();
+						report(m_points.back());
+						if (hung)
+						{
+							// the hung scene was leaked, its device may still block any further driver call
+							std::cout.flush();
+							std::_Exit(2);
+						}
+					}
+		auto const measured = std::all_of(m_points.begin(), m_points.end(), [](Point const& p) { return p.error.empty(); });
+		return measured ? 0 : 1;
+	}
+
+private:
+	struct Point
+	{
+		uint32_t swapchain_images = 0;
+		LatencyMode latency_mode = LatencyMode::VSync;
+		uint32_t frames_in_flight = 0;
+		RecordMode record_mode = RecordMode::ReRecord;
+
+		std::string error;
+		// what the scene ended up with
+		uint32_t actual_images = 0;
+		vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+		uint64_t frames = 0;
+		double wall_s = 0.0;
+		double cpu_s = 0.0;
+		// nanoseconds per frame
+		SampleSet frame_ns;
+		std::array<SampleSet, frame_phase_count> phase_ns;
+	};
+
+	struct Device
+	{
+		vk::PhysicalDeviceProperties props;
+		vk::PhysicalDeviceDriverProperties driver;
+	};
+
+	// false if the scene hung
+	bool measure(Point& point)
+	{
+		auto const warmup = m_config.warmup_frames;
+		std::chrono::steady_clock::time_point start{};
+		double cpu_start = 0.0;
+
+		auto config = m_config.scene;
+		config.swapchain_images = point.swapchain_images;
+		config.latency_mode = point.latency_mode;
+		config.frames_in_flight = point.frames_in_flight;
+		config.record_mode = point.record_mode;
+		config.on_frame = [&](uint64_t frame)
+		{
+			if (frame == warmup)
+			{
+				start = std::chrono::steady_clock::now();
+				cpu_start = processCpuSeconds();
+			}
+			if (frame >= warmup)
+				++point.frames;
+		};
+
+		auto scene = std::make_unique<Scene>(config);
+		try
+		{
+			scene->initialize();
+			if (!m_device)
+				m_device = Device{ scene->deviceProperties(), scene->driverProperties() };
+			point.actual_images = scene->imageCount();
+			point.present_mode = scene->presentMode();
+
+			scene->run();
+			if (point.frames != 0)
+			{
+				point.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				point.cpu_s = processCpuSeconds() - cpu_start;
+			}
+			for (auto const& record : scene->frameRecords())
+			{
+				if (record.frame < warmup)
+					continue;
+				point.frame_ns.add(record.frame_ms * 1e6);
+				for (size_t i = 0; i < frame_phase_count; ++i)
+					point.phase_ns[i].add(record.phases[i].duration_ms * 1e6);
+			}
+		}
+		catch (HangError const& e)
+		{
+			point.error = e.what();
+			// destroying the scene would wait on the hung device
+			scene.release();
+			return false;
+		}
+		catch (std::exception const& e)
+		{
+			point.error = e.what();
+		}
+		scene->shutdown();
+		return true;
+	}
+
+	void report(Point const& point) const
+	{
+		std::cout << "images " << point.swapchain_images << ", " << toString(point.latency_mode) << ", " << point.frames_in_flight
+			<< " in flight, " << toString(point.record_mode) << ": ";
+		if (!point.error.empty())
+			std::cout << point.error;
+		else
+			std::cout << framesPerSecond(point) << " frames/s, " << cpuNsPerFrame(point) << " cpu ns/frame";
+		std::cout << std::endl;
+	}
+
+	static double framesPerSecond(Point const& point)
+	{
+		return point.wall_s > 0.0 ? point.frames / point.wall_s : 0.0;
+	}
+
+	static double cpuNsPerFrame(Point const& point)
+	{
+		return point.frames != 0 ? point.cpu_s * 1e9 / point.frames : 0.0;
+	}
+
+	void write() const
+	{
+		std::ofstream file(m_config.output, std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "could not write " << m_config.output.string() << std::endl;
+			return;
+		}
+
+		JsonWriter json(file);
+		json.beginObject()
+			.field("benchmark", "frame")
+			.field("headless", m_config.scene.headless)
+			.field("warmup_frames", m_config.warmup_frames)
+			.field("frames", m_config.frames);
+		json.key("device");
+		if (m_device)
+			writeDevice(json, m_device->props, m_device->driver);
+		else
+			json.beginObject().endObject();
+
+		json.key("points").beginArray();
+		for (auto const& point : m_points)
+		{
+			json.beginObject()
+				.field("swapchain_images_requested", point.swapchain_images)
+				.field("swapchain_images", point.actual_images)
+				.field("latency_mode", toString(point.latency_mode))
+				.field("present_mode", m_config.scene.headless ? std::string("offscreen") : vk::to_string(point.present_mode))
+				.field("frames_in_flight", point.frames_in_flight)
+				.field("record_mode", toString(point.record_mode))
+				.field("error", point.error)
+				.field("measured_frames", point.frames)
+				.field("frames_per_second", framesPerSecond(point))
+				.field("cpu_ns_per_frame", cpuNsPerFrame(point))
+				.field("wall_ns_per_frame", point.frames != 0 ? point.wall_s * 1e9 / point.frames : 0.0);
+			json.key("frame_time");
+			writeSummary(json, point.frame_ns, "ns", 1000.0);
+			json.key("phases").beginObject();
+			for (size_t i = 0; i < frame_phase_count; ++i)
+			{
+				json.key(toString(static_cast<FramePhase>(i)));
+				writeSummary(json, point.phase_ns[i], "ns", 1000.0);
+			}
+			json.endObject();
+			json.endObject();
+		}
+		json.endArray();
+		json.endObject();
+		file << std::endl;
+	}
+
+	FrameBenchmarkConfig m_config;
+	std::vector<Point> m_points;
+	std::optional<Device> m_device;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <chrono>
+#include <thread>
+
+// CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, Windows 10 1803 and later; older SDKs don't define it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Sleeps until a deadline with well under a millisecond of overshoot. The OS timer wakes up a little early,
+// the rest is spent yielding. On Windows a high resolution waitable timer replaces the 15.6 ms Sleep() granularity.
+class PreciseSleeper
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	PreciseSleeper()
+	{
+#ifdef _WIN32
+		m_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		// pre 1803 systems: a plain timer, which only gets the coarse resolution
+		if (m_timer == nullptr)
+			m_timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+#endif
+	}
+
+	~PreciseSleeper()
+	{
+#ifdef _WIN32
+		if (m_timer != nullptr)
+			CloseHandle(m_timer);
+#endif
+	}
+
+	PreciseSleeper(PreciseSleeper const&) = delete;
+	PreciseSleeper& operator=(PreciseSleeper const&) = delete;
+
+	void sleepUntil(Clock::time_point deadline)
+	{
+		auto const coarse = deadline - slack;
+		auto const now = Clock::now();
+		if (coarse > now)
+		{
+#ifdef _WIN32
+			if (m_timer != nullptr)
+			{
+				// relative, in 100 ns units
+				LARGE_INTEGER due{};
+				due.QuadPart = -std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, 10000000>>>(coarse - now).count();
+				if (SetWaitableTimerEx(m_timer, &due, 0, nullptr, nullptr, nullptr, 0))
+					WaitForSingleObject(m_timer, INFINITE);
+			}
+			else
+				std::this_thread::sleep_until(coarse);
+#else
+			std::this_thread::sleep_until(coarse);
+#endif
+		}
+		while (Clock::now() < deadline)
+			std::this_thread::yield();
+	}
+
+private:
+	// how much earlier than the deadline the OS timer is asked to wake up
+	static constexpr auto slack = std::chrono::microseconds(500);
+
+#ifdef _WIN32
+	HANDLE m_timer = nullptr;
+#endif
+};
+
+// Paces a loop to a target rate: wait() returns once a frame interval passed since the previous frame's
+// deadline. Deadlines advance by the interval, so a frame that overslept is made up by the next one; a loop
+// that falls more than an interval behind starts over from now instead of running a burst to catch up.
+class FrameLimiter
+{
+public:
+	using Clock = PreciseSleeper::Clock;
+
+	// 0 disables the limit
+	void setTargetRate(double frames_per_second)
+	{
+		if (frames_per_second == m_rate)
+			return;
+		m_rate = frames_per_second;
+		m_interval = frames_per_second > 0.0
+			? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frames_per_second))
+			: Clock::duration::zero();
+		// the next wait() starts a new schedule
+		m_deadline = Clock::time_point{};
+	}
+
+	double targetRate() const { return m_rate; }
+
+	void wait()
+	{
+		if (m_interval == Clock::duration::zero())
+			return;
+		auto const now = Clock::now();
+		if (m_deadline == Clock::time_point{} || now - m_deadline > m_interval)
+		{
+			m_deadline = now;
+			return;
+		}
+		m_deadline += m_interval;
+		m_sleeper.sleepUntil(m_deadline);
+	}
+
+private:
+	double m_rate = 0.0;
+	Clock::duration m_interval = Clock::duration::zero();
+	Clock::time_point m_deadline{};
+	PreciseSleeper m_sleeper;
+};
@@ -0,0 +1,466 @@
+#pragma once
+
+#include "gpu_clock.h"
+#include "spsc_ring.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+enum class FramePhase
+{
+	Poll,
+	FenceWait,
+	Acquire,
+	Record,
+	Submit,
+	Present,
+	Count
+};
+
+inline char const* toString(FramePhase phase)
+{
+	switch (phase)
+	{
+	case FramePhase::Poll: return "poll";
+	case FramePhase::FenceWait: return "fence wait";
+	case FramePhase::Acquire: return "acquire";
+	case FramePhase::Record: return "record";
+	case FramePhase::Submit: return "submit";
+	case FramePhase::Present: return "present";
+	default: return "unknown";
+	}
+}
+
+constexpr size_t frame_phase_count = static_cast<size_t>(FramePhase::Count);
+
+struct FrameRecord
+{
+	struct Phase
+	{
+		// relative to the start of the frame
+		double start_ms = 0.0;
+		double duration_ms = 0.0;
+	};
+
+	uint64_t frame = 0;
+	// since the profiler was created
+	double start_ms = 0.0;
+	double frame_ms = 0.0;
+	std::array<Phase, frame_phase_count> phases{};
+	// render pass time on the GPU, negative if no timestamps were available
+	double gpu_ms = -1.0;
+	// when the render pass started on the GPU, since the profiler was created; negative without calibrated timestamps
+	double gpu_start_ms = -1.0;
+	// from the start of vkAcquireNextImageKHR until vkQueuePresentKHR returned
+	double acquire_to_present_ms = 0.0;
+	// from the oldest input event the frame consumed until vkQueuePresentKHR returned, negative without input
+	double input_to_present_ms = -1.0;
+};
+
+// Timestamp query pair per frame slot, written around the render pass. Results are read once the slot's
+// fence signaled, so reading never waits on the GPU. With a calibrated clock the pass is also placed on the CPU timeline.
+class GpuTimestamps
+{
+public:
+	struct Interval
+	{
+		double duration_ms = 0.0;
+		std::optional<std::chrono::steady_clock::time_point> start;
+	};
+
+	GpuTimestamps(vk::Device device, float timestamp_period, uint32_t valid_bits, uint32_t slots, GpuClock const* clock = nullptr)
+		: m_device(device)
+		, m_clock(clock)
+		, m_period_ns(timestamp_period)
+		, m_mask(valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1)
+		, m_written(slots, false)
+	{
+		if (valid_bits == 0)
+			return;
+		vk::QueryPoolCreateInfo qp_ci{};
+		qp_ci.queryType = vk::QueryType::eTimestamp;
+		qp_ci.queryCount = 2 * slots;
+		m_pool = device.createQueryPoolUnique(qp_ci);
+	}
+
+	bool supported() const { return static_cast<bool>(m_pool); }
+
+	// both have to be recorded outside of a render pass
+	void begin(vk::CommandBuffer cmd, uint32_t slot)
+	{
+		if (!supported())
+			return;
+		cmd.resetQueryPool(*m_pool, 2 * slot, 2);
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *m_pool, 2 * slot);
+	}
+
+	void end(vk::CommandBuffer cmd, uint32_t slot)
+	{
+		if (!supported())
+			return;
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *m_pool, 2 * slot + 1);
+		m_written[slot] = true;
+	}
+
+	// the slot's fence must have signaled
+	std::optional<Interval> read(uint32_t slot)
+	{
+		if (!supported() || !m_written[slot])
+			return std::nullopt;
+		m_written[slot] = false;
+
+		std::array<uint64_t, 2> ticks{};
+		auto const result = m_device.getQueryPoolResults(*m_pool, 2 * slot, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+		if (result != vk::Result::eSuccess)
+			return std::nullopt;
+		auto const delta = (ticks[1] - ticks[0]) & m_mask;
+		Interval interval{};
+		interval.duration_ms = delta * double(m_period_ns) / 1e6;
+		if (m_clock)
+			interval.start = m_clock->toSteady(ticks[0]);
+		return interval;
+	}
+
+private:
+	vk::Device m_device;
+	GpuClock const* m_clock;
+	float m_period_ns;
+	uint64_t m_mask;
+	vk::UniqueQueryPool m_pool;
+	std::vector<bool> m_written;
+};
+
+// CPU side of the profiler, used by the render thread only. A frame's record is completed when its slot
+// comes around again and the GPU time is known, then it is pushed into a lock-free ring for the exporter.
+class FrameProfiler
+{
+public:
+	class Scope
+	{
+	public:
+		Scope(FrameProfiler& profiler, FramePhase phase)
+			: m_profiler(profiler)
+			, m_phase(phase)
+			, m_start(std::chrono::steady_clock::now())
+		{}
+		~Scope() { m_profiler.addPhase(m_phase, m_start, std::chrono::steady_clock::now()); }
+
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+
+	private:
+		FrameProfiler& m_profiler;
+		FramePhase m_phase;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	explicit FrameProfiler(size_t ring_capacity = 4096)
+		: m_ring(ring_capacity)
+		, m_epoch(std::chrono::steady_clock::now())
+	{}
+
+	SpscRing<FrameRecord>& ring() { return m_ring; }
+	uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	void setSlotCount(uint32_t slots) { m_pending.assign(slots, std::nullopt); }
+
+	void beginFrame()
+	{
+		m_frame_start = std::chrono::steady_clock::now();
+		m_current = FrameRecord{};
+		m_current.frame = m_frame_counter++;
+		m_current.start_ms = toMs(m_frame_start - m_epoch);
+	}
+
+	Scope phase(FramePhase phase) { return Scope(*this, phase); }
+
+	// an input event the window system received at that time was consumed; it counts towards the next frame
+	// that presents, frames skipped before it don't take it along
+	void input(std::chrono::steady_clock::time_point received)
+	{
+		if (!m_input || received < *m_input)
+			m_input = received;
+	}
+
+	// the frame was submitted with the slot, its record waits there for the GPU time
+	void endFrame(uint32_t slot)
+	{
+		m_current.frame_ms = toMs(std::chrono::steady_clock::now() - m_frame_start);
+		auto const& acquire = m_current.phases[static_cast<size_t>(FramePhase::Acquire)];
+		auto const& present = m_current.phases[static_cast<size_t>(FramePhase::Present)];
+		m_current.acquire_to_present_ms = present.start_ms + present.duration_ms - acquire.start_ms;
+		if (m_input)
+			m_current.input_to_present_ms = present.start_ms + present.duration_ms - toMs(*m_input - m_frame_start);
+		m_input.reset();
+		if (slot < m_pending.size())
+			m_pending[slot] = m_current;
+	}
+
+	// the frame endFrame() completed, until the next beginFrame(); without its GPU time
+	FrameRecord const& lastFrame() const { return m_current; }
+
+	// the slot's fence signaled, its previous frame is complete
+	void retire(uint32_t slot, std::optional<GpuTimestamps::Interval> gpu)
+	{
+		if (slot >= m_pending.size() || !m_pending[slot])
+			return;
+		auto record = *m_pending[slot];
+		m_pending[slot].reset();
+		if (gpu)
+		{
+			record.gpu_ms = gpu->duration_ms;
+			if (gpu->start)
+				record.gpu_start_ms = toMs(*gpu->start - m_epoch);
+		}
+		if (!m_ring.push(record))
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	static double toMs(std::chrono::steady_clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+
+	void addPhase(FramePhase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+	{
+		// a phase may run more than once per frame, e.g. fence waits
+		auto& p = m_current.phases[static_cast<size_t>(phase)];
+		if (p.duration_ms == 0.0)
+			p.start_ms = toMs(start - m_frame_start);
+		p.duration_ms += toMs(end - start);
+	}
+
+	SpscRing<FrameRecord> m_ring;
+	std::atomic<uint64_t> m_dropped{ 0 };
+	std::chrono::steady_clock::time_point m_epoch;
+	std::chrono::steady_clock::time_point m_frame_start;
+	uint64_t m_frame_counter = 0;
+	FrameRecord m_current;
+	std::optional<std::chrono::steady_clock::time_point> m_input;
+	std::vector<std::optional<FrameRecord>> m_pending;
+};
+
+struct FrameStatistics
+{
+	struct Percentiles
+	{
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	size_t frames = 0;
+	Percentiles frame_ms;
+	Percentiles gpu_ms;
+	Percentiles acquire_to_present_ms;
+	Percentiles input_to_present_ms;
+
+	template<typename Records>
+	static FrameStatistics compute(Records const& records)
+	{
+		std::vector<double> frame, gpu, latency, input;
+		for (auto const& record : records)
+		{
+			frame.push_back(record.frame_ms);
+			if (record.gpu_ms >= 0.0)
+				gpu.push_back(record.gpu_ms);
+			latency.push_back(record.acquire_to_present_ms);
+			if (record.input_to_present_ms >= 0.0)
+				input.push_back(record.input_to_present_ms);
+		}
+
+		FrameStatistics stats{};
+		stats.frames = frame.size();
+		stats.frame_ms = percentiles(frame);
+		stats.gpu_ms = percentiles(gpu);
+		stats.acquire_to_present_ms = percentiles(latency);
+		stats.input_to_present_ms = percentiles(input);
+		return stats;
+	}
+
+	void print(std::ostream& os) const
+	{
+		auto const line = [&](char const* name, Percentiles const& p)
+		{
+			os << "  " << name << ": p50 " << p.p50 << " ms, p99 " << p.p99 << " ms, max " << p.max << " ms" << std::endl;
+		};
+		os << "  frames: " << frames << std::endl;
+		line("frame time", frame_ms);
+		line("gpu time", gpu_ms);
+		line("acquire to present", acquire_to_present_ms);
+		line("input to present", input_to_present_ms);
+	}
+
+private:
+	static Percentiles percentiles(std::vector<double>& values)
+	{
+		Percentiles p{};
+		if (values.empty())
+			return p;
+		auto const at = [&](double q)
+		{
+			auto const n = static_cast<size_t>(q * (values.size() - 1) + 0.5);
+			std::nth_element(values.begin(), values.begin() + n, values.end());
+			return values[n];
+		};
+		p.p50 = at(0.50);
+		p.p99 = at(0.99);
+		p.max = *std::max_element(values.begin(), values.end());
+		return p;
+	}
+};
+
+// Consumer of the profiler's ring on its own thread. Keeps the most recent frames and writes them
+// as CSV and Chrome trace (chrome://tracing, Perfetto) when stopped.
+class ProfileExporter
+{
+public:
+	ProfileExporter(FrameProfiler& profiler, std::filesystem::path output, size_t max_frames = 100000)
+		: m_profiler(profiler)
+		, m_output(std::move(output))
+		, m_max_frames(max_frames)
+		, m_thread([this] { work(); })
+	{}
+
+	~ProfileExporter()
+	{
+		stop();
+	}
+
+	ProfileExporter(ProfileExporter const&) = delete;
+	ProfileExporter& operator=(ProfileExporter const&) = delete;
+
+	// drains the ring a last time and writes the files, empty output only prints the statistics
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_stop)
+				return;
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+		drain();
+
+		std::cout << "frame statistics" << std::endl;
+		FrameStatistics::compute(m_records).print(std::cout);
+		if (m_profiler.dropped() != 0)
+			std::cout << "  dropped: " << m_profiler.dropped() << std::endl;
+		if (m_output.empty())
+			return;
+		writeCsv(std::filesystem::path(m_output).replace_extension(".csv"));
+		writeChromeTrace(std::filesystem::path(m_output).replace_extension(".json"));
+	}
+
+	// completed frames so far, oldest first; safe while the exporter runs
+	std::vector<FrameRecord> snapshot()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		drain();
+		return { m_records.begin(), m_records.end() };
+	}
+
+private:
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop)
+		{
+			m_cv.wait_for(lock, std::chrono::milliseconds(250));
+			drain();
+		}
+	}
+
+	void drain()
+	{
+		while (auto record = m_profiler.ring().pop())
+		{
+			m_records.push_back(*record);
+			if (m_records.size() > m_max_frames)
+				m_records.pop_front();
+		}
+	}
+
+	void writeCsv(std::filesystem::path const& path) const
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			std::cerr << "Could not write " << path.string() << std::endl;
+			return;
+		}
+		file << "frame,start_ms,frame_ms,gpu_ms,gpu_start_ms,acquire_to_present_ms,input_to_present_ms";
+		for (size_t i = 0; i < frame_phase_count; ++i)
+			file << "," << toString(static_cast<FramePhase>(i)) << "_ms";
+		file << "\n";
+		for (auto const& record : m_records)
+		{
+			file << record.frame << "," << record.start_ms << "," << record.frame_ms << "," << record.gpu_ms << "," << record.gpu_start_ms << "," << record.acquire_to_present_ms << "," << record.input_to_present_ms;
+			for (auto const& phase : record.phases)
+				file << "," << phase.duration_ms;
+			file << "\n";
+		}
+	}
+
+	void writeChromeTrace(std::filesystem::path const& path) const
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			std::cerr << "Could not write " << path.string() << std::endl;
+			return;
+		}
+		auto const event = [&](char const* name, int tid, double start_ms, double duration_ms, bool& first)
+		{
+			file << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+				<< ",\"ts\":" << start_ms * 1000.0 << ",\"dur\":" << duration_ms * 1000.0 << "}";
+			first = false;
+		};
+
+		bool first = true;
+		file << "{\"traceEvents\":[";
+		for (auto const& record : m_records)
+		{
+			event("frame", 1, record.start_ms, record.frame_ms, first);
+			for (size_t i = 0; i < frame_phase_count; ++i)
+			{
+				auto const& phase = record.phases[i];
+				if (phase.duration_ms > 0.0)
+					event(toString(static_cast<FramePhase>(i)), 2, record.start_ms + phase.start_ms, phase.duration_ms, first);
+			}
+			// where the GPU clock is not calibrated against the CPU, the pass is placed at the submit
+			if (record.gpu_ms >= 0.0)
+			{
+				auto const& submit = record.phases[static_cast<size_t>(FramePhase::Submit)];
+				auto const start_ms = record.gpu_start_ms >= 0.0 ? record.gpu_start_ms : record.start_ms + submit.start_ms;
+				event("render pass (gpu)", 3, start_ms, record.gpu_ms, first);
+			}
+		}
+		file << "\n]}\n";
+	}
+
+	FrameProfiler& m_profiler;
+	std::filesystem::path m_output;
+	size_t m_max_frames;
+	std::deque<FrameRecord> m_records;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop = false;
+	std::thread m_thread;
+};
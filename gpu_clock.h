@@ -0,0 +1,188 @@
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <vulkan/vulkan.hpp>
+// included after Vulkan so GLFW declares its Vulkan surface functions
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <optional>
+#include <vector>
+
+// A host clock that has a Vulkan time domain, read raw in ticks of its own frequency.
+struct HostTimer
+{
+	vk::TimeDomainEXT domain = vk::TimeDomainEXT::eDevice;
+	uint64_t (*now)() = nullptr;
+	uint64_t frequency = 0;
+
+	// GLFW's raw timer, the clock input events are stamped with; glfwInit() must have succeeded
+	static std::optional<HostTimer> glfw()
+	{
+		HostTimer timer;
+		switch (glfwGetTimerSource())
+		{
+		case GLFW_TIMER_QUERY_PERFORMANCE_COUNTER: timer.domain = vk::TimeDomainEXT::eQueryPerformanceCounter; break;
+		case GLFW_TIMER_CLOCK_MONOTONIC: timer.domain = vk::TimeDomainEXT::eClockMonotonic; break;
+		case GLFW_TIMER_CLOCK_MONOTONIC_RAW: timer.domain = vk::TimeDomainEXT::eClockMonotonicRaw; break;
+		default: return std::nullopt;
+		}
+		timer.now = [] { return glfwGetTimerValue(); };
+		timer.frequency = glfwGetTimerFrequency();
+		return timer;
+	}
+
+	// without a window system
+	static HostTimer system()
+	{
+		HostTimer timer;
+#ifdef _WIN32
+		LARGE_INTEGER frequency{};
+		QueryPerformanceFrequency(&frequency);
+		timer.domain = vk::TimeDomainEXT::eQueryPerformanceCounter;
+		timer.now = []
+		{
+			LARGE_INTEGER value{};
+			QueryPerformanceCounter(&value);
+			return static_cast<uint64_t>(value.QuadPart);
+		};
+		timer.frequency = static_cast<uint64_t>(frequency.QuadPart);
+#else
+		timer.domain = vk::TimeDomainEXT::eClockMonotonic;
+		timer.now = []
+		{
+			timespec ts{};
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+		};
+		timer.frequency = 1000000000u;
+#endif
+		return timer;
+	}
+};
+
+// Puts device timestamps on the steady_clock timeline with VK_EXT_calibrated_timestamps. The device and the host
+// timer are sampled together by vkGetCalibratedTimestampsEXT, the host timer and steady_clock back to back right
+// after. The clocks drift apart, calibrate() is cheap enough to call every frame and only samples once a second.
+// Without the extension, or a time domain both sides support, nothing is calibrated.
+class GpuClock
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	GpuClock(vk::Device device, vk::PhysicalDevice phys_dev, vk::DispatchLoaderDynamic const& dispatch, bool extension_enabled,
+		HostTimer const& host, float timestamp_period, uint32_t valid_bits)
+		: m_device(device)
+		, m_dispatch(&dispatch)
+		, m_host(host)
+		, m_period_ns(timestamp_period)
+		, m_valid_bits(std::min<uint32_t>(valid_bits, 64))
+	{
+		if (!extension_enabled || valid_bits == 0 || !dispatch.vkGetCalibratedTimestampsEXT || !dispatch.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+			return;
+		uint32_t count = 0;
+		if (dispatch.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(phys_dev, &count, nullptr) != VK_SUCCESS)
+			return;
+		std::vector<VkTimeDomainEXT> domains(count);
+		if (dispatch.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(phys_dev, &count, domains.data()) != VK_SUCCESS)
+			return;
+		domains.resize(count);
+		auto const has = [&](vk::TimeDomainEXT domain)
+		{
+			return std::find(domains.begin(), domains.end(), static_cast<VkTimeDomainEXT>(domain)) != domains.end();
+		};
+		m_supported = has(vk::TimeDomainEXT::eDevice) && has(m_host.domain);
+		if (m_supported)
+			calibrate();
+	}
+
+	GpuClock(GpuClock const&) = delete;
+	GpuClock& operator=(GpuClock const&) = delete;
+
+	bool supported() const { return m_supported; }
+	bool calibrated() const { return m_calibrated; }
+	// of the last calibration, how far apart the device and host samples may have been
+	std::chrono::nanoseconds maxDeviation() const { return m_deviation; }
+
+	void calibrate()
+	{
+		if (!m_supported)
+			return;
+		auto const now = Clock::now();
+		if (m_calibrated && now - m_calibrated_at < recalibrate_interval)
+			return;
+
+		std::array<VkCalibratedTimestampInfoEXT, 2> infos{};
+		infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+		infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+		infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+		infos[1].timeDomain = static_cast<VkTimeDomainEXT>(m_host.domain);
+
+		// a preempted sample has a large deviation, the tightest of a few is kept
+		std::optional<Sample> best;
+		for (int attempt = 0; attempt < 3; ++attempt)
+		{
+			std::array<uint64_t, 2> timestamps{};
+			uint64_t deviation = 0;
+			if (m_dispatch->vkGetCalibratedTimestampsEXT(m_device, static_cast<uint32_t>(infos.size()), infos.data(), timestamps.data(), &deviation) != VK_SUCCESS)
+				break;
+			auto const steady = Clock::now();
+			auto const host = m_host.now();
+			if (best && deviation >= best->deviation)
+				continue;
+			// where steady_clock was when the host timer read timestamps[1]
+			auto const behind = std::chrono::duration<double>(double(host - timestamps[1]) / double(m_host.frequency));
+			best = Sample{ timestamps[0], steady - std::chrono::duration_cast<Clock::duration>(behind), deviation };
+		}
+		if (!best)
+			return;
+		m_device_ticks = best->device_ticks;
+		m_steady = best->steady;
+		m_deviation = std::chrono::nanoseconds(best->deviation);
+		m_calibrated = true;
+		m_calibrated_at = now;
+	}
+
+	// nullopt before the first calibration
+	std::optional<Clock::time_point> toSteady(uint64_t device_ticks) const
+	{
+		if (!m_calibrated)
+			return std::nullopt;
+		// signed distance from the calibration point, the counter wraps at its valid bits
+		auto const shift = 64 - m_valid_bits;
+		auto const delta = static_cast<int64_t>((device_ticks - m_device_ticks) << shift) >> shift;
+		auto const ns = std::chrono::duration<double, std::nano>(double(delta) * double(m_period_ns));
+		return m_steady + std::chrono::duration_cast<Clock::duration>(ns);
+	}
+
+private:
+	struct Sample
+	{
+		uint64_t device_ticks;
+		Clock::time_point steady;
+		uint64_t deviation;
+	};
+
+	static constexpr auto recalibrate_interval = std::chrono::seconds(1);
+
+	vk::Device m_device;
+	vk::DispatchLoaderDynamic const* m_dispatch;
+	HostTimer m_host;
+	float m_period_ns;
+	uint32_t m_valid_bits;
+	bool m_supported = false;
+	bool m_calibrated = false;
+	Clock::time_point m_calibrated_at{};
+	uint64_t m_device_ticks = 0;
+	Clock::time_point m_steady{};
+	std::chrono::nanoseconds m_deviation{ 0 };
+};
@@ -0,0 +1,416 @@
+#pragma once
+
+#include "descriptor_allocator.h"
+#include "device_allocator.h"
+#include "pipeline_compiler.h"
+#include "shader_reflection.h"
+#include "upload_engine.h"
+
+#include "cull.comp.h"
+#include "cull.comp.reflect.h"
+#include "cull.comp.OCCLUSION.h"
+#include "cull.comp.OCCLUSION.reflect.h"
+#include "hiz.comp.h"
+#include "hiz.comp.reflect.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+// matches DrawObject in Cull.comp
+struct DrawObject
+{
+	// bounding sphere in world space, xyz center and w radius
+	std::array<float, 4> sphere{};
+	uint32_t index_count = 0;
+	uint32_t first_index = 0;
+	int32_t vertex_offset = 0;
+	uint32_t first_instance = 0;
+};
+static_assert(sizeof(DrawObject) == 32, "DrawObject must match the std430 layout of Cull.comp");
+
+// Mip chain of the farthest depth of a depth buffer, at half its resolution, that the culling pass tests
+// bounding boxes against. build() runs once the frame's depth is written, so the next frame culls against it.
+class HiZPyramid
+{
+public:
+	// depth stays bound to the first level; depth_layout is the layout it is in when build() runs
+	HiZPyramid(vk::Device device, DeviceAllocator& allocator, DescriptorLayoutCache& layouts, PipelineCompiler& compiler,
+		vk::ImageView depth, vk::ImageLayout depth_layout, vk::Extent2D depth_extent)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_depth_extent(depth_extent)
+		, m_extent{ std::max(depth_extent.width / 2, 1u), std::max(depth_extent.height / 2, 1u) }
+	{
+		while ((std::max(m_extent.width, m_extent.height) >> m_levels) > 1)
+			++m_levels;
+		++m_levels;
+
+		vk::ImageCreateInfo img_ci{};
+		img_ci.imageType = vk::ImageType::e2D;
+		img_ci.format = vk::Format::eR32Sfloat;
+		img_ci.extent = vk::Extent3D{ m_extent.width, m_extent.height, 1 };
+		img_ci.mipLevels = m_levels;
+		img_ci.arrayLayers = 1;
+		img_ci.samples = vk::SampleCountFlagBits::e1;
+		img_ci.tiling = vk::ImageTiling::eOptimal;
+		img_ci.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage;
+		img_ci.sharingMode = vk::SharingMode::eExclusive;
+		img_ci.initialLayout = vk::ImageLayout::eUndefined;
+		m_image = device.createImageUnique(img_ci);
+		m_memory = allocator.allocateFor(*m_image, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+
+		vk::ImageViewCreateInfo view_ci{};
+		view_ci.image = *m_image;
+		view_ci.viewType = vk::ImageViewType::e2D;
+		view_ci.format = img_ci.format;
+		view_ci.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, m_levels, 0, 1 };
+		m_view = device.createImageViewUnique(view_ci);
+		for (uint32_t level = 0; level < m_levels; ++level)
+		{
+			view_ci.subresourceRange = { vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 };
+			m_level_views.push_back(device.createImageViewUnique(view_ci));
+		}
+
+		vk::SamplerCreateInfo sampler_ci{};
+		sampler_ci.magFilter = vk::Filter::eNearest;
+		sampler_ci.minFilter = vk::Filter::eNearest;
+		sampler_ci.mipmapMode = vk::SamplerMipmapMode::eNearest;
+		sampler_ci.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+		sampler_ci.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+		sampler_ci.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+		sampler_ci.maxLod = static_cast<float>(m_levels);
+		m_sampler = device.createSamplerUnique(sampler_ci);
+
+		auto layout = createReflectedLayout(device, layouts, { &::HiZ_comp_reflection });
+		m_pipeline_layout = std::move(layout.pipeline_layout);
+		auto pipeline = compiler.compileCompute(*m_pipeline_layout, ::HiZ_comp);
+
+		// one set per level, reading the level above or the depth buffer
+		const vk::DescriptorPoolSize sizes[] = {
+			{ vk::DescriptorType::eCombinedImageSampler, m_levels },
+			{ vk::DescriptorType::eStorageImage, m_levels },
+		};
+		vk::DescriptorPoolCreateInfo pool_ci{};
+		pool_ci.maxSets = m_levels;
+		pool_ci.poolSizeCount = 2;
+		pool_ci.pPoolSizes = sizes;
+		m_pool = device.createDescriptorPoolUnique(pool_ci);
+
+		std::vector<vk::DescriptorSetLayout> set_layouts(m_levels, layout.set_layouts.front());
+		vk::DescriptorSetAllocateInfo ds_ai{};
+		ds_ai.descriptorPool = *m_pool;
+		ds_ai.descriptorSetCount = m_levels;
+		ds_ai.pSetLayouts = set_layouts.data();
+		m_sets = device.allocateDescriptorSets(ds_ai);
+
+		for (uint32_t level = 0; level < m_levels; ++level)
+		{
+			const vk::DescriptorImageInfo src{ *m_sampler, level == 0 ? depth : *m_level_views[level - 1],
+				level == 0 ? depth_layout : vk::ImageLayout::eGeneral };
+			const vk::DescriptorImageInfo dst{ {}, *m_level_views[level], vk::ImageLayout::eGeneral };
+			const vk::WriteDescriptorSet writes[] = {
+				{ m_sets[level], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &src },
+				{ m_sets[level], 1, 0, 1, vk::DescriptorType::eStorageImage, &dst },
+			};
+			device.updateDescriptorSets(writes, nullptr);
+		}
+		m_pipeline = pipeline.get();
+	}
+
+	~HiZPyramid()
+	{
+		m_level_views.clear();
+		m_view.reset();
+		m_image.reset();
+		m_allocator.free(m_memory);
+	}
+
+	HiZPyramid(HiZPyramid const&) = delete;
+	HiZPyramid& operator=(HiZPyramid const&) = delete;
+
+	vk::ImageView view() const { return *m_view; }
+	vk::Sampler sampler() const { return *m_sampler; }
+	vk::Extent2D extent() const { return m_extent; }
+	uint32_t levels() const { return m_levels; }
+
+	// the depth buffer's writes must be visible to compute shader reads in depth_layout
+	void build(vk::CommandBuffer cmd) const
+	{
+		// the previous pyramid was only read by culling, its contents are discarded
+		vk::ImageMemoryBarrier barrier{};
+		barrier.image = *m_image;
+		barrier.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, m_levels, 0, 1 };
+		barrier.oldLayout = vk::ImageLayout::eUndefined;
+		barrier.newLayout = vk::ImageLayout::eGeneral;
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *m_pipeline);
+		vk::Extent2D src_size = m_depth_extent;
+		for (uint32_t level = 0; level < m_levels; ++level)
+		{
+			const vk::Extent2D dst_size{ std::max(m_extent.width >> level, 1u), std::max(m_extent.height >> level, 1u) };
+			const int32_t sizes[] = {
+				static_cast<int32_t>(src_size.width), static_cast<int32_t>(src_size.height),
+				static_cast<int32_t>(dst_size.width), static_cast<int32_t>(dst_size.height) };
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *m_pipeline_layout, 0, m_sets[level], nullptr);
+			cmd.pushConstants(*m_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(sizes), sizes);
+			cmd.dispatch((dst_size.width + 7) / 8, (dst_size.height + 7) / 8, 1);
+
+			// read by the next level and by the culling passes after this one
+			barrier.subresourceRange.baseMipLevel = level;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.oldLayout = vk::ImageLayout::eGeneral;
+			barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+			barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+			src_size = dst_size;
+		}
+	}
+
+private:
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	vk::Extent2D m_depth_extent;
+	vk::Extent2D m_extent;
+	uint32_t m_levels = 0;
+	vk::UniqueImage m_image;
+	Allocation m_memory;
+	vk::UniqueImageView m_view;
+	std::vector<vk::UniqueImageView> m_level_views;
+	vk::UniqueSampler m_sampler;
+	vk::UniquePipelineLayout m_pipeline_layout;
+	vk::UniquePipeline m_pipeline;
+	vk::UniqueDescriptorPool m_pool;
+	std::vector<vk::DescriptorSet> m_sets;
+};
+
+// GPU-driven draw submission. Objects live in a device-local buffer; every frame cull() runs a compute pass
+// that tests them against the frustum, and against a Hi-Z pyramid if one is set, and packs the visible ones into
+// an indirect buffer that draw() consumes with one vkCmdDrawIndexedIndirectCount per draw range. The CPU cost of a
+// frame no longer depends on the number of objects, and the recorded draws never change, so cached command buffers
+// stay valid. The objects are split into draw ranges packed separately, so workers can record a range each.
+class GpuCuller
+{
+public:
+	GpuCuller(vk::Device device, DeviceAllocator& allocator, DescriptorLayoutCache& layouts, PipelineCompiler& compiler,
+		UploadEngine& uploads, uint32_t max_objects, uint32_t draw_ranges = 1)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_uploads(uploads)
+		, m_max_objects(max_objects)
+		, m_draw_ranges(std::max(1u, std::min(draw_ranges, max_objects)))
+		, m_range_size((max_objects + m_draw_ranges - 1) / m_draw_ranges)
+	{
+		m_objects = createBuffer(sizeof(DrawObject) * max_objects, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, m_objects_memory);
+		m_draws = createBuffer(sizeof(vk::DrawIndexedIndirectCommand) * m_range_size * m_draw_ranges,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, m_draws_memory);
+		m_count = createBuffer(sizeof(uint32_t) * m_draw_ranges,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst, m_count_memory);
+
+		// the occlusion variant additionally samples the Hi-Z pyramid at binding 3
+		auto frustum_layout = createReflectedLayout(device, layouts, { &::Cull_comp_reflection });
+		auto occlusion_layout = createReflectedLayout(device, layouts, { &::Cull_comp_OCCLUSION_reflection });
+		m_frustum.layout = std::move(frustum_layout.pipeline_layout);
+		m_occlusion.layout = std::move(occlusion_layout.pipeline_layout);
+		// both variants build in parallel while the descriptors are set up
+		auto frustum_pipeline = compiler.compileCompute(*m_frustum.layout, ::Cull_comp);
+		auto occlusion_pipeline = compiler.compileCompute(*m_occlusion.layout, ::Cull_comp_OCCLUSION);
+
+		const vk::DescriptorPoolSize sizes[] = {
+			{ vk::DescriptorType::eStorageBuffer, 6 },
+			{ vk::DescriptorType::eCombinedImageSampler, 1 },
+		};
+		vk::DescriptorPoolCreateInfo pool_ci{};
+		pool_ci.maxSets = 2;
+		pool_ci.poolSizeCount = 2;
+		pool_ci.pPoolSizes = sizes;
+		m_pool = device.createDescriptorPoolUnique(pool_ci);
+
+		const vk::DescriptorSetLayout set_layouts[] = { frustum_layout.set_layouts.front(), occlusion_layout.set_layouts.front() };
+		vk::DescriptorSetAllocateInfo ds_ai{};
+		ds_ai.descriptorPool = *m_pool;
+		ds_ai.descriptorSetCount = 2;
+		ds_ai.pSetLayouts = set_layouts;
+		auto const sets = device.allocateDescriptorSets(ds_ai);
+		m_frustum.set = sets[0];
+		m_occlusion.set = sets[1];
+
+		const vk::DescriptorBufferInfo buffers[] = {
+			{ *m_objects, 0, VK_WHOLE_SIZE },
+			{ *m_draws, 0, VK_WHOLE_SIZE },
+			{ *m_count, 0, VK_WHOLE_SIZE },
+		};
+		for (auto const set : sets)
+		{
+			const vk::WriteDescriptorSet write{ set, 0, 0, 3, vk::DescriptorType::eStorageBuffer, nullptr, buffers };
+			device.updateDescriptorSets(write, nullptr);
+		}
+		m_frustum.pipeline = frustum_pipeline.get();
+		m_occlusion.pipeline = occlusion_pipeline.get();
+	}
+
+	~GpuCuller()
+	{
+		m_objects.reset();
+		m_draws.reset();
+		m_count.reset();
+		m_allocator.free(m_objects_memory);
+		m_allocator.free(m_draws_memory);
+		m_allocator.free(m_count_memory);
+	}
+
+	GpuCuller(GpuCuller const&) = delete;
+	GpuCuller& operator=(GpuCuller const&) = delete;
+
+	uint32_t objectCount() const { return static_cast<uint32_t>(m_cpu_objects.size()); }
+	uint32_t drawRanges() const { return m_draw_ranges; }
+
+	uint32_t add(DrawObject const& object)
+	{
+		if (m_cpu_objects.size() == m_max_objects)
+			throw std::runtime_error("GpuCuller is full!");
+		m_cpu_objects.push_back(object);
+		markDirty(objectCount() - 1);
+		return objectCount() - 1;
+	}
+
+	void update(uint32_t index, DrawObject const& object)
+	{
+		m_cpu_objects.at(index) = object;
+		markDirty(index);
+	}
+
+	// null culls against the frustum only; the pyramid must outlive its use here
+	void setHiZ(HiZPyramid const* hiz)
+	{
+		m_hiz = hiz;
+		if (!hiz)
+			return;
+		const vk::DescriptorImageInfo image{ hiz->sampler(), hiz->view(), vk::ImageLayout::eGeneral };
+		const vk::WriteDescriptorSet write{ m_occlusion.set, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &image };
+		m_device.updateDescriptorSets(write, nullptr);
+	}
+
+	// queues the objects changed since the last call on the upload engine, before its submit()
+	void upload()
+	{
+		if (m_dirty_begin >= m_dirty_end)
+			return;
+		m_uploads.uploadBuffer(*m_objects, sizeof(DrawObject) * m_dirty_begin, &m_cpu_objects[m_dirty_begin],
+			sizeof(DrawObject) * (m_dirty_end - m_dirty_begin), vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead);
+		m_dirty_begin = UINT32_MAX;
+		m_dirty_end = 0;
+	}
+
+	// outside of any render pass, before the draw() that consumes it; view_proj is column major
+	void cull(vk::CommandBuffer cmd, std::array<float, 16> const& view_proj) const
+	{
+		// the previous frame's draw still reads the buffers the fill and the dispatch overwrite
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+			{}, nullptr, nullptr, nullptr);
+		cmd.fillBuffer(*m_count, 0, sizeof(uint32_t) * m_draw_ranges, 0);
+		vk::BufferMemoryBarrier cleared{};
+		cleared.buffer = *m_count;
+		cleared.size = VK_WHOLE_SIZE;
+		cleared.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		cleared.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, cleared, nullptr);
+
+		auto const& variant = m_hiz ? m_occlusion : m_frustum;
+		Constants constants{};
+		constants.view_proj = view_proj;
+		constants.object_count = objectCount();
+		if (m_hiz)
+		{
+			constants.hiz_levels = m_hiz->levels();
+			constants.hiz_size = { static_cast<float>(m_hiz->extent().width), static_cast<float>(m_hiz->extent().height) };
+		}
+		constants.range_size = m_range_size;
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *variant.pipeline);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *variant.layout, 0, variant.set, nullptr);
+		cmd.pushConstants(*variant.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+		cmd.dispatch((constants.object_count + 63) / 64, 1, 1);
+
+		vk::MemoryBarrier packed{};
+		packed.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		packed.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, packed, nullptr, nullptr);
+	}
+
+	// inside the render pass with the pipeline and index buffer bound
+	void draw(vk::CommandBuffer cmd) const
+	{
+		for (uint32_t range = 0; range < m_draw_ranges; ++range)
+			draw(cmd, range);
+	}
+
+	// the visible objects of one draw range only, ranges may be recorded into different command buffers
+	void draw(vk::CommandBuffer cmd, uint32_t range) const
+	{
+		cmd.drawIndexedIndirectCount(*m_draws, sizeof(vk::DrawIndexedIndirectCommand) * m_range_size * range, *m_count,
+			sizeof(uint32_t) * range, m_range_size, sizeof(vk::DrawIndexedIndirectCommand));
+	}
+
+private:
+	// matches the push constants of Cull.comp
+	struct Constants
+	{
+		std::array<float, 16> view_proj;
+		uint32_t object_count = 0;
+		uint32_t hiz_levels = 0;
+		std::array<float, 2> hiz_size{};
+		uint32_t range_size = 0;
+	};
+
+	struct Variant
+	{
+		vk::UniquePipelineLayout layout;
+		vk::UniquePipeline pipeline;
+		vk::DescriptorSet set;
+	};
+
+	vk::UniqueBuffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, Allocation& memory)
+	{
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = size;
+		buf_ci.usage = usage;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+		auto buffer = m_device.createBufferUnique(buf_ci);
+		memory = m_allocator.allocateFor(*buffer, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+		return buffer;
+	}
+
+	void markDirty(uint32_t index)
+	{
+		m_dirty_begin = std::min(m_dirty_begin, index);
+		m_dirty_end = std::max(m_dirty_end, index + 1);
+	}
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	UploadEngine& m_uploads;
+	uint32_t m_max_objects;
+	uint32_t m_draw_ranges;
+	uint32_t m_range_size;
+
+	vk::UniqueBuffer m_objects;
+	Allocation m_objects_memory;
+	vk::UniqueBuffer m_draws;
+	Allocation m_draws_memory;
+	vk::UniqueBuffer m_count;
+	Allocation m_count_memory;
+
+	vk::UniqueDescriptorPool m_pool;
+	Variant m_frustum;
+	Variant m_occlusion;
+	HiZPyramid const* m_hiz = nullptr;
+
+	std::vector<DrawObject> m_cpu_objects;
+	uint32_t m_dirty_begin = UINT32_MAX;
+	uint32_t m_dirty_end = 0;
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+#include "arena.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <vector>
+
+// VkAllocationCallbacks that account the driver's host memory per domain, the objects that were created with
+// that domain's callbacks and the calls made on them. Blocks of up to 512 bytes, most of what drivers ask for,
+// come from pools that keep freed blocks; command scope allocations of calls made inside a LinearArena::Scope
+// come from that arena, everything else from the heap.
+// The allocator has to outlive every object created with its callbacks, the callbacks themselves never move.
+class HostAllocator
+{
+public:
+	enum class Domain : uint32_t
+	{
+		Instance,
+		Device,
+		// pipelines, their shader modules and caches
+		Pipelines,
+		Count
+	};
+
+	struct Stats
+	{
+		// allocated now, the most there ever were, and allocations made in total
+		uint64_t bytes = 0;
+		uint64_t high_water = 0;
+		uint64_t live = 0;
+		uint64_t allocations = 0;
+		// what the driver allocated itself and reported, executable memory for shaders mostly
+		uint64_t internal_bytes = 0;
+		// allocated now by VkSystemAllocationScope
+		std::array<uint64_t, 5> scope_bytes{};
+	};
+
+	HostAllocator()
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(Domain::Count); ++i)
+		{
+			auto& domain = m_domains[i];
+			domain.owner = this;
+			domain.callbacks = vk::AllocationCallbacks{ &domain, &vkAllocate, &vkReallocate, &vkFree, &vkInternalAllocate, &vkInternalFree };
+		}
+	}
+
+	~HostAllocator()
+	{
+		for (auto& pool : m_pools)
+			for (auto* const chunk : pool.chunks)
+				::operator delete(chunk, std::align_val_t(chunk_alignment));
+	}
+
+	HostAllocator(HostAllocator const&) = delete;
+	HostAllocator& operator=(HostAllocator const&) = delete;
+
+	vk::AllocationCallbacks const& callbacks(Domain domain) const { return m_domains[static_cast<uint32_t>(domain)].callbacks; }
+
+	Stats stats(Domain domain) const
+	{
+		auto const& d = m_domains[static_cast<uint32_t>(domain)];
+		Stats stats;
+		stats.bytes = d.bytes.load(std::memory_order_relaxed);
+		stats.high_water = d.high_water.load(std::memory_order_relaxed);
+		stats.live = d.live.load(std::memory_order_relaxed);
+		stats.allocations = d.allocations.load(std::memory_order_relaxed);
+		stats.internal_bytes = d.internal_bytes.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < stats.scope_bytes.size(); ++i)
+			stats.scope_bytes[i] = d.scope_bytes[i].load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	// bytes the pools hold, in use or free
+	size_t pooledBytes() const
+	{
+		size_t bytes = 0;
+		for (auto& pool : m_pools)
+		{
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			bytes += pool.chunks.size() * chunk_size;
+		}
+		return bytes;
+	}
+
+	static char const* toString(Domain domain)
+	{
+		switch (domain)
+		{
+		case Domain::Instance: return "instance";
+		case Domain::Device: return "device";
+		case Domain::Pipelines: return "pipelines";
+		case Domain::Count: break;
+		}
+		return "unknown";
+	}
+
+	void report(std::ostream& os) const
+	{
+		static char const* const scopes[] = { "command", "object", "cache", "device", "instance" };
+		for (uint32_t i = 0; i < static_cast<uint32_t>(Domain::Count); ++i)
+		{
+			auto const stats = this->stats(static_cast<Domain>(i));
+			os << "  " << toString(static_cast<Domain>(i)) << ": " << stats.bytes << " bytes in " << stats.live << " allocations, peak "
+				<< stats.high_water << " bytes, " << stats.allocations << " allocations made, " << stats.internal_bytes << " internal bytes (";
+			for (size_t scope = 0; scope < stats.scope_bytes.size(); ++scope)
+				os << (scope ? ", " : "") << scopes[scope] << " " << stats.scope_bytes[scope];
+			os << ")" << std::endl;
+		}
+		os << "  pooled: " << pooledBytes() << " bytes" << std::endl;
+	}
+
+private:
+	static constexpr size_t chunk_size = 64 * 1024;
+	// every block is aligned to its size, up to the largest
+	static constexpr size_t chunk_alignment = 512;
+	static constexpr size_t pool_count = 4;
+	static constexpr size_t smallest_block = 64;
+	// room for the header in front of every allocation, pooled memory is aligned to it
+	static constexpr size_t header_slot = 32;
+
+	static constexpr uint8_t from_heap = 0xff;
+	static constexpr uint8_t from_arena = 0xfe;
+
+	struct Header
+	{
+		// the heap allocation or the pool block
+		void* raw;
+		size_t size;
+		uint8_t scope;
+		uint8_t origin;
+	};
+	static_assert(sizeof(Header) <= header_slot, "the header does not fit in front of the allocation");
+
+	struct DomainState
+	{
+		HostAllocator* owner = nullptr;
+		vk::AllocationCallbacks callbacks;
+		std::atomic<uint64_t> bytes{ 0 };
+		std::atomic<uint64_t> high_water{ 0 };
+		std::atomic<uint64_t> live{ 0 };
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> internal_bytes{ 0 };
+		std::array<std::atomic<uint64_t>, 5> scope_bytes{};
+	};
+
+	struct Pool
+	{
+		mutable std::mutex mutex;
+		std::vector<void*> chunks;
+		// freed blocks, each holds the next one
+		void* free = nullptr;
+	};
+
+	static size_t blockSize(size_t pool) { return smallest_block << pool; }
+
+	void* allocate(DomainState& domain, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		alignment = std::max(alignment, alignof(Header));
+		void* memory = nullptr;
+		uint8_t origin = from_heap;
+		void* raw = nullptr;
+		if (auto* const arena = scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND ? LinearArena::current() : nullptr)
+		{
+			try
+			{
+				raw = arena->allocate(size + header_slot + alignment, alignof(Header));
+			}
+			catch (std::bad_alloc const&)
+			{
+			}
+			origin = from_arena;
+		}
+		else if (alignment <= header_slot && size + header_slot <= blockSize(pool_count - 1))
+		{
+			origin = 0;
+			while (size + header_slot > blockSize(origin))
+				++origin;
+			raw = allocateBlock(origin);
+			// the block's size is a multiple of the slot, so the memory behind it is aligned to it
+			memory = raw ? static_cast<std::byte*>(raw) + header_slot : nullptr;
+		}
+		else
+			raw = ::operator new(size + header_slot + alignment, std::nothrow);
+		if (!raw)
+			return nullptr;
+		if (!memory)
+			memory = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(raw) + header_slot + alignment - 1) & ~(uintptr_t(alignment) - 1));
+		*reinterpret_cast<Header*>(static_cast<std::byte*>(memory) - sizeof(Header)) = { raw, size, static_cast<uint8_t>(scope), origin };
+
+		auto const bytes = domain.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		auto high_water = domain.high_water.load(std::memory_order_relaxed);
+		while (bytes > high_water && !domain.high_water.compare_exchange_weak(high_water, bytes, std::memory_order_relaxed))
+			;
+		domain.live.fetch_add(1, std::memory_order_relaxed);
+		domain.allocations.fetch_add(1, std::memory_order_relaxed);
+		domain.scope_bytes[std::min<size_t>(scope, 4)].fetch_add(size, std::memory_order_relaxed);
+		return memory;
+	}
+
+	void free(DomainState& domain, void* memory)
+	{
+		auto const header = *reinterpret_cast<Header const*>(static_cast<std::byte*>(memory) - sizeof(Header));
+		domain.bytes.fetch_sub(header.size, std::memory_order_relaxed);
+		domain.live.fetch_sub(1, std::memory_order_relaxed);
+		domain.scope_bytes[std::min<size_t>(header.scope, 4)].fetch_sub(header.size, std::memory_order_relaxed);
+		// the arena's memory goes with its next reset
+		if (header.origin == from_heap)
+			::operator delete(header.raw);
+		else if (header.origin != from_arena)
+			freeBlock(header.origin, header.raw);
+	}
+
+	void* allocateBlock(uint8_t pool_index)
+	{
+		auto& pool = m_pools[pool_index];
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		if (!pool.free)
+		{
+			auto* const chunk = static_cast<std::byte*>(::operator new(chunk_size, std::align_val_t(chunk_alignment), std::nothrow));
+			if (!chunk)
+				return nullptr;
+			pool.chunks.push_back(chunk);
+			for (size_t offset = chunk_size; offset >= blockSize(pool_index); offset -= blockSize(pool_index))
+			{
+				auto* const block = chunk + offset - blockSize(pool_index);
+				*reinterpret_cast<void**>(block) = pool.free;
+				pool.free = block;
+			}
+		}
+		auto* const block = pool.free;
+		pool.free = *static_cast<void**>(block);
+		return block;
+	}
+
+	void freeBlock(uint8_t pool_index, void* block)
+	{
+		auto& pool = m_pools[pool_index];
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		*static_cast<void**>(block) = pool.free;
+		pool.free = block;
+	}
+
+	static DomainState& domainOf(void* user_data) { return *static_cast<DomainState*>(user_data); }
+
+	static void* VKAPI_PTR vkAllocate(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		auto& domain = domainOf(user_data);
+		return domain.owner->allocate(domain, size, alignment, scope);
+	}
+
+	static void* VKAPI_PTR vkReallocate(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		if (!original)
+			return vkAllocate(user_data, size, alignment, scope);
+		if (size == 0)
+		{
+			vkFree(user_data, original);
+			return nullptr;
+		}
+		auto* const memory = vkAllocate(user_data, size, alignment, scope);
+		if (!memory)
+			return nullptr;
+		auto const& header = *reinterpret_cast<Header const*>(static_cast<std::byte*>(original) - sizeof(Header));
+		std::memcpy(memory, original, std::min(size, header.size));
+		vkFree(user_data, original);
+		return memory;
+	}
+
+	static void VKAPI_PTR vkFree(void* user_data, void* memory)
+	{
+		if (memory)
+			domainOf(user_data).owner->free(domainOf(user_data), memory);
+	}
+
+	static void VKAPI_PTR vkInternalAllocate(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+	{
+		domainOf(user_data).internal_bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	static void VKAPI_PTR vkInternalFree(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+	{
+		domainOf(user_data).internal_bytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+	std::array<DomainState, static_cast<size_t>(Domain::Count)> m_domains;
+	std::array<Pool, pool_count> m_pools;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A memory-mapped KTX2 container with a 2D, single layer and face texture whose mip levels are stored as they are
+// uploaded: uncompressed or BCn/ASTC, without supercompression. Level 0 is the largest, the file stores the levels
+// smallest first, so any range of levels down to the last one is one contiguous range of the file.
+class Ktx2File
+{
+public:
+	struct Level
+	{
+		uint64_t offset = 0;
+		uint64_t size = 0;
+	};
+
+	explicit Ktx2File(std::filesystem::path const& path)
+		: m_path(path)
+		, m_file(path)
+	{
+		static const uint8_t identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+		if (m_file.size() < header_size || std::memcmp(m_file.data(), identifier, sizeof(identifier)) != 0)
+			fail("is not a KTX2 file");
+
+		uint32_t header[9];
+		std::memcpy(header, m_file.data() + sizeof(identifier), sizeof(header));
+		m_format = static_cast<vk::Format>(header[0]);
+		m_extent = vk::Extent2D{ header[2], header[3] };
+		auto const depth = header[4];
+		auto const layers = header[5];
+		auto const faces = header[6];
+		// 0 asks for mipmaps to be generated at load, which streaming does not do
+		auto const levels = std::max(header[7], 1u);
+		auto const supercompression = header[8];
+		if (m_format == vk::Format::eUndefined)
+			fail("has no Vulkan format");
+		if (m_extent.width == 0 || m_extent.height == 0 || depth > 1 || layers > 1 || faces != 1)
+			fail("is not a 2D texture");
+		if (supercompression != 0)
+			fail("is supercompressed");
+		if (levels > 32 || (std::max(m_extent.width, m_extent.height) >> (levels - 1)) == 0)
+			fail("has more mip levels than its size allows");
+
+		auto const index_end = header_size + uint64_t(levels) * sizeof(uint64_t) * 3;
+		if (m_file.size() < index_end)
+			fail("is truncated");
+		m_levels.resize(levels);
+		for (uint32_t level = 0; level < levels; ++level)
+		{
+			uint64_t entry[3];
+			std::memcpy(entry, m_file.data() + header_size + level * sizeof(entry), sizeof(entry));
+			m_levels[level] = { entry[0], entry[1] };
+			if (entry[0] < index_end || entry[1] == 0 || entry[0] > m_file.size() || entry[1] > m_file.size() - entry[0])
+				fail("has a mip level outside of the file");
+		}
+	}
+
+	Ktx2File(Ktx2File const&) = delete;
+	Ktx2File& operator=(Ktx2File const&) = delete;
+
+	std::filesystem::path const& path() const { return m_path; }
+	vk::Format format() const { return m_format; }
+	uint32_t levelCount() const { return static_cast<uint32_t>(m_levels.size()); }
+	Level const& level(uint32_t level) const { return m_levels[level]; }
+	uint8_t const* data() const { return m_file.data(); }
+
+	vk::Extent2D extent(uint32_t level = 0) const
+	{
+		return { std::max(m_extent.width >> level, 1u), std::max(m_extent.height >> level, 1u) };
+	}
+
+	// the file range holding levels [first, last), all remaining ones by default
+	Level levels(uint32_t first, uint32_t last = UINT32_MAX) const
+	{
+		auto begin = UINT64_MAX;
+		uint64_t end = 0;
+		for (auto i = first; i < std::min(last, levelCount()); ++i)
+		{
+			begin = std::min(begin, m_levels[i].offset);
+			end = std::max(end, m_levels[i].offset + m_levels[i].size);
+		}
+		return { begin, end - begin };
+	}
+
+	// texel block of BCn and ASTC formats, 1x1 for uncompressed ones
+	static vk::Extent2D blockExtent(vk::Format format)
+	{
+		auto const value = static_cast<uint32_t>(format);
+		// VK_FORMAT_BC1_RGB_UNORM_BLOCK to VK_FORMAT_BC7_SRGB_BLOCK
+		if (value >= 131 && value <= 146)
+			return { 4, 4 };
+		// VK_FORMAT_ASTC_4x4_UNORM_BLOCK to VK_FORMAT_ASTC_12x12_SRGB_BLOCK, two formats per block size
+		if (value >= 157 && value <= 184)
+		{
+			static const vk::Extent2D astc[] = { { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+				{ 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 } };
+			return astc[(value - 157) / 2];
+		}
+		return { 1, 1 };
+	}
+
+	static bool isBc(vk::Format format) { return static_cast<uint32_t>(format) >= 131 && static_cast<uint32_t>(format) <= 146; }
+	static bool isAstc(vk::Format format) { return static_cast<uint32_t>(format) >= 157 && static_cast<uint32_t>(format) <= 184; }
+
+private:
+	// identifier, 9 header words, the DFD, KVD and SGD ranges
+	static constexpr uint64_t header_size = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+
+	[[noreturn]] void fail(std::string const& what) const
+	{
+		throw std::runtime_error(m_path.string() + " " + what + "!");
+	}
+
+	std::filesystem::path m_path;
+	MappedFile m_file;
+	vk::Format m_format = vk::Format::eUndefined;
+	vk::Extent2D m_extent;
+	std::vector<Level> m_levels;
+};
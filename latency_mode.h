@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+enum class LatencyMode
+{
+	// newest frame wins, no tearing: Mailbox, Immediate, FIFO relaxed, FIFO
+	LowLatency,
+	// uncapped throughput for benchmarking, tears: Immediate, Mailbox, FIFO relaxed, FIFO
+	Uncapped,
+	// vsync that tears instead of stuttering on a missed interval: FIFO relaxed, FIFO
+	Adaptive,
+	// FIFO only, always available
+	VSync
+};
+
+inline char const* toString(LatencyMode mode)
+{
+	switch (mode)
+	{
+	case LatencyMode::LowLatency: return "low latency";
+	case LatencyMode::Uncapped: return "uncapped";
+	case LatencyMode::Adaptive: return "adaptive";
+	case LatencyMode::VSync: return "vsync";
+	}
+	return "unknown";
+}
+
+inline LatencyMode nextLatencyMode(LatencyMode mode)
+{
+	switch (mode)
+	{
+	case LatencyMode::LowLatency: return LatencyMode::Uncapped;
+	case LatencyMode::Uncapped: return LatencyMode::Adaptive;
+	case LatencyMode::Adaptive: return LatencyMode::VSync;
+	default: return LatencyMode::LowLatency;
+	}
+}
+
+// present modes in order of preference
+inline std::vector<vk::PresentModeKHR> presentModeChain(LatencyMode mode)
+{
+	switch (mode)
+	{
+	case LatencyMode::LowLatency:
+		return { vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eFifoRelaxed, vk::PresentModeKHR::eFifo };
+	case LatencyMode::Uncapped:
+		return { vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eFifoRelaxed, vk::PresentModeKHR::eFifo };
+	case LatencyMode::Adaptive:
+		return { vk::PresentModeKHR::eFifoRelaxed, vk::PresentModeKHR::eFifo };
+	default:
+		return { vk::PresentModeKHR::eFifo };
+	}
+}
+
+inline vk::PresentModeKHR choosePresentMode(LatencyMode mode, std::vector<vk::PresentModeKHR> const& available)
+{
+	for (auto const present_mode : presentModeChain(mode))
+		if (std::find(available.begin(), available.end(), present_mode) != available.end())
+			return present_mode;
+	throw std::runtime_error("Surface does not support FIFO presentation!");
+}
+
+// mailbox needs an image to spare beyond the one on screen and the one being rendered
+inline uint32_t swapchainImageCount(vk::PresentModeKHR present_mode, vk::SurfaceCapabilitiesKHR const& caps, uint32_t requested)
+{
+	uint32_t count = present_mode == vk::PresentModeKHR::eMailbox ? std::max(requested, 3u) : requested;
+	count = std::max(count, caps.minImageCount);
+	if (caps.maxImageCount != 0)
+		count = std::min(count, caps.maxImageCount);
+	return count;
+}
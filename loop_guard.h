@@ -0,0 +1,565 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "shader_reflection.h"
+#include "spirv.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct LoopGuardConfig
+{
+	// instrument the scene's shaders as they are loaded, the embedded ones and reloaded ones
+	bool enabled = false;
+	// times one run of a loop may enter its header before the loop is left
+	uint32_t max_iterations = 1u << 16;
+};
+
+// A SPIR-V pass for shaders that are not trusted to terminate. Every loop gets an iteration counter in its header;
+// once the counter reaches the cap the header branches to the loop's merge block, through a block that counts the
+// bailout in a storage buffer if a binding for it is given. A shader that would hang then finishes with whatever
+// its loops computed so far, the frame is slow instead of the device lost.
+// Handles the structured loops compilers emit: headers ending in an unconditional branch, or in a conditional one
+// that leaves or continues the loop. Other loops are left as they are and counted as skipped.
+class LoopGuard
+{
+public:
+	struct Binding
+	{
+		uint32_t set;
+		uint32_t binding;
+	};
+
+	struct Result
+	{
+		std::vector<uint32_t> code;
+		uint32_t guarded = 0;
+		uint32_t skipped = 0;
+	};
+
+	// report: where the stage finds the violation counter, a storage buffer holding one uint; none only caps the
+	// loops. Reporting needs the stage's StoresAndAtomics feature.
+	static Result instrument(SpirvView spv, uint32_t max_iterations, std::optional<Binding> report)
+	{
+		if (!spv.valid())
+			throw std::runtime_error("Loop guard input is not SPIR-V!");
+		LoopGuard pass(spv);
+		Result result;
+		pass.run(max_iterations, report, result);
+		result.code = pass.assemble();
+		return result;
+	}
+
+private:
+	using Instruction = std::vector<uint32_t>;
+
+	enum Op : uint32_t
+	{
+		OpUndef = 1,
+		OpExtension = 10,
+		OpCapability = 17,
+		OpEntryPoint = 15,
+		OpTypeBool = 20,
+		OpTypeInt = 21,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpFunction = 54,
+		OpFunctionEnd = 56,
+		OpVariable = 59,
+		OpAccessChain = 65,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+		OpIAdd = 128,
+		OpUGreaterThanEqual = 174,
+		OpAtomicIAdd = 234,
+		OpPhi = 245,
+		OpLoopMerge = 246,
+		OpLabel = 248,
+		OpBranch = 249,
+		OpBranchConditional = 250,
+		OpSwitch = 251,
+	};
+
+	static constexpr uint32_t storage_buffer = 12;
+	static constexpr uint32_t decoration_block = 2;
+	static constexpr uint32_t decoration_binding = 33;
+	static constexpr uint32_t decoration_descriptor_set = 34;
+	static constexpr uint32_t decoration_offset = 35;
+
+	struct Block
+	{
+		uint32_t label;
+		// the OpLabel first, the terminator last
+		std::vector<Instruction> instructions;
+	};
+
+	struct Function
+	{
+		// OpFunction and its parameters
+		std::vector<Instruction> begin;
+		std::vector<Block> blocks;
+	};
+
+	explicit LoopGuard(SpirvView spv)
+		: m_header(spv.data(), spv.data() + spirv_header_words)
+	{
+		Function* function = nullptr;
+		for (size_t offset = spirv_header_words; offset < spv.size();)
+		{
+			auto const word_count = spv.data()[offset] >> 16;
+			if (word_count == 0 || offset + word_count > spv.size())
+				throw std::runtime_error("Loop guard input has a malformed instruction at word " + std::to_string(offset) + "!");
+			Instruction instruction(spv.data() + offset, spv.data() + offset + word_count);
+			offset += word_count;
+
+			auto const op = opcode(instruction);
+			if (op == OpFunction)
+			{
+				m_functions.emplace_back();
+				function = &m_functions.back();
+				function->begin.push_back(std::move(instruction));
+			}
+			else if (!function)
+				m_globals.push_back(std::move(instruction));
+			else if (op == OpFunctionEnd)
+				function = nullptr;
+			else if (op == OpLabel)
+				function->blocks.push_back({ instruction[1], { std::move(instruction) } });
+			else if (function->blocks.empty())
+				function->begin.push_back(std::move(instruction));
+			else
+				function->blocks.back().instructions.push_back(std::move(instruction));
+		}
+		if (function)
+			throw std::runtime_error("Loop guard input ends inside a function!");
+	}
+
+	static uint32_t opcode(Instruction const& instruction) { return instruction[0] & 0xffff; }
+
+	static Instruction make(uint32_t op, std::initializer_list<uint32_t> operands)
+	{
+		Instruction instruction{ (static_cast<uint32_t>(operands.size() + 1) << 16) | op };
+		instruction.insert(instruction.end(), operands);
+		return instruction;
+	}
+
+	static void setWordCount(Instruction& instruction) { instruction[0] = (static_cast<uint32_t>(instruction.size()) << 16) | opcode(instruction); }
+
+	uint32_t newId() { return m_header[3]++; }
+
+	uint32_t version() const { return m_header[1]; }
+
+	// the id of a type the module declares, types other than structs must not be declared twice
+	uint32_t type(Instruction const& declaration)
+	{
+		for (auto const& instruction : m_globals)
+			if (opcode(instruction) == opcode(declaration) && instruction.size() == declaration.size()
+				&& std::equal(instruction.begin() + 2, instruction.end(), declaration.begin() + 2))
+				return instruction[1];
+		for (auto const& instruction : m_new_globals)
+			if (opcode(instruction) == opcode(declaration) && instruction.size() == declaration.size()
+				&& std::equal(instruction.begin() + 2, instruction.end(), declaration.begin() + 2))
+				return instruction[1];
+		auto instruction = declaration;
+		instruction[1] = newId();
+		m_new_globals.push_back(instruction);
+		return instruction[1];
+	}
+
+	uint32_t constant(uint32_t type, uint32_t value)
+	{
+		auto const id = newId();
+		m_new_globals.push_back(make(OpConstant, { type, id, value }));
+		return id;
+	}
+
+	uint32_t undef(uint32_t type)
+	{
+		auto& id = m_undefs[type];
+		if (!id)
+		{
+			id = newId();
+			m_new_globals.push_back(make(OpUndef, { type, id }));
+		}
+		return id;
+	}
+
+	// labels a block terminator branches to
+	static std::vector<uint32_t> targets(Instruction const& terminator, std::set<uint32_t> const& labels)
+	{
+		switch (opcode(terminator))
+		{
+		case OpBranch: return { terminator[1] };
+		case OpBranchConditional: return { terminator[2], terminator[3] };
+		case OpSwitch:
+		{
+			// literals take one word for 32-bit selectors and two for 64-bit ones
+			std::vector<uint32_t> labels_of{ terminator[2] };
+			auto const is_stride = [&](size_t stride)
+			{
+				if ((terminator.size() - 3) % stride != 0)
+					return false;
+				for (size_t i = 3 + stride - 1; i < terminator.size(); i += stride)
+					if (!labels.count(terminator[i]))
+						return false;
+				return true;
+			};
+			auto const stride = is_stride(2) ? 2 : 3;
+			for (size_t i = 3 + stride - 1; i < terminator.size(); i += stride)
+				labels_of.push_back(terminator[i]);
+			return labels_of;
+		}
+		default: return {};
+		}
+	}
+
+	static void replacePhiParent(Block& block, uint32_t from, uint32_t to)
+	{
+		for (auto& instruction : block.instructions)
+			if (opcode(instruction) == OpPhi)
+				for (size_t i = 4; i < instruction.size(); i += 2)
+					if (instruction[i] == from)
+						instruction[i] = to;
+	}
+
+	static Block* find(Function& function, uint32_t label)
+	{
+		for (auto& block : function.blocks)
+			if (block.label == label)
+				return &block;
+		return nullptr;
+	}
+
+	void run(uint32_t max_iterations, std::optional<Binding> report, Result& result)
+	{
+		bool has_loops = false;
+		for (auto const& function : m_functions)
+			for (auto const& block : function.blocks)
+				for (auto const& instruction : block.instructions)
+					has_loops = has_loops || opcode(instruction) == OpLoopMerge;
+		if (!has_loops)
+			return;
+
+		auto const uint_type = type(make(OpTypeInt, { 0, 32, 0 }));
+		auto const bool_type = type(make(OpTypeBool, { 0 }));
+		auto const zero = constant(uint_type, 0);
+		auto const one = constant(uint_type, 1);
+		auto const cap = constant(uint_type, max_iterations);
+
+		uint32_t counter = 0;
+		uint32_t counter_pointer = 0;
+		if (report)
+		{
+			auto const block_type = newId();
+			m_new_globals.push_back(make(OpTypeStruct, { block_type, uint_type }));
+			auto const block_pointer = type(make(OpTypePointer, { 0, storage_buffer, block_type }));
+			counter_pointer = type(make(OpTypePointer, { 0, storage_buffer, uint_type }));
+			counter = newId();
+			m_new_globals.push_back(make(OpVariable, { block_pointer, counter, storage_buffer }));
+			m_annotations.push_back(make(OpDecorate, { block_type, decoration_block }));
+			m_annotations.push_back(make(OpMemberDecorate, { block_type, 0, decoration_offset, 0 }));
+			m_annotations.push_back(make(OpDecorate, { counter, decoration_descriptor_set, report->set }));
+			m_annotations.push_back(make(OpDecorate, { counter, decoration_binding, report->binding }));
+		}
+
+		for (auto& function : m_functions)
+		{
+			// the counter of every guarded header, its phi is added once all branches are rewritten
+			std::vector<std::pair<uint32_t, uint32_t>> counters;
+			std::vector<uint32_t> headers;
+			for (auto const& block : function.blocks)
+				if (block.instructions.size() >= 3 && opcode(block.instructions[block.instructions.size() - 2]) == OpLoopMerge)
+					headers.push_back(block.label);
+
+			for (auto const header_label : headers)
+			{
+				auto* header = find(function, header_label);
+				auto const merge = header->instructions[header->instructions.size() - 2][1];
+				auto const continue_target = header->instructions[header->instructions.size() - 2][2];
+				auto const terminator = header->instructions.back();
+				auto const leaves = opcode(terminator) == OpBranchConditional
+					&& (terminator[2] == merge || terminator[3] == merge || terminator[2] == continue_target || terminator[3] == continue_target);
+				if (continue_target == header_label || (opcode(terminator) != OpBranch && !leaves))
+				{
+					++result.skipped;
+					continue;
+				}
+
+				auto const count = newId();
+				auto const next = newId();
+				auto const exceeded = newId();
+				auto const bail = newId();
+				counters.emplace_back(header_label, count);
+
+				// the header's own branch moves into a block behind the check
+				uint32_t go_on = opcode(terminator) == OpBranch ? terminator[1] : newId();
+				auto const header_index = static_cast<size_t>(header - function.blocks.data());
+				std::vector<Block> inserted;
+				if (opcode(terminator) == OpBranchConditional)
+				{
+					inserted.push_back({ go_on, { make(OpLabel, { go_on }), terminator } });
+					for (auto const target : { terminator[2], terminator[3] })
+						if (auto* const block = find(function, target))
+							replacePhiParent(*block, header_label, go_on);
+				}
+				Block bailout{ bail, { make(OpLabel, { bail }) } };
+				if (report)
+				{
+					auto const pointer = newId();
+					bailout.instructions.push_back(make(OpAccessChain, { counter_pointer, pointer, counter, zero }));
+					// device scope is the constant 1, relaxed semantics 0
+					bailout.instructions.push_back(make(OpAtomicIAdd, { uint_type, newId(), pointer, one, zero, one }));
+				}
+				bailout.instructions.push_back(make(OpBranch, { merge }));
+				inserted.push_back(std::move(bailout));
+
+				// the merge block gets a predecessor, its phis take no value from it
+				if (auto* const merge_block = find(function, merge))
+				{
+					for (auto& instruction : merge_block->instructions)
+					{
+						if (opcode(instruction) != OpPhi)
+							continue;
+						instruction.push_back(undef(instruction[1]));
+						instruction.push_back(bail);
+						setWordCount(instruction);
+					}
+				}
+
+				header = &function.blocks[header_index];
+				header->instructions.back() = make(OpBranchConditional, { exceeded, bail, go_on });
+				auto const loop_merge = header->instructions.end() - 2;
+				header->instructions.insert(loop_merge, { make(OpIAdd, { uint_type, next, count, one }),
+					make(OpUGreaterThanEqual, { bool_type, exceeded, count, cap }) });
+				m_next[count] = next;
+				function.blocks.insert(function.blocks.begin() + header_index + 1, inserted.begin(), inserted.end());
+				++result.guarded;
+			}
+
+			if (counters.empty())
+				continue;
+
+			// blocks are ordered after the blocks that dominate them, so predecessors behind the header are the
+			// back edge and the count goes on there, it starts over on entry from everywhere else
+			std::set<uint32_t> labels;
+			for (auto const& block : function.blocks)
+				labels.insert(block.label);
+			for (auto const& [header_label, count] : counters)
+			{
+				size_t header_index = 0;
+				while (function.blocks[header_index].label != header_label)
+					++header_index;
+				Instruction phi = make(OpPhi, { uint_type, count });
+				for (size_t i = 0; i < function.blocks.size(); ++i)
+				{
+					auto const branches = targets(function.blocks[i].instructions.back(), labels);
+					if (std::find(branches.begin(), branches.end(), header_label) == branches.end())
+						continue;
+					phi.push_back(i > header_index ? m_next[count] : zero);
+					phi.push_back(function.blocks[i].label);
+				}
+				setWordCount(phi);
+				auto& instructions = function.blocks[header_index].instructions;
+				auto position = instructions.begin() + 1;
+				while (position != instructions.end() && opcode(*position) == OpPhi)
+					++position;
+				instructions.insert(position, std::move(phi));
+			}
+		}
+
+		if (report)
+		{
+			// SPIR-V 1.3 made the storage class core, from 1.4 on entry points list every global they use
+			if (version() < 0x00010300 && !hasExtension("SPV_KHR_storage_buffer_storage_class"))
+				m_extensions.push_back(extension("SPV_KHR_storage_buffer_storage_class"));
+			if (version() >= 0x00010400)
+			{
+				for (auto& instruction : m_globals)
+				{
+					if (opcode(instruction) != OpEntryPoint)
+						continue;
+					instruction.push_back(counter);
+					setWordCount(instruction);
+				}
+			}
+		}
+	}
+
+	bool hasExtension(char const* name) const
+	{
+		for (auto const& instruction : m_globals)
+			if (opcode(instruction) == OpExtension && std::strncmp(reinterpret_cast<char const*>(instruction.data() + 1), name, (instruction.size() - 1) * 4) == 0)
+				return true;
+		return false;
+	}
+
+	static Instruction extension(char const* name)
+	{
+		auto const length = std::strlen(name);
+		Instruction instruction(1 + length / 4 + 1, 0);
+		std::memcpy(instruction.data() + 1, name, length);
+		instruction[0] = OpExtension;
+		setWordCount(instruction);
+		return instruction;
+	}
+
+	// capabilities, extensions, imports, memory model, entry points, execution modes and debug instructions
+	// come before the annotations, the types, constants and global variables after them
+	static bool precedesAnnotations(uint32_t op)
+	{
+		return (op >= 2 && op <= 7) || (op >= 10 && op <= 17) || op == 330 || op == 331;
+	}
+
+	static bool isAnnotation(uint32_t op)
+	{
+		return (op >= OpDecorate && op <= 75) || op == 332 || op == 5632 || op == 5633;
+	}
+
+	std::vector<uint32_t> assemble() const
+	{
+		std::vector<uint32_t> code(m_header.begin(), m_header.end());
+		auto const append = [&code](Instruction const& instruction) { code.insert(code.end(), instruction.begin(), instruction.end()); };
+
+		bool extensions_done = false;
+		bool annotations_done = false;
+		for (auto const& instruction : m_globals)
+		{
+			auto const op = opcode(instruction);
+			if (!extensions_done && op != OpCapability)
+			{
+				for (auto const& extension : m_extensions)
+					append(extension);
+				extensions_done = true;
+			}
+			if (!annotations_done && !precedesAnnotations(op) && !isAnnotation(op))
+			{
+				for (auto const& annotation : m_annotations)
+					append(annotation);
+				annotations_done = true;
+			}
+			append(instruction);
+		}
+		if (!annotations_done)
+			for (auto const& annotation : m_annotations)
+				append(annotation);
+		for (auto const& global : m_new_globals)
+			append(global);
+
+		for (auto const& function : m_functions)
+		{
+			for (auto const& instruction : function.begin)
+				append(instruction);
+			for (auto const& block : function.blocks)
+				for (auto const& instruction : block.instructions)
+					append(instruction);
+			append(make(OpFunctionEnd, {}));
+		}
+		return code;
+	}
+
+	std::vector<uint32_t> m_header;
+	std::vector<Instruction> m_globals;
+	std::vector<Function> m_functions;
+	std::vector<Instruction> m_extensions;
+	std::vector<Instruction> m_annotations;
+	// appended to the types, constants and global variables
+	std::vector<Instruction> m_new_globals;
+	std::map<uint32_t, uint32_t> m_undefs;
+	// the incremented count of every counter, for the back edges of its phi
+	std::map<uint32_t, uint32_t> m_next;
+};
+
+// The storage buffer guarded stages count their loop bailouts in, with its descriptor set. The counter only ever
+// grows; poll() reports what was added since the last call once the frames that added it completed.
+class LoopViolations
+{
+public:
+	// stages: those reporting through the set, their StoresAndAtomics features enabled
+	LoopViolations(vk::Device device, DeviceAllocator& allocator, uint32_t set, vk::ShaderStageFlags stages)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_set_index(set)
+		, m_binding{ set, 0, vk::DescriptorType::eStorageBuffer, 1 }
+		, m_stages(stages)
+	{
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = sizeof(uint32_t);
+		buf_ci.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+		m_buffer = device.createBufferUnique(buf_ci);
+
+		auto const host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		m_memory = allocator.allocateFor(*m_buffer, host_flags, host_flags, AllocationStrategy::Linear);
+		std::memset(m_memory.mapped, 0, sizeof(uint32_t));
+
+		const vk::DescriptorPoolSize size{ vk::DescriptorType::eStorageBuffer, 1 };
+		vk::DescriptorPoolCreateInfo pool_ci{};
+		pool_ci.maxSets = 1;
+		pool_ci.poolSizeCount = 1;
+		pool_ci.pPoolSizes = &size;
+		m_pool = device.createDescriptorPoolUnique(pool_ci);
+	}
+
+	~LoopViolations()
+	{
+		m_buffer.reset();
+		m_allocator.free(m_memory);
+	}
+
+	LoopViolations(LoopViolations const&) = delete;
+	LoopViolations& operator=(LoopViolations const&) = delete;
+
+	uint32_t setIndex() const { return m_set_index; }
+	vk::ShaderStageFlags stages() const { return m_stages; }
+	bool reports(vk::ShaderStageFlagBits stage) const { return bool(m_stages & stage); }
+
+	LoopGuard::Binding binding() const { return { m_binding.set, m_binding.binding }; }
+
+	// what a reporting stage adds to its interface, for createReflectedLayout; points into this object
+	ShaderReflection interfaceOf(vk::ShaderStageFlagBits stage) const { return { stage, &m_binding, 1, 0 }; }
+
+	// allocates and writes the set, layout is the set's layout in the pipeline layout
+	void bind(vk::DescriptorSetLayout layout)
+	{
+		m_device.resetDescriptorPool(*m_pool);
+		vk::DescriptorSetAllocateInfo ds_ai{};
+		ds_ai.descriptorPool = *m_pool;
+		ds_ai.descriptorSetCount = 1;
+		ds_ai.pSetLayouts = &layout;
+		m_set = m_device.allocateDescriptorSets(ds_ai).front();
+		const vk::DescriptorBufferInfo buffer{ *m_buffer, 0, VK_WHOLE_SIZE };
+		const vk::WriteDescriptorSet write{ m_set, m_binding.binding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &buffer };
+		m_device.updateDescriptorSets(write, nullptr);
+	}
+
+	vk::DescriptorSet descriptorSet() const { return m_set; }
+
+	uint32_t poll()
+	{
+		auto const count = *static_cast<uint32_t const volatile*>(m_memory.mapped);
+		return count - std::exchange(m_last, count);
+	}
+
+private:
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	uint32_t m_set_index;
+	ShaderBinding m_binding;
+	vk::ShaderStageFlags m_stages;
+	vk::UniqueBuffer m_buffer;
+	Allocation m_memory;
+	vk::UniqueDescriptorPool m_pool;
+	vk::DescriptorSet m_set;
+	uint32_t m_last = 0;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+// Read-only view of a whole file. The pages are backed by the file itself, so reading them neither copies the
+// file nor counts against the process' private memory, and the OS drops them again under memory pressure.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(std::filesystem::path const& path)
+	{
+#ifdef _WIN32
+		auto const file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Can not open " + path.string());
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("Can not query the size of " + path.string());
+		}
+		m_size = static_cast<size_t>(size.QuadPart);
+		if (m_size != 0)
+		{
+			auto const mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping != nullptr)
+			{
+				m_data = static_cast<uint8_t const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				// the view keeps the mapping alive
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+#else
+		auto const file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0)
+			throw std::runtime_error("Can not open " + path.string());
+		struct stat st{};
+		if (fstat(file, &st) != 0)
+		{
+			close(file);
+			throw std::runtime_error("Can not query the size of " + path.string());
+		}
+		m_size = static_cast<size_t>(st.st_size);
+		if (m_size != 0)
+		{
+			auto* const data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED)
+			{
+				m_data = static_cast<uint8_t const*>(data);
+				madvise(data, m_size, MADV_SEQUENTIAL);
+			}
+		}
+		close(file);
+#endif
+		if (m_size != 0 && m_data == nullptr)
+			throw std::runtime_error("Can not map " + path.string());
+	}
+
+	~MappedFile()
+	{
+		reset();
+	}
+
+	MappedFile(MappedFile&& other) noexcept
+		: m_data(std::exchange(other.m_data, nullptr))
+		, m_size(std::exchange(other.m_size, 0))
+	{}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			m_data = std::exchange(other.m_data, nullptr);
+			m_size = std::exchange(other.m_size, 0);
+		}
+		return *this;
+	}
+
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	uint8_t const* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	void reset()
+	{
+		if (m_data)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+#else
+			munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+		}
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+private:
+	uint8_t const* m_data = nullptr;
+	size_t m_size = 0;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "device_allocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+struct HeapBudget
+{
+	vk::DeviceSize size = 0;
+	// what the process may use of the heap before the OS starts paging, and what it uses now
+	vk::DeviceSize budget = 0;
+	vk::DeviceSize usage = 0;
+	// blocks of the allocator, part of usage
+	vk::DeviceSize allocator_usage = 0;
+	bool device_local = false;
+};
+
+// Per heap usage and budget, queried once per frame from VK_EXT_memory_budget. Without the extension the
+// usage is the allocator's own and the budget a fixed share of the heap, which is about what drivers report
+// for an otherwise idle system. Budgets shrink when other processes claim memory.
+class MemoryBudget
+{
+public:
+	// share of a heap taken as its budget without the extension, and kept free of the allocator's budget
+	static constexpr float fallback_share = 0.8f;
+	static constexpr float reserve_share = 0.05f;
+
+	// memory_budget: VK_EXT_memory_budget is enabled on the device
+	MemoryBudget(vk::PhysicalDevice phys_dev, bool memory_budget)
+		: m_phys_dev(phys_dev)
+		, m_ext(memory_budget)
+	{
+		auto const mem_props = phys_dev.getMemoryProperties();
+		m_heaps.resize(mem_props.memoryHeapCount);
+		for (uint32_t heap = 0; heap < mem_props.memoryHeapCount; ++heap)
+		{
+			m_heaps[heap].size = mem_props.memoryHeaps[heap].size;
+			m_heaps[heap].device_local = static_cast<bool>(mem_props.memoryHeaps[heap].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+			if (m_heaps[heap].device_local && (!m_device_local || m_heaps[heap].size > m_heaps[*m_device_local].size))
+				m_device_local = heap;
+		}
+	}
+
+	bool queriesDriver() const { return m_ext; }
+
+	// once per frame, hands the allocator its share of every heap: the budget minus what the rest of the
+	// process uses and a small reserve
+	void update(DeviceAllocator& allocator)
+	{
+		auto const own = allocator.heapUsage();
+		if (m_ext)
+		{
+			auto const props = m_phys_dev.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+			auto const& budget = props.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+			for (uint32_t heap = 0; heap < m_heaps.size(); ++heap)
+			{
+				m_heaps[heap].budget = budget.heapBudget[heap];
+				m_heaps[heap].usage = budget.heapUsage[heap];
+			}
+		}
+		for (uint32_t heap = 0; heap < m_heaps.size(); ++heap)
+		{
+			auto& info = m_heaps[heap];
+			info.allocator_usage = own[heap];
+			if (!m_ext)
+			{
+				info.budget = static_cast<vk::DeviceSize>(info.size * fallback_share);
+				info.usage = own[heap];
+			}
+			// usage lags behind allocations on some drivers
+			info.usage = std::max(info.usage, own[heap]);
+			auto const others = info.usage - own[heap];
+			auto const reserve = static_cast<vk::DeviceSize>(info.budget * reserve_share);
+			auto const available = info.budget > others + reserve ? info.budget - others - reserve : 0;
+			allocator.setHeapBudget(heap, available);
+		}
+	}
+
+	std::vector<HeapBudget> const& heaps() const { return m_heaps; }
+	HeapBudget const& heap(uint32_t heap) const { return m_heaps[heap]; }
+
+	// the largest device-local heap, where textures and render targets go
+	uint32_t deviceLocalHeap() const { return m_device_local.value_or(0); }
+
+	// bytes the heap can still take before it is over budget, negative when it already is
+	int64_t slack(uint32_t heap) const
+	{
+		auto const& info = m_heaps[heap];
+		auto const reserve = static_cast<vk::DeviceSize>(info.budget * reserve_share);
+		return static_cast<int64_t>(info.budget - reserve) - static_cast<int64_t>(info.usage);
+	}
+
+private:
+	vk::PhysicalDevice m_phys_dev;
+	bool m_ext;
+	std::vector<HeapBudget> m_heaps;
+	std::optional<uint32_t> m_device_local;
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// One vertex attribute of a mesh file, format is a VkFormat.
+struct MeshAttribute
+{
+	uint32_t location = 0;
+	uint32_t format = 0;
+	uint32_t offset = 0;
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(MeshAttribute) == 16, "MeshAttribute is part of the mesh file format");
+
+// Start of a mesh file, followed by its attributes and the encoded vertex and index streams at the offsets given.
+struct MeshFileHeader
+{
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t vertex_count = 0;
+	uint32_t vertex_stride = 0;
+	uint32_t index_count = 0;
+	uint32_t attribute_count = 0;
+	uint64_t vertex_offset = 0;
+	uint64_t vertex_size = 0;
+	uint64_t index_offset = 0;
+	uint64_t index_size = 0;
+	// bounding sphere in object space, xyz center and w radius
+	std::array<float, 4> sphere{};
+};
+static_assert(sizeof(MeshFileHeader) == 72, "MeshFileHeader is part of the mesh file format");
+
+// a mesh file in memory, the pointers point into it
+struct MeshFileView
+{
+	MeshFileHeader header;
+	MeshAttribute const* attributes = nullptr;
+	uint8_t const* vertex_data = nullptr;
+	uint8_t const* index_data = nullptr;
+};
+
+// Lossless vertex and index compression in the spirit of meshoptimizer's codecs, decoded at several hundred MB/s.
+// Vertices are split into blocks and every byte of the vertex is coded as its own lane: the difference to the same
+// byte of the previous vertex, zigzag coded, in groups of 16 packed to 0, 2, 4 or 8 bits with a 2 bit header each.
+// Positions and attributes of neighbouring vertices differ little, most groups end up at 2 or 4 bits. Indices are
+// the zigzag coded difference to the previous index as a LEB128 varint, which a vertex cache optimized triangle
+// list brings down to about one byte an index. Decoders check every read against the end of the stream.
+class MeshCodec
+{
+public:
+	static constexpr uint32_t file_magic = 0x4853454d; // "MESH"
+	static constexpr uint32_t file_version = 1;
+
+	static std::vector<uint8_t> encodeVertices(void const* vertices, size_t count, size_t stride)
+	{
+		checkStride(stride);
+		auto const* const bytes = static_cast<uint8_t const*>(vertices);
+		std::vector<uint8_t> out;
+		out.reserve(1 + count * stride / 2);
+		out.push_back(vertex_stream);
+
+		std::vector<uint8_t> last(stride, 0);
+		auto const block = blockSize(stride);
+		for (size_t start = 0; start < count; start += block)
+		{
+			auto const n = std::min(block, count - start);
+			auto const groups = (n + 15) / 16;
+			for (size_t k = 0; k < stride; ++k)
+			{
+				auto const header = out.size();
+				out.resize(header + (groups + 3) / 4, 0);
+				for (size_t g = 0; g < groups; ++g)
+				{
+					std::array<uint8_t, 16> deltas{};
+					uint8_t max = 0;
+					for (size_t i = 0; i < 16 && g * 16 + i < n; ++i)
+					{
+						auto const v = start + g * 16 + i;
+						auto const previous = v == start ? last[k] : bytes[(v - 1) * stride + k];
+						deltas[i] = zigzag(static_cast<uint8_t>(bytes[v * stride + k] - previous));
+						max = std::max(max, deltas[i]);
+					}
+					uint8_t const mode = max == 0 ? 0 : max < 4 ? 1 : max < 16 ? 2 : 3;
+					out[header + g / 4] |= static_cast<uint8_t>(mode << (g % 4 * 2));
+					pack(out, deltas, mode);
+				}
+			}
+			std::memcpy(last.data(), bytes + (start + n - 1) * stride, stride);
+		}
+		return out;
+	}
+
+	// count and stride as encoded, vertices has room for count * stride bytes
+	static void decodeVertices(void* vertices, size_t count, size_t stride, uint8_t const* data, size_t size)
+	{
+		checkStride(stride);
+		auto* const bytes = static_cast<uint8_t*>(vertices);
+		auto const* const end = data + size;
+		if (size == 0 || *data++ != vertex_stream)
+			throw std::runtime_error("Not an encoded vertex stream!");
+
+		std::array<uint8_t, 256> last{};
+		auto const block = blockSize(stride);
+		for (size_t start = 0; start < count; start += block)
+		{
+			auto const n = std::min(block, count - start);
+			auto const groups = (n + 15) / 16;
+			for (size_t k = 0; k < stride; ++k)
+			{
+				auto const* const header = data;
+				data = checked(data, (groups + 3) / 4, end);
+				auto previous = last[k];
+				for (size_t g = 0; g < groups; ++g)
+				{
+					auto const mode = (header[g / 4] >> (g % 4 * 2)) & 3;
+					std::array<uint8_t, 16> deltas;
+					data = unpack(deltas, mode, data, end);
+					auto const group_end = std::min<size_t>(16, n - g * 16);
+					auto* out = bytes + (start + g * 16) * stride + k;
+					for (size_t i = 0; i < group_end; ++i, out += stride)
+					{
+						previous = static_cast<uint8_t>(previous + unzigzag(deltas[i]));
+						*out = previous;
+					}
+				}
+			}
+			std::memcpy(last.data(), bytes + (start + n - 1) * stride, stride);
+		}
+		if (data != end)
+			throw std::runtime_error("Encoded vertex stream has trailing data!");
+	}
+
+	static std::vector<uint8_t> encodeIndices(uint32_t const* indices, size_t count)
+	{
+		std::vector<uint8_t> out;
+		out.reserve(1 + count + count / 4);
+		out.push_back(index_stream);
+		uint32_t last = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto const delta = static_cast<int32_t>(indices[i] - last);
+			auto value = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+			while (value >= 0x80)
+			{
+				out.push_back(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<uint8_t>(value));
+			last = indices[i];
+		}
+		return out;
+	}
+
+	static void decodeIndices(uint32_t* indices, size_t count, uint8_t const* data, size_t size)
+	{
+		auto const* const end = data + size;
+		if (size == 0 || *data++ != index_stream)
+			throw std::runtime_error("Not an encoded index stream!");
+		uint32_t last = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t value = 0;
+			for (uint32_t shift = 0;; shift += 7)
+			{
+				if (data == end || shift > 28)
+					throw std::runtime_error("Encoded index stream is truncated!");
+				auto const byte = *data++;
+				value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					break;
+			}
+			last += (value >> 1) ^ (0u - (value & 1));
+			indices[i] = last;
+		}
+		if (data != end)
+			throw std::runtime_error("Encoded index stream has trailing data!");
+	}
+
+	// a complete mesh file, for tools converting assets
+	static std::vector<uint8_t> encodeFile(void const* vertices, uint32_t vertex_count, uint32_t vertex_stride, std::vector<MeshAttribute> const& attributes,
+		uint32_t const* indices, uint32_t index_count, std::array<float, 4> const& sphere)
+	{
+		auto const vertex_data = encodeVertices(vertices, vertex_count, vertex_stride);
+		auto const index_data = encodeIndices(indices, index_count);
+
+		MeshFileHeader header{};
+		header.magic = file_magic;
+		header.version = file_version;
+		header.vertex_count = vertex_count;
+		header.vertex_stride = vertex_stride;
+		header.index_count = index_count;
+		header.attribute_count = static_cast<uint32_t>(attributes.size());
+		header.vertex_offset = sizeof(header) + attributes.size() * sizeof(MeshAttribute);
+		header.vertex_size = vertex_data.size();
+		header.index_offset = header.vertex_offset + header.vertex_size;
+		header.index_size = index_data.size();
+		header.sphere = sphere;
+
+		std::vector<uint8_t> file(static_cast<size_t>(header.index_offset + header.index_size));
+		std::memcpy(file.data(), &header, sizeof(header));
+		if (!attributes.empty())
+			std::memcpy(file.data() + sizeof(header), attributes.data(), attributes.size() * sizeof(MeshAttribute));
+		std::memcpy(file.data() + header.vertex_offset, vertex_data.data(), vertex_data.size());
+		std::memcpy(file.data() + header.index_offset, index_data.data(), index_data.size());
+		return file;
+	}
+
+	// validates the layout of the file, the streams are only checked when decoded
+	static MeshFileView parseFile(uint8_t const* data, size_t size)
+	{
+		MeshFileView view;
+		if (size < sizeof(MeshFileHeader))
+			throw std::runtime_error("Mesh file is truncated!");
+		std::memcpy(&view.header, data, sizeof(MeshFileHeader));
+		auto const& header = view.header;
+		if (header.magic != file_magic)
+			throw std::runtime_error("Not a mesh file!");
+		if (header.version != file_version)
+			throw std::runtime_error("Unsupported mesh file version " + std::to_string(header.version) + "!");
+		checkStride(header.vertex_stride);
+		auto const attributes_end = sizeof(MeshFileHeader) + uint64_t(header.attribute_count) * sizeof(MeshAttribute);
+		if (attributes_end > size || header.vertex_offset < attributes_end || header.vertex_size > size - std::min<uint64_t>(header.vertex_offset, size)
+			|| header.index_size > size - std::min<uint64_t>(header.index_offset, size) || header.vertex_offset > size || header.index_offset > size)
+			throw std::runtime_error("Mesh file is truncated!");
+		view.attributes = reinterpret_cast<MeshAttribute const*>(data + sizeof(MeshFileHeader));
+		view.vertex_data = data + header.vertex_offset;
+		view.index_data = data + header.index_offset;
+		return view;
+	}
+
+private:
+	static constexpr uint8_t vertex_stream = 0xa1;
+	static constexpr uint8_t index_stream = 0xb1;
+
+	static void checkStride(size_t stride)
+	{
+		if (stride == 0 || stride > 256 || stride % 4 != 0)
+			throw std::runtime_error("Vertex stride must be a multiple of 4 of at most 256 bytes!");
+	}
+
+	// vertices per block, so a block's lanes of one vertex stay within 8 KiB
+	static size_t blockSize(size_t stride)
+	{
+		return std::clamp<size_t>((8192 / stride) & ~size_t(15), 16, 256);
+	}
+
+	static uint8_t zigzag(uint8_t value)
+	{
+		return static_cast<uint8_t>((value << 1) ^ static_cast<uint8_t>(static_cast<int8_t>(value) >> 7));
+	}
+
+	static uint8_t unzigzag(uint8_t value)
+	{
+		return static_cast<uint8_t>((value >> 1) ^ (0u - (value & 1)));
+	}
+
+	static void pack(std::vector<uint8_t>& out, std::array<uint8_t, 16> const& deltas, uint8_t mode)
+	{
+		if (mode == 3)
+		{
+			out.insert(out.end(), deltas.begin(), deltas.end());
+			return;
+		}
+		auto const bits = mode == 1 ? 2u : 4u;
+		auto const per_byte = 8 / bits;
+		for (size_t i = 0; mode != 0 && i < 16; i += per_byte)
+		{
+			uint8_t byte = 0;
+			for (size_t j = 0; j < per_byte; ++j)
+				byte |= static_cast<uint8_t>(deltas[i + j] << (j * bits));
+			out.push_back(byte);
+		}
+	}
+
+	static uint8_t const* unpack(std::array<uint8_t, 16>& deltas, uint32_t mode, uint8_t const* data, uint8_t const* end)
+	{
+		switch (mode)
+		{
+		case 0:
+			deltas.fill(0);
+			return data;
+		case 1:
+			data = checked(data, 4, end);
+			for (size_t i = 0; i < 16; ++i)
+				deltas[i] = ((data - 4)[i / 4] >> (i % 4 * 2)) & 3;
+			return data;
+		case 2:
+			data = checked(data, 8, end);
+			for (size_t i = 0; i < 16; ++i)
+				deltas[i] = ((data - 8)[i / 2] >> (i % 2 * 4)) & 15;
+			return data;
+		default:
+			data = checked(data, 16, end);
+			std::memcpy(deltas.data(), data - 16, 16);
+			return data;
+		}
+	}
+
+	// data advanced by size, if the stream has that much left
+	static uint8_t const* checked(uint8_t const* data, size_t size, uint8_t const* end)
+	{
+		if (size_t(end - data) < size)
+			throw std::runtime_error("Encoded vertex stream is truncated!");
+		return data + size;
+	}
+};
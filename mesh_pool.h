@@ -0,0 +1,458 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "mapped_file.h"
+#include "mesh_codec.h"
+#include "staging_ring.h"
+#include "thread_pool.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// First fit over [0, capacity) in units of the caller, freed ranges merge with their neighbours.
+class RangeAllocator
+{
+public:
+	explicit RangeAllocator(uint32_t capacity)
+	{
+		if (capacity)
+			m_free.emplace(0, capacity);
+	}
+
+	std::optional<uint32_t> allocate(uint32_t size)
+	{
+		if (size == 0)
+			return 0;
+		for (auto it = m_free.begin(); it != m_free.end(); ++it)
+		{
+			if (it->second < size)
+				continue;
+			auto const offset = it->first;
+			auto const rest = it->second - size;
+			m_free.erase(it);
+			if (rest)
+				m_free.emplace(offset + size, rest);
+			return offset;
+		}
+		return std::nullopt;
+	}
+
+	void free(uint32_t offset, uint32_t size)
+	{
+		if (size == 0)
+			return;
+		auto next = m_free.lower_bound(offset);
+		if (next != m_free.end() && next->first == offset + size)
+		{
+			size += next->second;
+			next = m_free.erase(next);
+		}
+		if (next != m_free.begin())
+		{
+			auto const previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				previous->second += size;
+				return;
+			}
+		}
+		m_free.emplace(offset, size);
+	}
+
+private:
+	// offset to size
+	std::map<uint32_t, uint32_t> m_free;
+};
+
+struct MeshHandle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// where a mesh lives in the pool's buffers, for DrawObject and vkCmdDrawIndexed
+struct MeshRange
+{
+	uint32_t first_index = 0;
+	uint32_t index_count = 0;
+	int32_t vertex_offset = 0;
+	uint32_t vertex_count = 0;
+	// object space, xyz center and w radius
+	std::array<float, 4> sphere{};
+};
+
+// Meshes of one vertex layout in a shared device-local vertex and index buffer, suballocated per mesh, so all of
+// them draw with one binding and the culling pass can pack them into a single indirect draw. load() memory-maps
+// the file and reserves the mesh's ranges right away; the streams are decoded on the thread pool straight from
+// the mapping, which is dropped once decoded. upload() streams decoded meshes through the frame's staging ring
+// partition, a mesh larger than the partition over several frames, and frees their CPU copies. A mesh is
+// resident() from the frame its last copy was queued in, its draws may be recorded from then on. Thread safe,
+// upload() belongs to the render thread.
+class MeshPool
+{
+public:
+	static constexpr vk::IndexType index_type = vk::IndexType::eUint32;
+
+	struct Stats
+	{
+		uint32_t meshes = 0;
+		uint32_t resident = 0;
+		// decoded and waiting for the staging ring
+		vk::DeviceSize pending_bytes = 0;
+		vk::DeviceSize vertex_bytes_used = 0;
+		vk::DeviceSize index_bytes_used = 0;
+		// of the meshes loaded from files, mapping to decoded
+		std::chrono::nanoseconds decode_time{ 0 };
+	};
+
+	// attributes are the pool's binding as reflected from the vertex shader, mesh files have to match them
+	MeshPool(vk::Device device, DeviceAllocator& allocator, ThreadPool& workers, uint32_t vertex_stride,
+		std::vector<vk::VertexInputAttributeDescription> attributes, uint32_t vertex_capacity, uint32_t index_capacity)
+		: m_allocator(allocator)
+		, m_workers(workers)
+		, m_vertex_stride(vertex_stride)
+		, m_attributes(std::move(attributes))
+		, m_vertex_ranges(vertex_capacity)
+		, m_index_ranges(index_capacity)
+	{
+		if (vertex_stride == 0 || vertex_stride % 4 != 0)
+			throw std::runtime_error("Mesh vertex stride must be a non-zero multiple of 4!");
+		std::sort(m_attributes.begin(), m_attributes.end(), [](auto const& a, auto const& b) { return a.location < b.location; });
+
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+		buf_ci.size = vk::DeviceSize(vertex_stride) * std::max(vertex_capacity, 1u);
+		buf_ci.usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+		m_vertex_buffer = device.createBufferUnique(buf_ci);
+		m_vertex_memory = allocator.allocateFor(*m_vertex_buffer, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+
+		buf_ci.size = sizeof(uint32_t) * vk::DeviceSize(std::max(index_capacity, 1u));
+		buf_ci.usage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+		m_index_buffer = device.createBufferUnique(buf_ci);
+		m_index_memory = allocator.allocateFor(*m_index_buffer, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+	}
+
+	~MeshPool()
+	{
+		// the decode jobs write into the meshes
+		for (auto& mesh : m_meshes)
+			if (mesh.decoded.valid())
+				mesh.decoded.wait();
+		m_vertex_buffer.reset();
+		m_index_buffer.reset();
+		m_allocator.free(m_vertex_memory);
+		m_allocator.free(m_index_memory);
+	}
+
+	MeshPool(MeshPool const&) = delete;
+	MeshPool& operator=(MeshPool const&) = delete;
+
+	vk::Buffer vertexBuffer() const { return *m_vertex_buffer; }
+	vk::Buffer indexBuffer() const { return *m_index_buffer; }
+	uint32_t vertexStride() const { return m_vertex_stride; }
+
+	void bind(vk::CommandBuffer cmd, uint32_t binding) const
+	{
+		cmd.bindVertexBuffers(binding, *m_vertex_buffer, vk::DeviceSize(0));
+		cmd.bindIndexBuffer(*m_index_buffer, 0, index_type);
+	}
+
+	// throws if the file is not a mesh of the pool's layout or the pool is full; decoding errors show up in failed()
+	MeshHandle load(std::filesystem::path const& path)
+	{
+		auto file = std::make_shared<MappedFile>(path);
+		auto const view = MeshCodec::parseFile(file->data(), file->size());
+		checkLayout(view, path);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const handle = reserve(view.header.vertex_count, view.header.index_count, view.header.sphere);
+		auto& mesh = m_meshes[handle.index];
+		mesh.data = std::make_shared<Data>();
+		mesh.data->vertices.resize(size_t(view.header.vertex_count) * m_vertex_stride);
+		mesh.data->indices.resize(view.header.index_count);
+		mesh.decoded = m_workers.submit([data = mesh.data, file = std::move(file), view](uint32_t)
+		{
+			auto const start = std::chrono::steady_clock::now();
+			auto const& header = view.header;
+			MeshCodec::decodeVertices(data->vertices.data(), header.vertex_count, header.vertex_stride, view.vertex_data, static_cast<size_t>(header.vertex_size));
+			MeshCodec::decodeIndices(data->indices.data(), header.index_count, view.index_data, static_cast<size_t>(header.index_size));
+			data->decode_time = std::chrono::steady_clock::now() - start;
+			// the mapping goes with the job, only the decoded copy stays until it was streamed
+		});
+		m_streaming.push_back(handle.index);
+		return handle;
+	}
+
+	// vertices in the pool's layout, indices relative to the mesh's first vertex
+	MeshHandle add(void const* vertices, uint32_t vertex_count, uint32_t const* indices, uint32_t index_count, std::array<float, 4> const& sphere)
+	{
+		auto data = std::make_shared<Data>();
+		auto const* const bytes = static_cast<uint8_t const*>(vertices);
+		data->vertices.assign(bytes, bytes + size_t(vertex_count) * m_vertex_stride);
+		data->indices.assign(indices, indices + index_count);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const handle = reserve(vertex_count, index_count, sphere);
+		m_meshes[handle.index].data = std::move(data);
+		m_streaming.push_back(handle.index);
+		return handle;
+	}
+
+	// the GPU must be done with the mesh's draws
+	void release(MeshHandle handle)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& mesh = meshOf(handle);
+		// still streaming, upload() drops it once its decode finished
+		mesh.released = true;
+		if (mesh.resident || mesh.error)
+			recycle(handle.index);
+	}
+
+	bool resident(MeshHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return meshOf(handle).resident;
+	}
+
+	// the decoding error, if the mesh could not be loaded
+	std::optional<std::string> failed(MeshHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return meshOf(handle).error;
+	}
+
+	MeshRange range(MeshHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return meshOf(handle).range;
+	}
+
+	Stats stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats stats = m_stats;
+		for (auto const index : m_streaming)
+		{
+			auto const& mesh = m_meshes[index];
+			if (mesh.data && !mesh.decoded.valid())
+				stats.pending_bytes += mesh.data->vertices.size() + mesh.data->indices.size() * sizeof(uint32_t) - mesh.streamed;
+		}
+		return stats;
+	}
+
+	// Queues decoded meshes on the staging ring, before its flush(), in the order they were loaded or added. Meshes
+	// still decoding are skipped, the ones behind them go ahead.
+	void upload(StagingRing& staging)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto it = m_streaming.begin(); it != m_streaming.end();)
+		{
+			auto const index = *it;
+			auto& mesh = m_meshes[index];
+			if (mesh.decoded.valid())
+			{
+				if (mesh.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				{
+					++it;
+					continue;
+				}
+				try
+				{
+					mesh.decoded.get();
+					m_stats.decode_time += mesh.data->decode_time;
+				}
+				catch (std::exception const& e)
+				{
+					mesh.error = e.what();
+				}
+			}
+			if (mesh.released || mesh.error)
+			{
+				mesh.data.reset();
+				if (mesh.released)
+					recycle(index);
+				it = m_streaming.erase(it);
+				continue;
+			}
+			if (!stream(mesh, staging))
+				break;
+			mesh.resident = true;
+			mesh.data.reset();
+			++m_stats.resident;
+			it = m_streaming.erase(it);
+		}
+	}
+
+private:
+	struct Data
+	{
+		std::vector<uint8_t> vertices;
+		std::vector<uint32_t> indices;
+		std::chrono::nanoseconds decode_time{ 0 };
+	};
+
+	struct Mesh
+	{
+		uint32_t generation = 0;
+		bool alive = false;
+		bool released = false;
+		bool resident = false;
+		MeshRange range;
+		// null once streamed
+		std::shared_ptr<Data> data;
+		std::future<void> decoded;
+		// bytes of vertices then indices already queued
+		vk::DeviceSize streamed = 0;
+		std::optional<std::string> error;
+	};
+
+	void checkLayout(MeshFileView const& view, std::filesystem::path const& path) const
+	{
+		auto const& header = view.header;
+		bool matches = header.vertex_stride == m_vertex_stride && header.attribute_count == m_attributes.size();
+		for (uint32_t i = 0; matches && i < header.attribute_count; ++i)
+		{
+			MeshAttribute attribute;
+			std::memcpy(&attribute, view.attributes + i, sizeof(attribute));
+			auto const expected = std::find_if(m_attributes.begin(), m_attributes.end(), [&](auto const& a) { return a.location == attribute.location; });
+			matches = expected != m_attributes.end() && static_cast<uint32_t>(expected->format) == attribute.format && expected->offset == attribute.offset;
+		}
+		if (!matches)
+			throw std::runtime_error("Vertex layout of " + path.string() + " does not match the vertex shader!");
+	}
+
+	MeshHandle reserve(uint32_t vertex_count, uint32_t index_count, std::array<float, 4> const& sphere)
+	{
+		auto const first_vertex = m_vertex_ranges.allocate(vertex_count);
+		if (!first_vertex)
+			throw std::runtime_error("Mesh pool is out of vertex space!");
+		auto const first_index = m_index_ranges.allocate(index_count);
+		if (!first_index)
+		{
+			m_vertex_ranges.free(*first_vertex, vertex_count);
+			throw std::runtime_error("Mesh pool is out of index space!");
+		}
+
+		uint32_t index;
+		if (!m_free_meshes.empty())
+		{
+			index = m_free_meshes.back();
+			m_free_meshes.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(m_meshes.size());
+			m_meshes.emplace_back();
+		}
+		auto& mesh = m_meshes[index];
+		mesh.alive = true;
+		mesh.released = false;
+		mesh.resident = false;
+		mesh.streamed = 0;
+		mesh.error.reset();
+		mesh.range = { *first_index, index_count, static_cast<int32_t>(*first_vertex), vertex_count, sphere };
+
+		++m_stats.meshes;
+		m_stats.vertex_bytes_used += vk::DeviceSize(vertex_count) * m_vertex_stride;
+		m_stats.index_bytes_used += vk::DeviceSize(index_count) * sizeof(uint32_t);
+		return { index, mesh.generation };
+	}
+
+	void recycle(uint32_t index)
+	{
+		auto& mesh = m_meshes[index];
+		auto const& range = mesh.range;
+		m_vertex_ranges.free(static_cast<uint32_t>(range.vertex_offset), range.vertex_count);
+		m_index_ranges.free(range.first_index, range.index_count);
+		--m_stats.meshes;
+		if (mesh.resident)
+			--m_stats.resident;
+		m_stats.vertex_bytes_used -= vk::DeviceSize(range.vertex_count) * m_vertex_stride;
+		m_stats.index_bytes_used -= vk::DeviceSize(range.index_count) * sizeof(uint32_t);
+
+		mesh.alive = false;
+		mesh.resident = false;
+		mesh.data.reset();
+		mesh.decoded = {};
+		++mesh.generation;
+		m_free_meshes.push_back(index);
+	}
+
+	Mesh const& meshOf(MeshHandle handle) const
+	{
+		if (handle.index >= m_meshes.size() || !m_meshes[handle.index].alive || m_meshes[handle.index].released
+			|| m_meshes[handle.index].generation != handle.generation)
+			throw std::runtime_error("MeshHandle does not refer to a live mesh!");
+		return m_meshes[handle.index];
+	}
+
+	Mesh& meshOf(MeshHandle handle)
+	{
+		return const_cast<Mesh&>(static_cast<MeshPool const*>(this)->meshOf(handle));
+	}
+
+	// true once all of the mesh is queued
+	bool stream(Mesh& mesh, StagingRing& staging)
+	{
+		auto const& data = *mesh.data;
+		auto const vertex_bytes = vk::DeviceSize(data.vertices.size());
+		auto const index_bytes = vk::DeviceSize(data.indices.size()) * sizeof(uint32_t);
+		auto const vertex_base = vk::DeviceSize(mesh.range.vertex_offset) * m_vertex_stride;
+		auto const index_base = vk::DeviceSize(mesh.range.first_index) * sizeof(uint32_t);
+
+		auto const queue = [&](vk::Buffer dst, vk::DeviceSize dst_offset, uint8_t const* src, vk::DeviceSize size)
+		{
+			auto const room = std::min(size, staging.available() / 4 * 4);
+			if (room == 0)
+				return vk::DeviceSize(0);
+			auto const region = staging.allocate(room);
+			std::memcpy(region.data, src, static_cast<size_t>(room));
+			staging.copy(dst, vk::BufferCopy{ region.offset, dst_offset, room });
+			return room;
+		};
+
+		if (mesh.streamed < vertex_bytes)
+			mesh.streamed += queue(*m_vertex_buffer, vertex_base + mesh.streamed, data.vertices.data() + mesh.streamed, vertex_bytes - mesh.streamed);
+		if (mesh.streamed >= vertex_bytes && mesh.streamed < vertex_bytes + index_bytes)
+		{
+			auto const done = mesh.streamed - vertex_bytes;
+			auto const* const src = reinterpret_cast<uint8_t const*>(data.indices.data()) + done;
+			mesh.streamed += queue(*m_index_buffer, index_base + done, src, index_bytes - done);
+		}
+		return mesh.streamed == vertex_bytes + index_bytes;
+	}
+
+	DeviceAllocator& m_allocator;
+	ThreadPool& m_workers;
+	uint32_t m_vertex_stride;
+	std::vector<vk::VertexInputAttributeDescription> m_attributes;
+
+	vk::UniqueBuffer m_vertex_buffer;
+	Allocation m_vertex_memory;
+	vk::UniqueBuffer m_index_buffer;
+	Allocation m_index_memory;
+
+	mutable std::mutex m_mutex;
+	RangeAllocator m_vertex_ranges;
+	RangeAllocator m_index_ranges;
+	std::vector<Mesh> m_meshes;
+	std::vector<uint32_t> m_free_meshes;
+	// indices of meshes not resident yet, in load order
+	std::deque<uint32_t> m_streaming;
+	Stats m_stats;
+};
@@ -0,0 +1,442 @@
+#pragma once
+
+#include "shared_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MetricsConfig
+{
+	// rewritten every interval in the Prometheus text format, e.g. for node_exporter's textfile collector;
+	// empty writes none
+	std::filesystem::path prometheus_file;
+	// name of a shared memory block the metrics are mirrored into every interval, see MetricsBlock; empty creates none
+	std::string shared_memory;
+	std::chrono::milliseconds interval{ 1000 };
+	// added to every sample, e.g. node="render-03",gpu="0"
+	std::string labels;
+};
+
+// Metrics are registered once and then only updated with relaxed atomics, so the render thread never takes a
+// lock or allocates for them; the exporter reads them concurrently and may see one update before another.
+class Counter
+{
+public:
+	void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> m_value{ 0 };
+};
+
+class Gauge
+{
+public:
+	void set(double value) { m_value.store(value, std::memory_order_relaxed); }
+	double value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<double> m_value{ 0.0 };
+};
+
+// Fixed upper bucket bounds, ascending; an observation above the last one only counts towards count() and sum().
+class Histogram
+{
+public:
+	explicit Histogram(std::vector<double> bounds)
+		: m_bounds(std::move(bounds))
+		, m_buckets(std::make_unique<std::atomic<uint64_t>[]>(m_bounds.size()))
+	{
+		if (!std::is_sorted(m_bounds.begin(), m_bounds.end()))
+			throw std::runtime_error("Histogram bounds are not ascending");
+		for (size_t i = 0; i < m_bounds.size(); ++i)
+			m_buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	void observe(double value)
+	{
+		auto const bucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin();
+		if (static_cast<size_t>(bucket) < m_bounds.size())
+			m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		// no fetch_add for atomic doubles before C++20
+		auto sum = m_sum.load(std::memory_order_relaxed);
+		while (!m_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed))
+		{}
+	}
+
+	std::vector<double> const& bounds() const { return m_bounds; }
+	// observations in the bucket alone, not cumulative
+	uint64_t bucket(size_t index) const { return m_buckets[index].load(std::memory_order_relaxed); }
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	double sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+private:
+	std::vector<double> m_bounds;
+	std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+	std::atomic<uint64_t> m_count{ 0 };
+	std::atomic<double> m_sum{ 0.0 };
+};
+
+// The layout of the shared memory block: a header and a fixed array of entries, in registration order. The
+// exporter writes it under a sequence lock, readers copy what they need and retry while the sequence was odd
+// or changed meanwhile.
+struct MetricsBlock
+{
+	static constexpr uint32_t magic_value = 0x4D525445; // "ETRM"
+	static constexpr uint32_t version_value = 1;
+	static constexpr uint32_t max_entries = 64;
+	static constexpr uint32_t max_bounds = 16;
+	static constexpr size_t max_name = 64;
+
+	enum class Type : uint32_t
+	{
+		Counter,
+		Gauge,
+		Histogram
+	};
+
+	struct Entry
+	{
+		char name[max_name];
+		uint32_t type;
+		uint32_t bound_count;
+		// counter or gauge value, histogram sum
+		double value;
+		uint64_t count;
+		double bounds[max_bounds];
+		// cumulative like Prometheus', observations up to and including the bound
+		uint64_t buckets[max_bounds];
+	};
+
+	uint32_t magic;
+	uint32_t version;
+	std::atomic<uint64_t> sequence;
+	// of the last export, since the epoch of the system clock
+	uint64_t timestamp_us;
+	uint32_t entry_count;
+	uint32_t reserved;
+	Entry entries[max_entries];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared block needs an address-free sequence");
+
+class MetricsRegistry
+{
+public:
+	MetricsRegistry() = default;
+	MetricsRegistry(MetricsRegistry const&) = delete;
+	MetricsRegistry& operator=(MetricsRegistry const&) = delete;
+
+	// registering a name again returns the metric registered first, which has to be of the same type
+	Counter& counter(std::string const& name, std::string const& help)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& entry = entryFor(name, help, MetricsBlock::Type::Counter);
+		if (!entry.counter)
+			entry.counter = std::make_unique<Counter>();
+		return *entry.counter;
+	}
+
+	Gauge& gauge(std::string const& name, std::string const& help)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& entry = entryFor(name, help, MetricsBlock::Type::Gauge);
+		if (!entry.gauge)
+			entry.gauge = std::make_unique<Gauge>();
+		return *entry.gauge;
+	}
+
+	Histogram& histogram(std::string const& name, std::string const& help, std::vector<double> bounds)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& entry = entryFor(name, help, MetricsBlock::Type::Histogram);
+		if (!entry.histogram)
+			entry.histogram = std::make_unique<Histogram>(std::move(bounds));
+		return *entry.histogram;
+	}
+
+	// Prometheus text exposition format 0.0.4
+	void writePrometheus(std::ostream& out, std::string const& labels = {}) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const with = [&labels](std::string const& extra)
+		{
+			if (labels.empty() && extra.empty())
+				return std::string();
+			return "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+		};
+		out << std::setprecision(10);
+		for (auto const& entry : m_entries)
+		{
+			out << "# HELP " << entry->name << " " << entry->help << "\n";
+			switch (entry->type)
+			{
+			case MetricsBlock::Type::Counter:
+				out << "# TYPE " << entry->name << " counter\n";
+				out << entry->name << with({}) << " " << entry->counter->value() << "\n";
+				break;
+			case MetricsBlock::Type::Gauge:
+				out << "# TYPE " << entry->name << " gauge\n";
+				out << entry->name << with({}) << " " << entry->gauge->value() << "\n";
+				break;
+			case MetricsBlock::Type::Histogram:
+			{
+				auto const& histogram = *entry->histogram;
+				out << "# TYPE " << entry->name << " histogram\n";
+				uint64_t cumulative = 0;
+				for (size_t i = 0; i < histogram.bounds().size(); ++i)
+				{
+					cumulative += histogram.bucket(i);
+					std::ostringstream bound;
+					bound << std::setprecision(10) << histogram.bounds()[i];
+					out << entry->name << "_bucket" << with("le=\"" + bound.str() + "\"") << " " << cumulative << "\n";
+				}
+				// read last, so +Inf is at least the sum of the buckets
+				auto const count = std::max(histogram.count(), cumulative);
+				out << entry->name << "_bucket" << with("le=\"+Inf\"") << " " << count << "\n";
+				out << entry->name << "_sum" << with({}) << " " << histogram.sum() << "\n";
+				out << entry->name << "_count" << with({}) << " " << count << "\n";
+				break;
+			}
+			}
+		}
+	}
+
+	// the block is as large as MetricsBlock, metrics past max_entries and bounds past max_bounds are left out
+	void writeBlock(MetricsBlock& block) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const sequence = block.sequence.load(std::memory_order_relaxed);
+		block.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		block.magic = MetricsBlock::magic_value;
+		block.version = MetricsBlock::version_value;
+		block.timestamp_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+		block.entry_count = static_cast<uint32_t>(std::min<size_t>(m_entries.size(), MetricsBlock::max_entries));
+		for (uint32_t i = 0; i < block.entry_count; ++i)
+		{
+			auto const& entry = *m_entries[i];
+			auto& out = block.entries[i];
+			std::memset(&out, 0, sizeof(out));
+			std::strncpy(out.name, entry.name.c_str(), MetricsBlock::max_name - 1);
+			out.type = static_cast<uint32_t>(entry.type);
+			switch (entry.type)
+			{
+			case MetricsBlock::Type::Counter:
+				out.value = static_cast<double>(entry.counter->value());
+				out.count = entry.counter->value();
+				break;
+			case MetricsBlock::Type::Gauge:
+				out.value = entry.gauge->value();
+				break;
+			case MetricsBlock::Type::Histogram:
+			{
+				auto const& histogram = *entry.histogram;
+				out.bound_count = static_cast<uint32_t>(std::min<size_t>(histogram.bounds().size(), MetricsBlock::max_bounds));
+				uint64_t cumulative = 0;
+				for (uint32_t b = 0; b < out.bound_count; ++b)
+				{
+					cumulative += histogram.bucket(b);
+					out.bounds[b] = histogram.bounds()[b];
+					out.buckets[b] = cumulative;
+				}
+				out.value = histogram.sum();
+				out.count = std::max(histogram.count(), cumulative);
+				break;
+			}
+			}
+		}
+
+		block.sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+private:
+	struct Entry
+	{
+		std::string name;
+		std::string help;
+		MetricsBlock::Type type;
+		std::unique_ptr<Counter> counter;
+		std::unique_ptr<Gauge> gauge;
+		std::unique_ptr<Histogram> histogram;
+	};
+
+	Entry& entryFor(std::string const& name, std::string const& help, MetricsBlock::Type type)
+	{
+		for (auto& entry : m_entries)
+			if (entry->name == name)
+			{
+				if (entry->type != type)
+					throw std::runtime_error("Metric " + name + " is registered with another type");
+				return *entry;
+			}
+		auto entry = std::make_unique<Entry>();
+		entry->name = name;
+		entry->help = help;
+		entry->type = type;
+		m_entries.push_back(std::move(entry));
+		return *m_entries.back();
+	}
+
+	mutable std::mutex m_mutex;
+	// stable addresses, metrics are handed out by reference
+	std::vector<std::unique_ptr<Entry>> m_entries;
+};
+
+// Exports the registry every interval on its own thread, and a last time when stopped.
+class MetricsExporter
+{
+public:
+	MetricsExporter(MetricsRegistry const& registry, MetricsConfig config)
+		: m_registry(registry)
+		, m_config(std::move(config))
+	{
+		if (!m_config.shared_memory.empty())
+		{
+			// readers find the block anew after a restart, e.g. of a supervised render worker that was killed
+			SharedMemory::removeStale(m_config.shared_memory);
+			m_memory = SharedMemory::create(m_config.shared_memory, sizeof(MetricsBlock));
+			// zero filled by the OS, the sequence starts even
+			m_block = new (m_memory.data()) MetricsBlock;
+		}
+		m_thread = std::thread([this] { work(); });
+	}
+
+	~MetricsExporter()
+	{
+		stop();
+	}
+
+	MetricsExporter(MetricsExporter const&) = delete;
+	MetricsExporter& operator=(MetricsExporter const&) = delete;
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_stop)
+				return;
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+		exportOnce();
+	}
+
+private:
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop)
+		{
+			m_cv.wait_for(lock, m_config.interval);
+			if (!m_stop)
+				exportOnce();
+		}
+	}
+
+	void exportOnce()
+	{
+		if (m_block)
+			m_registry.writeBlock(*m_block);
+		if (m_config.prometheus_file.empty())
+			return;
+		// scrapers never see a half written file
+		auto tmp_path = m_config.prometheus_file;
+		tmp_path += ".tmp";
+		{
+			std::ofstream file(tmp_path, std::ios::trunc);
+			m_registry.writePrometheus(file, m_config.labels);
+			if (!file)
+			{
+				std::cerr << "Could not write metrics " << tmp_path.string() << std::endl;
+				return;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::rename(tmp_path, m_config.prometheus_file, ec);
+		if (ec)
+			std::cerr << "Could not replace metrics " << m_config.prometheus_file.string() << ": " << ec.message() << std::endl;
+	}
+
+	MetricsRegistry const& m_registry;
+	MetricsConfig m_config;
+	SharedMemory m_memory;
+	MetricsBlock* m_block = nullptr;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop = false;
+	std::thread m_thread;
+};
+
+// What the scene reports, registered on construction.
+struct SceneMetrics
+{
+	explicit SceneMetrics(MetricsRegistry& registry)
+		: frames(registry.counter("bugexample_frames_total", "Frames submitted"))
+		, frame_time(registry.histogram("bugexample_frame_time_seconds", "CPU time of a frame, from its start until it was presented",
+			frameBounds()))
+		, fence_wait(registry.histogram("bugexample_fence_wait_seconds", "Time a frame waited for the GPU to release its slot and images", frameBounds()))
+		, present_latency(registry.histogram("bugexample_present_latency_seconds",
+			"From the start of vkAcquireNextImageKHR until vkQueuePresentKHR returned", frameBounds()))
+		, input_latency(registry.histogram("bugexample_input_latency_seconds",
+			"From the oldest input event a frame consumed until vkQueuePresentKHR returned", frameBounds()))
+		, vram_usage(registry.gauge("bugexample_vram_usage_bytes", "Usage of the largest device-local heap"))
+		, vram_budget(registry.gauge("bugexample_vram_budget_bytes", "Budget of the largest device-local heap"))
+		, device_lost(registry.counter("bugexample_device_lost_total", "Device losses"))
+		, recoveries(registry.counter("bugexample_recoveries_total", "Device recoveries, failovers included"))
+		, failovers(registry.counter("bugexample_failovers_total", "Switch-overs to the standby device"))
+		, recovery_duration(registry.histogram("bugexample_recovery_duration_seconds",
+			"Time to rebuild the device objects after a device loss", { 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0 }))
+		, pipeline_requests(registry.counter("bugexample_pipeline_requests_total", "Pipeline states requested from the compiler"))
+		, pipeline_cache_hits(registry.counter("bugexample_pipeline_cache_hits_total",
+			"Pipeline states the compiler had built already"))
+		, hangs(registry.counter("bugexample_hangs_total", "Driver calls the watchdog found hanging"))
+		, errors(registry.counter("bugexample_errors_total", "Errors that ended rendering, device losses and hangs excluded"))
+		, window_system_errors(registry.counter("bugexample_window_system_errors_total", "Errors GLFW reported"))
+	{}
+
+	Counter& frames;
+	Histogram& frame_time;
+	Histogram& fence_wait;
+	Histogram& present_latency;
+	Histogram& input_latency;
+	Gauge& vram_usage;
+	Gauge& vram_budget;
+	Counter& device_lost;
+	Counter& recoveries;
+	Counter& failovers;
+	Histogram& recovery_duration;
+	Counter& pipeline_requests;
+	Counter& pipeline_cache_hits;
+	Counter& hangs;
+	Counter& errors;
+	Counter& window_system_errors;
+
+private:
+	// around the refresh intervals of common displays
+	static std::vector<double> frameBounds()
+	{
+		return { 0.001, 0.002, 0.004, 0.007, 0.0085, 0.0115, 0.017, 0.025, 0.034, 0.05, 0.1, 0.25 };
+	}
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "device_group.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <vector>
+
+// Ring of color images that stands in for the swapchain when rendering headless. Images are handed out
+// round robin and left in eTransferSrcOptimal by the render pass; with readback enabled every image gets
+// a host-visible buffer the frame copies its image into.
+class OffscreenTarget
+{
+public:
+	OffscreenTarget(vk::Device device, DeviceAllocator& allocator, vk::Format format, vk::Extent2D extent,
+		uint32_t image_count, bool readback)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_format(format)
+		, m_extent(extent)
+	{
+		vk::ImageCreateInfo img_ci{};
+		img_ci.imageType = vk::ImageType::e2D;
+		img_ci.format = format;
+		img_ci.extent = vk::Extent3D{ extent.width, extent.height, 1 };
+		img_ci.mipLevels = 1;
+		img_ci.arrayLayers = 1;
+		img_ci.samples = vk::SampleCountFlagBits::e1;
+		img_ci.tiling = vk::ImageTiling::eOptimal;
+		img_ci.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+		img_ci.sharingMode = vk::SharingMode::eExclusive;
+		img_ci.initialLayout = vk::ImageLayout::eUndefined;
+
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = vk::DeviceSize(extent.width) * extent.height * bytesPerPixel(format);
+		buf_ci.usage = vk::BufferUsageFlagBits::eTransferDst;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+
+		m_targets.resize(image_count);
+		for (auto& target : m_targets)
+		{
+			target.image = device.createImage(img_ci);
+			target.image_memory = allocator.allocateFor(target.image, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+			m_images.push_back(target.image);
+			if (!readback)
+				continue;
+
+			target.readback = device.createBuffer(buf_ci);
+			auto const host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+			target.readback_memory = allocator.allocateFor(target.readback, host_flags | vk::MemoryPropertyFlagBits::eHostCached, host_flags, AllocationStrategy::Linear);
+		}
+	}
+
+	~OffscreenTarget()
+	{
+		for (auto const& target : m_targets)
+		{
+			m_device.destroyImage(target.image);
+			m_allocator.free(target.image_memory);
+			if (target.readback)
+			{
+				m_device.destroyBuffer(target.readback);
+				m_allocator.free(target.readback_memory);
+			}
+		}
+	}
+
+	OffscreenTarget(OffscreenTarget const&) = delete;
+	OffscreenTarget& operator=(OffscreenTarget const&) = delete;
+
+	std::vector<vk::Image> const& images() const { return m_images; }
+	vk::Format format() const { return m_format; }
+	vk::Extent2D extent() const { return m_extent; }
+	bool readbackEnabled() const { return !m_targets.empty() && m_targets.front().readback; }
+
+	// the image acquire() returns next, the one rendered longest ago
+	uint32_t nextIndex() const { return m_next; }
+
+	uint32_t acquire()
+	{
+		auto const index = m_next;
+		m_next = (m_next + 1) % static_cast<uint32_t>(m_targets.size());
+		return index;
+	}
+
+	// records the copy into the image's readback buffer, the render pass must have ended; with split-frame
+	// device areas every device copies its own
+	void recordReadback(vk::CommandBuffer cmd, uint32_t index, std::vector<vk::Rect2D> const& device_areas = {})
+	{
+		auto& target = m_targets[index];
+		if (!target.readback)
+			return;
+
+		copyImageBands(cmd, target.image, target.readback, m_extent, m_extent.width * bytesPerPixel(m_format), device_areas);
+
+		vk::BufferMemoryBarrier barrier{};
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		barrier.buffer = target.readback;
+		barrier.size = VK_WHOLE_SIZE;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, barrier, nullptr);
+		target.pending = true;
+	}
+
+	// pixels of the last frame that rendered the image, the caller must have waited for that frame's fence
+	void const* takeReadback(uint32_t index)
+	{
+		auto& target = m_targets[index];
+		if (!target.pending)
+			return nullptr;
+		target.pending = false;
+		return target.readback_memory.mapped;
+	}
+
+private:
+	struct Target
+	{
+		vk::Image image;
+		Allocation image_memory;
+		vk::Buffer readback;
+		Allocation readback_memory;
+		bool pending = false;
+	};
+
+	static uint32_t bytesPerPixel(vk::Format format)
+	{
+		switch (format)
+		{
+		case vk::Format::eR16G16B16A16Sfloat: return 8;
+		case vk::Format::eR32G32B32A32Sfloat: return 16;
+		default: return 4;
+		}
+	}
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	vk::Format m_format;
+	vk::Extent2D m_extent;
+	std::vector<Target> m_targets;
+	std::vector<vk::Image> m_images;
+	uint32_t m_next = 0;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+
+// Records secondary command buffers on the thread pool. Every (frame, worker) pair owns a transient
+// command pool, so workers never share a pool and a whole frame's buffers are recycled with one reset.
+class ParallelRecorder
+{
+public:
+	using Task = std::function<void(vk::CommandBuffer cmd)>;
+
+	ParallelRecorder(vk::Device device, uint32_t queue_family, uint32_t frames_in_flight, ThreadPool& pool)
+		: m_device(device)
+		, m_pool(pool)
+	{
+		vk::CommandPoolCreateInfo cmd_pool_ci{};
+		cmd_pool_ci.queueFamilyIndex = queue_family;
+		cmd_pool_ci.flags = vk::CommandPoolCreateFlagBits::eTransient;
+
+		m_frames.resize(frames_in_flight);
+		for (auto& frame : m_frames)
+		{
+			frame.resize(pool.size());
+			for (auto& worker : frame)
+				worker.pool = device.createCommandPoolUnique(cmd_pool_ci);
+		}
+	}
+
+	// the pool is shared, only the recorder's own tasks are waited for
+	~ParallelRecorder()
+	{
+		waitForTasks();
+	}
+
+	ParallelRecorder(ParallelRecorder const&) = delete;
+	ParallelRecorder& operator=(ParallelRecorder const&) = delete;
+
+	// the frame's fence must have signaled, all of its secondaries are reset at once
+	void beginFrame(uint32_t frame_index)
+	{
+		m_frame_index = frame_index;
+		for (auto& worker : m_frames[frame_index])
+		{
+			m_device.resetCommandPool(*worker.pool, {});
+			worker.used = 0;
+		}
+	}
+
+	// records every task into its own secondary buffer, returned in task order
+	std::vector<vk::CommandBuffer> record(vk::CommandBufferInheritanceInfo const& inheritance, std::vector<Task> const& tasks)
+	{
+		std::vector<std::future<vk::CommandBuffer>> pending;
+		pending.reserve(tasks.size());
+		for (auto const& task : tasks)
+		{
+			pending.push_back(submit([this, inheritance, &task](uint32_t worker)
+			{
+				auto const cmd = acquire(m_frames[m_frame_index][worker]);
+
+				vk::CommandBufferBeginInfo begin_info{};
+				begin_info.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+				begin_info.pInheritanceInfo = &inheritance;
+
+				cmd.begin(begin_info);
+				task(cmd);
+				cmd.end();
+				return cmd;
+			}));
+		}
+
+		// every task finishes before a failure propagates, they reference inheritance and the tasks of the caller
+		for (auto const& cmd : pending)
+			cmd.wait();
+
+		std::vector<vk::CommandBuffer> cmds;
+		cmds.reserve(pending.size());
+		for (auto& cmd : pending)
+			cmds.push_back(cmd.get());
+		return cmds;
+	}
+
+private:
+	// counts the task as the recorder's until it finished, also when it threw
+	template<typename F>
+	auto submit(F&& f) -> std::future<decltype(f(uint32_t{}))>
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_tasks_mutex);
+			++m_outstanding;
+		}
+		return m_pool.submit([this, f = std::forward<F>(f)](uint32_t worker) mutable
+		{
+			struct Done
+			{
+				ParallelRecorder& recorder;
+				~Done() { recorder.taskDone(); }
+			} const done{ *this };
+			return f(worker);
+		});
+	}
+
+	void taskDone()
+	{
+		std::lock_guard<std::mutex> lock(m_tasks_mutex);
+		if (--m_outstanding == 0)
+			m_tasks_done.notify_all();
+	}
+
+	void waitForTasks()
+	{
+		std::unique_lock<std::mutex> lock(m_tasks_mutex);
+		m_tasks_done.wait(lock, [this] { return m_outstanding == 0; });
+	}
+
+	struct WorkerPool
+	{
+		vk::UniqueCommandPool pool;
+		std::vector<vk::CommandBuffer> buffers;
+		size_t used = 0;
+	};
+
+	vk::CommandBuffer acquire(WorkerPool& worker)
+	{
+		if (worker.used == worker.buffers.size())
+		{
+			vk::CommandBufferAllocateInfo cmd_b_ai{};
+			cmd_b_ai.commandPool = *worker.pool;
+			cmd_b_ai.commandBufferCount = 1;
+			cmd_b_ai.level = vk::CommandBufferLevel::eSecondary;
+			worker.buffers.push_back(m_device.allocateCommandBuffers(cmd_b_ai).front());
+		}
+		return worker.buffers[worker.used++];
+	}
+
+	vk::Device m_device;
+	ThreadPool& m_pool;
+	std::vector<std::vector<WorkerPool>> m_frames;
+	uint32_t m_frame_index = 0;
+
+	std::mutex m_tasks_mutex;
+	std::condition_variable m_tasks_done;
+	uint32_t m_outstanding = 0;
+};
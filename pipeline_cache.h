@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Pipeline cache persisted per device in <directory>/pipeline_cache_<vendor>_<device>_<uuid>.bin.
+// The last known cache contents are kept in memory, so a cache recreated after a device loss
+// starts warm even though the lost device can no longer be queried.
+class PipelineCache
+{
+public:
+	// warm is a cache object created ahead from initialData(), e.g. by a standby device, and taken as it is
+	void create(vk::Device device, vk::PhysicalDeviceProperties const& props, std::filesystem::path const& directory,
+		vk::UniquePipelineCache warm = {})
+	{
+		m_device = device;
+		m_path = directory / fileName(props);
+
+		if (!isCompatible(m_data, props))
+			m_data = readFile(m_path);
+		if (!isCompatible(m_data, props))
+			m_data.clear();
+
+		if (warm)
+		{
+			m_cache = std::move(warm);
+			return;
+		}
+		vk::PipelineCacheCreateInfo pc_ci{};
+		pc_ci.initialDataSize = m_data.size();
+		pc_ci.pInitialData = m_data.empty() ? nullptr : m_data.data();
+		m_cache = device.createPipelineCacheUnique(pc_ci);
+	}
+
+	// drops the device object, the in-memory contents survive for the next create()
+	void destroy()
+	{
+		m_cache.reset();
+		m_device = nullptr;
+	}
+
+	// what create() would start a cache of a device with props from: the in-memory contents if they are the
+	// device's, else its file; not while create() or snapshot() run
+	std::vector<uint8_t> initialData(vk::PhysicalDeviceProperties const& props, std::filesystem::path const& directory) const
+	{
+		if (isCompatible(m_data, props))
+			return m_data;
+		auto data = readFile(directory / fileName(props));
+		if (!isCompatible(data, props))
+			data.clear();
+		return data;
+	}
+
+	vk::PipelineCache get() const { return *m_cache; }
+	bool loadedWarm() const { return !m_data.empty(); }
+	std::vector<uint8_t> const& data() const { return m_data; }
+
+	void merge(vk::ArrayProxy<const vk::PipelineCache> caches)
+	{
+		if (caches.size() != 0)
+			m_device.mergePipelineCaches(*m_cache, caches);
+	}
+
+	// refreshes the in-memory copy, only valid while the device is healthy
+	void snapshot()
+	{
+		if (m_cache)
+			m_data = m_device.getPipelineCacheData(*m_cache);
+	}
+
+	// writes to a temporary file and renames it over the old one so a crash never leaves a torn cache
+	void save() const
+	{
+		if (m_data.empty() || m_path.empty())
+			return;
+
+		auto tmp_path = m_path;
+		tmp_path += ".tmp";
+		{
+			std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<char const*>(m_data.data()), static_cast<std::streamsize>(m_data.size()));
+			if (!file)
+			{
+				std::cerr << "Could not write pipeline cache " << tmp_path.string() << std::endl;
+				return;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::rename(tmp_path, m_path, ec);
+		if (ec)
+			std::cerr << "Could not replace pipeline cache " << m_path.string() << ": " << ec.message() << std::endl;
+	}
+
+private:
+	static std::string fileName(vk::PhysicalDeviceProperties const& props)
+	{
+		std::ostringstream name;
+		name << "pipeline_cache_" << std::hex << std::setfill('0')
+			<< std::setw(4) << props.vendorID << "_" << std::setw(4) << props.deviceID << "_";
+		for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+			name << std::setw(2) << static_cast<uint32_t>(props.pipelineCacheUUID[i]);
+		name << ".bin";
+		return name.str();
+	}
+
+	static std::vector<uint8_t> readFile(std::filesystem::path const& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return {};
+		std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		if (!file)
+			return {};
+		return data;
+	}
+
+	// VkPipelineCacheHeaderVersionOne: length, version, vendorID, deviceID, pipelineCacheUUID
+	static bool isCompatible(std::vector<uint8_t> const& data, vk::PhysicalDeviceProperties const& props)
+	{
+		constexpr size_t header_size = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+		if (data.size() < header_size)
+			return false;
+
+		uint32_t header[4];
+		std::memcpy(header, data.data(), sizeof(header));
+		return header[0] >= header_size && header[0] <= data.size()
+			&& header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			&& header[2] == props.vendorID
+			&& header[3] == props.deviceID
+			&& std::memcmp(data.data() + sizeof(header), &props.pipelineCacheUUID[0], VK_UUID_SIZE) == 0;
+	}
+
+	vk::Device m_device;
+	std::filesystem::path m_path;
+	std::vector<uint8_t> m_data;
+	vk::UniquePipelineCache m_cache;
+};
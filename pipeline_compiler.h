@@ -0,0 +1,196 @@
+#pragma once
+
+#include "metrics.h"
+#include "pipeline_cache.h"
+#include "specialization.h"
+#include "spirv.h"
+#include "state_key.h"
+#include "thread_pool.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+inline vk::UniquePipeline createComputePipeline(vk::Device device, vk::PipelineCache cache, vk::PipelineLayout layout, SpirvView spv,
+	vk::Optional<const vk::AllocationCallbacks> allocator = nullptr, SpecializationConstants const& constants = {})
+{
+	if (!spv.valid())
+		throw std::runtime_error("Compute shader code is not SPIR-V!");
+	auto const module = device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{}.setCodeSize(spv.sizeBytes()).setPCode(spv.data()), allocator);
+
+	vk::ComputePipelineCreateInfo cp_ci{};
+	cp_ci.stage.stage = vk::ShaderStageFlagBits::eCompute;
+	cp_ci.stage.module = *module;
+	cp_ci.stage.pName = "main";
+	auto const specialization = constants.info();
+	cp_ci.stage.pSpecializationInfo = constants.empty() ? nullptr : &specialization;
+	cp_ci.layout = layout;
+	return device.createComputePipelineUnique(cache, cp_ci, allocator).value;
+}
+
+// Builds pipelines on the thread pool. Every worker compiles into its own VkPipelineCache, seeded from the
+// persistent cache, so workers never contend on one cache; mergeInto() folds them back afterwards.
+// compileCached() builds every distinct pipeline state once and keeps the pipeline until the compiler goes,
+// callers asking for a state again (e.g. a shader reverted during reloading) get it back right away.
+// Jobs create their modules and pipelines with the compiler's host allocation callbacks, as are the worker caches.
+class PipelineCompiler
+{
+public:
+	// a job creates its own shader modules and create infos, it runs after the caller's stack is gone
+	using Job = std::function<vk::UniquePipeline(vk::Device device, vk::PipelineCache cache, vk::Optional<const vk::AllocationCallbacks> allocator)>;
+
+	// allocator: null for the driver's own, has to outlive the compiler and its pipelines
+	PipelineCompiler(vk::Device device, ThreadPool& pool, PipelineCache const& seed, vk::AllocationCallbacks const* allocator = nullptr)
+		: m_device(device)
+		, m_pool(pool)
+		, m_allocator(allocator)
+	{
+		auto const& data = seed.data();
+		vk::PipelineCacheCreateInfo pc_ci{};
+		pc_ci.initialDataSize = data.size();
+		pc_ci.pInitialData = data.empty() ? nullptr : data.data();
+		for (uint32_t i = 0; i < pool.size(); ++i)
+			m_worker_caches.push_back(device.createPipelineCacheUnique(pc_ci, m_allocator));
+	}
+
+	~PipelineCompiler()
+	{
+		// outstanding jobs still use the worker caches
+		waitForJobs();
+	}
+
+	PipelineCompiler(PipelineCompiler const&) = delete;
+	PipelineCompiler& operator=(PipelineCompiler const&) = delete;
+
+	std::future<vk::UniquePipeline> compile(Job job)
+	{
+		return submit([this, job = std::move(job)](uint32_t worker)
+		{
+			return job(m_device, *m_worker_caches[worker], m_allocator);
+		});
+	}
+
+	// key has to cover everything job puts into the pipeline, handles included; failed builds stay failed
+	std::shared_future<vk::Pipeline> compileCached(StateKey const& key, Job job)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& entry = m_pipelines[key];
+		if (m_requests_counter)
+			m_requests_counter->add();
+		if (entry.pipeline.valid())
+		{
+			++m_hits;
+			if (m_hits_counter)
+				m_hits_counter->add();
+			return entry.pipeline;
+		}
+		entry.owned = std::make_shared<vk::UniquePipeline>();
+		entry.pipeline = submit([this, owned = entry.owned, job = std::move(job)](uint32_t worker)
+		{
+			*owned = job(m_device, *m_worker_caches[worker], m_allocator);
+			return **owned;
+		}).share();
+		return entry.pipeline;
+	}
+
+	// pipelines compileCached() built and requests it answered from them
+	size_t cachedCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_pipelines.size();
+	}
+	uint64_t cacheHits() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_hits;
+	}
+
+	// every compileCached() call from now on counts into requests, those answered from a built state also into hits;
+	// the counters have to outlive the compiler
+	void countInto(Counter* requests, Counter* hits)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests_counter = requests;
+		m_hits_counter = hits;
+	}
+
+	// spv must stay alive until the pipeline is built, embedded shaders always are
+	std::future<vk::UniquePipeline> compileCompute(vk::PipelineLayout layout, SpirvView spv, SpecializationConstants constants = {})
+	{
+		return compile([layout, spv, constants = std::move(constants)](vk::Device device, vk::PipelineCache cache, vk::Optional<const vk::AllocationCallbacks> allocator)
+		{
+			return createComputePipeline(device, cache, layout, spv, allocator, constants);
+		});
+	}
+
+	// merges the worker caches into cache without waiting: what finished jobs put there is folded in, jobs still
+	// compiling (e.g. a link time optimized build) add theirs with a later merge; pipeline caches are internally synchronized
+	void mergeInto(PipelineCache& cache)
+	{
+		std::vector<vk::PipelineCache> srcs;
+		for (auto const& worker_cache : m_worker_caches)
+			srcs.push_back(*worker_cache);
+		cache.merge(srcs);
+		cache.snapshot();
+	}
+
+private:
+	// counts the job as the compiler's until it finished, also when it threw
+	template<typename F>
+	auto submit(F&& f) -> std::future<decltype(f(uint32_t{}))>
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_jobs_mutex);
+			++m_outstanding;
+		}
+		return m_pool.submit([this, f = std::forward<F>(f)](uint32_t worker) mutable
+		{
+			struct Done
+			{
+				PipelineCompiler& compiler;
+				~Done() { compiler.jobDone(); }
+			} const done{ *this };
+			return f(worker);
+		});
+	}
+
+	void jobDone()
+	{
+		std::lock_guard<std::mutex> lock(m_jobs_mutex);
+		if (--m_outstanding == 0)
+			m_jobs_done.notify_all();
+	}
+
+	void waitForJobs()
+	{
+		std::unique_lock<std::mutex> lock(m_jobs_mutex);
+		m_jobs_done.wait(lock, [this] { return m_outstanding == 0; });
+	}
+
+	struct Entry
+	{
+		std::shared_future<vk::Pipeline> pipeline;
+		// written by the job, read once the future is ready
+		std::shared_ptr<vk::UniquePipeline> owned;
+	};
+
+	vk::Device m_device;
+	ThreadPool& m_pool;
+	vk::AllocationCallbacks const* m_allocator;
+	std::vector<vk::UniquePipelineCache> m_worker_caches;
+	mutable std::mutex m_mutex;
+	std::unordered_map<StateKey, Entry, StateKey::Hash> m_pipelines;
+	uint64_t m_hits = 0;
+	Counter* m_requests_counter = nullptr;
+	Counter* m_hits_counter = nullptr;
+	std::mutex m_jobs_mutex;
+	std::condition_variable m_jobs_done;
+	uint32_t m_outstanding = 0;
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "pipeline_compiler.h"
+#include "render_graph.h"
+#include "shader_reflection.h"
+#include "specialization.h"
+#include "spirv.h"
+#include "state_key.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+// One graphics pipeline state, grouped into the four parts VK_EXT_graphics_pipeline_library compiles on their own.
+struct GraphicsPipelineState
+{
+	// vertex input interface
+	ReflectedVertexInput vertex_input;
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+	// pre-rasterization shaders
+	SpirvView vertex_shader;
+	SpecializationConstants vertex_constants;
+	vk::CullModeFlags cull_mode = vk::CullModeFlagBits::eNone;
+	vk::FrontFace front_face = vk::FrontFace::eCounterClockwise;
+	// fragment shader
+	SpirvView fragment_shader;
+	SpecializationConstants fragment_constants;
+	bool depth_test = true;
+	bool depth_write = true;
+	vk::CompareOp depth_compare = vk::CompareOp::eLessOrEqual;
+	// fragment output interface
+	RenderGraph::RenderingFormats formats;
+	bool alpha_blend = false;
+
+	// shared by the shader parts
+	vk::PipelineLayout layout;
+	// the pass the pipeline is used in, by its formats with VK_KHR_dynamic_rendering
+	vk::RenderPass render_pass;
+	uint32_t subpass = 0;
+	bool dynamic_rendering = false;
+	// cull mode, front face and topology are set while recording too
+	bool extended_dynamic_state = false;
+	// keeps the shader code alive until the pipeline is built, null for embedded shaders
+	std::shared_ptr<void const> code;
+};
+
+// Builds the variants of graphics pipelines on the pipeline compiler. With VK_EXT_graphics_pipeline_library every
+// part is compiled once into a library and shared by all states that have it, a state whose parts all exist is
+// only a fast link; optimize() links the same libraries with link time optimization for replacing the fast
+// linked pipeline later. Without the extension the first state compiled is the base pipeline of all later ones,
+// which are created as its derivatives.
+// Jobs wait for the parts and the base pipeline they use, which the thread pool started before them.
+class GraphicsPipelineBuilder
+{
+public:
+	// libraries: VK_EXT_graphics_pipeline_library is enabled with its graphicsPipelineLibrary feature
+	GraphicsPipelineBuilder(PipelineCompiler& compiler, bool libraries)
+		: m_compiler(compiler)
+#ifdef VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+		, m_libraries(libraries)
+#endif
+	{
+		static_cast<void>(libraries);
+	}
+
+	GraphicsPipelineBuilder(GraphicsPipelineBuilder const&) = delete;
+	GraphicsPipelineBuilder& operator=(GraphicsPipelineBuilder const&) = delete;
+
+	bool libraries() const { return m_libraries; }
+
+	// built once per distinct state, as every part of it
+	std::shared_future<vk::Pipeline> build(GraphicsPipelineState const& state)
+	{
+#ifdef VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+		if (m_libraries)
+			return link(state, {});
+#endif
+		return derive(state);
+	}
+
+	// the link time optimized pipeline of the state, invalid without libraries where build() already is one
+	std::shared_future<vk::Pipeline> optimize(GraphicsPipelineState const& state)
+	{
+#ifdef VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+		if (m_libraries)
+			return link(state, vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT);
+#endif
+		static_cast<void>(state);
+		return {};
+	}
+
+private:
+	enum Part : uint32_t
+	{
+		VertexInput = 1,
+		PreRasterization = 2,
+		FragmentShader = 4,
+		FragmentOutput = 8,
+		AllParts = 15
+	};
+
+	// what build() and optimize() key on besides the state
+	enum Kind : uint32_t
+	{
+		Library,
+		FastLink,
+		OptimizedLink,
+		Derivative
+	};
+
+	static void addKey(StateKey& key, GraphicsPipelineState const& state, uint32_t parts)
+	{
+		key.add(parts);
+		if (parts & VertexInput)
+		{
+			for (auto const& binding : state.vertex_input.bindings)
+				key.add(binding.binding).add(binding.stride).add(binding.inputRate);
+			for (auto const& attribute : state.vertex_input.attributes)
+				key.add(attribute.location).add(attribute.binding).add(attribute.format).add(attribute.offset);
+			key.add(state.topology);
+		}
+		if (parts & PreRasterization)
+		{
+			key.addBytes(state.vertex_shader.data(), state.vertex_shader.sizeBytes()).add(state.cull_mode).add(state.front_face);
+			state.vertex_constants.addKey(key);
+		}
+		if (parts & FragmentShader)
+		{
+			key.addBytes(state.fragment_shader.data(), state.fragment_shader.sizeBytes()).add(state.depth_test).add(state.depth_write).add(state.depth_compare);
+			state.fragment_constants.addKey(key);
+		}
+		if (parts & FragmentOutput)
+		{
+			key.add(state.formats.colors.size());
+			for (auto const format : state.formats.colors)
+				key.add(format);
+			key.add(state.formats.depth).add(state.formats.stencil).add(state.alpha_blend);
+		}
+		// the parts are compiled against the pass and with their dynamic state
+		key.add(state.formats.samples).add(state.layout).add(state.render_pass).add(state.subpass).add(state.dynamic_rendering).add(state.extended_dynamic_state);
+	}
+
+	static vk::UniqueShaderModule createModule(vk::Device device, SpirvView spv, vk::Optional<const vk::AllocationCallbacks> allocator)
+	{
+		if (!spv.valid())
+			throw std::runtime_error("Shader code is not SPIR-V!");
+		return device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{}.setCodeSize(spv.sizeBytes()).setPCode(spv.data()), allocator);
+	}
+
+	// the parts of the state in one pipeline or library, none for a pipeline linked from libraries in next
+	static vk::UniquePipeline create(vk::Device device, vk::PipelineCache cache, vk::Optional<const vk::AllocationCallbacks> allocator,
+		GraphicsPipelineState const& state, uint32_t parts, vk::PipelineCreateFlags flags, void const* next = nullptr, vk::Pipeline base = {})
+	{
+		auto const vt_inp_ci = state.vertex_input.createInfo();
+
+		vk::PipelineInputAssemblyStateCreateInfo as_ci{};
+		as_ci.topology = state.topology;
+
+		// set while recording, so resizes never touch the pipeline
+		vk::PipelineViewportStateCreateInfo vps_ci{};
+		vps_ci.viewportCount = 1;
+		vps_ci.scissorCount = 1;
+
+		vk::PipelineRasterizationStateCreateInfo rss_ci{};
+		rss_ci.cullMode = state.cull_mode;
+		rss_ci.frontFace = state.front_face;
+		rss_ci.polygonMode = vk::PolygonMode::eFill;
+		rss_ci.lineWidth = 1.0f;
+
+		vk::PipelineDepthStencilStateCreateInfo dss_ci{};
+		dss_ci.depthTestEnable = state.depth_test;
+		dss_ci.depthWriteEnable = state.depth_write;
+		dss_ci.depthCompareOp = state.depth_compare;
+
+		vk::PipelineMultisampleStateCreateInfo mss_ci{};
+		mss_ci.rasterizationSamples = state.formats.samples;
+
+		vk::PipelineColorBlendAttachmentState cbas_ci{};
+		cbas_ci.colorWriteMask = static_cast<vk::ColorComponentFlags>(0xf);
+		if (state.alpha_blend)
+		{
+			cbas_ci.blendEnable = true;
+			cbas_ci.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+			cbas_ci.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+			cbas_ci.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+			cbas_ci.dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+		}
+		vk::PipelineColorBlendStateCreateInfo cbs_ci{};
+		cbs_ci.attachmentCount = 1;
+		cbs_ci.pAttachments = &cbas_ci;
+
+		// the extended ones last, they are only set with VK_EXT_extended_dynamic_state
+		const std::array<vk::DynamicState, 5> dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor,
+			vk::DynamicState::eCullModeEXT, vk::DynamicState::eFrontFaceEXT, vk::DynamicState::ePrimitiveTopologyEXT };
+		vk::PipelineDynamicStateCreateInfo ds_ci{};
+		ds_ci.dynamicStateCount = state.extended_dynamic_state ? 5 : 2;
+		ds_ci.pDynamicStates = dynamic_states.data();
+
+		// modules are only needed until the pipeline is created
+		vk::UniqueShaderModule vert_shader, frag_shader;
+		std::array<vk::PipelineShaderStageCreateInfo, 2> sh_stages{};
+		uint32_t stage_count = 0;
+		auto const vert_constants = state.vertex_constants.info();
+		auto const frag_constants = state.fragment_constants.info();
+		if (parts & PreRasterization)
+		{
+			vert_shader = createModule(device, state.vertex_shader, allocator);
+			sh_stages[stage_count].pName = "main";
+			sh_stages[stage_count].module = *vert_shader;
+			sh_stages[stage_count].pSpecializationInfo = state.vertex_constants.empty() ? nullptr : &vert_constants;
+			sh_stages[stage_count++].stage = vk::ShaderStageFlagBits::eVertex;
+		}
+		if (parts & FragmentShader)
+		{
+			frag_shader = createModule(device, state.fragment_shader, allocator);
+			sh_stages[stage_count].pName = "main";
+			sh_stages[stage_count].module = *frag_shader;
+			sh_stages[stage_count].pSpecializationInfo = state.fragment_constants.empty() ? nullptr : &frag_constants;
+			sh_stages[stage_count++].stage = vk::ShaderStageFlagBits::eFragment;
+		}
+
+		vk::PipelineRenderingCreateInfoKHR rendering_ci{};
+		rendering_ci.pNext = next;
+		rendering_ci.colorAttachmentCount = static_cast<uint32_t>(state.formats.colors.size());
+		rendering_ci.pColorAttachmentFormats = state.formats.colors.data();
+		rendering_ci.depthAttachmentFormat = state.formats.depth;
+		rendering_ci.stencilAttachmentFormat = state.formats.stencil;
+
+		// every part ignores the state of the others
+		vk::GraphicsPipelineCreateInfo gp_ci{};
+		gp_ci.pNext = state.dynamic_rendering ? &rendering_ci : next;
+		gp_ci.flags = flags;
+		if (parts & VertexInput)
+		{
+			gp_ci.pVertexInputState = &vt_inp_ci;
+			gp_ci.pInputAssemblyState = &as_ci;
+		}
+		if (parts & PreRasterization)
+		{
+			gp_ci.pViewportState = &vps_ci;
+			gp_ci.pRasterizationState = &rss_ci;
+		}
+		if (parts & FragmentShader)
+			gp_ci.pDepthStencilState = &dss_ci;
+		if (parts & (FragmentShader | FragmentOutput))
+			gp_ci.pMultisampleState = &mss_ci;
+		if (parts & FragmentOutput)
+			gp_ci.pColorBlendState = &cbs_ci;
+		if (parts != 0)
+			gp_ci.pDynamicState = &ds_ci;
+		gp_ci.stageCount = stage_count;
+		gp_ci.pStages = sh_stages.data();
+		gp_ci.layout = state.layout;
+		gp_ci.renderPass = state.render_pass;
+		gp_ci.subpass = state.subpass;
+		gp_ci.basePipelineHandle = base;
+		gp_ci.basePipelineIndex = -1;
+		return device.createGraphicsPipelineUnique(cache, gp_ci, allocator).value;
+	}
+
+#ifdef VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+	std::shared_future<vk::Pipeline> part(GraphicsPipelineState const& state, Part part)
+	{
+		StateKey key;
+		key.add(Library);
+		addKey(key, state, part);
+		return m_compiler.compileCached(key, [state, part](vk::Device device, vk::PipelineCache cache, vk::Optional<const vk::AllocationCallbacks> allocator)
+		{
+			vk::GraphicsPipelineLibraryCreateInfoEXT library_ci{};
+			library_ci.flags = part == VertexInput ? vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface
+				: part == PreRasterization ? vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders
+				: part == FragmentShader ? vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader
+				: vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface;
+			// kept for optimize(), which links them again
+			return create(device, cache, allocator, state, part,
+				vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT, &library_ci);
+		});
+	}
+
+	std::shared_future<vk::Pipeline> link(GraphicsPipelineState const& state, vk::PipelineCreateFlags flags)
+	{
+		const std::array<std::shared_future<vk::Pipeline>, 4> parts = {
+			part(state, VertexInput), part(state, PreRasterization), part(state, FragmentShader), part(state, FragmentOutput) };
+		StateKey key;
+		key.add(flags ? OptimizedLink : FastLink);
+		addKey(key, state, AllParts);
+		return m_compiler.compileCached(key, [state, parts, flags](vk::Device device, vk::PipelineCache cache, vk::Optional<const vk::AllocationCallbacks> allocator)
+		{
+			std::array<vk::Pipeline, 4> libraries;
+			for (size_t i = 0; i < parts.size(); ++i)
+				libraries[i] = parts[i].get();
+			vk::PipelineLibraryCreateInfoKHR link_ci{};
+			link_ci.libraryCount = static_cast<uint32_t>(libraries.size());
+			link_ci.pLibraries = libraries.data();
+			return create(device, cache, allocator, state, 0, flags, &link_ci);
+		});
+	}
+#endif
+
+	std::shared_future<vk::Pipeline> derive(GraphicsPipelineState const& state)
+	{
+		StateKey key;
+		key.add(Derivative);
+		addKey(key, state, AllParts);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const base = m_base;
+		auto pipeline = m_compiler.compileCached(key, [state, base](vk::Device device, vk::PipelineCache cache, vk::Optional<const vk::AllocationCallbacks> allocator)
+		{
+			// a base that failed to build leaves a plain pipeline
+			vk::Pipeline base_pipeline;
+			if (base.valid())
+			{
+				try
+				{
+					base_pipeline = base.get();
+				}
+				catch (std::exception const&)
+				{
+				}
+			}
+			auto const flags = base_pipeline ? vk::PipelineCreateFlagBits::eAllowDerivatives | vk::PipelineCreateFlagBits::eDerivative
+				: vk::PipelineCreateFlags(vk::PipelineCreateFlagBits::eAllowDerivatives);
+			return create(device, cache, allocator, state, AllParts, flags, nullptr, base_pipeline);
+		});
+		if (!m_base.valid())
+			m_base = pipeline;
+		return pipeline;
+	}
+
+	PipelineCompiler& m_compiler;
+	bool m_libraries = false;
+	std::mutex m_mutex;
+	// the first pipeline derive() built, the base of all others
+	std::shared_future<vk::Pipeline> m_base;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Presents the images of several swapchains with one vkQueuePresentKHR. Each swapchain gets its own result,
+// so a window that went out of date or suboptimal is recreated without affecting the others.
+class PresentBatch
+{
+public:
+	void clear()
+	{
+		m_swapchains.clear();
+		m_image_indices.clear();
+		m_wait_semaphores.clear();
+		m_present_ids.clear();
+		m_device_masks.clear();
+		m_results.clear();
+	}
+
+	// wait is signaled by the submission that rendered the image; a nonzero present_id, which needs
+	// VK_KHR_present_id, can be waited for with vkWaitForPresentKHR. On a device group a nonzero device_mask
+	// selects the instances of the image that are shown, in the batch's device group mode.
+	void add(vk::SwapchainKHR swapchain, uint32_t image_index, vk::Semaphore wait, uint64_t present_id = 0, uint32_t device_mask = 0)
+	{
+		m_swapchains.push_back(swapchain);
+		m_image_indices.push_back(image_index);
+		m_wait_semaphores.push_back(wait);
+		m_present_ids.push_back(present_id);
+		m_device_masks.push_back(device_mask);
+	}
+
+	// one for every swapchain of the call
+	void setDeviceGroupMode(vk::DeviceGroupPresentModeFlagBitsKHR mode) { m_device_group_mode = mode; }
+
+	bool empty() const { return m_swapchains.empty(); }
+	size_t size() const { return m_swapchains.size(); }
+
+	// results in add() order; out of date swapchains are reported there instead of thrown
+	std::vector<vk::Result> const& present(vk::Queue queue)
+	{
+		m_results.assign(m_swapchains.size(), vk::Result::eSuccess);
+		if (m_swapchains.empty())
+			return m_results;
+
+		vk::PresentInfoKHR present_info{};
+		present_info.waitSemaphoreCount = static_cast<uint32_t>(m_wait_semaphores.size());
+		present_info.pWaitSemaphores = m_wait_semaphores.data();
+		present_info.swapchainCount = static_cast<uint32_t>(m_swapchains.size());
+		present_info.pSwapchains = m_swapchains.data();
+		present_info.pImageIndices = m_image_indices.data();
+		present_info.pResults = m_results.data();
+#ifdef VK_KHR_PRESENT_ID_EXTENSION_NAME
+		vk::PresentIdKHR present_ids{};
+		if (std::any_of(m_present_ids.begin(), m_present_ids.end(), [](uint64_t id) { return id != 0; }))
+		{
+			present_ids.swapchainCount = static_cast<uint32_t>(m_present_ids.size());
+			present_ids.pPresentIds = m_present_ids.data();
+			present_info.pNext = &present_ids;
+		}
+#endif
+		vk::DeviceGroupPresentInfoKHR group_info{};
+		if (std::any_of(m_device_masks.begin(), m_device_masks.end(), [](uint32_t mask) { return mask != 0; }))
+		{
+			group_info.swapchainCount = static_cast<uint32_t>(m_device_masks.size());
+			group_info.pDeviceMasks = m_device_masks.data();
+			group_info.mode = m_device_group_mode;
+			group_info.pNext = present_info.pNext;
+			present_info.pNext = &group_info;
+		}
+		try
+		{
+			queue.presentKHR(present_info);
+		}
+		catch (vk::OutOfDateKHRError const&)
+		{
+			// the per-swapchain results are written even when the call fails
+		}
+		return m_results;
+	}
+
+private:
+	std::vector<vk::SwapchainKHR> m_swapchains;
+	std::vector<uint32_t> m_image_indices;
+	std::vector<vk::Semaphore> m_wait_semaphores;
+	// 0 for swapchains presented without an id
+	std::vector<uint64_t> m_present_ids;
+	std::vector<uint32_t> m_device_masks;
+	vk::DeviceGroupPresentModeFlagBitsKHR m_device_group_mode = vk::DeviceGroupPresentModeFlagBitsKHR::eLocal;
+	std::vector<vk::Result> m_results;
+};
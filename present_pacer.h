@@ -0,0 +1,123 @@
+#pragma once
+
+#include "frame_limiter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+struct PresentPacingConfig
+{
+	// FIFO frames start late enough that they finish just before the vblank that shows them, which needs
+	// VK_KHR_present_id and VK_KHR_present_wait; mailbox and immediate don't queue frames and are never paced
+	bool enabled = false;
+	// kept free before the predicted vblank, covers the GPU part of a frame and wake-up jitter
+	std::chrono::microseconds margin{ 2000 };
+	// longest wait for the previous present, an occluded window may never complete one
+	std::chrono::milliseconds timeout{ 100 };
+};
+
+// Predicts when the next frame has to start from the times presents completed on the display. The refresh
+// interval is estimated from the spacing of completions, the lead before the predicted vblank from the frame's
+// CPU time plus the margin; a frame shown a vblank late raises the lead, frames on time lower it again slowly.
+// Render thread only.
+class PresentPacer
+{
+public:
+	using Clock = PreciseSleeper::Clock;
+
+	void setMargin(Clock::duration margin) { m_margin = margin; }
+
+	// forgets the last completion, e.g. for a new swapchain whose present ids start over; the estimates are kept
+	void reset()
+	{
+		m_last_id = 0;
+		m_target_id = 0;
+		m_started = false;
+		m_predicted = false;
+	}
+
+	// present id was shown on the display, the wait for it returned at
+	void completed(uint64_t id, Clock::time_point at)
+	{
+		if (m_last_id != 0 && id > m_last_id)
+		{
+			// completions are whole refresh intervals apart, frames that missed one span several
+			auto const spacing = (at - m_last_at) / static_cast<int64_t>(id - m_last_id);
+			if (m_refresh == Clock::duration::zero())
+				m_refresh = spacing;
+			else
+			{
+				auto const intervals = std::max<int64_t>(1, (spacing + m_refresh / 2) / m_refresh);
+				m_refresh += (spacing / intervals - m_refresh) / 16;
+			}
+		}
+		if (id == m_target_id && m_refresh != Clock::duration::zero())
+		{
+			if (at > m_target + m_refresh / 2)
+			{
+				++m_missed;
+				m_lead += m_refresh / 8;
+			}
+			else
+				m_lead -= m_refresh / 64;
+			m_lead = std::clamp(m_lead, std::min(m_work + m_margin, m_refresh), m_refresh);
+		}
+		m_last_id = id;
+		m_last_at = at;
+	}
+
+	uint64_t lastCompleted() const { return m_last_id; }
+
+	// sleeps until the predicted start of the next frame, which is the one after the last completed present
+	void waitForStart()
+	{
+		if (m_last_id != 0 && m_refresh != Clock::duration::zero())
+		{
+			m_target = m_last_at + m_refresh;
+			m_sleeper.sleepUntil(m_target - lead());
+			m_predicted = true;
+		}
+		m_start = Clock::now();
+		m_started = true;
+	}
+
+	// the frame that waitForStart() began was presented with id
+	void presented(uint64_t id)
+	{
+		if (!m_started)
+			return;
+		m_started = false;
+		auto const work = Clock::now() - m_start;
+		// follows rises at once and falls off over several frames
+		m_work = work > m_work ? work : m_work + (work - m_work) / 16;
+		m_target_id = m_predicted ? id : 0;
+		m_predicted = false;
+	}
+
+	// zero until two presents completed
+	Clock::duration refreshInterval() const { return m_refresh; }
+	// how long before the predicted vblank frames start, a whole interval starts them right after the previous one showed
+	Clock::duration lead() const { return std::min(std::max(m_lead, m_work + m_margin), m_refresh); }
+	// paced frames that were shown at least a vblank after the predicted one
+	uint64_t missed() const { return m_missed; }
+
+private:
+	Clock::duration m_margin = std::chrono::microseconds(2000);
+	Clock::duration m_refresh = Clock::duration::zero();
+	// starts out at a whole interval and comes down from there
+	Clock::duration m_lead = Clock::duration::max() / 2;
+	// CPU time from the start of a frame to its present
+	Clock::duration m_work = Clock::duration::zero();
+	uint64_t m_last_id = 0;
+	Clock::time_point m_last_at{};
+	// the frame in flight: the vblank predicted for it and its present id once presented
+	Clock::time_point m_target{};
+	uint64_t m_target_id = 0;
+	Clock::time_point m_start{};
+	bool m_started = false;
+	bool m_predicted = false;
+	uint64_t m_missed = 0;
+	PreciseSleeper m_sleeper;
+};
@@ -0,0 +1,1086 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "state_key.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+inline bool isDepthFormat(vk::Format format)
+{
+	switch (format)
+	{
+	case vk::Format::eD16Unorm:
+	case vk::Format::eX8D24UnormPack32:
+	case vk::Format::eD32Sfloat:
+	case vk::Format::eD16UnormS8Uint:
+	case vk::Format::eD24UnormS8Uint:
+	case vk::Format::eD32SfloatS8Uint:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Deduplicates render passes by their attachment ops, layouts, subpasses and dependencies: graphs recompiled
+// after a resize and the graphs of other windows get the same render pass object back. Render passes live as
+// long as the cache.
+class RenderPassCache
+{
+public:
+	explicit RenderPassCache(vk::Device device)
+		: m_device(device)
+	{}
+
+	RenderPassCache(RenderPassCache const&) = delete;
+	RenderPassCache& operator=(RenderPassCache const&) = delete;
+
+	// rp_ci must not have a pNext chain
+	vk::RenderPass get(vk::RenderPassCreateInfo const& rp_ci)
+	{
+		if (rp_ci.pNext)
+			throw std::runtime_error("Render pass create infos with a pNext chain are not cached!");
+		auto const key = signature(rp_ci);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& render_pass = m_render_passes[key];
+		if (!render_pass)
+			render_pass = m_device.createRenderPassUnique(rp_ci);
+		return *render_pass;
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_render_passes.size();
+	}
+
+private:
+	static StateKey signature(vk::RenderPassCreateInfo const& rp_ci)
+	{
+		StateKey key;
+		auto const add_refs = [&key](uint32_t count, vk::AttachmentReference const* refs)
+		{
+			key.add(refs ? count : 0);
+			for (uint32_t i = 0; refs && i < count; ++i)
+				key.add(refs[i].attachment).add(refs[i].layout);
+		};
+
+		key.add(rp_ci.flags).add(rp_ci.attachmentCount);
+		for (uint32_t i = 0; i < rp_ci.attachmentCount; ++i)
+		{
+			auto const& desc = rp_ci.pAttachments[i];
+			key.add(desc.flags).add(desc.format).add(desc.samples).add(desc.loadOp).add(desc.storeOp)
+				.add(desc.stencilLoadOp).add(desc.stencilStoreOp).add(desc.initialLayout).add(desc.finalLayout);
+		}
+		key.add(rp_ci.subpassCount);
+		for (uint32_t i = 0; i < rp_ci.subpassCount; ++i)
+		{
+			auto const& subpass = rp_ci.pSubpasses[i];
+			key.add(subpass.flags).add(subpass.pipelineBindPoint);
+			add_refs(subpass.inputAttachmentCount, subpass.pInputAttachments);
+			add_refs(subpass.colorAttachmentCount, subpass.pColorAttachments);
+			add_refs(subpass.colorAttachmentCount, subpass.pResolveAttachments);
+			add_refs(1, subpass.pDepthStencilAttachment);
+			key.add(subpass.preserveAttachmentCount);
+			for (uint32_t p = 0; p < subpass.preserveAttachmentCount; ++p)
+				key.add(subpass.pPreserveAttachments[p]);
+		}
+		key.add(rp_ci.dependencyCount);
+		for (uint32_t i = 0; i < rp_ci.dependencyCount; ++i)
+		{
+			auto const& dep = rp_ci.pDependencies[i];
+			key.add(dep.srcSubpass).add(dep.dstSubpass).add(dep.srcStageMask).add(dep.dstStageMask)
+				.add(dep.srcAccessMask).add(dep.dstAccessMask).add(dep.dependencyFlags);
+		}
+		return key;
+	}
+
+	vk::Device m_device;
+	mutable std::mutex m_mutex;
+	std::unordered_map<StateKey, vk::UniqueRenderPass, StateKey::Hash> m_render_passes;
+};
+
+// Passes declare which attachments they write and read, compile() turns them into as few VkRenderPasses
+// as possible: consecutive passes become subpasses of one render pass unless a pass samples what an
+// earlier pass of the same render pass wrote. Layout transitions and barriers are expressed as
+// attachment layouts and subpass dependencies. Attachments that never leave their render pass get
+// lazily allocated memory where the device has it, the other transient attachments share memory
+// whenever their lifetimes do not overlap. Load and store ops follow from the uses: contents are only
+// loaded when an earlier group wrote them and no clear replaces them, and only stored
+// when a later group or the owner of an imported image reads them.
+// With dynamic rendering every pass records between vkCmdBeginRenderingKHR and vkCmdEndRenderingKHR and the
+// same transitions become image barriers; no render pass or framebuffer objects exist then. Graphs with
+// pixel-local reads keep using render passes, dynamic rendering has no subpasses.
+// Multisampled attachments are resolved into single-sampled ones at the end of the subpass that wrote them, so
+// only the resolved image ever leaves the tile; with their depth they get lazily allocated memory as well.
+// All attachments have the extent of the graph. Passes run in the order they were added.
+class RenderGraph
+{
+	struct PassData;
+
+public:
+	using ResourceId = uint32_t;
+	using PassId = uint32_t;
+	using RecordFn = std::function<void(vk::CommandBuffer cmd, uint32_t image_index)>;
+
+	enum class Access
+	{
+		Color,
+		DepthWrite,
+		DepthRead,
+		// pixel-local read of an attachment written by an earlier pass, stays in the writer's render pass
+		Input,
+		// filtered read in a shader, ends the render pass of the writer
+		Sampled,
+		// single-sampled target a multisampled color attachment of the pass is resolved into
+		Resolve
+	};
+
+	class PassBuilder
+	{
+	public:
+		// a cleared attachment discards its previous contents, otherwise they are loaded if there are any
+		PassBuilder& writeColor(ResourceId resource, bool clear = false) { return use(resource, Access::Color, clear); }
+		PassBuilder& writeDepth(ResourceId resource, bool clear = false) { return use(resource, Access::DepthWrite, clear); }
+		PassBuilder& readDepth(ResourceId resource) { return use(resource, Access::DepthRead, false); }
+		PassBuilder& readAttachment(ResourceId resource) { return use(resource, Access::Input, false); }
+		PassBuilder& sample(ResourceId resource) { return use(resource, Access::Sampled, false); }
+		// color has to be written by this pass already
+		PassBuilder& resolveColor(ResourceId color, ResourceId target)
+		{
+			auto const& source = m_graph.m_resources.at(color);
+			auto const& target_data = m_graph.m_resources.at(target);
+			bool const written = std::any_of(m_pass.uses.begin(), m_pass.uses.end(), [color](Use const& use) { return use.resource == color && use.access == Access::Color; });
+			if (!written || source.samples == vk::SampleCountFlagBits::e1 || target_data.samples != vk::SampleCountFlagBits::e1 || source.format != target_data.format)
+				throw std::runtime_error("Pass " + m_pass.name + " can not resolve " + source.name + " into " + target_data.name + "!");
+			use(target, Access::Resolve, false);
+			m_pass.uses.back().resolve_source = color;
+			return *this;
+		}
+		PassBuilder& contents(vk::SubpassContents contents)
+		{
+			m_pass.contents = contents;
+			return *this;
+		}
+
+	private:
+		friend class RenderGraph;
+
+		PassBuilder(RenderGraph const& graph, PassData& pass) : m_graph(graph), m_pass(pass) {}
+
+		PassBuilder& use(ResourceId resource, Access access, bool clear)
+		{
+			auto const& resource_data = m_graph.m_resources.at(resource);
+			bool const depth = access == Access::DepthWrite || access == Access::DepthRead;
+			if (isAttachment(access) && access != Access::Input && depth != isDepthFormat(resource_data.format))
+				throw std::runtime_error("Pass " + m_pass.name + " uses " + resource_data.name + " with an access that does not match its format!");
+			for (auto const& use : m_pass.uses)
+			{
+				if (use.resource == resource)
+					throw std::runtime_error("Pass " + m_pass.name + " uses " + resource_data.name + " twice!");
+				if (depth && (use.access == Access::DepthWrite || use.access == Access::DepthRead))
+					throw std::runtime_error("Pass " + m_pass.name + " has more than one depth attachment!");
+			}
+			m_pass.uses.push_back({ resource, access, clear });
+			return *this;
+		}
+
+		RenderGraph const& m_graph;
+		PassData& m_pass;
+	};
+
+	// attachment formats of a pass, for pipelines and secondary command buffers under dynamic rendering
+	struct RenderingFormats
+	{
+		std::vector<vk::Format> colors;
+		vk::Format depth = vk::Format::eUndefined;
+		vk::Format stencil = vk::Format::eUndefined;
+		vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+	};
+
+	RenderGraph(vk::Device device, DeviceAllocator& allocator, vk::Extent2D extent)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_extent(extent)
+	{}
+
+	~RenderGraph()
+	{
+		releaseTransients();
+	}
+
+	RenderGraph(RenderGraph const&) = delete;
+	RenderGraph& operator=(RenderGraph const&) = delete;
+
+	// an attachment backed by images outside the graph, e.g. the swapchain; one image and view per frame image.
+	// The contents are undefined when the graph starts and left in final_layout at its end.
+	ResourceId importImage(std::string name, vk::Format format, std::vector<vk::Image> images, std::vector<vk::ImageView> views,
+		vk::ImageLayout final_layout, vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1)
+	{
+		if (views.empty() || images.size() != views.size())
+			throw std::runtime_error("Imported image " + name + " needs one view per image!");
+		if (m_image_count != 0 && views.size() != m_image_count)
+			throw std::runtime_error("Imported image " + name + " does not have one view per frame image!");
+		m_image_count = static_cast<uint32_t>(views.size());
+
+		ResourceData resource{};
+		resource.name = std::move(name);
+		resource.format = format;
+		resource.samples = samples;
+		resource.imported = true;
+		resource.imported_images = std::move(images);
+		resource.imported_views = std::move(views);
+		resource.final_layout = final_layout;
+		m_resources.push_back(std::move(resource));
+		return static_cast<ResourceId>(m_resources.size() - 1);
+	}
+
+	// an attachment the graph allocates, its contents only live while the frame runs through the graph
+	ResourceId createAttachment(std::string name, vk::Format format, vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1)
+	{
+		ResourceData resource{};
+		resource.name = std::move(name);
+		resource.format = format;
+		resource.samples = samples;
+		m_resources.push_back(std::move(resource));
+		return static_cast<ResourceId>(m_resources.size() - 1);
+	}
+
+	// used by every pass that clears the attachment, read at record time
+	void setClearValue(ResourceId resource, vk::ClearValue value) { m_resources.at(resource).clear_value = value; }
+
+	template<typename Setup>
+	PassId addPass(std::string name, Setup&& setup, RecordFn record)
+	{
+		PassData pass{};
+		pass.name = std::move(name);
+		pass.record = std::move(record);
+		PassBuilder builder(*this, pass);
+		setup(builder);
+		if (!std::any_of(pass.uses.begin(), pass.uses.end(), [](Use const& use) { return use.access != Access::Sampled; }))
+			throw std::runtime_error("Pass " + pass.name + " has no attachments!");
+		m_passes.push_back(std::move(pass));
+		return static_cast<PassId>(m_passes.size() - 1);
+	}
+
+	// takes effect with the next compile(), render passes then come from the cache and outlive the graph
+	void useRenderPassCache(RenderPassCache* cache) { m_render_pass_cache = cache; }
+	// takes effect with the next compile(), the dispatcher needs VK_KHR_dynamic_rendering loaded
+	void useDynamicRendering(vk::DispatchLoaderDynamic const* dispatch) { m_dispatch = dispatch; }
+	// valid after compile()
+	bool dynamicRendering() const { return m_dynamic; }
+	// split-frame rendering on a device group: device i renders only areas[i] of every pass, empty renders everything
+	// everywhere; draws have to scissor to their device's area
+	void setDeviceRenderAreas(std::vector<vk::Rect2D> areas) { m_device_areas = std::move(areas); }
+
+	void compile()
+	{
+		releaseTransients();
+		m_dynamic = m_dispatch && std::none_of(m_passes.begin(), m_passes.end(), [](PassData const& pass)
+		{
+			return std::any_of(pass.uses.begin(), pass.uses.end(), [](Use const& use) { return use.access == Access::Input; });
+		});
+		groupPasses();
+		analyzeResources();
+		allocateTransients();
+		for (uint32_t group = 0; group < m_groups.size(); ++group)
+			createRenderPass(group);
+		createFramebuffers();
+	}
+
+	// records every pass, each render pass is begun and ended here; one thread at a time, it reuses the graph's scratch space
+	void record(vk::CommandBuffer cmd, uint32_t image_index) const
+	{
+		for (auto const& group : m_groups)
+		{
+			if (m_dynamic)
+			{
+				recordDynamic(cmd, image_index, group);
+				continue;
+			}
+
+			auto& clear_values = m_scratch.clear_values;
+			clear_values.clear();
+			for (auto const resource : group.attachments)
+				clear_values.push_back(m_resources[resource].clear_value);
+
+			vk::RenderPassBeginInfo rp_begin_info{};
+			rp_begin_info.renderPass = group.render_pass;
+			rp_begin_info.framebuffer = *group.framebuffers[image_index];
+			rp_begin_info.renderArea = vk::Rect2D({ 0, 0 }, m_extent);
+			rp_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+			rp_begin_info.pClearValues = clear_values.data();
+			auto const group_begin_info = deviceGroupBeginInfo();
+			if (!m_device_areas.empty())
+				rp_begin_info.pNext = &group_begin_info;
+
+			cmd.beginRenderPass(rp_begin_info, m_passes[group.passes.front()].contents);
+			for (size_t i = 0; i < group.passes.size(); ++i)
+			{
+				auto const& pass = m_passes[group.passes[i]];
+				if (i != 0)
+					cmd.nextSubpass(pass.contents);
+				pass.record(cmd, image_index);
+			}
+			cmd.endRenderPass();
+		}
+	}
+
+	// for pipeline creation and secondary command buffer inheritance, valid after compile()
+	vk::RenderPass renderPass(PassId pass) const { return m_groups[m_passes.at(pass).group].render_pass; }
+	uint32_t subpass(PassId pass) const { return m_passes.at(pass).subpass; }
+	vk::Framebuffer framebuffer(PassId pass, uint32_t image_index) const
+	{
+		return m_dynamic ? vk::Framebuffer{} : *m_groups[m_passes.at(pass).group].framebuffers.at(image_index);
+	}
+	RenderingFormats renderingFormats(PassId pass) const
+	{
+		RenderingFormats formats;
+		for (auto const& use : m_passes.at(pass).uses)
+		{
+			auto const& resource = m_resources[use.resource];
+			if (!isAttachment(use.access) || use.access == Access::Input || use.access == Access::Resolve)
+				continue;
+			formats.samples = resource.samples;
+			if (use.access == Access::Color)
+				formats.colors.push_back(resource.format);
+			else
+			{
+				formats.depth = resource.format;
+				if (hasStencil(resource.format))
+					formats.stencil = resource.format;
+			}
+		}
+		return formats;
+	}
+	vk::ImageView view(ResourceId resource, uint32_t image_index) const
+	{
+		auto const& res = m_resources.at(resource);
+		return res.imported ? res.imported_views.at(image_index) : *res.view;
+	}
+
+	vk::Extent2D extent() const { return m_extent; }
+	uint32_t renderPassCount() const { return static_cast<uint32_t>(m_groups.size()); }
+	// device memory bound to transient attachments after aliasing, lazily allocated memory not included
+	vk::DeviceSize transientMemorySize() const { return m_transient_memory_size; }
+
+private:
+	static constexpr uint32_t none = ~0u;
+
+	struct Use
+	{
+		ResourceId resource;
+		Access access;
+		bool clear;
+		// the multisampled color attachment a Resolve use resolves
+		ResourceId resolve_source = none;
+	};
+
+	struct PassData
+	{
+		std::string name;
+		std::vector<Use> uses;
+		vk::SubpassContents contents = vk::SubpassContents::eInline;
+		RecordFn record;
+		// compiled
+		uint32_t group = none;
+		uint32_t subpass = 0;
+	};
+
+	struct ResourceData
+	{
+		std::string name;
+		vk::Format format = vk::Format::eUndefined;
+		vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+		vk::ClearValue clear_value{};
+		bool imported = false;
+		std::vector<vk::Image> imported_images;
+		std::vector<vk::ImageView> imported_views;
+		vk::ImageLayout final_layout = vk::ImageLayout::eUndefined;
+
+		// compiled
+		vk::ImageUsageFlags usage;
+		uint32_t first_group = none;
+		uint32_t last_group = none;
+		// the contents never leave one render pass
+		bool transient = false;
+		vk::Image image;
+		vk::UniqueImageView view;
+		Allocation memory;
+		// layout at the end of the group compiled last
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+		// a group wrote the resource before the one being compiled
+		bool written = false;
+	};
+
+	struct Group
+	{
+		std::vector<PassId> passes;
+		// framebuffer attachment order
+		std::vector<ResourceId> attachments;
+		// dynamic rendering only, the transitions the render pass would do
+		std::vector<vk::AttachmentDescription> descriptions;
+		// from the cache if there is one, owned_render_pass otherwise
+		vk::RenderPass render_pass;
+		vk::UniqueRenderPass owned_render_pass;
+		std::vector<vk::UniqueFramebuffer> framebuffers;
+	};
+
+	static bool hasStencil(vk::Format format)
+	{
+		return format == vk::Format::eD16UnormS8Uint || format == vk::Format::eD24UnormS8Uint || format == vk::Format::eD32SfloatS8Uint;
+	}
+
+	// color formats render passes resolve to sample 0, dynamic rendering has to ask for it
+	static bool isIntegerFormat(vk::Format format)
+	{
+		switch (format)
+		{
+		case vk::Format::eR8Uint:
+		case vk::Format::eR8Sint:
+		case vk::Format::eR8G8Uint:
+		case vk::Format::eR8G8Sint:
+		case vk::Format::eR8G8B8Uint:
+		case vk::Format::eR8G8B8Sint:
+		case vk::Format::eB8G8R8Uint:
+		case vk::Format::eB8G8R8Sint:
+		case vk::Format::eR8G8B8A8Uint:
+		case vk::Format::eR8G8B8A8Sint:
+		case vk::Format::eB8G8R8A8Uint:
+		case vk::Format::eB8G8R8A8Sint:
+		case vk::Format::eA8B8G8R8UintPack32:
+		case vk::Format::eA8B8G8R8SintPack32:
+		case vk::Format::eA2R10G10B10UintPack32:
+		case vk::Format::eA2R10G10B10SintPack32:
+		case vk::Format::eA2B10G10R10UintPack32:
+		case vk::Format::eA2B10G10R10SintPack32:
+		case vk::Format::eR16Uint:
+		case vk::Format::eR16Sint:
+		case vk::Format::eR16G16Uint:
+		case vk::Format::eR16G16Sint:
+		case vk::Format::eR16G16B16Uint:
+		case vk::Format::eR16G16B16Sint:
+		case vk::Format::eR16G16B16A16Uint:
+		case vk::Format::eR16G16B16A16Sint:
+		case vk::Format::eR32Uint:
+		case vk::Format::eR32Sint:
+		case vk::Format::eR32G32Uint:
+		case vk::Format::eR32G32Sint:
+		case vk::Format::eR32G32B32Uint:
+		case vk::Format::eR32G32B32Sint:
+		case vk::Format::eR32G32B32A32Uint:
+		case vk::Format::eR32G32B32A32Sint:
+		case vk::Format::eR64Uint:
+		case vk::Format::eR64Sint:
+		case vk::Format::eR64G64Uint:
+		case vk::Format::eR64G64Sint:
+		case vk::Format::eR64G64B64Uint:
+		case vk::Format::eR64G64B64Sint:
+		case vk::Format::eR64G64B64A64Uint:
+		case vk::Format::eR64G64B64A64Sint:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static vk::ImageAspectFlags aspectFor(vk::Format format)
+	{
+		if (!isDepthFormat(format))
+			return vk::ImageAspectFlagBits::eColor;
+		return hasStencil(format) ? vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil : vk::ImageAspectFlags(vk::ImageAspectFlagBits::eDepth);
+	}
+
+	static vk::PipelineStageFlags attachmentStages()
+	{
+		return vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+	}
+	static vk::AccessFlags attachmentWrites()
+	{
+		return vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+	}
+	static vk::AccessFlags attachmentAccess()
+	{
+		return attachmentWrites() | vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentRead
+			| vk::AccessFlagBits::eInputAttachmentRead;
+	}
+	// consumers behind a render pass: samplers of later passes and readback copies
+	static vk::PipelineStageFlags exitStages() { return vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eTransfer; }
+	static vk::AccessFlags exitAccess() { return vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead; }
+
+	static bool isAttachment(Access access) { return access != Access::Sampled; }
+	static bool isWrite(Access access) { return access == Access::Color || access == Access::DepthWrite || access == Access::Resolve; }
+
+	static vk::ImageLayout layoutFor(Access access, vk::Format format)
+	{
+		switch (access)
+		{
+		case Access::Color:
+		case Access::Resolve: return vk::ImageLayout::eColorAttachmentOptimal;
+		case Access::DepthWrite: return vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		case Access::DepthRead: return vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+		case Access::Input: return isDepthFormat(format) ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eShaderReadOnlyOptimal;
+		default: return vk::ImageLayout::eShaderReadOnlyOptimal;
+		}
+	}
+
+	static vk::ImageUsageFlags usageFor(Access access)
+	{
+		switch (access)
+		{
+		case Access::Color:
+		case Access::Resolve: return vk::ImageUsageFlagBits::eColorAttachment;
+		case Access::DepthWrite:
+		case Access::DepthRead: return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+		case Access::Input: return vk::ImageUsageFlagBits::eInputAttachment;
+		default: return vk::ImageUsageFlagBits::eSampled;
+		}
+	}
+
+	void groupPasses()
+	{
+		std::vector<bool> written_in_group(m_resources.size(), false);
+		for (PassId id = 0; id < m_passes.size(); ++id)
+		{
+			auto& pass = m_passes[id];
+			bool const samples_group_output = std::any_of(pass.uses.begin(), pass.uses.end(),
+				[&](Use const& use) { return use.access == Access::Sampled && written_in_group[use.resource]; });
+			if (m_groups.empty() || samples_group_output || m_dynamic)
+			{
+				m_groups.emplace_back();
+				std::fill(written_in_group.begin(), written_in_group.end(), false);
+			}
+
+			pass.group = static_cast<uint32_t>(m_groups.size() - 1);
+			pass.subpass = static_cast<uint32_t>(m_groups.back().passes.size());
+			m_groups.back().passes.push_back(id);
+			for (auto const& use : pass.uses)
+				if (isWrite(use.access))
+					written_in_group[use.resource] = true;
+		}
+	}
+
+	void analyzeResources()
+	{
+		for (auto& resource : m_resources)
+		{
+			resource.usage = {};
+			resource.first_group = none;
+			resource.last_group = none;
+			resource.layout = vk::ImageLayout::eUndefined;
+			resource.written = false;
+		}
+
+		std::vector<bool> written(m_resources.size(), false);
+		std::vector<bool> sampled(m_resources.size(), false);
+		for (auto const& pass : m_passes)
+		{
+			for (auto const& use : pass.uses)
+			{
+				auto& resource = m_resources[use.resource];
+				if (!isWrite(use.access) && !written[use.resource])
+					throw std::runtime_error("Pass " + pass.name + " reads " + resource.name + " before any pass wrote it!");
+				if (isWrite(use.access))
+					written[use.resource] = true;
+				if (use.access == Access::Sampled)
+					sampled[use.resource] = true;
+
+				resource.usage |= usageFor(use.access);
+				if (resource.first_group == none)
+					resource.first_group = pass.group;
+				resource.last_group = pass.group;
+			}
+		}
+
+		for (ResourceId id = 0; id < m_resources.size(); ++id)
+		{
+			auto& resource = m_resources[id];
+			resource.transient = !resource.imported && !sampled[id] && resource.first_group == resource.last_group;
+			if (resource.transient)
+				resource.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+		}
+	}
+
+	void allocateTransients()
+	{
+		// memory slot shared by transient attachments with disjoint lifetimes
+		struct Slot
+		{
+			vk::MemoryRequirements requirements;
+			uint32_t busy_until = 0;
+			std::vector<ResourceId> members;
+		};
+		std::vector<Slot> slots;
+
+		std::vector<ResourceId> order;
+		for (ResourceId id = 0; id < m_resources.size(); ++id)
+			if (!m_resources[id].imported && m_resources[id].first_group != none)
+				order.push_back(id);
+		std::stable_sort(order.begin(), order.end(), [this](ResourceId a, ResourceId b) { return m_resources[a].first_group < m_resources[b].first_group; });
+
+		for (auto const id : order)
+		{
+			auto& resource = m_resources[id];
+			vk::ImageCreateInfo img_ci{};
+			img_ci.imageType = vk::ImageType::e2D;
+			img_ci.format = resource.format;
+			img_ci.extent = vk::Extent3D{ m_extent.width, m_extent.height, 1 };
+			img_ci.mipLevels = 1;
+			img_ci.arrayLayers = 1;
+			img_ci.samples = resource.samples;
+			img_ci.tiling = vk::ImageTiling::eOptimal;
+			img_ci.usage = resource.usage;
+			img_ci.sharingMode = vk::SharingMode::eExclusive;
+			img_ci.initialLayout = vk::ImageLayout::eUndefined;
+			resource.image = m_device.createImage(img_ci);
+
+			auto const mem_req = m_device.getImageMemoryRequirements(resource.image);
+			if (resource.transient)
+			{
+				auto const lazy_flags = vk::MemoryPropertyFlagBits::eLazilyAllocated | vk::MemoryPropertyFlagBits::eDeviceLocal;
+				auto const type = m_allocator.selectMemoryType(mem_req, lazy_flags, vk::MemoryPropertyFlagBits::eDeviceLocal);
+				// tile memory on tilers, the driver backs it only if it ever has to
+				if (m_allocator.memoryProperties().memoryTypes[type].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated)
+				{
+					resource.memory = m_allocator.allocateFor(resource.image, lazy_flags, vk::MemoryPropertyFlagBits::eDeviceLocal);
+					continue;
+				}
+			}
+
+			auto slot = std::find_if(slots.begin(), slots.end(), [&](Slot const& s)
+			{
+				return s.busy_until < resource.first_group && (s.requirements.memoryTypeBits & mem_req.memoryTypeBits);
+			});
+			if (slot == slots.end())
+			{
+				slots.push_back({ mem_req, resource.last_group, { id } });
+				continue;
+			}
+			slot->requirements.size = std::max(slot->requirements.size, mem_req.size);
+			slot->requirements.alignment = std::max(slot->requirements.alignment, mem_req.alignment);
+			slot->requirements.memoryTypeBits &= mem_req.memoryTypeBits;
+			slot->busy_until = resource.last_group;
+			slot->members.push_back(id);
+		}
+
+		m_transient_memory_size = 0;
+		for (auto const& slot : slots)
+		{
+			// the first member owns the allocation, the others only bind to it
+			auto const memory = m_allocator.allocate(slot.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, {}, ResourceKind::Optimal);
+			m_transient_memory_size += slot.requirements.size;
+			for (auto const id : slot.members)
+				m_device.bindImageMemory(m_resources[id].image, memory.memory, memory.offset);
+			m_resources[slot.members.front()].memory = memory;
+		}
+
+		for (auto const id : order)
+		{
+			auto& resource = m_resources[id];
+			vk::ImageViewCreateInfo view_ci{};
+			view_ci.image = resource.image;
+			view_ci.viewType = vk::ImageViewType::e2D;
+			view_ci.format = resource.format;
+			// attachment views of depth-stencil formats cover both aspects, as the barriers do
+			view_ci.subresourceRange = vk::ImageSubresourceRange{ aspectFor(resource.format), 0, 1, 0, 1 };
+			resource.view = m_device.createImageViewUnique(view_ci);
+		}
+	}
+
+	void createRenderPass(uint32_t group_index)
+	{
+		auto& group = m_groups[group_index];
+
+		// attachment index per resource in this group
+		std::vector<uint32_t> attachment_of(m_resources.size(), none);
+		for (auto const pass_id : group.passes)
+			for (auto const& use : m_passes[pass_id].uses)
+				if (isAttachment(use.access) && attachment_of[use.resource] == none)
+				{
+					attachment_of[use.resource] = static_cast<uint32_t>(group.attachments.size());
+					group.attachments.push_back(use.resource);
+				}
+
+		std::vector<vk::AttachmentDescription> descriptions;
+		for (auto const id : group.attachments)
+		{
+			auto& resource = m_resources[id];
+			Use const* first = nullptr;
+			Use const* last = nullptr;
+			for (auto const pass_id : group.passes)
+				for (auto const& use : m_passes[pass_id].uses)
+					if (use.resource == id && isAttachment(use.access))
+					{
+						if (!first)
+							first = &use;
+						last = &use;
+					}
+
+			vk::AttachmentDescription desc{};
+			desc.format = resource.format;
+			desc.samples = resource.samples;
+			// resolves overwrite every pixel
+			if (first->access == Access::Resolve)
+				desc.loadOp = vk::AttachmentLoadOp::eDontCare;
+			else if (first->clear)
+				desc.loadOp = vk::AttachmentLoadOp::eClear;
+			else if (resource.written)
+				desc.loadOp = vk::AttachmentLoadOp::eLoad;
+			else
+				desc.loadOp = vk::AttachmentLoadOp::eDontCare;
+			bool const used_later = resource.last_group > group_index;
+			desc.storeOp = resource.imported || used_later ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+			desc.stencilLoadOp = desc.loadOp;
+			desc.stencilStoreOp = desc.storeOp;
+			desc.initialLayout = desc.loadOp == vk::AttachmentLoadOp::eLoad ? resource.layout : vk::ImageLayout::eUndefined;
+
+			desc.finalLayout = layoutFor(last->access, resource.format);
+			if (used_later)
+			{
+				// the next group that touches the resource decides, samplers need read-only layouts
+				for (auto const& pass : m_passes)
+				{
+					if (pass.group <= group_index)
+						continue;
+					auto const it = std::find_if(pass.uses.begin(), pass.uses.end(), [id](Use const& use) { return use.resource == id; });
+					if (it == pass.uses.end())
+						continue;
+					if (it->access == Access::Sampled)
+						desc.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+					break;
+				}
+			}
+			else if (resource.imported)
+				desc.finalLayout = resource.final_layout;
+
+			resource.layout = desc.finalLayout;
+			descriptions.push_back(desc);
+		}
+		markWritten(group);
+		if (m_dynamic)
+		{
+			group.descriptions = std::move(descriptions);
+			return;
+		}
+
+		struct SubpassRefs
+		{
+			std::vector<vk::AttachmentReference> colors;
+			// empty or one per color
+			std::vector<vk::AttachmentReference> resolves;
+			std::optional<vk::AttachmentReference> depth;
+			std::vector<vk::AttachmentReference> inputs;
+			std::vector<uint32_t> preserve;
+		};
+		std::vector<SubpassRefs> refs(group.passes.size());
+		for (size_t s = 0; s < group.passes.size(); ++s)
+		{
+			auto const& pass = m_passes[group.passes[s]];
+			for (auto const& use : pass.uses)
+			{
+				if (!isAttachment(use.access))
+					continue;
+				vk::AttachmentReference ref{ attachment_of[use.resource], layoutFor(use.access, m_resources[use.resource].format) };
+				if (use.access == Access::Color)
+					refs[s].colors.push_back(ref);
+				else if (use.access == Access::Resolve)
+				{
+					refs[s].resolves.resize(refs[s].colors.size(), vk::AttachmentReference{ VK_ATTACHMENT_UNUSED, vk::ImageLayout::eUndefined });
+					auto const source = std::find_if(refs[s].colors.begin(), refs[s].colors.end(),
+						[&](vk::AttachmentReference const& color) { return color.attachment == attachment_of[use.resolve_source]; });
+					refs[s].resolves[source - refs[s].colors.begin()] = ref;
+				}
+				else if (use.access == Access::Input)
+					refs[s].inputs.push_back(ref);
+				else
+					refs[s].depth = ref;
+			}
+		}
+
+		// attachments a subpass does not touch but a later one needs have to be preserved across it
+		auto const touches = [&](size_t s, ResourceId id)
+		{
+			auto const& uses = m_passes[group.passes[s]].uses;
+			return std::any_of(uses.begin(), uses.end(), [id](Use const& use) { return use.resource == id && isAttachment(use.access); });
+		};
+		for (auto const id : group.attachments)
+		{
+			for (size_t s = 1; s + 1 < group.passes.size(); ++s)
+			{
+				if (touches(s, id))
+					continue;
+				bool before = false;
+				bool after = false;
+				for (size_t i = 0; i < s; ++i)
+					before |= touches(i, id);
+				for (size_t i = s + 1; i < group.passes.size(); ++i)
+					after |= touches(i, id);
+				if (before && after)
+					refs[s].preserve.push_back(attachment_of[id]);
+			}
+		}
+
+		std::vector<vk::SubpassDescription> subpasses;
+		for (auto& ref : refs)
+		{
+			vk::SubpassDescription subpass_desc{};
+			subpass_desc.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+			subpass_desc.colorAttachmentCount = static_cast<uint32_t>(ref.colors.size());
+			subpass_desc.pColorAttachments = ref.colors.data();
+			if (!ref.resolves.empty())
+			{
+				// colors written after the first resolve were not covered by resize() yet
+				ref.resolves.resize(ref.colors.size(), vk::AttachmentReference{ VK_ATTACHMENT_UNUSED, vk::ImageLayout::eUndefined });
+				subpass_desc.pResolveAttachments = ref.resolves.data();
+			}
+			subpass_desc.pDepthStencilAttachment = ref.depth ? &*ref.depth : nullptr;
+			subpass_desc.inputAttachmentCount = static_cast<uint32_t>(ref.inputs.size());
+			subpass_desc.pInputAttachments = ref.inputs.data();
+			subpass_desc.preserveAttachmentCount = static_cast<uint32_t>(ref.preserve.size());
+			subpass_desc.pPreserveAttachments = ref.preserve.data();
+			subpasses.push_back(subpass_desc);
+		}
+
+		auto const attachment_stages = attachmentStages();
+		auto const attachment_writes = attachmentWrites();
+		auto const attachment_access = attachmentAccess();
+
+		std::vector<vk::SubpassDependency> dependencies;
+		// earlier groups, earlier frames and the previous users of aliased memory; covers the swapchain acquire as well
+		vk::SubpassDependency entry{};
+		entry.srcSubpass = VK_SUBPASS_EXTERNAL;
+		entry.dstSubpass = 0;
+		entry.srcStageMask = attachment_stages | vk::PipelineStageFlagBits::eFragmentShader;
+		entry.dstStageMask = attachment_stages | vk::PipelineStageFlagBits::eFragmentShader;
+		entry.srcAccessMask = attachment_writes;
+		entry.dstAccessMask = attachment_access | vk::AccessFlagBits::eShaderRead;
+		dependencies.push_back(entry);
+
+		for (uint32_t dst = 1; dst < group.passes.size(); ++dst)
+			for (uint32_t src = 0; src < dst; ++src)
+			{
+				bool const shared = std::any_of(group.attachments.begin(), group.attachments.end(),
+					[&](ResourceId id) { return touches(src, id) && touches(dst, id); });
+				if (!shared)
+					continue;
+				vk::SubpassDependency dep{};
+				dep.srcSubpass = src;
+				dep.dstSubpass = dst;
+				dep.srcStageMask = attachment_stages | vk::PipelineStageFlagBits::eFragmentShader;
+				dep.dstStageMask = attachment_stages | vk::PipelineStageFlagBits::eFragmentShader;
+				dep.srcAccessMask = attachment_writes;
+				dep.dstAccessMask = attachment_access;
+				dep.dependencyFlags = vk::DependencyFlagBits::eByRegion;
+				dependencies.push_back(dep);
+			}
+
+		// later groups sample the outputs, readbacks copy them
+		vk::SubpassDependency exit{};
+		exit.srcSubpass = static_cast<uint32_t>(group.passes.size() - 1);
+		exit.dstSubpass = VK_SUBPASS_EXTERNAL;
+		exit.srcStageMask = attachment_stages;
+		exit.dstStageMask = exitStages();
+		exit.srcAccessMask = attachment_writes;
+		exit.dstAccessMask = exitAccess();
+		dependencies.push_back(exit);
+
+		vk::RenderPassCreateInfo rp_ci{};
+		rp_ci.attachmentCount = static_cast<uint32_t>(descriptions.size());
+		rp_ci.pAttachments = descriptions.data();
+		rp_ci.subpassCount = static_cast<uint32_t>(subpasses.size());
+		rp_ci.pSubpasses = subpasses.data();
+		rp_ci.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		rp_ci.pDependencies = dependencies.data();
+		if (m_render_pass_cache)
+			group.render_pass = m_render_pass_cache->get(rp_ci);
+		else
+		{
+			group.owned_render_pass = m_device.createRenderPassUnique(rp_ci);
+			group.render_pass = *group.owned_render_pass;
+		}
+	}
+
+	void markWritten(Group const& group)
+	{
+		for (auto const pass_id : group.passes)
+			for (auto const& use : m_passes[pass_id].uses)
+				if (isWrite(use.access))
+					m_resources[use.resource].written = true;
+	}
+
+	vk::ImageMemoryBarrier imageBarrier(ResourceId id, uint32_t image_index, vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+		vk::AccessFlags src_access, vk::AccessFlags dst_access) const
+	{
+		auto const& resource = m_resources[id];
+		vk::ImageMemoryBarrier barrier{};
+		barrier.srcAccessMask = src_access;
+		barrier.dstAccessMask = dst_access;
+		barrier.oldLayout = old_layout;
+		barrier.newLayout = new_layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = resource.imported ? resource.imported_images.at(image_index) : resource.image;
+		barrier.subresourceRange = vk::ImageSubresourceRange{ aspectFor(resource.format), 0, 1, 0, 1 };
+		return barrier;
+	}
+
+	// the device mask covers every device with an area
+	vk::DeviceGroupRenderPassBeginInfo deviceGroupBeginInfo() const
+	{
+		auto const count = static_cast<uint32_t>(m_device_areas.size());
+		return vk::DeviceGroupRenderPassBeginInfo{ count >= 32 ? ~0u : (1u << count) - 1, count, m_device_areas.data() };
+	}
+
+	// a group holds exactly one pass under dynamic rendering
+	void recordDynamic(vk::CommandBuffer cmd, uint32_t image_index, Group const& group) const
+	{
+		auto const& pass = m_passes[group.passes.front()];
+		auto& barriers = m_scratch.barriers;
+		auto& layouts = m_scratch.layouts;
+		auto& colors = m_scratch.colors;
+		// per color, the resource it is
+		auto& color_ids = m_scratch.color_ids;
+		barriers.clear();
+		layouts.clear();
+		colors.clear();
+		color_ids.clear();
+		std::optional<vk::RenderingAttachmentInfoKHR> depth;
+		vk::Format depth_format = vk::Format::eUndefined;
+		for (size_t i = 0; i < group.attachments.size(); ++i)
+		{
+			auto const id = group.attachments[i];
+			auto const& desc = group.descriptions[i];
+			auto const use = std::find_if(pass.uses.begin(), pass.uses.end(), [id](Use const& use) { return use.resource == id; });
+			auto const layout = layoutFor(use->access, m_resources[id].format);
+			layouts.push_back(layout);
+			barriers.push_back(imageBarrier(id, image_index, desc.initialLayout, layout, attachmentWrites(), attachmentAccess() | vk::AccessFlagBits::eShaderRead));
+
+			vk::RenderingAttachmentInfoKHR attachment{};
+			attachment.imageView = view(id, image_index);
+			attachment.imageLayout = layout;
+			attachment.loadOp = desc.loadOp;
+			attachment.storeOp = desc.storeOp;
+			attachment.clearValue = m_resources[id].clear_value;
+			if (use->access == Access::Resolve)
+				continue;
+			if (use->access == Access::Color)
+			{
+				colors.push_back(attachment);
+				color_ids.push_back(id);
+			}
+			else
+			{
+				depth = attachment;
+				depth_format = m_resources[id].format;
+			}
+		}
+		for (size_t i = 0; i < group.attachments.size(); ++i)
+		{
+			auto const id = group.attachments[i];
+			auto const use = std::find_if(pass.uses.begin(), pass.uses.end(), [id](Use const& use) { return use.resource == id; });
+			if (use->access != Access::Resolve)
+				continue;
+			auto& color = colors[std::find(color_ids.begin(), color_ids.end(), use->resolve_source) - color_ids.begin()];
+			color.resolveMode = isIntegerFormat(m_resources[use->resolve_source].format) ? vk::ResolveModeFlagBits::eSampleZero : vk::ResolveModeFlagBits::eAverage;
+			color.resolveImageView = view(id, image_index);
+			color.resolveImageLayout = layouts[i];
+		}
+		// the entry dependency of the render pass path
+		cmd.pipelineBarrier(attachmentStages() | vk::PipelineStageFlagBits::eFragmentShader, attachmentStages() | vk::PipelineStageFlagBits::eFragmentShader,
+			{}, nullptr, nullptr, barriers);
+
+		vk::RenderingInfoKHR rendering_info{};
+		if (pass.contents == vk::SubpassContents::eSecondaryCommandBuffers)
+			rendering_info.flags = vk::RenderingFlagBitsKHR::eContentsSecondaryCommandBuffers;
+		rendering_info.renderArea = vk::Rect2D({ 0, 0 }, m_extent);
+		rendering_info.layerCount = 1;
+		rendering_info.colorAttachmentCount = static_cast<uint32_t>(colors.size());
+		rendering_info.pColorAttachments = colors.data();
+		rendering_info.pDepthAttachment = depth ? &*depth : nullptr;
+		rendering_info.pStencilAttachment = depth && hasStencil(depth_format) ? &*depth : nullptr;
+		auto const group_begin_info = deviceGroupBeginInfo();
+		if (!m_device_areas.empty())
+			rendering_info.pNext = &group_begin_info;
+
+		cmd.beginRenderingKHR(rendering_info, *m_dispatch);
+		pass.record(cmd, image_index);
+		cmd.endRenderingKHR(*m_dispatch);
+
+		// and its exit dependency, including the final layouts
+		barriers.clear();
+		for (size_t i = 0; i < group.attachments.size(); ++i)
+			barriers.push_back(imageBarrier(group.attachments[i], image_index, layouts[i], group.descriptions[i].finalLayout, attachmentWrites(), exitAccess()));
+		cmd.pipelineBarrier(attachmentStages(), exitStages(), {}, nullptr, nullptr, barriers);
+	}
+
+	void createFramebuffers()
+	{
+		if (m_dynamic)
+			return;
+		auto const image_count = std::max(m_image_count, 1u);
+		for (auto& group : m_groups)
+		{
+			for (uint32_t image = 0; image < image_count; ++image)
+			{
+				std::vector<vk::ImageView> views;
+				for (auto const id : group.attachments)
+					views.push_back(view(id, image));
+
+				vk::FramebufferCreateInfo fb_ci{};
+				fb_ci.renderPass = group.render_pass;
+				fb_ci.attachmentCount = static_cast<uint32_t>(views.size());
+				fb_ci.pAttachments = views.data();
+				fb_ci.width = m_extent.width;
+				fb_ci.height = m_extent.height;
+				fb_ci.layers = 1;
+				group.framebuffers.push_back(m_device.createFramebufferUnique(fb_ci));
+			}
+		}
+	}
+
+	void releaseTransients()
+	{
+		m_groups.clear();
+		for (auto& resource : m_resources)
+		{
+			resource.view.reset();
+			if (resource.image)
+				m_device.destroyImage(resource.image);
+			resource.image = nullptr;
+			m_allocator.free(resource.memory);
+			resource.memory = {};
+		}
+		m_transient_memory_size = 0;
+	}
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	vk::Extent2D m_extent;
+	uint32_t m_image_count = 0;
+	std::vector<ResourceData> m_resources;
+	std::vector<PassData> m_passes;
+	std::vector<Group> m_groups;
+	vk::DeviceSize m_transient_memory_size = 0;
+	vk::DispatchLoaderDynamic const* m_dispatch = nullptr;
+	bool m_dynamic = false;
+	std::vector<vk::Rect2D> m_device_areas;
+	RenderPassCache* m_render_pass_cache = nullptr;
+	// what recording a frame fills, kept so the frames after the first one don't allocate
+	struct Scratch
+	{
+		std::vector<vk::ClearValue> clear_values;
+		std::vector<vk::ImageMemoryBarrier> barriers;
+		std::vector<vk::ImageLayout> layouts;
+		std::vector<vk::RenderingAttachmentInfoKHR> colors;
+		std::vector<ResourceId> color_ids;
+	};
+	mutable Scratch m_scratch;
+};
@@ -0,0 +1,501 @@
+#pragma once
+
+#include "capture_ring.h"
+#include "shared_memory.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Rendering split off into a worker process, so a driver that hangs in vkCreateDevice or faults takes down the
+// worker and not the process serving its frames. The supervisor creates the shared memory, starts the worker
+// with "--worker <name>" and restarts it when it crashes or its heartbeat stops; the worker renders headless and
+// its frames land in the shared memory's slots, which the supervisor reads in place.
+
+// The layout at the start of the shared memory, followed by the slots. Only lock-free atomics, which work
+// across processes, are written by both sides.
+struct RenderWorkerHeader
+{
+	static constexpr uint32_t magic_value = 0x4B524F57; // "WORK"
+	static constexpr uint32_t version_value = 1;
+	static constexpr uint32_t max_slots = 8;
+	static constexpr uint32_t no_slot = ~0u;
+
+	enum class Status : uint32_t
+	{
+		// creating its device or recovering from a device loss, under the startup timeout
+		Starting,
+		Rendering,
+		// done, the worker exits by itself
+		Finished
+	};
+
+	enum class SlotState : uint32_t
+	{
+		// the worker may fill it
+		Free,
+		// holds a frame, the supervisor may take it for reading and the worker may reclaim it
+		Ready,
+		// the supervisor reads it in place
+		Reading
+	};
+
+	struct Slot
+	{
+		std::atomic<uint32_t> state;
+		std::atomic<uint64_t> serial;
+	};
+
+	// written by the supervisor before it starts a worker
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t row_pitch;
+	uint32_t slot_count;
+	uint64_t slot_offset;
+	uint64_t slot_stride;
+	// the worker's
+	std::atomic<uint32_t> format;
+	std::atomic<uint32_t> status;
+	std::atomic<uint64_t> heartbeat;
+	std::atomic<uint32_t> latest;
+	std::array<Slot, max_slots> slots;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+	"the shared header needs address-free atomics");
+
+struct RenderWorkerConfig
+{
+	// the worker binary, usually this one, and what it gets after "--worker <name>"
+	std::string executable;
+	std::vector<std::string> arguments;
+	// of the worker's headless target, its frames are B8G8R8A8
+	vk::Extent2D extent{ 1280, 720 };
+	// one is read, one is the latest, the others are rendered into
+	uint32_t slots = 3;
+	// a worker that rendered before and sends no heartbeat for this long is restarted
+	std::chrono::milliseconds hang_timeout{ 2000 };
+	// the same from its start or a recovery, which include vkCreateDevice and the pipeline compiles
+	std::chrono::milliseconds startup_timeout{ 20000 };
+	// the supervisor gives up after this many restarts in a row without a rendered frame in between
+	uint32_t max_restarts = 5;
+};
+
+// The worker process as the supervisor sees it. A process stuck inside the driver may not go away at once when
+// killed, the supervisor waits a moment and then starts the next worker regardless.
+class WorkerProcess
+{
+public:
+	WorkerProcess() = default;
+
+	static WorkerProcess start(std::string const& executable, std::vector<std::string> const& arguments)
+	{
+		WorkerProcess process;
+#ifdef _WIN32
+		std::string command_line = "\"" + executable + "\"";
+		for (auto const& arg : arguments)
+			command_line += " \"" + arg + "\"";
+		STARTUPINFOA startup{};
+		startup.cb = sizeof(startup);
+		PROCESS_INFORMATION info{};
+		if (!CreateProcessA(executable.c_str(), command_line.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &info))
+			throw std::runtime_error("Can not start the render worker " + executable);
+		CloseHandle(info.hThread);
+		process.m_process = info.hProcess;
+#else
+		std::vector<char*> argv;
+		argv.push_back(const_cast<char*>(executable.c_str()));
+		for (auto const& arg : arguments)
+			argv.push_back(const_cast<char*>(arg.c_str()));
+		argv.push_back(nullptr);
+		auto const pid = fork();
+		if (pid < 0)
+			throw std::runtime_error("Can not start the render worker " + executable);
+		if (pid == 0)
+		{
+			execv(executable.c_str(), argv.data());
+			_exit(127);
+		}
+		process.m_pid = pid;
+#endif
+		return process;
+	}
+
+	~WorkerProcess()
+	{
+		kill();
+	}
+
+	WorkerProcess(WorkerProcess&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	WorkerProcess& operator=(WorkerProcess&& other) noexcept
+	{
+		if (this != &other)
+		{
+			kill();
+#ifdef _WIN32
+			m_process = std::exchange(other.m_process, nullptr);
+#else
+			m_pid = std::exchange(other.m_pid, -1);
+#endif
+		}
+		return *this;
+	}
+
+	WorkerProcess(WorkerProcess const&) = delete;
+	WorkerProcess& operator=(WorkerProcess const&) = delete;
+
+	bool running() const
+	{
+#ifdef _WIN32
+		return m_process != nullptr;
+#else
+		return m_pid > 0;
+#endif
+	}
+
+	// the exit code once the process ended, which also stops tracking it
+	std::optional<int> exited()
+	{
+		if (!running())
+			return std::nullopt;
+#ifdef _WIN32
+		if (WaitForSingleObject(m_process, 0) != WAIT_OBJECT_0)
+			return std::nullopt;
+		DWORD code = 0;
+		GetExitCodeProcess(m_process, &code);
+		CloseHandle(m_process);
+		m_process = nullptr;
+		return static_cast<int>(code);
+#else
+		int status = 0;
+		if (waitpid(m_pid, &status, WNOHANG) != m_pid)
+			return std::nullopt;
+		m_pid = -1;
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+	}
+
+	void kill(std::chrono::milliseconds grace = std::chrono::milliseconds(1000))
+	{
+		if (!running())
+			return;
+#ifdef _WIN32
+		TerminateProcess(m_process, 3);
+		WaitForSingleObject(m_process, static_cast<DWORD>(grace.count()));
+		CloseHandle(m_process);
+		m_process = nullptr;
+#else
+		::kill(m_pid, SIGKILL);
+		auto const until = std::chrono::steady_clock::now() + grace;
+		int status = 0;
+		while (waitpid(m_pid, &status, WNOHANG) == 0 && std::chrono::steady_clock::now() < until)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		m_pid = -1;
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE m_process = nullptr;
+#else
+	pid_t m_pid = -1;
+#endif
+};
+
+// A frame as the supervisor serves it, valid until the next frame() or poll()
+struct SupervisedFrame
+{
+	void const* pixels = nullptr;
+	vk::Extent2D extent;
+	vk::Format format = vk::Format::eUndefined;
+	uint32_t row_pitch = 0;
+	// of the worker that rendered it, starts over with every worker
+	uint64_t serial = 0;
+	// false for the last good frame of a worker that was restarted, until the next one renders
+	bool live = false;
+};
+
+// The supervisor's side: owns the shared memory and the worker process. Single threaded.
+class RenderWorkerSupervisor
+{
+public:
+	explicit RenderWorkerSupervisor(RenderWorkerConfig config)
+		: m_config(std::move(config))
+	{
+		m_config.slots = std::clamp(m_config.slots, 3u, RenderWorkerHeader::max_slots);
+		// views and imports both want the slots at the allocation granularity, 64 KiB covers every OS and device
+		constexpr uint64_t alignment = 64 * 1024;
+		auto const align = [](uint64_t size) { return (size + alignment - 1) / alignment * alignment; };
+		auto const row_pitch = m_config.extent.width * 4;
+		auto const slot_offset = align(sizeof(RenderWorkerHeader));
+		auto const slot_stride = align(uint64_t(row_pitch) * m_config.extent.height);
+		m_name = "bugexample_worker_" + std::to_string(currentProcessId()) + "_" + std::to_string(reinterpret_cast<uintptr_t>(this));
+		m_memory = SharedMemory::create(m_name, static_cast<size_t>(slot_offset + slot_stride * m_config.slots));
+
+		auto* const header = new (m_memory.data()) RenderWorkerHeader{};
+		header->magic = RenderWorkerHeader::magic_value;
+		header->version = RenderWorkerHeader::version_value;
+		header->width = m_config.extent.width;
+		header->height = m_config.extent.height;
+		header->row_pitch = row_pitch;
+		header->slot_count = m_config.slots;
+		header->slot_offset = slot_offset;
+		header->slot_stride = slot_stride;
+		m_header = header;
+		startWorker();
+	}
+
+	RenderWorkerSupervisor(RenderWorkerSupervisor const&) = delete;
+	RenderWorkerSupervisor& operator=(RenderWorkerSupervisor const&) = delete;
+
+	std::string const& name() const { return m_name; }
+	uint32_t restarts() const { return m_restarts; }
+
+	// restarts a worker that crashed or hangs; false once the worker finished, or kept failing past max_restarts
+	bool poll()
+	{
+		auto const now = std::chrono::steady_clock::now();
+		auto const beat = m_header->heartbeat.load(std::memory_order_acquire);
+		auto const status = static_cast<RenderWorkerHeader::Status>(m_header->status.load(std::memory_order_acquire));
+		if (beat != m_last_beat)
+		{
+			m_last_beat = beat;
+			m_last_beat_at = now;
+			if (status == RenderWorkerHeader::Status::Rendering)
+				m_failures = 0;
+		}
+		if (auto const code = m_worker.exited())
+		{
+			if (*code == 0 && status == RenderWorkerHeader::Status::Finished)
+				return false;
+			std::cerr << "Render worker exited with " << *code << ", restarting" << std::endl;
+			return restart();
+		}
+		auto const timeout = status == RenderWorkerHeader::Status::Rendering ? m_config.hang_timeout : m_config.startup_timeout;
+		if (now - m_last_beat_at > timeout)
+		{
+			std::cerr << "Render worker sent no heartbeat for " << timeout.count() << " ms, restarting" << std::endl;
+			return restart();
+		}
+		return true;
+	}
+
+	// the newest complete frame, read in place while the worker runs; null before the first one
+	SupervisedFrame const* frame()
+	{
+		auto const latest = m_header->latest.load(std::memory_order_acquire);
+		if (latest != RenderWorkerHeader::no_slot && latest != m_reading)
+		{
+			auto& slot = m_header->slots[latest];
+			auto expected = static_cast<uint32_t>(RenderWorkerHeader::SlotState::Ready);
+			// fails when the worker reclaimed it for a newer frame, which the next call takes
+			if (slot.state.compare_exchange_strong(expected, static_cast<uint32_t>(RenderWorkerHeader::SlotState::Reading), std::memory_order_acq_rel))
+			{
+				if (m_reading != RenderWorkerHeader::no_slot)
+					m_header->slots[m_reading].state.store(static_cast<uint32_t>(RenderWorkerHeader::SlotState::Ready), std::memory_order_release);
+				m_reading = latest;
+				m_frame.pixels = slotPixels(latest);
+				m_frame.extent = m_config.extent;
+				m_frame.format = static_cast<vk::Format>(m_header->format.load(std::memory_order_relaxed));
+				m_frame.row_pitch = m_header->row_pitch;
+				m_frame.serial = slot.serial.load(std::memory_order_relaxed);
+				m_frame.live = true;
+			}
+		}
+		return m_frame.pixels ? &m_frame : nullptr;
+	}
+
+private:
+	static uint64_t currentProcessId()
+	{
+#ifdef _WIN32
+		return GetCurrentProcessId();
+#else
+		return static_cast<uint64_t>(getpid());
+#endif
+	}
+
+	void* slotPixels(uint32_t slot) const
+	{
+		return static_cast<uint8_t*>(m_memory.data()) + m_header->slot_offset + m_header->slot_stride * slot;
+	}
+
+	bool restart()
+	{
+		m_worker.kill();
+		if (++m_failures > m_config.max_restarts)
+		{
+			std::cerr << "Render worker failed " << m_failures << " times in a row, giving up" << std::endl;
+			return false;
+		}
+		++m_restarts;
+		// the frame being read is the last good one, copied out so the next worker can have every slot
+		if (m_reading != RenderWorkerHeader::no_slot)
+		{
+			m_last_good.assign(static_cast<uint8_t const*>(slotPixels(m_reading)),
+				static_cast<uint8_t const*>(slotPixels(m_reading)) + size_t(m_header->row_pitch) * m_header->height);
+			m_frame.pixels = m_last_good.data();
+			m_frame.live = false;
+			m_reading = RenderWorkerHeader::no_slot;
+		}
+		startWorker();
+		return true;
+	}
+
+	// no worker runs, the supervisor is the only one touching the header
+	void startWorker()
+	{
+		m_header->status.store(static_cast<uint32_t>(RenderWorkerHeader::Status::Starting), std::memory_order_relaxed);
+		m_header->heartbeat.store(0, std::memory_order_relaxed);
+		m_header->latest.store(RenderWorkerHeader::no_slot, std::memory_order_relaxed);
+		for (auto& slot : m_header->slots)
+		{
+			slot.state.store(static_cast<uint32_t>(RenderWorkerHeader::SlotState::Free), std::memory_order_relaxed);
+			slot.serial.store(0, std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		std::vector<std::string> arguments = { "--worker", m_name };
+		arguments.insert(arguments.end(), m_config.arguments.begin(), m_config.arguments.end());
+		m_worker = WorkerProcess::start(m_config.executable, arguments);
+		m_last_beat = 0;
+		m_last_beat_at = std::chrono::steady_clock::now();
+	}
+
+	RenderWorkerConfig m_config;
+	std::string m_name;
+	SharedMemory m_memory;
+	RenderWorkerHeader* m_header = nullptr;
+	WorkerProcess m_worker;
+	uint64_t m_last_beat = 0;
+	std::chrono::steady_clock::time_point m_last_beat_at;
+	uint32_t m_restarts = 0;
+	uint32_t m_failures = 0;
+	uint32_t m_reading = RenderWorkerHeader::no_slot;
+	SupervisedFrame m_frame;
+	std::vector<uint8_t> m_last_good;
+};
+
+// The worker's side: opens the supervisor's shared memory and hands the scene what it needs to capture into it.
+// Render thread only.
+class RenderWorkerChannel
+{
+public:
+	explicit RenderWorkerChannel(std::string const& name)
+		: m_memory(SharedMemory::open(name))
+		, m_header(static_cast<RenderWorkerHeader*>(m_memory.data()))
+	{
+		if (m_memory.size() < sizeof(RenderWorkerHeader) || m_header->magic != RenderWorkerHeader::magic_value
+			|| m_header->version != RenderWorkerHeader::version_value || m_header->slot_count > RenderWorkerHeader::max_slots
+			|| m_memory.size() < m_header->slot_offset + m_header->slot_stride * m_header->slot_count)
+			throw std::runtime_error("Shared memory " + name + " is not a render worker's!");
+	}
+
+	vk::Extent2D extent() const { return vk::Extent2D{ m_header->width, m_header->height }; }
+	uint32_t slotCount() const { return m_header->slot_count; }
+
+	// for CaptureConfig::host_memory, the capture ring then renders into the slots directly
+	CaptureHostMemory hostMemory() const
+	{
+		CaptureHostMemory memory;
+		for (uint32_t i = 0; i < m_header->slot_count; ++i)
+			memory.slots.push_back(slotPixels(i));
+		memory.slot_size = m_header->slot_stride;
+		auto* const header = m_header;
+		memory.writable = [header](uint32_t slot)
+		{
+			return header->slots[slot].state.load(std::memory_order_acquire) == static_cast<uint32_t>(RenderWorkerHeader::SlotState::Free);
+		};
+		return memory;
+	}
+
+	// every render loop iteration, e.g. from SceneConfig::on_frame
+	void heartbeat()
+	{
+		m_header->heartbeat.fetch_add(1, std::memory_order_release);
+	}
+
+	// before a device recovery, which may take as long as the startup
+	void recovering()
+	{
+		m_header->status.store(static_cast<uint32_t>(RenderWorkerHeader::Status::Starting), std::memory_order_release);
+		heartbeat();
+	}
+
+	void finish()
+	{
+		m_header->status.store(static_cast<uint32_t>(RenderWorkerHeader::Status::Finished), std::memory_order_release);
+	}
+
+	// from CaptureConfig::on_frame; frames the scene captured into its own buffers are copied into a free slot
+	void publish(CaptureFrame const& frame)
+	{
+		uint32_t slot = frame.slot;
+		bool const in_place = slot < m_header->slot_count && frame.pixels == slotPixels(slot);
+		if (!in_place)
+		{
+			slot = RenderWorkerHeader::no_slot;
+			for (uint32_t i = 0; i < m_header->slot_count && slot == RenderWorkerHeader::no_slot; ++i)
+				if (m_header->slots[i].state.load(std::memory_order_acquire) == static_cast<uint32_t>(RenderWorkerHeader::SlotState::Free))
+					slot = i;
+			if (slot == RenderWorkerHeader::no_slot || frame.size > m_header->slot_stride || frame.row_pitch != m_header->row_pitch)
+			{
+				frame.release();
+				return;
+			}
+			std::memcpy(slotPixels(slot), frame.pixels, static_cast<size_t>(frame.size));
+		}
+		// imported slots stay out of the ring's use by their shared state, the capture goes back at once
+		frame.release();
+
+		m_header->format.store(static_cast<uint32_t>(frame.format), std::memory_order_relaxed);
+		m_header->slots[slot].serial.store(frame.serial, std::memory_order_relaxed);
+		m_header->slots[slot].state.store(static_cast<uint32_t>(RenderWorkerHeader::SlotState::Ready), std::memory_order_release);
+		m_header->latest.store(slot, std::memory_order_release);
+		m_header->status.store(static_cast<uint32_t>(RenderWorkerHeader::Status::Rendering), std::memory_order_release);
+		// older frames the supervisor does not read become free again
+		for (uint32_t i = 0; i < m_header->slot_count; ++i)
+		{
+			if (i == slot)
+				continue;
+			auto expected = static_cast<uint32_t>(RenderWorkerHeader::SlotState::Ready);
+			m_header->slots[i].state.compare_exchange_strong(expected, static_cast<uint32_t>(RenderWorkerHeader::SlotState::Free), std::memory_order_acq_rel);
+		}
+	}
+
+private:
+	void* slotPixels(uint32_t slot) const
+	{
+		return static_cast<uint8_t*>(m_memory.data()) + m_header->slot_offset + m_header->slot_stride * slot;
+	}
+
+	SharedMemory m_memory;
+	RenderWorkerHeader* m_header;
+};
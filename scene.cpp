@@ -0,0 +1,2275 @@
+#include "scene.h"
+
+#include "vertex.vert.h"
+#include "vertex.vert.reflect.h"
+#include "fragment.frag.h"
+#include "fragment.frag.reflect.h"
+
+// the shader build emits the SPIR-V as constexpr arrays
+static_assert(isSpirv(::Vertex_vert), "vertex.vert.h does not contain SPIR-V");
+static_assert(isSpirv(::Fragment_frag), "fragment.frag.h does not contain SPIR-V");
+static_assert(alignof(decltype(::Vertex_vert)) >= alignof(std::uint32_t) && alignof(decltype(::Fragment_frag)) >= alignof(std::uint32_t),
+	"SPIR-V must be 4 byte aligned");
+
+// Vertex.vert reads GpuInstance at the first locations, binding 0, and the mesh vertex from there on, binding 1
+static constexpr uint32_t instance_locations = 5;
+static constexpr uint32_t mesh_binding = 1;
+
+// matches the specialization constants of Fragment.frag
+struct FragmentConstants
+{
+	uint32_t loop_iterations = 0;
+};
+
+// The program's global operator new and delete, so HeapCounter sees every heap allocation of the main and the
+// benchmark executable, both link this file. The array, nothrow and sized forms forward to these.
+static void* heapAllocate(std::size_t size, std::size_t alignment)
+{
+	HeapCounter::add();
+	size = std::max<std::size_t>(size, 1);
+	while (true)
+	{
+#ifdef _MSC_VER
+		void* const memory = alignment > alignof(std::max_align_t) ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+		void* const memory = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1)) : std::malloc(size);
+#endif
+		if (memory)
+			return memory;
+		auto const handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new(std::size_t size) { return heapAllocate(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return heapAllocate(size, static_cast<std::size_t>(alignment)); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+void operator delete(void* memory, [[maybe_unused]] std::align_val_t alignment) noexcept
+{
+#ifdef _MSC_VER
+	if (static_cast<std::size_t>(alignment) > alignof(std::max_align_t))
+		return _aligned_free(memory);
+#endif
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept { operator delete(memory, alignment); }
+
+// the callback has no user pointer, the scene that initialized GLFW counts its errors until it terminates GLFW
+static Counter* glfw_errors = nullptr;
+
+Scene::Scene(SceneConfig const& config)
+	: m_config(config)
+	, m_watchdog(config.watchdog)
+	, m_metrics(m_metrics_registry)
+	, m_latency_mode(config.latency_mode)
+	, m_objects(config.max_scene_objects)
+{
+	if (m_config.frames_in_flight == 0)
+		throw std::runtime_error("At least one frame in flight is required!");
+	if (m_config.swapchain_images == 0)
+		throw std::runtime_error("At least one swapchain image is required!");
+	if (m_config.windows.empty())
+		throw std::runtime_error("At least one window is required!");
+	for (auto const& window : m_config.windows)
+		if (window.present_interval == 0)
+			throw std::runtime_error("The present interval of a window must be at least 1!");
+	m_profile_exporter = std::make_unique<ProfileExporter>(m_profiler, m_config.profile_output);
+	if (!m_config.metrics.prometheus_file.empty() || !m_config.metrics.shared_memory.empty())
+		m_metrics_exporter = std::make_unique<MetricsExporter>(m_metrics_registry, m_config.metrics);
+	m_pacer.setMargin(m_config.present_pacing.margin);
+	m_disabled_workloads.insert(m_config.disabled_workloads.begin(), m_config.disabled_workloads.end());
+}
+
+TaskGraph::Report Scene::initialize()
+{
+	// neither the allocator nor the descriptor layout cache is thread safe, so the steps using them are chained;
+	// GLFW calls that need the main thread and steps that wait for thread pool jobs run on the calling thread
+	LinearArena::Scope const arena_scope(m_init_arena);
+	TaskGraph graph;
+	auto const window_system = graph.add("initialize window system", {}, [this] { initializeWindowSystem(); }, true);
+	auto const windows = graph.add("create windows", { window_system }, [this] { createWindows(); }, true);
+	// the instance extensions GLFW needs are known once it is initialized
+	auto const instance = graph.add("create instance", { window_system }, [this] { initializeVKInstance(); });
+	auto const surfaces = graph.add("create surfaces", { windows, instance }, [this]
+	{
+		if (!m_config.headless)
+			for (auto& output : m_outputs)
+				createSurface(*output);
+	});
+	auto const physical_device = graph.add("select physical device", { surfaces }, [this]
+	{
+		selectQueueFamilyAndPhysicalDevice(m_config.device_uuid ? m_config.device_uuid : DeviceSelector::uuidFromEnvironment());
+	});
+	auto const device = graph.add("create device", { physical_device }, [this] { initializeDevice(); });
+	auto const allocator = graph.add("create allocator", { device }, [this] { createAllocator(); });
+	auto const breadcrumbs = graph.add("create breadcrumbs", { allocator }, [this] { createBreadcrumbs(); });
+	auto const staging = graph.add("create staging ring", { breadcrumbs }, [this] { createStagingRing(); });
+	auto const uploads = graph.add("create upload engine", { staging }, [this] { createUploadEngine(); });
+	auto const objects = graph.add("create scene storage", { uploads }, [this] { createSceneStorage(); });
+	auto const meshes = graph.add("create mesh pool", { objects }, [this] { createMeshPool(); });
+	graph.add("create compute scheduler", { device }, [this] { createComputeScheduler(); });
+	// independent of the scene's device, only the GPUs it renders with have to be known
+	graph.add("create compute offload", { device }, [this] { createComputeOffload(); });
+	graph.add("create timestamp queries", { device }, [this] { createGpuTimestamps(); });
+	auto const descriptors = graph.add("create descriptor allocators", { device }, [this] { createDescriptors(); });
+	auto const pipeline_cache = graph.add("create pipeline cache", { device }, [this] { createPipelineCache(); });
+	// allocates and fills the bindless table, so between the mesh pool and the culling on the allocator
+	auto const textures = graph.add("create texture streamer", { meshes, descriptors }, [this] { createTextureStreamer(); });
+	// blocks on its compute pipelines, which compile on the thread pool
+	auto const culling = graph.add("create gpu culling", { textures, uploads, objects, meshes, descriptors, pipeline_cache }, [this] { createGpuCulling(); }, true);
+	// swapchains only need the device, the offscreen target allocates
+	auto const swapchains = graph.add("create swapchains", { m_config.headless ? culling : device }, [this]
+	{
+		if (m_config.headless)
+			createOffscreenTarget();
+		else
+			for (auto& output : m_outputs)
+				createSwapChainAndImages(*output);
+	});
+	auto const image_views = graph.add("create image views", { swapchains }, [this]
+	{
+		for (auto& output : m_outputs)
+			createSwapChainImageViews(*output);
+	});
+	auto const render_graphs = graph.add("create render graphs", { image_views, culling }, [this]
+	{
+		for (auto& output : m_outputs)
+			createRenderGraph(*output);
+	});
+	auto const command_buffers = graph.add("allocate command buffers", { swapchains }, [this] { allocateCommandBuffers(); });
+	// allocates the loop violation buffer, after the render graphs' transients
+	auto const shader_interface = graph.add("create pipeline layout", { descriptors, render_graphs }, [this] { createShaderInterface(); });
+	graph.add("create pipeline", { shader_interface, render_graphs, pipeline_cache }, [this] { createPipeline(); });
+	graph.add("create sync objects", { command_buffers }, [this] { initSyncEntities(); });
+	// reads the pipeline cache's contents, so after it was created
+	graph.add("start standby device", { pipeline_cache }, [this] { startStandby(); });
+	graph.add("create shader watcher", {}, [this]
+	{
+		if (!m_config.shader_reload_dir.empty())
+			m_shader_watcher = std::make_unique<ShaderWatcher>(std::vector<std::filesystem::path>{
+				m_config.shader_reload_dir / "Vertex.vert", m_config.shader_reload_dir / "Fragment.frag" });
+	});
+	auto report = graph.run(m_thread_pool);
+	m_init_arena.reset();
+	return report;
+}
+
+void Scene::run()
+{
+	if (m_config.headless)
+	{
+		renderLoop();
+		return;
+	}
+
+	m_render_done = false;
+	std::exception_ptr error;
+	std::thread render_thread([this, &error]
+	{
+		try
+		{
+			renderLoop();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		m_render_done = true;
+		// wakes the event loop
+		glfwPostEmptyEvent();
+	});
+
+	// a slow present or fence wait no longer delays event handling
+	bool quit = false;
+	while (!m_render_done)
+	{
+		glfwWaitEvents();
+		if (!quit)
+			quit = !pollWindows();
+	}
+	render_thread.join();
+	// packets the render thread did not get to, past a Quit too, so closed windows are released by their outputs
+	while (!applyPackets())
+		;
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void Scene::renderLoop()
+{
+	LinearArena::Scope const arena_scope(m_frame_arena);
+	uint64_t heap_allocations = HeapCounter::count();
+	for (uint64_t iteration = 0;; ++iteration)
+	{
+		// what the previous iteration allocated, by now the frame arena has grown to what an iteration needs
+		if (iteration > 0)
+		{
+			m_frame_heap_allocations = HeapCounter::count() - heap_allocations;
+			if (m_config.heap_free_after != 0 && iteration > m_config.heap_free_after && m_frame_heap_allocations != 0)
+				throw std::runtime_error("Render loop iteration " + std::to_string(iteration - 1) + " made " + std::to_string(m_frame_heap_allocations) + " heap allocations!");
+		}
+		heap_allocations = HeapCounter::count();
+		m_frame_arena.reset();
+		if (m_config.max_frames != 0 && m_frame_timeline->submitted() >= m_config.max_frames)
+			break;
+		if (m_config.on_frame)
+			m_config.on_frame(m_frame_timeline->submitted());
+
+		// outside the frame's phases, the time slept is not part of the frame
+		m_limiter.setTargetRate(frameRateLimit());
+		m_limiter.wait();
+		// before the poll, so the frame takes the latest input along
+		pacePresent();
+		m_profiler.beginFrame();
+		if (!m_config.headless)
+		{
+			{
+				auto const scope = m_profiler.phase(FramePhase::Poll);
+				if (!applyPackets())
+					break;
+			}
+			bool visible = false;
+			for (auto& output : m_outputs)
+				if (!output->iconified && (!output->dirty || recreateSwapchain(*output)))
+					visible = true;
+			if (!visible)
+			{
+				// every window is minimized, nothing to present until a packet restores one
+				waitForPacket();
+				continue;
+			}
+		}
+		const uint64_t tick = m_tick++;
+
+		auto& frame = m_frames[m_frame_index];
+		if (!m_frame_timeline->reached(frame.serial))
+		{
+			auto const scope = m_profiler.phase(FramePhase::FenceWait);
+			m_watchdog.waitForSemaphore(*m_device, m_frame_timeline->semaphore(), frame.serial);
+		}
+		m_gpu_clock->calibrate();
+		m_profiler.retire(m_frame_index, m_gpu_timestamps->read(m_frame_index));
+		destroyRetiredObjects();
+		reloadShaders();
+		m_staging->beginFrame(m_frame_index);
+		m_descriptors->beginFrame(m_frame_index);
+		m_uploads->collect();
+		m_compute->collect();
+		if (m_offload)
+			m_offload->pump();
+
+		selectFrameDevice();
+		bool acquired = false;
+		{
+			auto const scope = m_profiler.phase(FramePhase::Acquire);
+			for (auto& output : m_outputs)
+			{
+				output->image_index.reset();
+				// minimized windows and windows between two of their presents skip the frame
+				if (output->dirty || output->iconified || tick % output->config.present_interval != 0)
+					continue;
+				output->image_index = acquireNextImage(*output, *output->acquire_semaphores[m_frame_index]);
+				if (output->image_index)
+					acquired = true;
+				else
+					output->dirty = true;
+			}
+		}
+		if (!acquired)
+			continue;
+
+		// an earlier frame of the ring may still be rendering into the acquired images
+		for (auto& output : m_outputs)
+		{
+			if (!output->image_index)
+				continue;
+			auto& image_serial = output->images_in_flight[*output->image_index];
+			if (!m_frame_timeline->reached(image_serial))
+			{
+				auto const scope = m_profiler.phase(FramePhase::FenceWait);
+				m_watchdog.waitForSemaphore(*m_device, m_frame_timeline->semaphore(), image_serial);
+			}
+			image_serial = m_frame_timeline->next();
+		}
+
+		deliverCaptures();
+		// the image's previous frame completed, so its readback is complete too
+		if (m_offscreen && m_config.on_readback)
+			if (auto const pixels = m_offscreen->takeReadback(*m_outputs.front()->image_index))
+				m_config.on_readback(pixels, m_offscreen->extent(), m_offscreen->format());
+
+		{
+			auto const scope = m_profiler.phase(FramePhase::Record);
+			updateMemoryBudget();
+			// uploads queued so far go out now, so this frame can already acquire them
+			m_meshes->upload(*m_staging);
+			m_objects.upload(*m_staging);
+			if (m_culler)
+				m_culler->upload();
+			if (m_textures)
+				m_textures->update(m_frame_timeline->submitted(), m_frame_timeline->completed());
+			m_uploads->submit();
+			recordFrame(frame);
+		}
+
+		{
+			auto const scope = m_profiler.phase(FramePhase::Submit);
+			std::pmr::vector<SubmitBatcher::Semaphore> waits(&m_frame_arena);
+			if (!m_offscreen)
+			{
+				for (auto const& output : m_outputs)
+					if (output->image_index)
+						waits.push_back({ *output->acquire_semaphores[m_frame_index], 0, vk::PipelineStageFlagBits::eColorAttachmentOutput });
+			}
+			if (auto const upload_wait = m_uploads->takeGraphicsWait())
+				waits.push_back({ upload_wait->semaphore, upload_wait->value, vk::PipelineStageFlagBits::eAllCommands });
+			if (auto const compute_wait = m_compute->takeGraphicsWait())
+				waits.push_back({ compute_wait->semaphore, compute_wait->value, compute_wait->stage });
+
+			// nobody would wait for the binary semaphore without a present
+			std::pmr::vector<SubmitBatcher::Semaphore> signals(&m_frame_arena);
+			if (!m_offscreen)
+			{
+				for (auto const& output : m_outputs)
+					if (output->image_index)
+						signals.push_back({ *output->render_semaphores[m_frame_index] });
+			}
+			signals.push_back({ m_frame_timeline->semaphore(), m_frame_timeline->next() });
+
+			m_submits->add(m_gr_queue, m_submit_cmds, waits, signals, frameDeviceMask());
+			// the frame's flush point: uploads, compute work and the frame go out in one call per queue, before
+			// the present waits on the render semaphores
+			m_submits->flushAll();
+			frame.serial = m_frame_timeline->advance();
+		}
+
+		if (!m_offscreen)
+		{
+			auto const scope = m_profiler.phase(FramePhase::Present);
+			m_present_batch.clear();
+			// the instance of the device that rendered the frame is shown
+			uint32_t present_mask = 0;
+			if (auto const mode = groupPresentMode(m_frame_device))
+			{
+				m_present_batch.setDeviceGroupMode(*mode);
+				present_mask = 1u << m_frame_device;
+			}
+			for (auto const& output : m_outputs)
+				if (output->image_index)
+					m_present_batch.add(*output->swapchain, *output->image_index, *output->render_semaphores[m_frame_index],
+						m_present_wait ? ++output->present_id : 0, present_mask);
+
+			auto const guard = m_watchdog.arm("vkQueuePresentKHR", maxDriverWait());
+			auto const& results = m_present_batch.present(m_gr_queue);
+			// in the order the outputs were added
+			size_t presented = 0;
+			for (auto& output : m_outputs)
+			{
+				if (!output->image_index)
+					continue;
+				auto const result = results[presented++];
+				if (result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR)
+					output->dirty = true;
+			}
+			if (m_outputs.front()->image_index)
+				m_pacer.presented(m_outputs.front()->present_id);
+		}
+
+		m_profiler.endFrame(m_frame_index);
+		recordFrameMetrics();
+		m_frame_index = (m_frame_index + 1) % m_config.frames_in_flight;
+	}
+	deliverPendingReadbacks();
+}
+
+void Scene::deliverPendingReadbacks()
+{
+	if (!m_offscreen || !m_config.on_readback)
+		return;
+	// the last frames' images are not acquired again, their readbacks go out in the order they were rendered
+	auto& output = *m_outputs.front();
+	auto const count = static_cast<uint32_t>(output.images.size());
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto const index = (m_offscreen->nextIndex() + i) % count;
+		auto const serial = output.images_in_flight[index];
+		if (serial == 0)
+			continue;
+		if (!m_frame_timeline->reached(serial))
+			m_watchdog.waitForSemaphore(*m_device, m_frame_timeline->semaphore(), serial);
+		if (auto const pixels = m_offscreen->takeReadback(index))
+			m_config.on_readback(pixels, m_offscreen->extent(), m_offscreen->format());
+	}
+}
+
+StepTimer Scene::recoverDevice(bool switch_device)
+{
+	LinearArena::Scope const arena_scope(m_init_arena);
+	StepTimer timer;
+	timer.time("destroy device objects", [this] { destroyDeviceObjects(); });
+	// reselecting also revalidates presentation support and queue families
+	timer.time("select physical device", [this, switch_device]
+	{
+		std::optional<DeviceUuid> preferred = m_phys_dev_uuid;
+		if (switch_device)
+		{
+			m_device_selector.blacklist(m_phys_dev_uuid);
+			preferred.reset();
+		}
+		selectQueueFamilyAndPhysicalDevice(preferred);
+	});
+	recreateDeviceObjects(timer);
+	m_init_arena.reset();
+	recordRecovery(timer);
+	return timer;
+}
+
+StepTimer Scene::failover()
+{
+	LinearArena::Scope const arena_scope(m_init_arena);
+	StepTimer timer;
+	timer.time("take standby device", [this]
+	{
+		auto standby = m_standby.take();
+		// it may have gone with the lost one, e.g. on the same GPU; nothing of the scene is destroyed yet then
+		{
+			auto const guard = m_watchdog.arm("vkDeviceWaitIdle", maxDriverWait());
+			standby.device->waitIdle();
+		}
+		m_takeover = std::move(standby);
+	});
+	timer.time("destroy device objects", [this] { destroyDeviceObjects(); });
+	timer.time("switch physical device", [this]
+	{
+		// the lost GPU hosts no further standby, it renders again only if nothing else is left
+		if (m_takeover->setup.candidate.uuid != m_phys_dev_uuid)
+			m_device_selector.blacklist(m_phys_dev_uuid);
+		useCandidate(m_takeover->setup.candidate);
+	});
+	recreateDeviceObjects(timer);
+	m_takeover.reset();
+	timer.time("start standby device", [this] { startStandby(); });
+	m_init_arena.reset();
+	m_metrics.failovers.add();
+	recordRecovery(timer);
+	return timer;
+}
+
+void Scene::startStandby()
+{
+	if (!m_config.standby.enabled)
+		return;
+	// ranked against the main window like the rendering device
+	auto const candidates = m_device_selector.rank(*m_instance, *m_outputs.front()->surface);
+	std::optional<DeviceCandidate> target;
+	if (!m_config.standby.same_gpu)
+		for (auto const& candidate : candidates)
+			if (candidate.suitable() && !candidate.blacklisted && !m_device_group.contains(candidate.device))
+			{
+				target = candidate;
+				break;
+			}
+	if (!target)
+		target = m_candidate;
+	auto setup = deviceSetup(*target);
+	auto initial_data = m_pipeline_cache.initialData(target->properties, m_config.pipeline_cache_dir);
+	std::cout << "standby device on " << target->properties.deviceName << std::endl;
+	// without the host allocator: the Device domain has to be empty once the rendering device is destroyed
+	m_standby.start([this, setup = std::move(setup), initial_data = std::move(initial_data)]
+	{
+		StandbyDevice standby{ setup };
+		standby.device = createLogicalDevice(setup, nullptr);
+		vk::PipelineCacheCreateInfo pc_ci{};
+		pc_ci.initialDataSize = initial_data.size();
+		pc_ci.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+		standby.pipeline_cache = standby.device->createPipelineCacheUnique(pc_ci);
+		return standby;
+	});
+}
+
+void Scene::recreateDeviceObjects(StepTimer& timer)
+{
+	timer.time("create device", [this] { initializeDevice(); });
+	timer.time("create allocator", [this] { createAllocator(); });
+	timer.time("create breadcrumbs", [this] { createBreadcrumbs(); });
+	timer.time("create staging ring", [this] { createStagingRing(); });
+	timer.time("create upload engine", [this] { createUploadEngine(); });
+	timer.time("create scene storage", [this] { createSceneStorage(); });
+	timer.time("create mesh pool", [this] { createMeshPool(); });
+	timer.time("create compute scheduler", [this] { createComputeScheduler(); });
+	timer.time("create timestamp queries", [this] { createGpuTimestamps(); });
+	timer.time("create descriptor allocators", [this] { createDescriptors(); });
+	timer.time("create pipeline cache", [this] { createPipelineCache(); });
+	timer.time("create texture streamer", [this] { createTextureStreamer(); });
+	timer.time("create gpu culling", [this] { createGpuCulling(); });
+	timer.time("create swapchains", [this]
+	{
+		if (m_config.headless)
+			createOffscreenTarget();
+		else
+			for (auto& output : m_outputs)
+				createSwapChainAndImages(*output);
+	});
+	timer.time("create image views", [this]
+	{
+		for (auto& output : m_outputs)
+			createSwapChainImageViews(*output);
+	});
+	timer.time("create render graphs", [this]
+	{
+		for (auto& output : m_outputs)
+			createRenderGraph(*output);
+	});
+	timer.time("allocate command buffers", [this] { allocateCommandBuffers(); });
+	timer.time("create pipeline layout", [this] { createShaderInterface(); });
+	timer.time("create pipeline", [this] { createPipeline(); });
+	timer.time("create sync objects", [this] { initSyncEntities(); });
+}
+
+void Scene::recordFrameMetrics()
+{
+	auto const& record = m_profiler.lastFrame();
+	m_metrics.frames.add();
+	m_metrics.frame_time.observe(record.frame_ms / 1000.0);
+	m_metrics.fence_wait.observe(record.phases[static_cast<size_t>(FramePhase::FenceWait)].duration_ms / 1000.0);
+	// headless frames are not presented
+	if (!m_offscreen)
+		m_metrics.present_latency.observe(record.acquire_to_present_ms / 1000.0);
+	if (record.input_to_present_ms >= 0.0)
+		m_metrics.input_latency.observe(record.input_to_present_ms / 1000.0);
+}
+
+void Scene::recordRecovery(StepTimer const& timer)
+{
+	m_metrics.recoveries.add();
+	m_metrics.recovery_duration.observe(timer.total().count() / 1000.0);
+}
+
+void Scene::diagnoseDeviceLoss()
+{
+	m_metrics.device_lost.add();
+	std::cerr << "  driver host memory:" << std::endl;
+	m_host_allocator.report(std::cerr);
+	if (!m_breadcrumbs)
+		return;
+	try
+	{
+		if (m_breadcrumbs->mode() == Breadcrumbs::Mode::None)
+			std::cerr << "  no breadcrumbs, the device has neither " VK_NV_DEVICE_DIAGNOSTIC_CHECKPOINTS_EXTENSION_NAME " nor " VK_AMD_BUFFER_MARKER_EXTENSION_NAME << std::endl;
+		auto const reports = m_breadcrumbs->report({ m_gr_queue, m_transfer_queue, m_compute_queue });
+		for (auto const& report : reports)
+		{
+			if (m_breadcrumbs->mode() == Breadcrumbs::Mode::None)
+				break;
+			std::cerr << "  " << report.queue << " queue: last started " << (report.last_started.empty() ? "-" : report.last_started)
+				<< ", last completed " << (report.last_completed.empty() ? "-" : report.last_completed) << std::endl;
+		}
+		auto const fault = m_breadcrumbs->faultDescription();
+		if (!fault.empty())
+			std::cerr << "  device fault: " << fault << std::endl;
+
+		if (auto const suspect = Breadcrumbs::suspect(reports))
+		{
+			m_disabled_workloads.insert(*suspect);
+			std::cerr << "  workload \"" << *suspect << "\" is disabled, pass --disable-workload \"" << *suspect
+				<< "\" to skip it in later runs" << std::endl;
+		}
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << "  breadcrumbs could not be read: " << e.what() << std::endl;
+	}
+}
+
+vk::PhysicalDeviceDriverProperties Scene::driverProperties() const
+{
+	if (m_phys_dev.getProperties().apiVersion < VK_MAKE_VERSION(1, 2, 0))
+		return {};
+	return m_phys_dev.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDriverProperties>().get<vk::PhysicalDeviceDriverProperties>();
+}
+
+bool Scene::workloadEnabled(Breadcrumbs::WorkloadId workload) const
+{
+	return m_disabled_workloads.count(m_breadcrumbs->name(workload)) == 0;
+}
+
+std::chrono::milliseconds Scene::maxDriverWait() const
+{
+	auto const& wd = m_watchdog.config();
+	return wd.fence_timeout * (1 << wd.fence_escalations) + wd.driver_grace;
+}
+
+void Scene::selectFrameDevice()
+{
+	if (m_multi_gpu != MultiGpuMode::AlternateFrame)
+		return;
+	for (uint32_t step = 1; step <= m_device_group.size(); ++step)
+	{
+		auto const device = (m_frame_device + step) % m_device_group.size();
+		if (m_config.headless || groupPresentMode(device))
+		{
+			m_frame_device = device;
+			return;
+		}
+	}
+}
+
+uint32_t Scene::frameDeviceMask() const
+{
+	switch (m_multi_gpu)
+	{
+	case MultiGpuMode::AlternateFrame: return 1u << m_frame_device;
+	case MultiGpuMode::SplitFrame: return m_device_group.allMask();
+	default: return 0;
+	}
+}
+
+std::optional<vk::DeviceGroupPresentModeFlagBitsKHR> Scene::groupPresentMode(uint32_t device) const
+{
+	if (!m_device_group.linked() || m_config.headless)
+		return std::nullopt;
+	// one mode for every window of the present
+	auto modes = m_device_group.presentModes();
+	for (auto const& output : m_outputs)
+		if (output->swapchain)
+			modes &= output->group_present_modes;
+	return m_device_group.presentModeFor(device, modes);
+}
+
+std::optional<uint32_t> Scene::acquireNextImage(Output& output, vk::Semaphore semaphore)
+{
+	if (m_offscreen)
+		return m_offscreen->acquire();
+
+	auto const& wd = m_watchdog.config();
+	auto const timeout = wd.fence_timeout * (1 << wd.fence_escalations);
+	auto const guard = m_watchdog.arm("vkAcquireNextImageKHR", timeout + wd.driver_grace);
+	auto const ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count());
+	try
+	{
+		// alternate frames: the image is acquired for the device rendering the frame
+		auto const result = m_multi_gpu == MultiGpuMode::AlternateFrame
+			? m_device->acquireNextImage2KHR(vk::AcquireNextImageInfoKHR{ *output.swapchain, ns, semaphore, {}, 1u << m_frame_device }, m_dispatch)
+			: m_device->acquireNextImageKHR(*output.swapchain, ns, semaphore, {});
+		if (result.result == vk::Result::eTimeout || result.result == vk::Result::eNotReady)
+			throw HangError(HangKind::GpuHung, "no swapchain image became available within " + std::to_string(timeout.count()) + " ms");
+		// a suboptimal image is still acquired and has to be presented
+		if (result.result == vk::Result::eSuboptimalKHR)
+			output.dirty = true;
+		return result.value;
+	}
+	catch (vk::OutOfDateKHRError const&)
+	{
+		return std::nullopt;
+	}
+}
+
+void Scene::destroyDeviceObjects()
+{
+	// children before their pools and everything before the device; destroying objects of a lost device is valid
+	m_deletion_queue.clear();
+	// the windows and surfaces stay, only their device objects go
+	for (auto& output : m_outputs)
+	{
+		output->image_index.reset();
+		output->secondary_cmds.clear();
+		output->acquire_semaphores.clear();
+		output->render_semaphores.clear();
+		output->images_in_flight.clear();
+		output->command_buffers.clear();
+		output->render_graph.reset();
+		output->image_views.clear();
+		output->images.clear();
+		output->swapchain.reset();
+	}
+	m_frames.clear();
+	m_recorder.reset();
+	m_frame_index = 0;
+	m_frame_timeline.reset();
+	if (m_pending_pipeline.valid())
+		m_pending_pipeline.wait();
+	m_pending_pipeline = {};
+	if (m_reloaded_pipeline.valid())
+		m_reloaded_pipeline.wait();
+	m_reloaded_pipeline = {};
+	if (m_optimized_pipeline.valid())
+		m_optimized_pipeline.wait();
+	m_optimized_pipeline = {};
+	m_pipeline = nullptr;
+	m_pipeline_layout.reset();
+	m_set_layouts.clear();
+	m_render_pass_cache.reset();
+	m_culler.reset();
+	m_loop_violations.reset();
+	// consumers get a moment to give their captures back, the pixels go with the device
+	if (m_capture)
+		m_retired_captures.push_back(std::move(m_capture));
+	for (auto const& ring : m_retired_captures)
+		if (!ring->waitReleased(m_config.capture.release_timeout))
+			std::cerr << "The capture consumer still holds frames, their pixels go with the device" << std::endl;
+	m_retired_captures.clear();
+	m_objects.detach();
+	m_meshes.reset();
+	m_textures.reset();
+	m_bindless.reset();
+	m_descriptors.reset();
+	m_layout_cache.reset();
+	m_cmd_b_pool.reset();
+	m_offscreen.reset();
+	m_pipeline_builder.reset();
+	m_pipeline_compiler.reset();
+	m_pipeline_cache.destroy();
+	m_compute.reset();
+	m_uploads.reset();
+	m_submits.reset();
+	m_gpu_timestamps.reset();
+	m_gpu_clock.reset();
+	m_gr_queue = nullptr;
+	m_transfer_queue = nullptr;
+	m_compute_queue = nullptr;
+	m_sparse_queue = nullptr;
+	m_staging.reset();
+	m_breadcrumbs.reset();
+	m_memory_budget.reset();
+	m_allocator.reset();
+	m_device.reset();
+
+	// the device's and its pipelines' host memory has to be back with the driver now
+	for (auto const domain : { HostAllocator::Domain::Device, HostAllocator::Domain::Pipelines })
+	{
+		auto const stats = m_host_allocator.stats(domain);
+		if (stats.live == 0)
+			continue;
+		std::cerr << "Driver host memory of the destroyed device was not freed: " << stats.bytes << " bytes in " << stats.live
+			<< " allocations (" << HostAllocator::toString(domain) << ")" << std::endl;
+		m_leaked_host_bytes += stats.bytes;
+	}
+}
+
+void Scene::shutdown()
+{
+	try
+	{
+		if (m_device)
+		{
+			if (m_submits)
+				m_submits->flushAll();
+			auto const guard = m_watchdog.arm("vkDeviceWaitIdle", maxDriverWait());
+			m_device->waitIdle();
+		}
+	}
+	catch (...)
+	{}
+	try
+	{
+		m_offload.reset();
+	}
+	catch (...)
+	{}
+	m_standby.reset();
+	m_takeover.reset();
+	try
+	{
+		// a link still running is not waited for, the cache file gets what the finished builds put there
+		if (m_pipeline_compiler)
+			m_pipeline_compiler->mergeInto(m_pipeline_cache);
+		m_pipeline_cache.snapshot();
+	}
+	catch (...)
+	{}
+	m_pipeline_cache.save();
+	m_profile_exporter->stop();
+	if (m_metrics_exporter)
+		m_metrics_exporter->stop();
+	m_shader_watcher.reset();
+	m_pending_pipeline = {};
+	m_reloaded_pipeline = {};
+	m_optimized_pipeline = {};
+	m_pipeline_builder.reset();
+	m_pipeline_compiler.reset();
+	m_pipeline_cache.destroy();
+	// closed windows may still wait in the deletion queue, their surfaces go before the windows and all of them before GLFW
+	m_deletion_queue.clear();
+	m_outputs.clear();
+	m_event_windows.clear();
+	m_closed_windows.clear();
+	glfwTerminate();
+	glfw_errors = nullptr;
+	std::cout << "driver host memory:" << std::endl;
+	m_host_allocator.report(std::cout);
+}
+
+void Scene::setLatencyMode(LatencyMode mode)
+{
+	if (mode == m_latency_mode)
+		return;
+	m_latency_mode = mode;
+	for (auto& output : m_outputs)
+		output->dirty = true;
+}
+
+void Scene::framebufferSizeCallback(Window* window, int width, int height)
+{
+	auto* const scene = static_cast<Scene*>(glfwGetWindowUserPointer(window));
+	scene->post({ FramePacket::Kind::Resize, window, vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) } });
+}
+
+void Scene::iconifyCallback(Window* window, int iconified)
+{
+	auto* const scene = static_cast<Scene*>(glfwGetWindowUserPointer(window));
+	scene->post({ FramePacket::Kind::Iconify, window, {}, iconified == GLFW_TRUE });
+}
+
+void Scene::focusCallback(Window* window, int focused)
+{
+	auto* const scene = static_cast<Scene*>(glfwGetWindowUserPointer(window));
+	scene->post({ FramePacket::Kind::Focus, window, {}, focused == GLFW_TRUE });
+}
+
+void Scene::post(FramePacket const& packet)
+{
+	// the render thread drains the ring every frame, a full ring only waits for its next frame
+	while (!m_packets.push(packet) && !m_render_done)
+		std::this_thread::yield();
+	// taken so the notification can't fall between the render thread's empty check and its wait
+	{
+		std::lock_guard<std::mutex> lock(m_wake_mutex);
+	}
+	m_wake.notify_one();
+}
+
+void Scene::waitForPacket()
+{
+	std::unique_lock<std::mutex> lock(m_wake_mutex);
+	m_wake.wait(lock, [this] { return !m_packets.empty(); });
+}
+
+double Scene::frameRateLimit() const
+{
+	if (m_config.headless || m_config.background_fps <= 0.0)
+		return m_config.max_fps;
+	for (auto const& output : m_outputs)
+		if (output->focused)
+			return m_config.max_fps;
+	return m_config.max_fps > 0.0 ? std::min(m_config.max_fps, m_config.background_fps) : m_config.background_fps;
+}
+
+bool Scene::pollWindows()
+{
+	for (auto it = m_event_windows.begin(); it != m_event_windows.end();)
+	{
+		if (!glfwWindowShouldClose(*it))
+		{
+			++it;
+			continue;
+		}
+		// closing the main window ends run()
+		if (it == m_event_windows.begin())
+		{
+			post({ FramePacket::Kind::Quit });
+			return false;
+		}
+		glfwHideWindow(*it);
+		// the render thread gives up its ownership when it applies the packet
+		m_closed_windows.emplace_back(*it);
+		post({ FramePacket::Kind::Close, *it });
+		it = m_event_windows.erase(it);
+	}
+	return true;
+}
+
+void Scene::applyInput()
+{
+	// the events carry GLFW's raw timer, their age puts them on the profiler's clock
+	auto const now = std::chrono::steady_clock::now();
+	auto const timer = glfwGetTimerValue();
+	auto const frequency = static_cast<double>(glfwGetTimerFrequency());
+	std::array<GLFWinputevent, 64> events;
+	while (int const count = glfwGetInputEvents(events.data(), static_cast<int>(events.size())))
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			auto const& event = events[i];
+			auto const age = std::chrono::duration<double>(static_cast<double>(timer - event.time) / frequency);
+			m_profiler.input(now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(age));
+			if (event.type == GLFW_EVENT_KEY && event.key == GLFW_KEY_L && event.action == GLFW_PRESS)
+				setLatencyMode(nextLatencyMode(m_latency_mode));
+		}
+	}
+}
+
+bool Scene::applyPackets()
+{
+	applyInput();
+	while (auto const packet = m_packets.pop())
+	{
+		switch (packet->kind)
+		{
+		case FramePacket::Kind::Resize:
+			for (auto& output : m_outputs)
+			{
+				if (output->window.get() != packet->window)
+					continue;
+				output->framebuffer = packet->framebuffer;
+				output->dirty = true;
+			}
+			break;
+		case FramePacket::Kind::Close:
+			closeWindow(packet->window);
+			break;
+		case FramePacket::Kind::Iconify:
+		case FramePacket::Kind::Focus:
+			for (auto& output : m_outputs)
+			{
+				if (output->window.get() != packet->window)
+					continue;
+				if (packet->kind == FramePacket::Kind::Iconify)
+					output->iconified = packet->state;
+				else
+					output->focused = packet->state;
+			}
+			break;
+		case FramePacket::Kind::Quit:
+			return false;
+		}
+	}
+	return true;
+}
+
+void glfwError(int ec, const char* emsg)
+{
+	if (glfw_errors)
+		glfw_errors->add();
+	std::cerr << "Error Code: " << ec << ", Error Msg: " << emsg << std::endl;
+}
+
+void Scene::initializeWindowSystem()
+{
+	if (m_config.headless)
+		return;
+
+	glfw_errors = &m_metrics.window_system_errors;
+	glfwSetErrorCallback(glfwError);
+	if (!glfwInit())
+		throw std::runtime_error("GLFW initialization failed, is a display available?");
+	// input reaches the render thread timestamped, without callbacks
+	glfwSetInputEventQueue(1024);
+}
+
+void Scene::createWindows()
+{
+	// headless renders at the main window's size
+	const size_t count = m_config.headless ? 1 : m_config.windows.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto output = std::make_unique<Output>();
+		output->config = m_config.windows[i];
+		output->width = output->config.width;
+		output->height = output->config.height;
+		m_outputs.push_back(std::move(output));
+	}
+	if (m_config.headless)
+		return;
+
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	int monitor_count = 0;
+	GLFWmonitor** const monitors = glfwGetMonitors(&monitor_count);
+	for (auto& output : m_outputs)
+	{
+		output->window.reset(glfwCreateWindow(static_cast<int>(output->width), static_cast<int>(output->height), output->config.title.c_str(), nullptr, nullptr));
+		if (!output->window)
+			throw std::runtime_error("Window Creation failed!");
+		if (output->config.monitor >= 0 && output->config.monitor < monitor_count)
+		{
+			int x = 0;
+			int y = 0;
+			glfwGetMonitorPos(monitors[output->config.monitor], &x, &y);
+			glfwSetWindowPos(output->window.get(), x, y);
+		}
+		int width = 0;
+		int height = 0;
+		glfwGetFramebufferSize(output->window.get(), &width, &height);
+		output->framebuffer = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+		output->iconified = glfwGetWindowAttrib(output->window.get(), GLFW_ICONIFIED) == GLFW_TRUE;
+		output->focused = glfwGetWindowAttrib(output->window.get(), GLFW_FOCUSED) == GLFW_TRUE;
+		m_event_windows.push_back(output->window.get());
+		glfwSetWindowUserPointer(output->window.get(), this);
+		glfwSetFramebufferSizeCallback(output->window.get(), framebufferSizeCallback);
+		glfwSetWindowIconifyCallback(output->window.get(), iconifyCallback);
+		glfwSetWindowFocusCallback(output->window.get(), focusCallback);
+	}
+}
+
+void Scene::initializeVKInstance()
+{
+	std::pmr::vector<const char*> extensions(&m_init_arena);
+	std::pmr::vector<const char*> layers(&m_init_arena);
+	auto const& capabilities = CapabilityRegistry::get();
+
+	if (!m_config.headless)
+	{
+		if (!glfwVulkanSupported())
+			throw std::runtime_error("GLFW found no Vulkan loader!");
+
+		// VK_KHR_surface plus the platform's surface extension (win32, xlib/xcb, wayland)
+		uint32_t glfw_ext_count = 0;
+		const char** glfw_exts = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+		if (glfw_exts == nullptr)
+			throw std::runtime_error("GLFW can not create Vulkan surfaces on this platform!");
+		for (uint32_t i = 0; i < glfw_ext_count; ++i)
+		{
+			if (!capabilities.hasInstanceExtension(glfw_exts[i]))
+				throw std::runtime_error(std::string(glfw_exts[i]) + " is not available!");
+			extensions.push_back(glfw_exts[i]);
+		}
+	}
+
+//	if (capabilities.hasInstanceLayer("VK_LAYER_KHRONOS_validation"))
+//		layers.push_back("VK_LAYER_KHRONOS_validation");
+
+	vk::InstanceCreateInfo inst_ci{};
+
+	inst_ci.enabledLayerCount = static_cast<uint32_t>(layers.size());
+	inst_ci.ppEnabledLayerNames = layers.data();
+	inst_ci.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	inst_ci.ppEnabledExtensionNames = extensions.data();
+
+	vk::ApplicationInfo app_info{};
+	app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+	app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+	app_info.pEngineName = "Test Engine";
+	app_info.apiVersion = VK_MAKE_VERSION(1, 2, 0);
+
+	inst_ci.pApplicationInfo = &app_info;
+	m_instance = vk::createInstanceUnique(inst_ci, m_host_allocator.callbacks(HostAllocator::Domain::Instance));
+}
+
+void Scene::selectQueueFamilyAndPhysicalDevice(std::optional<DeviceUuid> const& preferred)
+{
+	// ranked against the main window, the others are checked when their swapchains are created
+	useCandidate(m_device_selector.select(*m_instance, *m_outputs.front()->surface, preferred));
+}
+
+void Scene::useCandidate(DeviceCandidate const& candidate)
+{
+	m_candidate = candidate;
+	m_phys_dev = candidate.device;
+	m_phys_dev_uuid = candidate.uuid;
+	m_gq_fam_idx = candidate.graphics_family;
+	m_tq_fam_idx = candidate.transfer_family;
+	m_cq_fam_idx = candidate.compute_family;
+}
+
+DeviceSetup Scene::deviceSetup(DeviceCandidate const& candidate) const
+{
+	DeviceSetup setup;
+	setup.candidate = candidate;
+	auto const phys_dev = candidate.device;
+	// runs on a watchdog worker, so everything the create info points to lives inside the lambda
+	setup.families = { candidate.graphics_family };
+	for (auto const family : { candidate.transfer_family, candidate.compute_family })
+		if (std::find(setup.families.begin(), setup.families.end(), family) == setup.families.end())
+			setup.families.push_back(family);
+
+	auto const& capabilities = CapabilityRegistry::get().device(phys_dev);
+	auto& extensions = setup.extensions;
+	if (!m_config.headless)
+		extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	for (auto const ext : extensions)
+		if (!capabilities.hasExtension(ext))
+			throw std::runtime_error(std::string(ext) + " is not supported by the device!");
+	// optional, the render graph falls back to render passes
+	setup.dynamic_rendering = m_config.dynamic_rendering && capabilities.hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	if (setup.dynamic_rendering)
+		extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	setup.extended_dynamic_state = capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+	if (setup.extended_dynamic_state)
+		extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+	// core in 1.2, but every part of it is optional
+	auto const& supported12 = capabilities.features12();
+	setup.descriptor_indexing = m_config.bindless && supported12.descriptorIndexing && supported12.runtimeDescriptorArray
+		&& supported12.descriptorBindingPartiallyBound && supported12.descriptorBindingUpdateUnusedWhilePending
+		&& supported12.descriptorBindingSampledImageUpdateAfterBind && supported12.descriptorBindingStorageBufferUpdateAfterBind
+		&& supported12.shaderSampledImageArrayNonUniformIndexing;
+	setup.draw_indirect_count = m_config.gpu_culling && supported12.drawIndirectCount;
+	// device loss diagnostics, checkpoints are preferred because the driver tracks them per queue and stage
+	if (m_config.breadcrumbs && capabilities.hasExtension(VK_NV_DEVICE_DIAGNOSTIC_CHECKPOINTS_EXTENSION_NAME))
+	{
+		setup.breadcrumbs_mode = Breadcrumbs::Mode::Checkpoints;
+		extensions.push_back(VK_NV_DEVICE_DIAGNOSTIC_CHECKPOINTS_EXTENSION_NAME);
+	}
+	else if (m_config.breadcrumbs && capabilities.hasExtension(VK_AMD_BUFFER_MARKER_EXTENSION_NAME))
+	{
+		setup.breadcrumbs_mode = Breadcrumbs::Mode::BufferMarkers;
+		extensions.push_back(VK_AMD_BUFFER_MARKER_EXTENSION_NAME);
+	}
+#ifdef VK_EXT_DEVICE_FAULT_EXTENSION_NAME
+	if (m_config.breadcrumbs && capabilities.hasExtension(VK_EXT_DEVICE_FAULT_EXTENSION_NAME))
+	{
+		auto const fault_features = phys_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceFaultFeaturesEXT>();
+		setup.device_fault = fault_features.get<vk::PhysicalDeviceFaultFeaturesEXT>().deviceFault == VK_TRUE;
+	}
+	if (setup.device_fault)
+		extensions.push_back(VK_EXT_DEVICE_FAULT_EXTENSION_NAME);
+#endif
+	// one vkQueueSubmit2KHR per queue and frame, several VkSubmitInfos in one vkQueueSubmit without it
+	if (capabilities.hasExtension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+	{
+		auto const sync2_features = phys_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceSynchronization2FeaturesKHR>();
+		setup.synchronization2 = sync2_features.get<vk::PhysicalDeviceSynchronization2FeaturesKHR>().synchronization2 == VK_TRUE;
+	}
+	if (setup.synchronization2)
+		extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+	// pipeline variants link from precompiled parts
+#ifdef VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+	if (m_config.pipeline_libraries && capabilities.hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)
+		&& capabilities.hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME))
+	{
+		auto const library_features = phys_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+		setup.graphics_pipeline_library = library_features.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary == VK_TRUE;
+	}
+	if (setup.graphics_pipeline_library)
+	{
+		extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	}
+#endif
+	// GPU timestamps on the CPU timeline of the profiler, no features to enable
+	setup.calibrated_timestamps = capabilities.hasExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	if (setup.calibrated_timestamps)
+		extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	// heap budgets from the driver, the allocator estimates them without
+	setup.memory_budget = capabilities.hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (setup.memory_budget)
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	// linked GPUs render with one logical device; split frames would need peer copies to be presented, so windows
+	// alternate frames instead
+	setup.multi_gpu = m_config.multi_gpu.mode;
+	if (setup.multi_gpu == MultiGpuMode::SplitFrame && !m_config.headless)
+		setup.multi_gpu = MultiGpuMode::AlternateFrame;
+	setup.device_group = setup.multi_gpu != MultiGpuMode::Single ? DeviceGroup::of(*m_instance, phys_dev) : DeviceGroup(phys_dev);
+	if (!setup.device_group.linked())
+		setup.multi_gpu = MultiGpuMode::Single;
+	// present completion times pace FIFO frames
+#ifdef VK_KHR_PRESENT_WAIT_EXTENSION_NAME
+	if (!m_config.headless && m_config.present_pacing.enabled && capabilities.hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME)
+		&& capabilities.hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		auto const present_features = phys_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePresentIdFeaturesKHR, vk::PhysicalDevicePresentWaitFeaturesKHR>();
+		setup.present_wait = present_features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId == VK_TRUE
+			&& present_features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait == VK_TRUE;
+	}
+	if (setup.present_wait)
+	{
+		extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	}
+#endif
+	// capture buffers in memory of the consumer's choosing, where the device can import it at its alignment
+	auto const& host_memory = m_config.capture.host_memory;
+	if (m_config.capture.on_frame && !host_memory.slots.empty() && capabilities.hasExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+	{
+		auto const alignment = phys_dev.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceExternalMemoryHostPropertiesEXT>()
+			.get<vk::PhysicalDeviceExternalMemoryHostPropertiesEXT>().minImportedHostPointerAlignment;
+		setup.capture_import = host_memory.slot_size % alignment == 0 && std::all_of(host_memory.slots.begin(), host_memory.slots.end(),
+			[alignment](void* slot) { return reinterpret_cast<uintptr_t>(slot) % alignment == 0; });
+		if (setup.capture_import)
+			extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+	}
+	// capture buffers shared with other processes, where host-visible buffers of the handle type can be exported
+	if (m_config.capture.on_frame && m_config.capture.export_memory && !setup.capture_import && capabilities.hasExtension(external_memory_extension))
+	{
+		auto const external = phys_dev.getExternalBufferProperties(
+			vk::PhysicalDeviceExternalBufferInfo{ {}, vk::BufferUsageFlagBits::eTransferDst, external_memory_handle_type });
+		setup.capture_export = bool(external.externalMemoryProperties.externalMemoryFeatures & vk::ExternalMemoryFeatureFlagBits::eExportable);
+		if (setup.capture_export)
+			extensions.push_back(external_memory_extension);
+	}
+	// block compressed formats and sparse residency for streamed textures, each where supported
+	auto const& supported10 = capabilities.features10();
+	auto& features = setup.features;
+	features.textureCompressionBC = supported10.textureCompressionBC;
+	features.textureCompressionASTC_LDR = supported10.textureCompressionASTC_LDR;
+	// the loop guard's bailout counter is written from the shader stages
+	if (m_config.loop_guard.enabled)
+	{
+		features.vertexPipelineStoresAndAtomics = supported10.vertexPipelineStoresAndAtomics;
+		features.fragmentStoresAndAtomics = supported10.fragmentStoresAndAtomics;
+	}
+	auto const family_props = phys_dev.getQueueFamilyProperties();
+	for (auto const family : { candidate.transfer_family, candidate.graphics_family })
+		if (!setup.sparse_family && (family_props[family].queueFlags & vk::QueueFlagBits::eSparseBinding))
+			setup.sparse_family = family;
+	if (setup.sparse_family && supported10.sparseBinding && supported10.sparseResidencyImage2D)
+	{
+		features.sparseBinding = true;
+		features.sparseResidencyImage2D = true;
+	}
+	return setup;
+}
+
+vk::UniqueDevice Scene::createLogicalDevice(DeviceSetup const& setup, vk::AllocationCallbacks const* allocator)
+{
+	return m_watchdog.createDevice(setup.candidate.device, [setup, allocator](vk::PhysicalDevice phys_dev)
+	{
+		vk::DeviceCreateInfo dev_ci{};
+		float queue_prio = 1.0f;
+
+		std::vector<vk::DeviceQueueCreateInfo> dev_q_cis;
+		for (auto const family : setup.families)
+		{
+			vk::DeviceQueueCreateInfo dev_q_ci{};
+			dev_q_ci.queueCount = 1;
+			dev_q_ci.pQueuePriorities = &queue_prio;
+			dev_q_ci.queueFamilyIndex = family;
+			dev_q_cis.push_back(dev_q_ci);
+		}
+
+		vk::PhysicalDeviceVulkan12Features features12{};
+		features12.timelineSemaphore = true;
+		features12.drawIndirectCount = setup.draw_indirect_count;
+		if (setup.descriptor_indexing)
+		{
+			features12.descriptorIndexing = true;
+			features12.runtimeDescriptorArray = true;
+			features12.descriptorBindingPartiallyBound = true;
+			features12.descriptorBindingUpdateUnusedWhilePending = true;
+			features12.descriptorBindingSampledImageUpdateAfterBind = true;
+			features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+			features12.shaderSampledImageArrayNonUniformIndexing = true;
+		}
+		vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features{};
+		dynamic_rendering_features.dynamicRendering = true;
+		vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT extended_dynamic_state_features{};
+		extended_dynamic_state_features.extendedDynamicState = true;
+		void* next = nullptr;
+		if (setup.dynamic_rendering)
+		{
+			dynamic_rendering_features.pNext = next;
+			next = &dynamic_rendering_features;
+		}
+		if (setup.extended_dynamic_state)
+		{
+			extended_dynamic_state_features.pNext = next;
+			next = &extended_dynamic_state_features;
+		}
+		vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2_features{};
+		synchronization2_features.synchronization2 = true;
+		if (setup.synchronization2)
+		{
+			synchronization2_features.pNext = next;
+			next = &synchronization2_features;
+		}
+#ifdef VK_EXT_DEVICE_FAULT_EXTENSION_NAME
+		vk::PhysicalDeviceFaultFeaturesEXT fault_features{};
+		fault_features.deviceFault = true;
+		if (setup.device_fault)
+		{
+			fault_features.pNext = next;
+			next = &fault_features;
+		}
+#endif
+#ifdef VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+		vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features{};
+		library_features.graphicsPipelineLibrary = true;
+		if (setup.graphics_pipeline_library)
+		{
+			library_features.pNext = next;
+			next = &library_features;
+		}
+#endif
+#ifdef VK_KHR_PRESENT_WAIT_EXTENSION_NAME
+		vk::PhysicalDevicePresentIdFeaturesKHR present_id_features{};
+		present_id_features.presentId = true;
+		vk::PhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+		present_wait_features.presentWait = true;
+		if (setup.present_wait)
+		{
+			present_id_features.pNext = next;
+			present_wait_features.pNext = &present_id_features;
+			next = &present_wait_features;
+		}
+#endif
+		features12.pNext = next;
+
+		dev_ci.pNext = &features12;
+		auto const& group_devices = setup.device_group.devices();
+		vk::DeviceGroupDeviceCreateInfo group_ci{ static_cast<uint32_t>(group_devices.size()), group_devices.data() };
+		if (group_devices.size() > 1)
+		{
+			group_ci.pNext = &features12;
+			dev_ci.pNext = &group_ci;
+		}
+		dev_ci.pEnabledFeatures = &setup.features;
+		dev_ci.queueCreateInfoCount = static_cast<uint32_t>(dev_q_cis.size());
+		dev_ci.pQueueCreateInfos = dev_q_cis.data();
+
+		dev_ci.enabledExtensionCount = static_cast<uint32_t>(setup.extensions.size());
+		dev_ci.ppEnabledExtensionNames = setup.extensions.data();
+
+		return phys_dev.createDeviceUnique(dev_ci, allocator);
+	});
+}
+
+void Scene::initializeDevice()
+{
+	// a standby device taking over was created ahead with its setup
+	DeviceSetup setup;
+	if (m_takeover)
+	{
+		setup = std::move(m_takeover->setup);
+		m_device = std::move(m_takeover->device);
+	}
+	else
+	{
+		setup = deviceSetup(m_candidate);
+		m_device = createLogicalDevice(setup, &m_host_allocator.callbacks(HostAllocator::Domain::Device));
+	}
+	m_dynamic_rendering = setup.dynamic_rendering;
+	m_extended_dynamic_state = setup.extended_dynamic_state;
+	m_descriptor_indexing = setup.descriptor_indexing;
+	m_draw_indirect_count = setup.draw_indirect_count;
+	m_breadcrumbs_mode = setup.breadcrumbs_mode;
+	m_device_fault = setup.device_fault;
+	m_synchronization2 = setup.synchronization2;
+	m_graphics_pipeline_library = setup.graphics_pipeline_library;
+	m_calibrated_timestamps = setup.calibrated_timestamps;
+	m_memory_budget_ext = setup.memory_budget;
+	m_present_wait = setup.present_wait;
+	m_capture_export = setup.capture_export;
+	m_capture_import = setup.capture_import;
+	m_features = setup.features;
+	m_device_group = setup.device_group;
+	m_multi_gpu = setup.multi_gpu;
+	if (m_multi_gpu != m_config.multi_gpu.mode)
+		std::cerr << toString(m_config.multi_gpu.mode) << " rendering is not available on the device, using " << toString(m_multi_gpu) << std::endl;
+
+	m_gr_queue = m_device->getQueue(m_gq_fam_idx, 0);
+	m_transfer_queue = m_device->getQueue(m_tq_fam_idx, 0);
+	m_compute_queue = m_device->getQueue(m_cq_fam_idx, 0);
+	if (m_features.sparseBinding)
+		m_sparse_queue = m_device->getQueue(*setup.sparse_family, 0);
+	m_dispatch.init(*m_instance, vkGetInstanceProcAddr, *m_device);
+	m_submits = std::make_unique<SubmitBatcher>(m_dispatch, m_synchronization2);
+	m_frame_device = 0;
+	if (m_device_group.linked())
+	{
+		if (!m_config.headless)
+			m_device_group.queryPresentCapabilities(*m_device, m_dispatch);
+		std::cout << "device group of " << m_device_group.size() << " GPUs, " << toString(m_multi_gpu) << " rendering" << std::endl;
+	}
+
+	for (auto const format : { vk::Format::eD32Sfloat, vk::Format::eX8D24UnormPack32, vk::Format::eD16Unorm })
+		if (m_phys_dev.getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment)
+		{
+			m_depth_image_format = format;
+			break;
+		}
+	auto const& limits = m_phys_dev.getProperties().limits;
+	auto sample_counts = limits.framebufferColorSampleCounts;
+	if (m_config.depth_buffer)
+		sample_counts &= limits.framebufferDepthSampleCounts;
+	m_msaa_samples = m_config.msaa_samples;
+	while (m_msaa_samples != vk::SampleCountFlagBits::e1 && !(sample_counts & m_msaa_samples))
+		m_msaa_samples = static_cast<vk::SampleCountFlagBits>(static_cast<uint32_t>(m_msaa_samples) >> 1);
+}
+
+void Scene::createAllocator()
+{
+	DeviceAllocator::Config allocator_config{};
+	allocator_config.linked_devices = m_device_group.linked();
+	m_allocator = std::make_unique<DeviceAllocator>(*m_device, m_phys_dev, allocator_config);
+	m_memory_budget = std::make_unique<MemoryBudget>(m_phys_dev, m_memory_budget_ext);
+	m_memory_budget->update(*m_allocator);
+}
+
+void Scene::createBreadcrumbs()
+{
+	// the queue names are in the order diagnoseDeviceLoss() passes the queues
+	m_breadcrumbs = std::make_unique<Breadcrumbs>(*m_device, *m_allocator, m_dispatch, m_breadcrumbs_mode,
+		std::vector<std::string>{ "graphics", "transfer", "compute" }, m_device_fault);
+	m_culling_workload = m_breadcrumbs->workload("gpu culling");
+	m_scene_pass_workload = m_breadcrumbs->workload("scene pass");
+	m_scene_draw_workload = m_breadcrumbs->workload("scene draw");
+}
+
+void Scene::createStagingRing()
+{
+	m_staging = std::make_unique<StagingRing>(*m_device, *m_allocator, m_config.staging_frame_size, m_config.frames_in_flight);
+}
+
+void Scene::createUploadEngine()
+{
+	m_uploads = std::make_unique<UploadEngine>(*m_device, *m_allocator, *m_submits, m_watchdog, m_transfer_queue, m_tq_fam_idx, m_gq_fam_idx);
+}
+
+void Scene::createComputeScheduler()
+{
+	m_compute = std::make_unique<ComputeScheduler>(*m_device, *m_submits, m_compute_queue, m_cq_fam_idx, m_gr_queue, m_gq_fam_idx);
+}
+
+void Scene::createComputeOffload()
+{
+	if (!m_config.multi_gpu.compute_offload || m_offload)
+		return;
+	// the best GPU the scene does not render with, evaluated without a surface
+	std::optional<DeviceCandidate> offload;
+	for (auto const& candidate : m_device_selector.rank(*m_instance, {}))
+		if (candidate.suitable() && !candidate.blacklisted && !m_device_group.contains(candidate.device))
+		{
+			offload = candidate;
+			break;
+		}
+	if (!offload)
+	{
+		std::cerr << "compute offload: every GPU renders" << std::endl;
+		return;
+	}
+	// without the device host allocator, its domain must be empty once the scene's device is destroyed
+	auto device = m_watchdog.createDevice(offload->device, [family = offload->compute_family](vk::PhysicalDevice phys_dev)
+	{
+		float queue_prio = 1.0f;
+		vk::DeviceQueueCreateInfo dev_q_ci{};
+		dev_q_ci.queueCount = 1;
+		dev_q_ci.pQueuePriorities = &queue_prio;
+		dev_q_ci.queueFamilyIndex = family;
+
+		vk::PhysicalDeviceVulkan12Features features12{};
+		features12.timelineSemaphore = true;
+		vk::DeviceCreateInfo dev_ci{};
+		dev_ci.pNext = &features12;
+		dev_ci.queueCreateInfoCount = 1;
+		dev_ci.pQueueCreateInfos = &dev_q_ci;
+		return phys_dev.createDeviceUnique(dev_ci);
+	});
+	m_offload = std::make_unique<ComputeOffload>(*m_instance, *offload, std::move(device));
+	std::cout << "compute offload on " << m_offload->name() << std::endl;
+}
+
+void Scene::createGpuTimestamps()
+{
+	const auto valid_bits = m_phys_dev.getQueueFamilyProperties()[m_gq_fam_idx].timestampValidBits;
+	const auto period = m_phys_dev.getProperties().limits.timestampPeriod;
+	// GLFW's raw timer where its clock has a time domain, it also stamps the input events
+	std::optional<HostTimer> host;
+	if (!m_config.headless)
+		host = HostTimer::glfw();
+	m_gpu_clock = std::make_unique<GpuClock>(*m_device, m_phys_dev, m_dispatch, m_calibrated_timestamps,
+		host.value_or(HostTimer::system()), period, valid_bits);
+	m_gpu_timestamps = std::make_unique<GpuTimestamps>(*m_device, period, valid_bits, m_config.frames_in_flight, m_gpu_clock.get());
+	// records of frames lost with the old device are dropped
+	m_profiler.setSlotCount(m_config.frames_in_flight);
+}
+
+void Scene::createDescriptors()
+{
+	m_layout_cache = std::make_unique<DescriptorLayoutCache>(*m_device);
+	m_descriptors = std::make_unique<DescriptorAllocator>(*m_device, m_config.frames_in_flight);
+	if (m_descriptor_indexing)
+		m_bindless = std::make_unique<BindlessTable>(*m_device, m_phys_dev, *m_layout_cache, m_config.bindless_set,
+			m_config.bindless_textures, m_config.bindless_buffers);
+}
+
+void Scene::createPipelineCache()
+{
+	m_pipeline_cache.create(*m_device, m_phys_dev.getProperties(), m_config.pipeline_cache_dir,
+		m_takeover ? std::move(m_takeover->pipeline_cache) : vk::UniquePipelineCache{});
+	m_pipeline_compiler = std::make_unique<PipelineCompiler>(*m_device, m_thread_pool, m_pipeline_cache,
+		&m_host_allocator.callbacks(HostAllocator::Domain::Pipelines));
+	m_pipeline_compiler->countInto(&m_metrics.pipeline_requests, &m_metrics.pipeline_cache_hits);
+	m_pipeline_builder = std::make_unique<GraphicsPipelineBuilder>(*m_pipeline_compiler, m_graphics_pipeline_library);
+}
+
+void Scene::createSceneStorage()
+{
+	// objects survive a device loss, only their instance buffer is recreated
+	m_objects.attach(*m_device, *m_allocator);
+	if (!m_objects.alive(m_quad))
+		m_quad = m_objects.create(ObjectTransform{});
+}
+
+void Scene::createMeshPool()
+{
+	m_vertex_input = createReflectedVertexInput(::Vertex_vert_reflection, {
+		{ 0, instance_locations, vk::VertexInputRate::eInstance, sizeof(GpuInstance) },
+		{ instance_locations, UINT32_MAX - instance_locations, vk::VertexInputRate::eVertex },
+	});
+	auto const& vertex_binding = m_vertex_input.bindings[mesh_binding];
+	auto const attributes = m_vertex_input.attributesOf(mesh_binding);
+	m_meshes = std::make_unique<MeshPool>(*m_device, *m_allocator, m_thread_pool, vertex_binding.stride, attributes,
+		m_config.mesh_vertex_capacity, m_config.mesh_index_capacity);
+
+	// the quad on the lower right, its transform is the identity; any other attribute stays zero
+	auto const position = std::find_if(attributes.begin(), attributes.end(), [](auto const& a) { return a.location == instance_locations; });
+	if (position == attributes.end() || position->format != vk::Format::eR32G32B32Sfloat)
+		throw std::runtime_error("Vertex.vert must read a vec3 position right after the instance attributes!");
+	const float positions[3][3] = { { 0.0f, 0.0f, 0.0f }, { 2.0f, 0.0f, 0.0f }, { 0.0f, 2.0f, 0.0f } };
+	std::vector<uint8_t> vertices(3 * vertex_binding.stride, 0);
+	for (size_t i = 0; i < 3; ++i)
+		std::memcpy(vertices.data() + i * vertex_binding.stride + position->offset, positions[i], sizeof(positions[i]));
+	const uint32_t indices[] = { 0, 1, 2 };
+	m_quad_mesh = m_meshes->add(vertices.data(), 3, indices, 3, { 1.0f, 1.0f, 0.0f, 1.5f });
+}
+
+void Scene::updateMemoryBudget()
+{
+	m_memory_budget->update(*m_allocator);
+	auto const& vram = m_memory_budget->heap(m_memory_budget->deviceLocalHeap());
+	m_metrics.vram_usage.set(static_cast<double>(vram.usage));
+	m_metrics.vram_budget.set(static_cast<double>(vram.budget));
+	// textures grow into what the device-local heap has left and are the first to give memory back
+	if (m_textures)
+	{
+		auto const slack = m_memory_budget->slack(m_memory_budget->deviceLocalHeap());
+		auto const resident = static_cast<int64_t>(m_textures->residentBytes());
+		m_textures->setBudgetLimit(static_cast<vk::DeviceSize>(std::max<int64_t>(resident + slack, 0)));
+	}
+}
+
+void Scene::createTextureStreamer()
+{
+	// textures are only reachable through the bindless table
+	if (!m_bindless)
+		return;
+	m_textures = std::make_unique<TextureStreamer>(*m_device, m_phys_dev, m_features, *m_allocator, *m_uploads, *m_bindless,
+		m_sparse_queue, m_config.texture_streaming);
+}
+
+void Scene::createGpuCulling()
+{
+	if (!m_draw_indirect_count)
+		return;
+	// secondaries record a draw range per recording worker, a primary draws them all
+	auto const draw_ranges = m_config.record_mode == RecordMode::Secondary ? m_record_pool.size() : 1u;
+	m_culler = std::make_unique<GpuCuller>(*m_device, *m_allocator, *m_layout_cache, *m_pipeline_compiler, *m_uploads,
+		m_config.max_draw_objects, draw_ranges);
+
+	auto const mesh = m_meshes->range(m_quad_mesh);
+	DrawObject quad{};
+	quad.sphere = mesh.sphere;
+	quad.index_count = mesh.index_count;
+	quad.first_index = mesh.first_index;
+	quad.vertex_offset = mesh.vertex_offset;
+	quad.first_instance = m_objects.instance(m_quad);
+	m_culler->add(quad);
+}
+
+void Scene::createSurface(Output& output)
+{
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	const vk::Result result{ glfwCreateWindowSurface(*m_instance, output.window.get(), nullptr, &surface) };
+	if (result != vk::Result::eSuccess || surface == VK_NULL_HANDLE)
+		throw std::runtime_error("Can not create Surface: " + vk::to_string(result));
+	output.surface = vk::UniqueSurfaceKHR(vk::SurfaceKHR(surface), *m_instance);
+}
+
+vk::Extent2D Scene::surfaceExtent(Output const& output, vk::SurfaceCapabilitiesKHR const& caps) const
+{
+	if (caps.currentExtent.width != UINT32_MAX)
+		return caps.currentExtent;
+
+	// the surface takes the size of the swapchain
+	return vk::Extent2D{
+		std::clamp(output.framebuffer.width, caps.minImageExtent.width, caps.maxImageExtent.width),
+		std::clamp(output.framebuffer.height, caps.minImageExtent.height, caps.maxImageExtent.height) };
+}
+
+void Scene::createSwapChainAndImages(Output& output, vk::SwapchainKHR old_swapchain)
+{
+	// the device was selected for the main window, every other window must be presentable from its graphics queue
+	if (!m_phys_dev.getSurfaceSupportKHR(m_gq_fam_idx, *output.surface))
+		throw std::runtime_error{ "the graphics queue can not present to window \"" + output.config.title + "\"" };
+
+	auto const caps{ m_phys_dev.getSurfaceCapabilitiesKHR(*output.surface) };
+	auto const extent = surfaceExtent(output, caps);
+	if (extent.width == 0 || extent.height == 0)
+		throw std::runtime_error{ "window surface has no area" };
+	output.width = extent.width;
+	output.height = extent.height;
+	if (!(caps.supportedUsageFlags & vk::ImageUsageFlagBits::eColorAttachment))
+		throw std::runtime_error{ "window surface cannot be used as color attachment" };
+
+	bool format_found = false;
+	for (auto const& surf_format : m_phys_dev.getSurfaceFormatsKHR(*output.surface))
+	{
+		if (surf_format.format == vk::Format::eUndefined || surf_format.format == m_swapchain_format)
+		{
+			format_found = true;
+			break;
+		}
+	}
+	if (!format_found)
+		throw std::runtime_error{ "window surface not compatible with chosen color format" };
+
+	output.present_mode = choosePresentMode(m_latency_mode, m_phys_dev.getSurfacePresentModesKHR(*output.surface));
+	// present ids count per swapchain
+	output.present_id = 0;
+	if (!m_outputs.empty() && &output == m_outputs.front().get())
+		m_pacer.reset();
+
+	vk::SwapchainCreateInfoKHR sw_ci{};
+	sw_ci.setSurface(*output.surface);
+	sw_ci.setMinImageCount(swapchainImageCount(output.present_mode, caps, m_config.swapchain_images));
+	sw_ci.setImageFormat(m_swapchain_format);
+	sw_ci.setImageExtent(vk::Extent2D{ output.width, output.height });
+	sw_ci.setImageArrayLayers(1);
+	// captured frames are copied out of the swapchain image
+	auto usage = vk::ImageUsageFlags(vk::ImageUsageFlagBits::eColorAttachment);
+	if (m_config.capture.on_frame && (caps.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc))
+		usage |= vk::ImageUsageFlagBits::eTransferSrc;
+	output.capturable = bool(usage & vk::ImageUsageFlagBits::eTransferSrc);
+	sw_ci.setImageUsage(usage);
+	sw_ci.setPreTransform(vk::SurfaceTransformFlagBitsKHR::eIdentity);
+	sw_ci.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque);
+	sw_ci.setPresentMode(output.present_mode);
+	sw_ci.setClipped(true);
+	sw_ci.setOldSwapchain(old_swapchain);
+	// on a device group, the devices whose images the window shows and how
+	output.group_present_modes = {};
+	vk::DeviceGroupSwapchainCreateInfoKHR group_sw_ci{};
+	if (m_device_group.linked())
+	{
+		output.group_present_modes = m_device->getGroupSurfacePresentModesKHR(*output.surface, m_dispatch) & m_device_group.presentModes();
+		group_sw_ci.modes = output.group_present_modes;
+		if (group_sw_ci.modes)
+			sw_ci.pNext = &group_sw_ci;
+	}
+
+	output.swapchain = m_device->createSwapchainKHRUnique(sw_ci);
+	output.images = m_device->getSwapchainImagesKHR(*output.swapchain);
+}
+
+void Scene::createOffscreenTarget()
+{
+	// one image per frame in flight, so frames never wait for an image
+	const uint32_t image_count = std::max(m_config.swapchain_images, m_config.frames_in_flight);
+	auto& output = *m_outputs.front();
+	m_offscreen = std::make_unique<OffscreenTarget>(*m_device, *m_allocator, m_swapchain_format, vk::Extent2D{ output.width, output.height },
+		image_count, static_cast<bool>(m_config.on_readback));
+	output.images = m_offscreen->images();
+}
+
+void Scene::createSwapChainImageViews(Output& output)
+{
+	vk::ImageSubresourceRange img_sb_range{};
+	img_sb_range.aspectMask = vk::ImageAspectFlagBits::eColor;
+	img_sb_range.levelCount = 1;
+	img_sb_range.layerCount = 1;
+
+	vk::ImageViewCreateInfo sw_imgv_ci{};
+	sw_imgv_ci.subresourceRange = img_sb_range;
+	sw_imgv_ci.format = m_swapchain_format;
+	sw_imgv_ci.viewType = vk::ImageViewType::e2D;
+
+	for (auto const sc_image : output.images)
+	{
+		sw_imgv_ci.image = sc_image;
+		output.image_views.push_back(m_device->createImageViewUnique(sw_imgv_ci));
+	}
+}
+
+bool Scene::recreateSwapchain(Output& output)
+{
+	// a minimized window has a zero extent and no swapchain can be created for it
+	if (surfaceExtent(output, m_phys_dev.getSurfaceCapabilitiesKHR(*output.surface)) == vk::Extent2D{ 0, 0 })
+		return false;
+
+	// pipeline jobs still in flight reference the old render pass
+	pipeline();
+	if (m_reloaded_pipeline.valid())
+		m_reloaded_pipeline.wait();
+
+	// frames in flight may still use the old objects, they are destroyed once those frames completed
+	RetiredSwapchain retired{};
+	retired.image_views = std::move(output.image_views);
+	retired.render_graph = std::move(output.render_graph);
+	retired.command_buffers = std::move(output.command_buffers);
+	retired.swapchain = std::move(output.swapchain);
+	output.image_views.clear();
+	output.command_buffers.clear();
+	output.images_in_flight.clear();
+
+	createSwapChainAndImages(output, *retired.swapchain);
+	createSwapChainImageViews(output);
+	// the graph's render passes stay compatible and viewport and scissor are dynamic, so the pipeline is kept
+	createRenderGraph(output);
+	allocateImageCommandBuffers(output);
+	output.images_in_flight.assign(output.images.size(), 0);
+
+	m_deletion_queue.retire(m_frame_timeline->submitted(), std::move(retired));
+	output.dirty = false;
+	return true;
+}
+
+void Scene::closeWindow(Window* window)
+{
+	// the output is removed once the frames using it completed, the event thread destroys the window
+	auto const it = std::find_if(std::next(m_outputs.begin()), m_outputs.end(), [window](auto const& output) { return output->window.get() == window; });
+	if (it == m_outputs.end())
+		return;
+	(*it)->window.release();
+	m_deletion_queue.retire(m_frame_timeline->submitted(), std::move(*it));
+	m_outputs.erase(it);
+}
+
+void Scene::destroyRetiredObjects()
+{
+	// frames complete in submission order on the graphics queue
+	auto const completed = m_frame_timeline->completed();
+	m_deletion_queue.collect(completed);
+	if (m_bindless)
+		m_bindless->collect(completed);
+	if (m_loop_violations)
+	{
+		if (auto const bailouts = m_loop_violations->poll())
+		{
+			if (m_loop_bailouts == 0)
+				std::cerr << "Shader loops reached the loop guard's cap of " << m_config.loop_guard.max_iterations << " iterations in "
+					<< bailouts << " invocations, further ones are only counted" << std::endl;
+			m_loop_bailouts += bailouts;
+		}
+	}
+}
+
+void Scene::createRenderGraph(Output& output)
+{
+	std::vector<vk::ImageView> views;
+	for (auto const& view : output.image_views)
+		views.push_back(*view);
+
+	// shared by every output and kept across resizes, each graph asks for the same render passes
+	if (!m_render_pass_cache)
+		m_render_pass_cache = std::make_unique<RenderPassCache>(*m_device);
+	output.render_graph = std::make_unique<RenderGraph>(*m_device, *m_allocator, vk::Extent2D{ output.width, output.height });
+	output.render_graph->useRenderPassCache(m_render_pass_cache.get());
+	// offscreen images are read back or copied after the graph
+	auto const backbuffer = output.render_graph->importImage("backbuffer", m_swapchain_format, output.images, std::move(views),
+		m_config.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
+	output.render_graph->setClearValue(backbuffer, vk::ClearColorValue(m_clear_color));
+	// only the resolved backbuffer is stored, the graph gives these transient memory
+	auto color = backbuffer;
+	if (m_msaa_samples != vk::SampleCountFlagBits::e1)
+	{
+		color = output.render_graph->createAttachment("scene color", m_swapchain_format, m_msaa_samples);
+		output.render_graph->setClearValue(color, vk::ClearColorValue(m_clear_color));
+	}
+	std::optional<RenderGraph::ResourceId> depth;
+	if (m_config.depth_buffer)
+	{
+		depth = output.render_graph->createAttachment("depth", m_depth_image_format, m_msaa_samples);
+		output.render_graph->setClearValue(*depth, vk::ClearDepthStencilValue(1.0f, 0));
+	}
+
+	// outputs are owned through unique_ptr, so the address stays valid while the graph exists
+	Output* const target = &output;
+	output.scene_pass = output.render_graph->addPass("scene", [&](RenderGraph::PassBuilder& pass)
+	{
+		pass.writeColor(color, true);
+		if (color != backbuffer)
+			pass.resolveColor(color, backbuffer);
+		if (depth)
+			pass.writeDepth(*depth, true);
+		if (m_config.record_mode == RecordMode::Secondary)
+			pass.contents(vk::SubpassContents::eSecondaryCommandBuffers);
+	}, [this, target](vk::CommandBuffer cmd, uint32_t /*image_index*/) { recordScenePass(cmd, *target); });
+	if (m_dynamic_rendering)
+		output.render_graph->useDynamicRendering(&m_dispatch);
+	output.device_areas.clear();
+	if (m_multi_gpu == MultiGpuMode::SplitFrame)
+		output.device_areas = m_device_group.splitAreas(vk::Extent2D{ output.width, output.height });
+	output.render_graph->setDeviceRenderAreas(output.device_areas);
+	output.render_graph->compile();
+}
+
+void Scene::allocateCommandBuffers()
+{
+	vk::CommandPoolCreateInfo cmd_pool_ci{};
+	cmd_pool_ci.queueFamilyIndex = m_gq_fam_idx;
+	cmd_pool_ci.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+
+	m_cmd_b_pool = m_device->createCommandPoolUnique(cmd_pool_ci);
+
+	vk::CommandBufferAllocateInfo cmd_b_ai{};
+	cmd_b_ai.commandBufferCount = m_config.frames_in_flight;
+	cmd_b_ai.commandPool = *m_cmd_b_pool;
+	cmd_b_ai.level = vk::CommandBufferLevel::ePrimary;
+
+	auto command_buffers = m_device->allocateCommandBuffersUnique(cmd_b_ai);
+	m_frames.resize(m_config.frames_in_flight);
+	for (uint32_t i = 0; i < m_config.frames_in_flight; ++i)
+		m_frames[i].command_buffer = std::move(command_buffers[i]);
+
+	if (m_config.record_mode == RecordMode::Cached)
+	{
+		auto post_command_buffers = m_device->allocateCommandBuffersUnique(cmd_b_ai);
+		for (uint32_t i = 0; i < m_config.frames_in_flight; ++i)
+			m_frames[i].post_command_buffer = std::move(post_command_buffers[i]);
+	}
+
+	for (auto& output : m_outputs)
+		allocateImageCommandBuffers(*output);
+
+	if (m_config.record_mode == RecordMode::Secondary)
+		m_recorder = std::make_unique<ParallelRecorder>(*m_device, m_gq_fam_idx, m_config.frames_in_flight, m_record_pool);
+}
+
+void Scene::allocateImageCommandBuffers(Output& output)
+{
+	if (m_config.record_mode != RecordMode::Cached)
+		return;
+
+	vk::CommandBufferAllocateInfo cmd_b_ai{};
+	cmd_b_ai.commandBufferCount = static_cast<uint32_t>(output.images.size());
+	cmd_b_ai.commandPool = *m_cmd_b_pool;
+	cmd_b_ai.level = vk::CommandBufferLevel::ePrimary;
+	for (auto& cmd : m_device->allocateCommandBuffersUnique(cmd_b_ai))
+		output.command_buffers.emplace_back(std::move(cmd));
+}
+
+
+void Scene::createShaderInterface()
+{
+	if (m_config.loop_guard.enabled)
+	{
+		// the bailout counter takes the set after all others
+		uint32_t set = m_bindless ? m_bindless->setIndex() + 1 : 0;
+		for (auto const* stage : { &::Vertex_vert_reflection, &::Fragment_frag_reflection })
+			for (auto const& binding : *stage)
+				set = std::max(set, binding.set + 1);
+		vk::ShaderStageFlags stages;
+		if (m_features.vertexPipelineStoresAndAtomics)
+			stages |= vk::ShaderStageFlagBits::eVertex;
+		if (m_features.fragmentStoresAndAtomics)
+			stages |= vk::ShaderStageFlagBits::eFragment;
+		m_loop_violations = std::make_unique<LoopViolations>(*m_device, *m_allocator, set, stages);
+	}
+
+	// built from the reflection headers the shader build emits; the counter is declared for both stages, only
+	// the reporting ones write it
+	ReflectedLayout layout;
+	if (m_loop_violations)
+	{
+		auto const vertex_counter = m_loop_violations->interfaceOf(vk::ShaderStageFlagBits::eVertex);
+		auto const fragment_counter = m_loop_violations->interfaceOf(vk::ShaderStageFlagBits::eFragment);
+		layout = createReflectedLayout(*m_device, *m_layout_cache, { &::Vertex_vert_reflection, &::Fragment_frag_reflection, &vertex_counter, &fragment_counter },
+			m_bindless.get());
+	}
+	else
+		layout = createReflectedLayout(*m_device, *m_layout_cache, { &::Vertex_vert_reflection, &::Fragment_frag_reflection }, m_bindless.get());
+	m_set_layouts = std::move(layout.set_layouts);
+	m_pipeline_layout = std::move(layout.pipeline_layout);
+
+	if (m_loop_violations)
+	{
+		m_loop_violations->bind(m_set_layouts[m_loop_violations->setIndex()]);
+		// reloaded shaders were instrumented when they came in and survive recoveries
+		if (!m_shader_binaries)
+			m_shader_binaries = guardShaders({ { std::begin(::Vertex_vert), std::end(::Vertex_vert) }, { std::begin(::Fragment_frag), std::end(::Fragment_frag) } });
+	}
+}
+
+std::shared_ptr<ShaderBinaries const> Scene::guardShaders(ShaderBinaries const& binaries) const
+{
+	static char const* const names[] = { "Vertex.vert", "Fragment.frag" };
+	static const vk::ShaderStageFlagBits stages[] = { vk::ShaderStageFlagBits::eVertex, vk::ShaderStageFlagBits::eFragment };
+	auto guarded = std::make_shared<ShaderBinaries>();
+	for (size_t i = 0; i < binaries.size(); ++i)
+	{
+		std::optional<LoopGuard::Binding> report;
+		if (i < 2 && m_loop_violations->reports(stages[i]))
+			report = m_loop_violations->binding();
+		auto result = LoopGuard::instrument(SpirvView(binaries[i].data(), binaries[i].size()), m_config.loop_guard.max_iterations, report);
+		if (result.skipped)
+			std::cerr << "Loop guard left " << result.skipped << " loops of " << (i < 2 ? names[i] : "a shader") << " unguarded" << std::endl;
+		guarded->push_back(std::move(result.code));
+	}
+	return guarded;
+}
+
+void Scene::createPipeline()
+{
+	m_pending_pipeline = compilePipeline();
+}
+
+GraphicsPipelineState Scene::pipelineState() const
+{
+	GraphicsPipelineState state;
+	state.vertex_input = m_vertex_input;
+	// reloaded binaries stay alive until the parts using them are built
+	auto const binaries = m_shader_binaries;
+	state.vertex_shader = binaries ? SpirvView((*binaries)[0].data(), (*binaries)[0].size()) : SpirvView(::Vertex_vert);
+	state.fragment_shader = binaries ? SpirvView((*binaries)[1].data(), (*binaries)[1].size()) : SpirvView(::Fragment_frag);
+	state.fragment_constants = SpecializationConstants::of(FragmentConstants{ m_config.fragment_loop_iterations });
+	state.code = binaries;
+	state.layout = *m_pipeline_layout;
+	// every output's graph has the same attachments and formats, so their render passes are compatible; the
+	// render pass comes from the render pass cache and survives resizes
+	auto const& output = *m_outputs.front();
+	state.render_pass = output.render_graph->renderPass(output.scene_pass);
+	state.subpass = output.render_graph->subpass(output.scene_pass);
+	// without a render pass the pipeline only depends on the attachment formats
+	state.dynamic_rendering = output.render_graph->dynamicRendering();
+	state.formats = output.render_graph->renderingFormats(output.scene_pass);
+	state.depth_test = state.formats.depth != vk::Format::eUndefined;
+	state.depth_write = state.depth_test;
+	state.extended_dynamic_state = m_extended_dynamic_state;
+	return state;
+}
+
+std::shared_future<vk::Pipeline> Scene::compilePipeline()
+{
+	auto const state = pipelineState();
+	// supersedes the optimized pipeline of an earlier state, which would bring that state back
+	m_optimized_pipeline = m_pipeline_builder->optimize(state);
+	return m_pipeline_builder->build(state);
+}
+
+vk::Pipeline Scene::pipeline()
+{
+	// the render loop only blocks on the compiler the first time a pipeline is used
+	if (m_pending_pipeline.valid())
+	{
+		m_pipeline = m_pending_pipeline.get();
+		m_pending_pipeline = {};
+		// the optimized build may still be linking, the merge takes what is there and does not wait for it
+		m_pipeline_compiler->mergeInto(m_pipeline_cache);
+	}
+	// the fast linked pipeline is replaced once its link time optimized version is built, a reload swaps its
+	// own in first; failures are reported with the fast linked pipeline
+	if (m_optimized_pipeline.valid() && !m_reloaded_pipeline.valid() && m_optimized_pipeline.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		try
+		{
+			m_pipeline = std::exchange(m_optimized_pipeline, {}).get();
+			m_pipeline_compiler->mergeInto(m_pipeline_cache);
+		}
+		catch (std::exception const&)
+		{
+		}
+	}
+	return m_pipeline;
+}
+
+void Scene::reloadShaders()
+{
+	if (m_shader_watcher)
+	{
+		if (auto binaries = m_shader_watcher->take())
+		{
+			m_shader_binaries = m_loop_violations ? guardShaders(*binaries) : std::move(binaries);
+			// supersedes a reload that is still compiling
+			m_reloaded_pipeline = compilePipeline();
+		}
+	}
+	if (!m_reloaded_pipeline.valid() || m_reloaded_pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+
+	// a failed build is reported once
+	auto const reloaded_pipeline = std::exchange(m_reloaded_pipeline, {});
+	try
+	{
+		auto const reloaded = reloaded_pipeline.get();
+		// resolves a pipeline that is still pending, so it can not replace the reloaded one later
+		pipeline();
+		// the compiler keeps the old pipeline for frames in flight and for when the shaders are reverted
+		m_pipeline = reloaded;
+		std::cout << "shaders reloaded" << std::endl;
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << "shader reload: pipeline creation failed, keeping the previous pipeline: " << e.what() << std::endl;
+	}
+}
+
+void Scene::initSyncEntities()
+{
+	// swapchain acquire and present still need binary semaphores, everything else waits on the timeline
+	m_frame_timeline = std::make_unique<Timeline>(*m_device);
+	for (auto& frame : m_frames)
+		frame.serial = 0;
+
+	for (auto& output : m_outputs)
+	{
+		for (uint32_t i = 0; i < m_config.frames_in_flight; ++i)
+		{
+			output->acquire_semaphores.push_back(m_device->createSemaphoreUnique(vk::SemaphoreCreateInfo()));
+			output->render_semaphores.push_back(m_device->createSemaphoreUnique(vk::SemaphoreCreateInfo()));
+		}
+		output->images_in_flight.assign(output->images.size(), 0);
+	}
+}
+
+void Scene::recordFrame(FrameData& frame)
+{
+	m_submit_cmds.clear();
+	auto const cmd = *frame.command_buffer;
+
+	if (m_config.record_mode == RecordMode::Cached)
+	{
+		// per-frame work goes into the frame's own buffers around the cached passes
+		cmd.begin(vk::CommandBufferBeginInfo{});
+		m_staging->flush(cmd);
+		m_uploads->recordAcquireBarriers(cmd);
+		m_gpu_timestamps->begin(cmd, m_frame_index);
+		recordCulling(cmd);
+		cmd.end();
+		m_submit_cmds.push_back(cmd);
+
+		// each image's previous frame was waited for, so its cached buffer is not pending anymore
+		for (auto const& output : m_outputs)
+		{
+			if (!output->image_index)
+				continue;
+			auto& cached = output->command_buffers[*output->image_index];
+			cached.update(recordState(*output), vk::CommandBufferBeginInfo{}, [&](vk::CommandBuffer cmd) { recordPass(cmd, *output); });
+			m_submit_cmds.push_back(cached.get());
+		}
+
+		auto const post_cmd = *frame.post_command_buffer;
+		post_cmd.begin(vk::CommandBufferBeginInfo{});
+		if (m_offscreen)
+			m_offscreen->recordReadback(post_cmd, *m_outputs.front()->image_index, m_outputs.front()->device_areas);
+		recordCapture(post_cmd);
+		m_gpu_timestamps->end(post_cmd, m_frame_index);
+		post_cmd.end();
+		m_submit_cmds.push_back(post_cmd);
+		return;
+	}
+
+	if (m_config.record_mode == RecordMode::Secondary)
+	{
+		m_recorder->beginFrame(m_frame_index);
+		for (auto& output : m_outputs)
+			if (output->image_index)
+				recordSecondaries(*output);
+	}
+
+	buildCommandBuffer(cmd);
+	m_submit_cmds.push_back(cmd);
+}
+
+void Scene::recordSecondaries(Output& output)
+{
+	auto const& graph = *output.render_graph;
+	vk::CommandBufferInheritanceInfo inheritance{};
+	inheritance.renderPass = graph.renderPass(output.scene_pass);
+	inheritance.subpass = graph.subpass(output.scene_pass);
+	inheritance.framebuffer = graph.framebuffer(output.scene_pass, *output.image_index);
+	// both null under dynamic rendering, the secondaries inherit the attachment formats instead
+	auto const formats = graph.renderingFormats(output.scene_pass);
+	vk::CommandBufferInheritanceRenderingInfoKHR rendering_inheritance{};
+	rendering_inheritance.colorAttachmentCount = static_cast<uint32_t>(formats.colors.size());
+	rendering_inheritance.pColorAttachmentFormats = formats.colors.data();
+	rendering_inheritance.depthAttachmentFormat = formats.depth;
+	rendering_inheritance.stencilAttachmentFormat = formats.stencil;
+	rendering_inheritance.rasterizationSamples = formats.samples;
+	if (graph.dynamicRendering())
+		inheritance.pNext = &rendering_inheritance;
+	output.secondary_cmds = m_recorder->record(inheritance, drawTasks(output));
+}
+
+RecordState Scene::recordState(Output const& output)
+{
+	RecordState state{};
+	state.render_pass = output.render_graph->renderPass(output.scene_pass);
+	state.framebuffer = output.render_graph->framebuffer(output.scene_pass, *output.image_index);
+	state.pipeline = pipeline();
+	state.clear_color = m_clear_color;
+	state.extent = vk::Extent2D{ output.width, output.height };
+	return state;
+}
+
+void Scene::buildCommandBuffer(vk::CommandBuffer cmd)
+{
+	vk::CommandBufferBeginInfo cmd_begin_info{};
+
+	cmd.begin(cmd_begin_info);
+	m_staging->flush(cmd);
+	m_uploads->recordAcquireBarriers(cmd);
+	m_gpu_timestamps->begin(cmd, m_frame_index);
+	recordCulling(cmd);
+	// one submission renders every window presented this frame
+	for (auto const& output : m_outputs)
+		if (output->image_index)
+			recordPass(cmd, *output);
+	if (m_offscreen)
+		m_offscreen->recordReadback(cmd, *m_outputs.front()->image_index, m_outputs.front()->device_areas);
+	recordCapture(cmd);
+	m_gpu_timestamps->end(cmd, m_frame_index);
+	cmd.end();
+}
+
+void Scene::recordPass(vk::CommandBuffer cmd, Output const& output)
+{
+	output.render_graph->record(cmd, *output.image_index);
+}
+
+void Scene::recordCulling(vk::CommandBuffer cmd)
+{
+	if (!m_culler || !workloadEnabled(m_culling_workload))
+		return;
+	// the scene has no camera yet, object bounds are in clip space
+	const std::array<float, 16> view_proj = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	m_breadcrumbs->begin(cmd, m_breadcrumb_queue, m_culling_workload);
+	m_culler->cull(cmd, view_proj);
+	m_breadcrumbs->end(cmd, m_breadcrumb_queue, m_culling_workload);
+}
+
+void Scene::recordCapture(vk::CommandBuffer cmd)
+{
+	auto const& output = *m_outputs.front();
+	if (!m_config.capture.on_frame || !output.image_index || !(m_offscreen || output.capturable))
+		return;
+	const vk::Extent2D extent{ output.width, output.height };
+	if (m_capture && m_capture->extent() != extent)
+		m_retired_captures.push_back(std::move(m_capture));
+	if (!m_capture)
+		m_capture = std::make_unique<CaptureRing>(*m_device, *m_allocator, m_dispatch, m_swapchain_format, extent, m_config.capture.slots, m_capture_export,
+			m_capture_import ? &m_config.capture.host_memory : nullptr);
+	// the pass leaves offscreen images ready for copies and swapchain images ready for presenting
+	m_capture->record(cmd, output.images[*output.image_index], m_offscreen ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR,
+		m_frame_timeline->next(), output.device_areas);
+}
+
+void Scene::pacePresent()
+{
+	if (!m_present_wait || m_outputs.empty())
+		return;
+	auto& output = *m_outputs.front();
+	// mailbox and immediate don't queue frames, there is nothing to wait out
+	bool const fifo = output.present_mode == vk::PresentModeKHR::eFifo || output.present_mode == vk::PresentModeKHR::eFifoRelaxed;
+	// a window between two of its presents has nothing new to wait for
+	if (!fifo || output.dirty || output.iconified || output.present_id == 0 || output.present_id == m_pacer.lastCompleted())
+		return;
+#ifdef VK_KHR_PRESENT_WAIT_EXTENSION_NAME
+	vk::Result result = vk::Result::eTimeout;
+	try
+	{
+		auto const guard = m_watchdog.arm("vkWaitForPresentKHR", maxDriverWait());
+		auto const timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(m_config.present_pacing.timeout).count();
+		result = m_device->waitForPresentKHR(*output.swapchain, output.present_id, static_cast<uint64_t>(timeout), m_dispatch);
+	}
+	catch (vk::OutOfDateKHRError const&)
+	{
+		output.dirty = true;
+	}
+	if (result == vk::Result::eTimeout || output.dirty)
+	{
+		// the compositor holds the window's images, start over once it presents again
+		m_pacer.reset();
+		return;
+	}
+	m_pacer.completed(output.present_id, PresentPacer::Clock::now());
+	m_pacer.waitForStart();
+#endif
+}
+
+void Scene::deliverCaptures()
+{
+	auto const completed = m_frame_timeline->completed();
+	// older rings hold older frames
+	for (auto const& ring : m_retired_captures)
+		while (auto const frame = ring->take(completed))
+			m_config.capture.on_frame(*frame);
+	m_retired_captures.erase(std::remove_if(m_retired_captures.begin(), m_retired_captures.end(), [](auto const& ring) { return ring->idle(); }),
+		m_retired_captures.end());
+	if (m_capture)
+		while (auto const frame = m_capture->take(completed))
+			m_config.capture.on_frame(*frame);
+}
+
+void Scene::recordScenePass(vk::CommandBuffer cmd, Output& output)
+{
+	if (!workloadEnabled(m_scene_pass_workload))
+		return;
+	if (m_config.record_mode == RecordMode::Secondary)
+	{
+		// nothing but vkCmdExecuteCommands may be recorded inline, the draw tasks carry the markers
+		cmd.executeCommands(output.secondary_cmds);
+		return;
+	}
+	m_breadcrumbs->begin(cmd, m_breadcrumb_queue, m_scene_pass_workload);
+	for (auto const& task : drawTasks(output))
+		task(cmd);
+	m_breadcrumbs->end(cmd, m_breadcrumb_queue, m_scene_pass_workload);
+}
+
+std::vector<ParallelRecorder::Task> const& Scene::drawTasks(Output& output)
+{
+	// resolved here on the render thread, the tasks may run on workers
+	auto& state = output.draw_state;
+	state.pipeline = pipeline();
+	state.viewport = vk::Viewport{ 0.0f, 0.0f, static_cast<float>(output.width), static_cast<float>(output.height), 0.0f, 1.0f };
+	state.scissor = vk::Rect2D{ { 0, 0 }, { output.width, output.height } };
+	state.device_areas = &output.device_areas;
+	// secondaries do not inherit dynamic state, every task sets its own
+	state.dispatch = m_extended_dynamic_state ? &m_dispatch : nullptr;
+	state.layout = *m_pipeline_layout;
+	state.bindless_set = m_bindless ? m_bindless->setIndex() : 0;
+	state.bindless = m_bindless ? m_bindless->descriptorSet() : vk::DescriptorSet{};
+	state.loop_violation_set = m_loop_violations ? m_loop_violations->setIndex() : 0;
+	state.loop_violations = m_loop_violations ? m_loop_violations->descriptorSet() : vk::DescriptorSet{};
+	// without its culling pass the draw count would be stale, the quad is then drawn directly
+	state.culler = workloadEnabled(m_culling_workload) ? m_culler.get() : nullptr;
+	state.meshes = m_meshes.get();
+	state.instance_buffer = m_objects.buffer();
+	state.quad_instance = m_objects.instance(m_quad);
+	state.quad = m_meshes->range(m_quad_mesh);
+	state.breadcrumbs = m_breadcrumbs.get();
+	state.workload = m_scene_draw_workload;
+	state.queue = m_breadcrumb_queue;
+	state.draw = workloadEnabled(state.workload);
+	if (!output.draw_tasks.empty())
+		return output.draw_tasks;
+	// a task per draw range of the culler, so every recording worker gets one; the output outlives its tasks,
+	// and a reference and an index fit the small buffer of std::function
+	for (uint32_t range = 0; range < m_culler->drawRanges(); ++range)
+	{
+		output.draw_tasks.push_back([&state, range](vk::CommandBuffer cmd)
+		{
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, state.pipeline);
+			// bound once per command buffer, draws select their resources by index
+			if (state.bindless)
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, state.layout, state.bindless_set, state.bindless, nullptr);
+			if (state.loop_violations)
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, state.layout, state.loop_violation_set, state.loop_violations, nullptr);
+			cmd.setViewport(0, state.viewport);
+			cmd.setScissor(0, state.scissor);
+			// split frames: every device draws its band only
+			auto const& device_areas = *state.device_areas;
+			if (!device_areas.empty())
+			{
+				for (uint32_t i = 0; i < device_areas.size(); ++i)
+				{
+					cmd.setDeviceMask(1u << i);
+					cmd.setScissor(0, device_areas[i]);
+				}
+				cmd.setDeviceMask(device_areas.size() >= 32 ? ~0u : (1u << device_areas.size()) - 1);
+			}
+			if (state.dispatch)
+			{
+				cmd.setCullModeEXT(vk::CullModeFlagBits::eNone, *state.dispatch);
+				cmd.setFrontFaceEXT(vk::FrontFace::eCounterClockwise, *state.dispatch);
+				cmd.setPrimitiveTopologyEXT(vk::PrimitiveTopology::eTriangleList, *state.dispatch);
+			}
+			// the quad alone is drawn by the first task
+			if (!state.draw || (!state.culler && range != 0))
+				return;
+			state.breadcrumbs->begin(cmd, state.queue, state.workload);
+			cmd.bindVertexBuffers(0, state.instance_buffer, vk::DeviceSize(0));
+			state.meshes->bind(cmd, mesh_binding);
+			// the visible objects of the range in one draw, packed by the culling pass
+			if (state.culler)
+				state.culler->draw(cmd, range);
+			else
+				cmd.drawIndexed(state.quad.index_count, 1, state.quad.first_index, state.quad.vertex_offset, state.quad_instance);
+			state.breadcrumbs->end(cmd, state.queue, state.workload);
+		});
+	}
+	return output.draw_tasks;
+}
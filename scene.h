@@ -0,0 +1,677 @@
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+// external memory handles for captured frames
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
+
+#include <vulkan/vulkan.hpp>
+// included after Vulkan so GLFW declares its Vulkan surface functions
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+
+#include "arena.h"
+#include "breadcrumbs.h"
+#include "capability_registry.h"
+#include "capture_ring.h"
+#include "command_cache.h"
+#include "compute_offload.h"
+#include "compute_scheduler.h"
+#include "deletion_queue.h"
+#include "descriptor_allocator.h"
+#include "device_allocator.h"
+#include "device_group.h"
+#include "device_selector.h"
+#include "device_standby.h"
+#include "frame_limiter.h"
+#include "frame_profiler.h"
+#include "gpu_clock.h"
+#include "gpu_culling.h"
+#include "host_allocator.h"
+#include "latency_mode.h"
+#include "loop_guard.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "mesh_pool.h"
+#include "offscreen_target.h"
+#include "parallel_recorder.h"
+#include "pipeline_cache.h"
+#include "pipeline_compiler.h"
+#include "pipeline_library.h"
+#include "present_batch.h"
+#include "present_pacer.h"
+#include "render_graph.h"
+#include "scene_storage.h"
+#include "shader_reflection.h"
+#include "shader_watcher.h"
+#include "specialization.h"
+#include "spirv.h"
+#include "spsc_ring.h"
+#include "staging_ring.h"
+#include "submit_batcher.h"
+#include "task_graph.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+#include "timeline.h"
+#include "upload_engine.h"
+#include "watchdog.h"
+
+class StepTimer
+{
+public:
+	struct Step
+	{
+		std::string name;
+		std::chrono::duration<double, std::milli> duration;
+	};
+
+	template<typename F>
+	void time(std::string name, F&& f)
+	{
+		auto const start = std::chrono::steady_clock::now();
+		f();
+		m_steps.push_back({ std::move(name), std::chrono::steady_clock::now() - start });
+	}
+
+	std::vector<Step> const& steps() const { return m_steps; }
+
+	std::chrono::duration<double, std::milli> total() const
+	{
+		std::chrono::duration<double, std::milli> sum{};
+		for (auto const& step : m_steps)
+			sum += step.duration;
+		return sum;
+	}
+
+	void print(std::ostream& os) const
+	{
+		for (auto const& step : m_steps)
+			os << "  " << step.name << ": " << step.duration.count() << " ms" << std::endl;
+		os << "  total: " << total().count() << " ms" << std::endl;
+	}
+
+private:
+	std::vector<Step> m_steps;
+};
+
+enum class RecordMode
+{
+	// record the frame's command buffer from scratch every frame
+	ReRecord,
+	// record once per swapchain image and resubmit until the recorded state changes
+	Cached,
+	// record the pass contents into secondary buffers on the thread pool
+	Secondary
+};
+
+inline char const* toString(RecordMode mode)
+{
+	switch (mode)
+	{
+	case RecordMode::ReRecord: return "re-record";
+	case RecordMode::Cached: return "cached";
+	case RecordMode::Secondary: return "secondary";
+	}
+	return "unknown";
+}
+
+struct WindowConfig
+{
+	std::string title;
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	// index into the connected monitors, the window opens at that monitor's origin; -1 leaves placement to the window system
+	int monitor = -1;
+	// the window presents every present_interval-th frame, e.g. 2 drives a second display at half the rate
+	uint32_t present_interval = 1;
+};
+
+struct SceneConfig
+{
+	// number of frames the CPU may record ahead of the GPU, independent of the swapchain image count
+	uint32_t frames_in_flight = 2;
+	// requested per swapchain, raised where the present mode or the surface needs more
+	uint32_t swapchain_images = 2;
+	// overrides the device ranking, otherwise taken from the BUGEXAMPLE_DEVICE_UUID environment variable
+	std::optional<DeviceUuid> device_uuid;
+	WatchdogConfig watchdog;
+	std::filesystem::path pipeline_cache_dir = ".";
+	RecordMode record_mode = RecordMode::ReRecord;
+	LatencyMode latency_mode = LatencyMode::VSync;
+	// delays the start of FIFO frames of the main window towards the vblank that shows them, input included
+	PresentPacingConfig present_pacing;
+	// linked GPUs of the selected device's device group render alternate frames or bands of every frame
+	MultiGpuConfig multi_gpu;
+	// a second device waits ready for a device loss, see failover()
+	StandbyConfig standby;
+	// frame, memory and device-health metrics exported periodically as Prometheus text or a shared memory block
+	MetricsConfig metrics;
+	// base name of the frame profile written at shutdown as .csv and .json (Chrome trace), empty only prints statistics
+	std::filesystem::path profile_output;
+	// each window gets its own surface and swapchain on the shared device and graphics queue, all of them are
+	// presented with one vkQueuePresentKHR; the first one is the main window, headless only uses its size
+	std::vector<WindowConfig> windows{ WindowConfig{} };
+	// render into an offscreen image ring instead of a window, nothing is presented
+	bool headless = false;
+	// headless only, called with the pixels of every frame once it completed; setting it enables readback
+	std::function<void(void const* pixels, vk::Extent2D extent, vk::Format format)> on_readback;
+	// copies of the main output's frames handed to a consumer, windowed or headless
+	CaptureConfig capture;
+	// ends run() after this many frames, 0 runs until the window is closed
+	uint64_t max_frames = 0;
+	// called at the start of every frame with the number of frames submitted before it
+	std::function<void(uint64_t frame)> on_frame;
+	// render loop iterations after which one that allocates from the heap throws, for finding what still does;
+	// 0 only counts them, see Scene::frameHeapAllocations()
+	uint64_t heap_free_after = 0;
+	// frame rate cap of the render loop, on top of what the present mode allows; 0 leaves pacing to the present mode
+	double max_fps = 0.0;
+	// the cap while no window has the input focus, 0 keeps max_fps; iconified windows are not rendered at all
+	double background_fps = 30.0;
+	// upload space per frame in flight
+	vk::DeviceSize staging_frame_size = vk::DeviceSize(4) << 20;
+	// record with VK_KHR_dynamic_rendering instead of render pass and framebuffer objects where the device has it
+	bool dynamic_rendering = true;
+	// build pipeline variants from shared VK_EXT_graphics_pipeline_library parts where the device has them,
+	// as derivatives of the first pipeline otherwise
+	bool pipeline_libraries = true;
+	// samples of the scene pass, resolved into the swapchain image at the end of the pass; the multisampled
+	// color and the depth buffer never leave the pass, so they take lazily allocated memory where there is any.
+	// Clamped to what the device supports for both.
+	vk::SampleCountFlagBits msaa_samples = vk::SampleCountFlagBits::e4;
+	bool depth_buffer = true;
+	// bind a descriptor-indexed texture and storage buffer table at bindless_set where the device supports it
+	bool bindless = true;
+	uint32_t bindless_set = 0;
+	uint32_t bindless_textures = 16384;
+	uint32_t bindless_buffers = 16384;
+	// cull and pack draws on the GPU and issue them with one indirect count draw where the device supports it
+	bool gpu_culling = true;
+	uint32_t max_draw_objects = 4096;
+	// transforms and materials of the scene's objects, streamed to one instance buffer
+	uint32_t max_scene_objects = 65536;
+	// size of the shared mesh vertex and index buffers
+	uint32_t mesh_vertex_capacity = 1u << 20;
+	uint32_t mesh_index_capacity = 3u << 20;
+	// KTX2 textures streamed into the bindless table by mip level, needs bindless
+	TextureStreamerConfig texture_streaming;
+	// wrap passes, dispatches and draws in NV checkpoints or AMD buffer markers where the device has them,
+	// so a device loss names the workload that was running
+	bool breadcrumbs = true;
+	// breadcrumb names of workloads skipped while recording, e.g. one an earlier device loss was blamed on
+	std::vector<std::string> disabled_workloads;
+	// development mode: Vertex.vert and Fragment.frag in this directory are recompiled when they change and the
+	// pipeline is swapped at a frame boundary; empty uses the embedded shaders only
+	std::filesystem::path shader_reload_dir;
+	// iterations of the loop in Fragment.frag, specialized into the pipeline; 0 keeps the endless loop that
+	// loses the device
+	uint32_t fragment_loop_iterations = 0;
+	// caps every loop of the scene's shaders where they are loaded, a shader that would hang the GPU then costs a
+	// slow frame; bailouts are counted where the device can store from the stage, see Scene::loopBailouts()
+	LoopGuardConfig loop_guard;
+};
+
+class Scene
+{
+public:
+	using Window = GLFWwindow;
+
+	explicit Scene(SceneConfig const& config = {});
+
+	// independent steps run concurrently, the report has every step's start and duration
+	TaskGraph::Report initialize();
+	// the calling thread handles window events while a render thread acquires, records, submits and presents;
+	// headless renders on the calling thread. Exceptions of the render thread are rethrown here.
+	void run();
+	void shutdown();
+
+	// takes effect at the start of the next frame, only the swapchain is recreated; while run() is active only
+	// from the render thread (e.g. SceneConfig::on_frame), the L key is forwarded there
+	void setLatencyMode(LatencyMode mode);
+	LatencyMode latencyMode() const { return m_latency_mode; }
+
+	// compute jobs on a GPU the scene does not render with, null unless MultiGpuConfig::compute_offload found one;
+	// pumped every frame, kept across device losses of the scene
+	ComputeOffload* computeOffload() { return m_offload.get(); }
+	// what the device group does, Single where the device is not linked
+	MultiGpuMode multiGpuMode() const { return m_multi_gpu; }
+
+	// meshes are loaded and decoded in the background from any thread, drawn once resident; the pool and its
+	// meshes go with the device
+	MeshPool& meshes() { return *m_meshes; }
+
+	// textures are sampled through TextureStreamer::bindlessIndex(), which changes as their mip levels stream in
+	// and out; null without bindless, the streamer and its textures go with the device
+	TextureStreamer* textures() { return m_textures.get(); }
+
+	// rebuilds all device-owned objects on the existing instance, window and surface; with switch_device
+	// the current device is blacklisted and the best remaining one is used if there is any
+	StepTimer recoverDevice(bool switch_device = false);
+	// StandbyConfig::enabled: a standby device is ready or being built, failover() can take it over
+	bool standbyPending() const { return m_standby.pending(); }
+	// after a vk::DeviceLostError, instead of recoverDevice(): the device objects are rebuilt on the standby device,
+	// whose creation and pipeline cache are done already, and the next standby is started in the background. Throws
+	// vk::DeviceLostError if the standby was lost too, the scene is untouched then and recoverDevice() still works.
+	StepTimer failover();
+
+	// after a vk::DeviceLostError and before recoverDevice(): prints the driver's host memory, the breadcrumbs of
+	// every queue and the driver's fault report, and disables the workload the loss is blamed on so the new device skips it
+	void diagnoseDeviceLoss();
+
+	// for benchmarks, valid between initialize() and shutdown()
+	DeviceAllocator::Stats memoryStats() const { return m_allocator ? m_allocator->stats() : DeviceAllocator::Stats{}; }
+	vk::PhysicalDeviceProperties deviceProperties() const { return m_phys_dev.getProperties(); }
+	// zeroed on devices below Vulkan 1.2
+	vk::PhysicalDeviceDriverProperties driverProperties() const;
+	// of the main window, or of the offscreen target when headless
+	vk::PresentModeKHR presentMode() const { return m_outputs.front()->present_mode; }
+	uint32_t imageCount() const { return static_cast<uint32_t>(m_outputs.front()->images.size()); }
+	// profiled frames whose slot came around again, oldest first
+	std::vector<FrameRecord> frameRecords() { return m_profile_exporter->snapshot(); }
+	// heap allocations the render thread made in the last render loop iteration, and the frame arena's peak
+	uint64_t frameHeapAllocations() const { return m_frame_heap_allocations; }
+	size_t frameArenaHighWater() const { return m_frame_arena.highWater(); }
+	// what the driver allocated on the host through the scene's callbacks, and what destroyed devices left
+	// of it, which would pile up over recoveries
+	HostAllocator const& hostMemory() const { return m_host_allocator; }
+	uint64_t leakedHostBytes() const { return m_leaked_host_bytes; }
+	// shader invocations that left a loop at the loop guard's cap, of completed frames
+	uint64_t loopBailouts() const { return m_loop_bailouts; }
+	// present timing of the main window, idle without VK_KHR_present_wait or outside FIFO
+	PresentPacer const& presentPacer() const { return m_pacer; }
+	// captures handed to the consumer and frames dropped for want of a free slot, of the current ring
+	uint64_t capturedFrames() const { return m_capture ? m_capture->captured() : 0; }
+	uint64_t droppedCaptures() const { return m_capture ? m_capture->dropped() : 0; }
+	// what the scene reports, updated lock-free; callers count their own errors in it and may register further
+	// metrics, all of them are exported with SceneConfig::metrics
+	SceneMetrics& metrics() { return m_metrics; }
+	MetricsRegistry& metricsRegistry() { return m_metrics_registry; }
+
+private:
+	struct FrameData
+	{
+		vk::UniqueCommandBuffer command_buffer;
+		// ends the frame after the cached pass, only used in RecordMode::Cached
+		vk::UniqueCommandBuffer post_command_buffer;
+		// frame timeline value of the frame last submitted with this slot
+		uint64_t serial = 0;
+	};
+
+	// objects of a replaced swapchain, in the order they have to be destroyed from last to first
+	struct RetiredSwapchain
+	{
+		vk::UniqueSwapchainKHR swapchain;
+		std::vector<vk::UniqueImageView> image_views;
+		// owns the framebuffers of the image views
+		std::unique_ptr<RenderGraph> render_graph;
+		std::vector<CachedCommandBuffer> command_buffers;
+	};
+
+	struct WindowDeleter
+	{
+		void operator()(Window* window) const { glfwDestroyWindow(window); }
+	};
+
+	// what the scene pass's draw task records with, resolved on the render thread every frame
+	struct DrawState
+	{
+		vk::Pipeline pipeline;
+		vk::Viewport viewport;
+		vk::Rect2D scissor;
+		std::vector<vk::Rect2D> const* device_areas = nullptr;
+		vk::DispatchLoaderDynamic const* dispatch = nullptr;
+		vk::PipelineLayout layout;
+		uint32_t bindless_set = 0;
+		vk::DescriptorSet bindless;
+		uint32_t loop_violation_set = 0;
+		vk::DescriptorSet loop_violations;
+		GpuCuller const* culler = nullptr;
+		MeshPool const* meshes = nullptr;
+		vk::Buffer instance_buffer;
+		uint32_t quad_instance = 0;
+		MeshRange quad{};
+		Breadcrumbs const* breadcrumbs = nullptr;
+		Breadcrumbs::WorkloadId workload{};
+		uint32_t queue = 0;
+		bool draw = false;
+	};
+
+	// a window and everything presenting into it; the device, the graphics queue and the pipeline are shared
+	struct Output
+	{
+		WindowConfig config;
+		// destroyed after its surface and swapchain
+		std::unique_ptr<Window, WindowDeleter> window;
+		vk::UniqueSurfaceKHR surface;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		// as last reported by the event thread, GLFW may only be asked on the main thread
+		vk::Extent2D framebuffer{};
+		// chosen from the latency mode's fallback chain
+		vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+		// of the last present to the current swapchain, 0 before the first one or without VK_KHR_present_id
+		uint64_t present_id = 0;
+		// on a device group, the modes the surface can show the devices' images in
+		vk::DeviceGroupPresentModeFlagsKHR group_present_modes;
+		// split-frame render areas of the devices, empty otherwise
+		std::vector<vk::Rect2D> device_areas;
+		// the swapchain images can be copied from, for capturing them
+		bool capturable = false;
+		bool dirty = false;
+		// as last reported by the event thread; X11 keeps an iconified window's size, so this is what skips it there
+		bool iconified = false;
+		bool focused = false;
+
+		vk::UniqueSwapchainKHR swapchain;
+		// the offscreen target's images when headless
+		std::vector<vk::Image> images;
+		std::vector<vk::UniqueImageView> image_views;
+		std::unique_ptr<RenderGraph> render_graph;
+		RenderGraph::PassId scene_pass = 0;
+		std::vector<CachedCommandBuffer> command_buffers;
+		// serial of the frame that last rendered into each image, 0 if the image is unused
+		std::vector<uint64_t> images_in_flight;
+		// one per frame in flight, acquire and present still need binary semaphores
+		std::vector<vk::UniqueSemaphore> acquire_semaphores;
+		std::vector<vk::UniqueSemaphore> render_semaphores;
+		// secondaries the scene pass executes in RecordMode::Secondary, recorded for the current frame
+		std::vector<vk::CommandBuffer> secondary_cmds;
+		// the draw tasks only point at the state, so neither is allocated again after the first frame
+		DrawState draw_state;
+		std::vector<ParallelRecorder::Task> draw_tasks;
+		// acquired for the current frame, empty while the window skips frames or is minimized
+		std::optional<uint32_t> image_index;
+	};
+
+	// what the event thread saw, applied by the render thread at the start of its next frame
+	struct FramePacket
+	{
+		enum class Kind
+		{
+			Resize,
+			// a secondary window closed; the event thread hid it and owns it from now on
+			Close,
+			Iconify,
+			Focus,
+			// the main window closed
+			Quit
+		};
+
+		Kind kind = Kind::Quit;
+		Window* window = nullptr;
+		// the framebuffer size of a Resize
+		vk::Extent2D framebuffer{};
+		// whether the window is now iconified or focused
+		bool state = false;
+	};
+
+	void destroyDeviceObjects();
+	std::chrono::milliseconds maxDriverWait() const;
+
+	void initializeWindowSystem();
+	void createWindows();
+	void initializeVKInstance();
+	void selectQueueFamilyAndPhysicalDevice(std::optional<DeviceUuid> const& preferred);
+	void useCandidate(DeviceCandidate const& candidate);
+	DeviceSetup deviceSetup(DeviceCandidate const& candidate) const;
+	// on a watchdog worker, from any thread
+	vk::UniqueDevice createLogicalDevice(DeviceSetup const& setup, vk::AllocationCallbacks const* allocator);
+	void initializeDevice();
+	// the steps of recoverDevice() and failover() from the device on
+	void recreateDeviceObjects(StepTimer& timer);
+	void startStandby();
+	void createPipelineCache();
+	void createAllocator();
+	void createBreadcrumbs();
+	bool workloadEnabled(Breadcrumbs::WorkloadId workload) const;
+	void createStagingRing();
+	void createUploadEngine();
+	void createComputeScheduler();
+	void createComputeOffload();
+	void createGpuTimestamps();
+	void createDescriptors();
+	void createSceneStorage();
+	void createMeshPool();
+	void createTextureStreamer();
+	void updateMemoryBudget();
+	// after endFrame(), observes the frame's times in the metrics
+	void recordFrameMetrics();
+	void recordRecovery(StepTimer const& timer);
+	void createGpuCulling();
+
+	void createSurface(Output& output);
+	vk::Extent2D surfaceExtent(Output const& output, vk::SurfaceCapabilitiesKHR const& caps) const;
+	void createSwapChainAndImages(Output& output, vk::SwapchainKHR old_swapchain = {});
+	void createOffscreenTarget();
+	void createSwapChainImageViews(Output& output);
+	bool recreateSwapchain(Output& output);
+	// render thread, false once the main window closed
+	bool applyPackets();
+	// drains GLFW's input event queue
+	void applyInput();
+	void closeWindow(Window* window);
+	void renderLoop();
+	// blocks the render thread while nothing can be presented, until the event thread posts a packet
+	void waitForPacket();
+	double frameRateLimit() const;
+	// event thread
+	void post(FramePacket const& packet);
+	bool pollWindows();
+	void destroyRetiredObjects();
+
+	void createRenderGraph(Output& output);
+	void allocateCommandBuffers();
+	void allocateImageCommandBuffers(Output& output);
+	void createShaderInterface();
+	std::shared_ptr<ShaderBinaries const> guardShaders(ShaderBinaries const& binaries) const;
+	void createPipeline();
+	GraphicsPipelineState pipelineState() const;
+	std::shared_future<vk::Pipeline> compilePipeline();
+	vk::Pipeline pipeline();
+	void reloadShaders();
+	void initSyncEntities();
+	void recordFrame(FrameData& frame);
+	void buildCommandBuffer(vk::CommandBuffer cmd);
+	void recordSecondaries(Output& output);
+	void recordPass(vk::CommandBuffer cmd, Output const& output);
+	void recordScenePass(vk::CommandBuffer cmd, Output& output);
+	void recordCulling(vk::CommandBuffer cmd);
+	void recordCapture(vk::CommandBuffer cmd);
+	// waits for the main window's last present and sleeps until the predicted start of the frame
+	void pacePresent();
+	void deliverCaptures();
+	// headless, at the end of the render loop: waits for the readbacks no later frame takes and delivers them
+	void deliverPendingReadbacks();
+	std::vector<ParallelRecorder::Task> const& drawTasks(Output& output);
+	RecordState recordState(Output const& output);
+	std::optional<uint32_t> acquireNextImage(Output& output, vk::Semaphore semaphore);
+	// alternate frames: the next device whose images every window can show
+	void selectFrameDevice();
+	// the devices the frame runs on, 0 without a device group
+	uint32_t frameDeviceMask() const;
+	std::optional<vk::DeviceGroupPresentModeFlagBitsKHR> groupPresentMode(uint32_t device) const;
+
+	static void framebufferSizeCallback(Window* window, int width, int height);
+	static void iconifyCallback(Window* window, int iconified);
+	static void focusCallback(Window* window, int focused);
+
+	SceneConfig m_config;
+	std::array<float, 4> m_clear_color{ 0, 0, 1, 1 };
+	Watchdog m_watchdog;
+	ThreadPool m_thread_pool;
+	// secondary recording only, the frame's draws must not queue behind pipeline compiles and mesh decodes
+	ThreadPool m_record_pool;
+	// temporaries of a render loop iteration and of initialize() or recoverDevice(), also the command scope
+	// allocations of the Vulkan calls made on the thread using them; init steps run on several threads
+	LinearArena m_frame_arena;
+	LinearArena m_init_arena{ 64 * 1024, true };
+	uint64_t m_frame_heap_allocations = 0;
+	// before the instance, every Vulkan object is created with its callbacks or the driver's own
+	HostAllocator m_host_allocator;
+	uint64_t m_leaked_host_bytes = 0;
+	FrameProfiler m_profiler;
+	std::unique_ptr<ProfileExporter> m_profile_exporter;
+	MetricsRegistry m_metrics_registry;
+	SceneMetrics m_metrics;
+	// null without an export target
+	std::unique_ptr<MetricsExporter> m_metrics_exporter;
+
+	const vk::Format m_swapchain_format = vk::Format::eB8G8R8A8Unorm;
+	// chosen with the device, the first of eD32Sfloat, eX8D24UnormPack32 and eD16Unorm it supports
+	vk::Format m_depth_image_format = vk::Format::eD32Sfloat;
+	vk::SampleCountFlagBits m_msaa_samples = vk::SampleCountFlagBits::e1;
+	LatencyMode m_latency_mode;
+
+	vk::UniqueInstance m_instance;
+	DeviceSelector m_device_selector;
+	vk::PhysicalDevice m_phys_dev;
+	DeviceUuid m_phys_dev_uuid{};
+	uint32_t m_gq_fam_idx = -1;
+	uint32_t m_tq_fam_idx = -1;
+	uint32_t m_cq_fam_idx = -1;
+	DeviceCandidate m_candidate;
+	// built in the background; the one taking over is consumed by the device's creation steps
+	DeviceStandby m_standby;
+	std::optional<StandbyDevice> m_takeover;
+	vk::UniqueDevice m_device;
+	vk::Queue m_gr_queue;
+	vk::Queue m_transfer_queue;
+	vk::Queue m_compute_queue;
+	// device-level entry points of the enabled extensions
+	vk::DispatchLoaderDynamic m_dispatch;
+	bool m_dynamic_rendering = false;
+	// cull mode, front face and topology are set while recording too
+	bool m_extended_dynamic_state = false;
+	bool m_descriptor_indexing = false;
+	bool m_draw_indirect_count = false;
+	Breadcrumbs::Mode m_breadcrumbs_mode = Breadcrumbs::Mode::None;
+	bool m_device_fault = false;
+	bool m_synchronization2 = false;
+	bool m_calibrated_timestamps = false;
+	bool m_memory_budget_ext = false;
+	// capture buffers get exportable memory
+	bool m_capture_export = false;
+	// capture buffers are bound to CaptureConfig::host_memory
+	bool m_capture_import = false;
+	// VK_KHR_present_id and VK_KHR_present_wait
+	bool m_present_wait = false;
+	// the selected device and the devices linked with it, a group of one without multi GPU rendering
+	DeviceGroup m_device_group;
+	MultiGpuMode m_multi_gpu = MultiGpuMode::Single;
+	// of the frame being recorded, under alternate frame rendering
+	uint32_t m_frame_device = 0;
+	bool m_graphics_pipeline_library = false;
+	// enabled 1.0 features, for the formats and sparse residency of streamed textures
+	vk::PhysicalDeviceFeatures m_features;
+	// sparse bindings go to the transfer queue, or the graphics queue if only its family supports them
+	vk::Queue m_sparse_queue;
+	std::unique_ptr<DeviceAllocator> m_allocator;
+	// queried every frame, bounds the allocator's heaps and the texture streamer
+	std::unique_ptr<MemoryBudget> m_memory_budget;
+	std::unique_ptr<Breadcrumbs> m_breadcrumbs;
+	// registered in the same order on every device, so the ids survive recoveries
+	Breadcrumbs::WorkloadId m_culling_workload = 0;
+	Breadcrumbs::WorkloadId m_scene_pass_workload = 0;
+	Breadcrumbs::WorkloadId m_scene_draw_workload = 0;
+	// index of the graphics queue in the breadcrumb reports
+	const uint32_t m_breadcrumb_queue = 0;
+	std::set<std::string> m_disabled_workloads;
+	// every queue submission of a frame goes through it, the engines below flush it before host waits
+	std::unique_ptr<SubmitBatcher> m_submits;
+	std::unique_ptr<StagingRing> m_staging;
+	std::unique_ptr<UploadEngine> m_uploads;
+	std::unique_ptr<ComputeScheduler> m_compute;
+	// its own device, independent of m_device
+	std::unique_ptr<ComputeOffload> m_offload;
+	// puts the GPU timestamps on the profiler's timeline, before them so it outlives them
+	std::unique_ptr<GpuClock> m_gpu_clock;
+	std::unique_ptr<GpuTimestamps> m_gpu_timestamps;
+	std::unique_ptr<DescriptorLayoutCache> m_layout_cache;
+	// render passes of all render graphs, pipelines are created against them
+	std::unique_ptr<RenderPassCache> m_render_pass_cache;
+	// transient sets, reset with their frame in flight
+	std::unique_ptr<DescriptorAllocator> m_descriptors;
+	// null without descriptor indexing
+	std::unique_ptr<BindlessTable> m_bindless;
+	// null without vkCmdDrawIndexedIndirectCount, the scene is then drawn directly
+	std::unique_ptr<GpuCuller> m_culler;
+	// null without the loop guard
+	std::unique_ptr<LoopViolations> m_loop_violations;
+	uint64_t m_loop_bailouts = 0;
+	// null without a capture consumer or while the main window cannot be copied from; a resize retires the ring,
+	// which is kept until its last capture was released
+	std::unique_ptr<CaptureRing> m_capture;
+	std::vector<std::unique_ptr<CaptureRing>> m_retired_captures;
+	// the CPU side survives device loss, attached to every new device
+	SceneStorage m_objects;
+	ObjectHandle m_quad;
+	// per instance bindings from the scene storage, per vertex ones from the mesh pool; reflected from Vertex.vert
+	ReflectedVertexInput m_vertex_input;
+	std::unique_ptr<MeshPool> m_meshes;
+	MeshHandle m_quad_mesh;
+	std::unique_ptr<TextureStreamer> m_textures;
+	PipelineCache m_pipeline_cache;
+	std::unique_ptr<PipelineCompiler> m_pipeline_compiler;
+	std::unique_ptr<GraphicsPipelineBuilder> m_pipeline_builder;
+
+	// replaces the swapchain when headless
+	std::unique_ptr<OffscreenTarget> m_offscreen;
+
+	vk::UniqueCommandPool m_cmd_b_pool;
+	// the first output is the main window, or the offscreen target when headless
+	std::vector<std::unique_ptr<Output>> m_outputs;
+	PresentBatch m_present_batch;
+	PresentPacer m_pacer;
+	std::unique_ptr<ParallelRecorder> m_recorder;
+
+	std::vector<vk::DescriptorSetLayout> m_set_layouts;
+	vk::UniquePipelineLayout m_pipeline_layout;
+	std::shared_future<vk::Pipeline> m_pending_pipeline;
+	// link time optimized from the libraries of the last pipeline compiled, replaces it once built
+	std::shared_future<vk::Pipeline> m_optimized_pipeline;
+	// owned by the pipeline compiler, which builds every pipeline state once
+	vk::Pipeline m_pipeline;
+
+	std::unique_ptr<ShaderWatcher> m_shader_watcher;
+	// vertex and fragment SPIR-V of the last reload, null while the embedded shaders are in use; with the loop
+	// guard they are always set, the embedded ones instrumented until the first reload
+	std::shared_ptr<ShaderBinaries const> m_shader_binaries;
+	std::shared_future<vk::Pipeline> m_reloaded_pipeline;
+
+	std::vector<FrameData> m_frames;
+	uint32_t m_frame_index = 0;
+	// run() iterations, the windows' present intervals count these
+	uint64_t m_tick = 0;
+	// signaled by every graphics submission with the frame's serial; the CPU, other queues and the
+	// retired objects all wait on its values
+	std::unique_ptr<Timeline> m_frame_timeline;
+	// command buffers of the current frame in submission order
+	std::vector<vk::CommandBuffer> m_submit_cmds;
+	// replaced objects frames in flight may still use, keyed on the frame timeline
+	DeletionQueue m_deletion_queue;
+
+	// event thread to render thread
+	SpscRing<FramePacket> m_packets{ 256 };
+	std::atomic<bool> m_render_done{ false };
+	// only guards the render thread's idle wait, the packets themselves don't need it
+	std::mutex m_wake_mutex;
+	std::condition_variable m_wake;
+	FrameLimiter m_limiter;
+	// event thread only: the windows it polls, the main window first, and the closed ones, which are destroyed
+	// at shutdown after their surfaces
+	std::vector<Window*> m_event_windows;
+	std::vector<std::unique_ptr<Window, WindowDeleter>> m_closed_windows;
+};
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "staging_ring.h"
+#include "transform_batch.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+// Refers to an object of a SceneStorage; stays valid while the object lives, also across device loss.
+struct ObjectHandle
+{
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator==(ObjectHandle const& rhs) const { return slot == rhs.slot && generation == rhs.generation; }
+	bool operator!=(ObjectHandle const& rhs) const { return !(*this == rhs); }
+};
+
+struct ObjectTransform
+{
+	std::array<float, 3> translation{};
+	// unit quaternion, xyzw
+	std::array<float, 4> rotation{ 0.0f, 0.0f, 0.0f, 1.0f };
+	std::array<float, 3> scale{ 1.0f, 1.0f, 1.0f };
+};
+
+// matches the per-instance vertex attributes of Vertex.vert
+struct GpuInstance
+{
+	// column major
+	std::array<float, 16> world{};
+	uint32_t material = 0;
+	uint32_t padding[3]{};
+};
+static_assert(sizeof(GpuInstance) == 80, "GpuInstance must match the instance vertex attributes of Vertex.vert");
+
+// Transforms and material IDs of the scene's objects as structure of arrays. Live objects are packed at the front of
+// every column, so updates iterate contiguous memory: destroying an object moves the last one into its place. The
+// instance buffer is indexed by slot instead, a handle's instance() never changes and is the first_instance of its
+// draws. Objects changed since the last upload() form one dirty range of dense indices; upload() composes their world
+// matrices with TransformBatch and copies them through the staging ring into a device-local buffer, which the
+// cached command buffers keep binding. The CPU side outlives the device, attach() after a device loss re-uploads all.
+class SceneStorage
+{
+public:
+	// the columns in dense order, for bulk updates; markDirty() what was written
+	struct Columns
+	{
+		std::array<float*, 3> translation{};
+		std::array<float*, 4> rotation{};
+		std::array<float*, 3> scale{};
+		uint32_t* material = nullptr;
+	};
+
+	explicit SceneStorage(uint32_t capacity)
+		: m_capacity(capacity)
+	{
+		forEachColumn([&](std::vector<float>& values) { values.reserve(capacity); });
+		m_material.reserve(capacity);
+		m_slot_of.reserve(capacity);
+	}
+
+	~SceneStorage()
+	{
+		detach();
+	}
+
+	SceneStorage(SceneStorage const&) = delete;
+	SceneStorage& operator=(SceneStorage const&) = delete;
+
+	// creates the instance buffer on the device, every object is uploaded again
+	void attach(vk::Device device, DeviceAllocator& allocator)
+	{
+		detach();
+		m_allocator = &allocator;
+
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = sizeof(GpuInstance) * std::max(m_capacity, 1u);
+		buf_ci.usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+		m_buffer = device.createBufferUnique(buf_ci);
+		m_memory = allocator.allocateFor(*m_buffer, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+		markDirty(0, size());
+	}
+
+	void detach()
+	{
+		m_buffer.reset();
+		if (m_allocator)
+			m_allocator->free(m_memory);
+		m_memory = {};
+		m_allocator = nullptr;
+	}
+
+	vk::Buffer buffer() const { return *m_buffer; }
+	uint32_t size() const { return static_cast<uint32_t>(m_slot_of.size()); }
+	uint32_t capacity() const { return m_capacity; }
+
+	ObjectHandle create(ObjectTransform const& transform, uint32_t material = 0)
+	{
+		if (size() == m_capacity)
+			throw std::runtime_error("SceneStorage is full!");
+		uint32_t slot;
+		if (!m_free_slots.empty())
+		{
+			slot = m_free_slots.back();
+			m_free_slots.pop_back();
+		}
+		else
+		{
+			slot = static_cast<uint32_t>(m_slots.size());
+			m_slots.push_back({});
+		}
+		auto const dense = size();
+		m_slots[slot].dense = dense;
+		m_slot_of.push_back(slot);
+		for (size_t i = 0; i < 3; ++i)
+		{
+			m_translation[i].push_back(transform.translation[i]);
+			m_scale[i].push_back(transform.scale[i]);
+		}
+		for (size_t i = 0; i < 4; ++i)
+			m_rotation[i].push_back(transform.rotation[i]);
+		m_material.push_back(material);
+		markDirty(dense, dense + 1);
+		return { slot, m_slots[slot].generation };
+	}
+
+	// its instance keeps its last contents until the slot is reused
+	void destroy(ObjectHandle handle)
+	{
+		auto const dense = denseIndex(handle);
+		auto const last = size() - 1;
+		if (dense != last)
+		{
+			// the last object moves into the hole, its instance stays where it is
+			forEachColumn([&](std::vector<float>& values) { values[dense] = values[last]; });
+			m_material[dense] = m_material[last];
+			m_slot_of[dense] = m_slot_of[last];
+			m_slots[m_slot_of[dense]].dense = dense;
+			// a pending write of the moved object now happens at its new dense index
+			if (last >= m_dirty_begin && last < m_dirty_end)
+				markDirty(dense, dense + 1);
+		}
+		forEachColumn([](std::vector<float>& values) { values.pop_back(); });
+		m_material.pop_back();
+		m_slot_of.pop_back();
+		m_dirty_end = std::min(m_dirty_end, size());
+
+		++m_slots[handle.slot].generation;
+		m_free_slots.push_back(handle.slot);
+	}
+
+	bool alive(ObjectHandle handle) const
+	{
+		return handle.slot < m_slots.size() && m_slots[handle.slot].generation == handle.generation
+			&& m_slots[handle.slot].dense < size() && m_slot_of[m_slots[handle.slot].dense] == handle.slot;
+	}
+
+	// the index of the object's instance in buffer()
+	uint32_t instance(ObjectHandle handle) const
+	{
+		denseIndex(handle);
+		return handle.slot;
+	}
+
+	ObjectTransform transform(ObjectHandle handle) const
+	{
+		auto const dense = denseIndex(handle);
+		ObjectTransform transform;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			transform.translation[i] = m_translation[i][dense];
+			transform.scale[i] = m_scale[i][dense];
+		}
+		for (size_t i = 0; i < 4; ++i)
+			transform.rotation[i] = m_rotation[i][dense];
+		return transform;
+	}
+
+	void setTransform(ObjectHandle handle, ObjectTransform const& transform)
+	{
+		auto const dense = denseIndex(handle);
+		for (size_t i = 0; i < 3; ++i)
+		{
+			m_translation[i][dense] = transform.translation[i];
+			m_scale[i][dense] = transform.scale[i];
+		}
+		for (size_t i = 0; i < 4; ++i)
+			m_rotation[i][dense] = transform.rotation[i];
+		markDirty(dense, dense + 1);
+	}
+
+	uint32_t material(ObjectHandle handle) const { return m_material[denseIndex(handle)]; }
+
+	void setMaterial(ObjectHandle handle, uint32_t material)
+	{
+		auto const dense = denseIndex(handle);
+		m_material[dense] = material;
+		markDirty(dense, dense + 1);
+	}
+
+	Columns columns()
+	{
+		Columns columns;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			columns.translation[i] = m_translation[i].data();
+			columns.scale[i] = m_scale[i].data();
+		}
+		for (size_t i = 0; i < 4; ++i)
+			columns.rotation[i] = m_rotation[i].data();
+		columns.material = m_material.data();
+		return columns;
+	}
+
+	// dense indices [begin, end) were written through columns()
+	void markDirty(uint32_t begin, uint32_t end)
+	{
+		end = std::min(end, size());
+		if (begin >= end)
+			return;
+		m_dirty_begin = std::min(m_dirty_begin, begin);
+		m_dirty_end = std::max(m_dirty_end, end);
+	}
+
+	bool dirty() const { return m_dirty_begin < m_dirty_end; }
+
+	// Queues the dirty objects' instances on the staging ring, before its flush(). As many as the ring's partition
+	// still has room for go out this frame, the rest stays dirty for the next ones.
+	void upload(StagingRing& staging)
+	{
+		if (!m_buffer || !dirty())
+			return;
+		auto const room = static_cast<uint32_t>(std::min<vk::DeviceSize>(staging.available(alignof(GpuInstance)) / sizeof(GpuInstance), m_dirty_end - m_dirty_begin));
+		if (room == 0)
+			return;
+		auto const region = staging.allocate(room * sizeof(GpuInstance), alignof(GpuInstance));
+		auto* const instances = static_cast<GpuInstance*>(region.data);
+
+		// composed in chunks that stay in the cache, then transposed into the ring
+		std::array<std::array<float, chunk>, 16> world;
+		Mat4Soa world_soa;
+		for (size_t e = 0; e < 16; ++e)
+			world_soa.m[e] = world[e].data();
+		auto const begin = m_dirty_begin;
+		for (uint32_t first = 0; first < room; first += chunk)
+		{
+			auto const count = std::min<uint32_t>(chunk, room - first);
+			auto const dense = begin + first;
+			auto const translation = Vec4SoaConst{ &m_translation[0][dense], &m_translation[1][dense], &m_translation[2][dense], &m_translation[2][dense] };
+			auto const rotation = Vec4SoaConst{ &m_rotation[0][dense], &m_rotation[1][dense], &m_rotation[2][dense], &m_rotation[3][dense] };
+			auto const scale = Vec4SoaConst{ &m_scale[0][dense], &m_scale[1][dense], &m_scale[2][dense], &m_scale[2][dense] };
+			TransformBatch::compose(world_soa, translation, rotation, scale, count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				auto& instance = instances[first + i];
+				for (size_t e = 0; e < 16; ++e)
+					instance.world[e] = world[e][i];
+				instance.material = m_material[dense + i];
+			}
+		}
+
+		// one copy per run of consecutive slots
+		for (uint32_t i = 0; i < room;)
+		{
+			auto const slot = m_slot_of[begin + i];
+			uint32_t run = 1;
+			while (i + run < room && m_slot_of[begin + i + run] == slot + run)
+				++run;
+			staging.copy(*m_buffer, vk::BufferCopy{ region.offset + i * sizeof(GpuInstance), slot * sizeof(GpuInstance), run * sizeof(GpuInstance) });
+			i += run;
+		}
+
+		m_dirty_begin += room;
+		if (m_dirty_begin >= m_dirty_end)
+		{
+			m_dirty_begin = UINT32_MAX;
+			m_dirty_end = 0;
+		}
+	}
+
+private:
+	struct Slot
+	{
+		uint32_t dense = 0;
+		uint32_t generation = 0;
+	};
+
+	static constexpr uint32_t chunk = 256;
+
+	template<typename F>
+	void forEachColumn(F&& f)
+	{
+		for (auto& values : m_translation)
+			f(values);
+		for (auto& values : m_rotation)
+			f(values);
+		for (auto& values : m_scale)
+			f(values);
+	}
+
+	uint32_t denseIndex(ObjectHandle handle) const
+	{
+		if (!alive(handle))
+			throw std::runtime_error("ObjectHandle does not refer to a live object!");
+		return m_slots[handle.slot].dense;
+	}
+
+	uint32_t m_capacity;
+	std::array<std::vector<float>, 3> m_translation;
+	std::array<std::vector<float>, 4> m_rotation;
+	std::array<std::vector<float>, 3> m_scale;
+	std::vector<uint32_t> m_material;
+	// dense index to slot and back
+	std::vector<uint32_t> m_slot_of;
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_free_slots;
+	uint32_t m_dirty_begin = UINT32_MAX;
+	uint32_t m_dirty_end = 0;
+
+	DeviceAllocator* m_allocator = nullptr;
+	vk::UniqueBuffer m_buffer;
+	Allocation m_memory;
+};
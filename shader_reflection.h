@@ -0,0 +1,204 @@
+#pragma once
+
+#include "descriptor_allocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Descriptor binding of a shader, as recorded by the reflection step of the shader build.
+struct ShaderBinding
+{
+	uint32_t set;
+	uint32_t binding;
+	vk::DescriptorType type;
+	// 0 for runtime-sized arrays
+	uint32_t count;
+};
+
+// Vertex input of a vertex shader, one per location; a matrix takes one location per column.
+struct ShaderInput
+{
+	uint32_t location;
+	vk::Format format;
+};
+
+// Interface of one shader stage, generated next to the SPIR-V header as <shader>.reflect.h.
+struct ShaderReflection
+{
+	vk::ShaderStageFlagBits stage;
+	ShaderBinding const* bindings;
+	size_t binding_count;
+	uint32_t push_constant_size;
+	// vertex stage only
+	ShaderInput const* inputs = nullptr;
+	size_t input_count = 0;
+
+	constexpr ShaderBinding const* begin() const { return bindings; }
+	constexpr ShaderBinding const* end() const { return bindings + binding_count; }
+};
+
+// The locations [first_location, first_location + location_count) are fed by one vertex buffer binding.
+struct VertexBindingLayout
+{
+	uint32_t first_location;
+	uint32_t location_count;
+	vk::VertexInputRate rate = vk::VertexInputRate::eVertex;
+	// 0 packs the attributes tightly, otherwise at least their packed size
+	uint32_t stride = 0;
+};
+
+struct ReflectedVertexInput
+{
+	// binding numbers in the order the layouts were given
+	std::vector<vk::VertexInputBindingDescription> bindings;
+	std::vector<vk::VertexInputAttributeDescription> attributes;
+
+	// points into this object
+	vk::PipelineVertexInputStateCreateInfo createInfo() const
+	{
+		vk::PipelineVertexInputStateCreateInfo vt_inp_ci{};
+		vt_inp_ci.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+		vt_inp_ci.pVertexBindingDescriptions = bindings.data();
+		vt_inp_ci.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+		vt_inp_ci.pVertexAttributeDescriptions = attributes.data();
+		return vt_inp_ci;
+	}
+
+	std::vector<vk::VertexInputAttributeDescription> attributesOf(uint32_t binding) const
+	{
+		std::vector<vk::VertexInputAttributeDescription> of;
+		for (auto const& attribute : attributes)
+			if (attribute.binding == binding)
+				of.push_back(attribute);
+		return of;
+	}
+};
+
+// size of the formats Shader.ps1 reflects vertex inputs as
+inline uint32_t vertexFormatSize(vk::Format format)
+{
+	switch (format)
+	{
+	case vk::Format::eR32Sfloat: case vk::Format::eR32Sint: case vk::Format::eR32Uint: return 4;
+	case vk::Format::eR32G32Sfloat: case vk::Format::eR32G32Sint: case vk::Format::eR32G32Uint: return 8;
+	case vk::Format::eR32G32B32Sfloat: case vk::Format::eR32G32B32Sint: case vk::Format::eR32G32B32Uint: return 12;
+	case vk::Format::eR32G32B32A32Sfloat: case vk::Format::eR32G32B32A32Sint: case vk::Format::eR32G32B32A32Uint: return 16;
+	default: throw std::runtime_error("Unsupported vertex input format " + vk::to_string(format) + "!");
+	}
+}
+
+// Lays out the vertex inputs of a vertex stage over vertex buffer bindings, each binding's attributes packed in
+// location order. Every input has to be covered by a binding, a binding may cover unused locations.
+inline ReflectedVertexInput createReflectedVertexInput(ShaderReflection const& stage, std::initializer_list<VertexBindingLayout> layouts)
+{
+	std::vector<ShaderInput> inputs(stage.inputs, stage.inputs + stage.input_count);
+	std::sort(inputs.begin(), inputs.end(), [](ShaderInput const& a, ShaderInput const& b) { return a.location < b.location; });
+
+	ReflectedVertexInput vertex_input;
+	std::vector<bool> covered(inputs.size(), false);
+	uint32_t binding = 0;
+	for (auto const& layout : layouts)
+	{
+		uint32_t offset = 0;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (inputs[i].location < layout.first_location || inputs[i].location - layout.first_location >= layout.location_count)
+				continue;
+			if (covered[i])
+				throw std::runtime_error("Vertex input at location " + std::to_string(inputs[i].location) + " is covered by two bindings!");
+			covered[i] = true;
+			vertex_input.attributes.emplace_back(inputs[i].location, binding, inputs[i].format, offset);
+			offset += vertexFormatSize(inputs[i].format);
+		}
+		if (layout.stride != 0 && layout.stride < offset)
+			throw std::runtime_error("Stride of vertex binding " + std::to_string(binding) + " is smaller than its attributes!");
+		vertex_input.bindings.emplace_back(binding, layout.stride != 0 ? layout.stride : offset, layout.rate);
+		++binding;
+	}
+	for (size_t i = 0; i < inputs.size(); ++i)
+		if (!covered[i])
+			throw std::runtime_error("Vertex input at location " + std::to_string(inputs[i].location) + " is not fed by any binding!");
+	return vertex_input;
+}
+
+struct ReflectedLayout
+{
+	// indexed by set number, unused sets get empty layouts; owned by the layout cache
+	std::vector<vk::DescriptorSetLayout> set_layouts;
+	vk::UniquePipelineLayout pipeline_layout;
+};
+
+// Merges the interfaces of the stages of a pipeline into its descriptor set and pipeline layouts.
+// With a bindless table its set is always part of the layout and the stages may only declare its arrays there.
+inline ReflectedLayout createReflectedLayout(vk::Device device, DescriptorLayoutCache& layouts, std::initializer_list<ShaderReflection const*> stages,
+	BindlessTable const* bindless = nullptr)
+{
+	std::map<uint32_t, std::map<uint32_t, vk::DescriptorSetLayoutBinding>> sets;
+	vk::PushConstantRange push_constants{};
+	for (auto const* stage : stages)
+	{
+		for (auto const& binding : *stage)
+		{
+			auto const location = "set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding);
+			if (bindless && binding.set == bindless->setIndex())
+			{
+				// runtime-sized arrays are sized by the table
+				if (binding.binding >= BindlessTable::BindingCount
+					|| binding.type != BindlessTable::descriptorType(static_cast<BindlessTable::Binding>(binding.binding))
+					|| binding.count > bindless->capacity(static_cast<BindlessTable::Binding>(binding.binding)))
+					throw std::runtime_error("Descriptor at " + location + " does not match the bindless table!");
+				continue;
+			}
+			if (binding.count == 0)
+				throw std::runtime_error("Runtime-sized descriptor array at " + location + " needs an explicit count!");
+			auto const [it, inserted] = sets[binding.set].try_emplace(binding.binding, binding.binding, binding.type, binding.count, stage->stage);
+			if (inserted)
+				continue;
+			if (it->second.descriptorType != binding.type || it->second.descriptorCount != binding.count)
+				throw std::runtime_error("Shader stages disagree on the descriptor at " + location + "!");
+			it->second.stageFlags |= stage->stage;
+		}
+		// one range for all stages, each stage only reads the part it declares
+		if (stage->push_constant_size)
+		{
+			push_constants.stageFlags |= stage->stage;
+			push_constants.size = std::max(push_constants.size, stage->push_constant_size);
+		}
+	}
+
+	ReflectedLayout layout;
+	auto set_count = sets.empty() ? 0u : sets.rbegin()->first + 1;
+	if (bindless)
+		set_count = std::max(set_count, bindless->setIndex() + 1);
+	for (uint32_t set = 0; set < set_count; ++set)
+	{
+		if (bindless && set == bindless->setIndex())
+		{
+			layout.set_layouts.push_back(bindless->layout());
+			continue;
+		}
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		for (auto const& entry : sets[set])
+			bindings.push_back(entry.second);
+		layout.set_layouts.push_back(layouts.get(std::move(bindings)));
+	}
+
+	vk::PipelineLayoutCreateInfo pl_ci{};
+	pl_ci.setLayoutCount = static_cast<uint32_t>(layout.set_layouts.size());
+	pl_ci.pSetLayouts = layout.set_layouts.data();
+	if (push_constants.size)
+	{
+		pl_ci.pushConstantRangeCount = 1;
+		pl_ci.pPushConstantRanges = &push_constants;
+	}
+	layout.pipeline_layout = device.createPipelineLayoutUnique(pl_ci);
+	return layout;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "spirv.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// SPIR-V of every watched source, in the order the sources were given.
+using ShaderBinaries = std::vector<std::vector<uint32_t>>;
+
+// Development aid: polls GLSL sources on a background thread and recompiles them with glslangValidator
+// whenever one changes. A set is only published once every source compiled, so a typo never reaches
+// the pipeline; the compiler output is printed instead and the previous set stays in use.
+class ShaderWatcher
+{
+public:
+	explicit ShaderWatcher(std::vector<std::filesystem::path> sources, std::chrono::milliseconds interval = std::chrono::milliseconds(250))
+		: m_sources(std::move(sources))
+		, m_interval(interval)
+		, m_write_times(m_sources.size())
+		, m_binaries(m_sources.size())
+	{
+		// the sources as they are now match the embedded shaders, only later edits trigger a reload
+		for (size_t i = 0; i < m_sources.size(); ++i)
+			m_write_times[i] = writeTime(m_sources[i]);
+		m_thread = std::thread([this] { watch(); });
+	}
+
+	~ShaderWatcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	ShaderWatcher(ShaderWatcher const&) = delete;
+	ShaderWatcher& operator=(ShaderWatcher const&) = delete;
+
+	// the newest set compiled since the last call, null if there is none
+	std::shared_ptr<ShaderBinaries const> take()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return std::move(m_published);
+	}
+
+private:
+	static std::optional<std::filesystem::file_time_type> writeTime(std::filesystem::path const& path)
+	{
+		std::error_code ec;
+		auto const time = std::filesystem::last_write_time(path, ec);
+		if (ec)
+			return std::nullopt;
+		return time;
+	}
+
+	static std::filesystem::path compilerPath()
+	{
+		if (char const* sdk = std::getenv("VULKAN_SDK"))
+			return std::filesystem::path(sdk) / "Bin" / "glslangValidator";
+		return "glslangValidator";
+	}
+
+	static std::optional<std::vector<uint32_t>> compile(std::filesystem::path const& source)
+	{
+		auto const output = std::filesystem::temp_directory_path() / (source.filename().string() + ".reload.spv");
+		std::string command = "\"" + compilerPath().string() + "\" -V -o \"" + output.string() + "\" \"" + source.string() + "\"";
+#ifdef _WIN32
+		// cmd strips the outer quotes of the whole line
+		command = "\"" + command + "\"";
+#endif
+		if (std::system(command.c_str()) != 0)
+		{
+			std::cerr << "shader reload: compiling " << source.string() << " failed" << std::endl;
+			return std::nullopt;
+		}
+
+		std::ifstream file(output, std::ios::binary | std::ios::ate);
+		if (!file)
+			return std::nullopt;
+		std::vector<uint32_t> words(static_cast<size_t>(file.tellg()) / sizeof(uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(words.data()), words.size() * sizeof(uint32_t));
+		if (!file || !SpirvView(words.data(), words.size()).valid())
+		{
+			std::cerr << "shader reload: " << output.string() << " is not SPIR-V" << std::endl;
+			return std::nullopt;
+		}
+		return words;
+	}
+
+	void watch()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; }))
+		{
+			lock.unlock();
+			poll();
+			lock.lock();
+		}
+	}
+
+	void poll()
+	{
+		std::vector<std::optional<std::filesystem::file_time_type>> times(m_sources.size());
+		bool changed = false;
+		for (size_t i = 0; i < m_sources.size(); ++i)
+		{
+			times[i] = writeTime(m_sources[i]);
+			// editors replace files by deleting and renaming, a missing source is picked up on the next poll
+			if (!times[i])
+				return;
+			changed |= times[i] != m_write_times[i];
+		}
+		if (!changed)
+			return;
+
+		bool complete = true;
+		for (size_t i = 0; i < m_sources.size(); ++i)
+		{
+			// unchanged sources are compiled once as well, every published set has to be complete
+			if (times[i] == m_write_times[i] && !m_binaries[i].empty())
+				continue;
+			m_write_times[i] = times[i];
+			if (auto words = compile(m_sources[i]))
+				m_binaries[i] = std::move(*words);
+			else
+			{
+				m_binaries[i].clear();
+				complete = false;
+			}
+		}
+		if (!complete)
+			return;
+
+		auto binaries = std::make_shared<ShaderBinaries const>(m_binaries);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_published = std::move(binaries);
+	}
+
+	std::vector<std::filesystem::path> m_sources;
+	std::chrono::milliseconds m_interval;
+	// only touched by the watch thread
+	std::vector<std::optional<std::filesystem::file_time_type>> m_write_times;
+	ShaderBinaries m_binaries;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::shared_ptr<ShaderBinaries const> m_published;
+	bool m_stop = false;
+	std::thread m_thread;
+};
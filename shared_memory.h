@@ -0,0 +1,163 @@
+#pragma once
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Named memory shared between processes, read-write in every one of them. The creator owns the name: it goes
+// when the creator's mapping does, mappings opened by others stay valid until they are reset too. Views start
+// at the OS's allocation granularity, at least a page.
+class SharedMemory
+{
+public:
+	SharedMemory() = default;
+
+	// name without a prefix, unique among the processes of the user
+	static SharedMemory create(std::string const& name, size_t size)
+	{
+		SharedMemory memory;
+		memory.m_size = size;
+#ifdef _WIN32
+		auto const full = "Local\\" + name;
+		memory.m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(uint64_t(size) >> 32),
+			static_cast<DWORD>(size), full.c_str());
+		if (memory.m_mapping == nullptr || GetLastError() == ERROR_ALREADY_EXISTS)
+			throw std::runtime_error("Can not create shared memory " + name);
+		memory.m_data = MapViewOfFile(memory.m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+		memory.m_name = "/" + name;
+		auto const file = shm_open(memory.m_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if (file < 0)
+			throw std::runtime_error("Can not create shared memory " + name);
+		memory.m_owner = true;
+		if (ftruncate(file, static_cast<off_t>(size)) == 0)
+		{
+			auto* const data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+			if (data != MAP_FAILED)
+				memory.m_data = data;
+		}
+		close(file);
+#endif
+		if (memory.m_data == nullptr)
+			throw std::runtime_error("Can not map shared memory " + name);
+		return memory;
+	}
+
+	static SharedMemory open(std::string const& name)
+	{
+		SharedMemory memory;
+#ifdef _WIN32
+		auto const full = "Local\\" + name;
+		memory.m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, full.c_str());
+		if (memory.m_mapping == nullptr)
+			throw std::runtime_error("Can not open shared memory " + name);
+		memory.m_data = MapViewOfFile(memory.m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		MEMORY_BASIC_INFORMATION info{};
+		if (memory.m_data && VirtualQuery(memory.m_data, &info, sizeof(info)) != 0)
+			memory.m_size = info.RegionSize;
+#else
+		auto const file = shm_open(("/" + name).c_str(), O_RDWR | O_CLOEXEC, 0);
+		if (file < 0)
+			throw std::runtime_error("Can not open shared memory " + name);
+		struct stat st{};
+		if (fstat(file, &st) == 0 && st.st_size > 0)
+		{
+			memory.m_size = static_cast<size_t>(st.st_size);
+			auto* const data = mmap(nullptr, memory.m_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+			if (data != MAP_FAILED)
+				memory.m_data = data;
+		}
+		close(file);
+#endif
+		if (memory.m_data == nullptr)
+			throw std::runtime_error("Can not map shared memory " + name);
+		return memory;
+	}
+
+	// drops a name whose creator died without resetting, no-op on Windows where names go with their last handle
+	static void removeStale(std::string const& name)
+	{
+#ifndef _WIN32
+		shm_unlink(("/" + name).c_str());
+#else
+		(void)name;
+#endif
+	}
+
+	~SharedMemory()
+	{
+		reset();
+	}
+
+	SharedMemory(SharedMemory&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	SharedMemory& operator=(SharedMemory&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			m_data = std::exchange(other.m_data, nullptr);
+			m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+			m_mapping = std::exchange(other.m_mapping, nullptr);
+#else
+			m_name = std::move(other.m_name);
+			m_owner = std::exchange(other.m_owner, false);
+#endif
+		}
+		return *this;
+	}
+
+	SharedMemory(SharedMemory const&) = delete;
+	SharedMemory& operator=(SharedMemory const&) = delete;
+
+	void* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	void reset()
+	{
+#ifdef _WIN32
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		m_mapping = nullptr;
+#else
+		if (m_data)
+			munmap(m_data, m_size);
+		if (m_owner)
+			shm_unlink(m_name.c_str());
+		m_owner = false;
+		m_name.clear();
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+private:
+	void* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	// the name lives as long as any handle to the mapping
+	HANDLE m_mapping = nullptr;
+#else
+	std::string m_name;
+	bool m_owner = false;
+#endif
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "state_key.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The number of members of an aggregate, the most initializers it takes
+template<typename T>
+class AggregateMembers
+{
+	// converts to any member type
+	struct Any
+	{
+		template<typename U>
+		constexpr operator U() const noexcept { return U{}; }
+	};
+
+	template<typename... Members>
+	static constexpr auto count(int) -> decltype(T{ Members{}... }, uint32_t{}) { return count<Members..., Any>(0); }
+
+	template<typename... Members>
+	static constexpr uint32_t count(long) { return static_cast<uint32_t>(sizeof...(Members)) - 1; }
+
+public:
+	static constexpr uint32_t value() { return count<>(0); }
+};
+
+// The map entries of a struct of specialization constants, built at compile time. Members are 32-bit scalars,
+// uint32_t, int32_t, float or VkBool32, in the order of their constant_id, the first one being FirstId.
+template<typename T, uint32_t FirstId = 0>
+class SpecializationLayout
+{
+	template<size_t... Indices>
+	struct Entries
+	{
+		static constexpr std::array<vk::SpecializationMapEntry, sizeof...(Indices)> value = {
+			vk::SpecializationMapEntry{ FirstId + static_cast<uint32_t>(Indices), static_cast<uint32_t>(Indices * 4), 4 }... };
+	};
+
+	template<size_t... Indices>
+	static Entries<Indices...> entriesOf(std::index_sequence<Indices...>);
+
+public:
+	static_assert(std::is_aggregate_v<T> && std::is_trivially_copyable_v<T>, "specialization constants must be a plain struct");
+
+	static constexpr uint32_t count = AggregateMembers<T>::value();
+
+	// every member takes 4 bytes without padding, so member i is at offset 4 * i
+	static_assert(count > 0 && sizeof(T) == 4 * count && alignof(T) == 4, "specialization constants must all be 32-bit scalars");
+
+	static constexpr std::array<vk::SpecializationMapEntry, count> entries = decltype(entriesOf(std::make_index_sequence<count>{}))::value;
+};
+
+// The values of a stage's specialization constants with their map entries, copyable into pipeline states that are
+// built after the caller's stack is gone. Empty leaves every constant at its default from the shader.
+class SpecializationConstants
+{
+public:
+	SpecializationConstants() = default;
+
+	template<uint32_t FirstId = 0, typename T>
+	static SpecializationConstants of(T const& values)
+	{
+		using Layout = SpecializationLayout<T, FirstId>;
+		SpecializationConstants constants;
+		constants.m_entries.assign(Layout::entries.begin(), Layout::entries.end());
+		constants.m_data.resize(Layout::count);
+		std::memcpy(constants.m_data.data(), &values, sizeof(T));
+		return constants;
+	}
+
+	bool empty() const { return m_entries.empty(); }
+
+	// points into the constants, valid while they are unchanged
+	vk::SpecializationInfo info() const
+	{
+		vk::SpecializationInfo info{};
+		info.mapEntryCount = static_cast<uint32_t>(m_entries.size());
+		info.pMapEntries = m_entries.data();
+		info.dataSize = m_data.size() * sizeof(uint32_t);
+		info.pData = m_data.data();
+		return info;
+	}
+
+	// the pipeline is a different one for every value
+	void addKey(StateKey& key) const
+	{
+		key.add(m_entries.size());
+		for (auto const& entry : m_entries)
+			key.add(entry.constantID);
+		for (auto const word : m_data)
+			key.add(word);
+	}
+
+private:
+	std::vector<vk::SpecializationMapEntry> m_entries;
+	std::vector<uint32_t> m_data;
+};
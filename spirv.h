@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr std::uint32_t spirv_magic = 0x07230203;
+// magic, version, generator, bound and schema
+constexpr std::size_t spirv_header_words = 5;
+
+// Non-owning view of SPIR-V words, so embedded shaders are passed to the driver without a copy.
+class SpirvView
+{
+public:
+	constexpr SpirvView() = default;
+	constexpr SpirvView(std::uint32_t const* words, std::size_t word_count)
+		: m_words(words)
+		, m_word_count(word_count)
+	{}
+	template<std::size_t N>
+	constexpr SpirvView(std::uint32_t const (&words)[N])
+		: m_words(words)
+		, m_word_count(N)
+	{}
+
+	constexpr std::uint32_t const* data() const { return m_words; }
+	constexpr std::size_t size() const { return m_word_count; }
+	constexpr std::size_t sizeBytes() const { return m_word_count * sizeof(std::uint32_t); }
+	constexpr bool valid() const { return m_words != nullptr && m_word_count >= spirv_header_words && m_words[0] == spirv_magic; }
+
+private:
+	std::uint32_t const* m_words = nullptr;
+	std::size_t m_word_count = 0;
+};
+
+// for the constexpr arrays the shader build embeds, use in a static_assert
+template<std::size_t N>
+constexpr bool isSpirv(std::uint32_t const (&words)[N])
+{
+	return N >= spirv_header_words && words[0] == spirv_magic;
+}
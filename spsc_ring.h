@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// The capacity is rounded up to a power of two; push fails instead of blocking when the ring is full.
+template<typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		m_slots.resize(size);
+		m_mask = size - 1;
+	}
+
+	SpscRing(SpscRing const&) = delete;
+	SpscRing& operator=(SpscRing const&) = delete;
+
+	size_t capacity() const { return m_slots.size(); }
+
+	// producer side
+	bool push(T value)
+	{
+		auto const tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == m_slots.size())
+			return false;
+		m_slots[tail & m_mask] = std::move(value);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side
+	std::optional<T> pop()
+	{
+		auto const head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return std::nullopt;
+		std::optional<T> value = std::move(m_slots[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+		return value;
+	}
+
+	// only a snapshot while the other side is running
+	bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+private:
+	std::vector<T> m_slots;
+	size_t m_mask = 0;
+	// on separate cache lines so producer and consumer don't share one
+	alignas(64) std::atomic<size_t> m_head{ 0 };
+	alignas(64) std::atomic<size_t> m_tail{ 0 };
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "device_allocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+// Persistently mapped, host-coherent upload buffer split into one partition per frame in flight.
+// A partition is handed out linearly during its frame and reclaimed once that frame's fence signaled,
+// so uploads never map/unmap and never wait on the GPU. All copies queued in a frame are recorded by flush().
+class StagingRing
+{
+public:
+	struct Region
+	{
+		void* data = nullptr;
+		vk::Buffer buffer;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+	};
+
+	StagingRing(vk::Device device, DeviceAllocator& allocator, vk::DeviceSize frame_size, uint32_t frames_in_flight)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_frame_size((frame_size + 255) / 256 * 256)
+		, m_frames_in_flight(frames_in_flight)
+	{
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = m_frame_size * frames_in_flight;
+		buf_ci.usage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+		m_buffer = device.createBufferUnique(buf_ci);
+
+		auto const host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		m_memory = allocator.allocateFor(*m_buffer, host_flags, host_flags, AllocationStrategy::Linear);
+		m_mapped = static_cast<uint8_t*>(m_memory.mapped);
+	}
+
+	~StagingRing()
+	{
+		m_buffer.reset();
+		m_allocator.free(m_memory);
+	}
+
+	StagingRing(StagingRing const&) = delete;
+	StagingRing& operator=(StagingRing const&) = delete;
+
+	vk::Buffer buffer() const { return *m_buffer; }
+	bool hasPendingCopies() const { return !m_copies.empty(); }
+
+	// the frame's fence must have signaled, its partition is reused from the start
+	void beginFrame(uint32_t frame_index)
+	{
+		m_frame_index = frame_index % m_frames_in_flight;
+		m_head = 0;
+		m_copies.clear();
+	}
+
+	// for data the GPU reads straight from the ring, e.g. per-frame uniforms
+	Region allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16)
+	{
+		auto const offset = (m_head + alignment - 1) / alignment * alignment;
+		if (offset + size > m_frame_size)
+			throw std::runtime_error("staging ring partition exhausted");
+		m_head = offset + size;
+
+		Region region{};
+		region.buffer = *m_buffer;
+		region.offset = m_frame_index * m_frame_size + offset;
+		region.data = m_mapped + region.offset;
+		region.size = size;
+		return region;
+	}
+
+	// what allocate() can still hand out this frame
+	vk::DeviceSize available(vk::DeviceSize alignment = 16) const
+	{
+		auto const offset = (m_head + alignment - 1) / alignment * alignment;
+		return offset < m_frame_size ? m_frame_size - offset : 0;
+	}
+
+	// queues a transfer from a region allocate() returned, src_offset is an offset into buffer()
+	void copy(vk::Buffer dst, vk::BufferCopy const& region)
+	{
+		m_copies[dst].push_back(region);
+	}
+
+	// copies data into the ring and queues the transfer to dst
+	void upload(vk::Buffer dst, vk::DeviceSize dst_offset, void const* data, vk::DeviceSize size)
+	{
+		auto const region = allocate(size, 4);
+		std::memcpy(region.data, data, static_cast<size_t>(size));
+		m_copies[dst].push_back(vk::BufferCopy{ region.offset, dst_offset, size });
+	}
+
+	// records all copies of the frame, one vkCmdCopyBuffer per destination and a single barrier;
+	// must be recorded outside a render pass before the consumers
+	void flush(vk::CommandBuffer cmd)
+	{
+		if (m_copies.empty())
+			return;
+		// earlier frames may still read the destinations
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader
+			| vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer,
+			{}, nullptr, nullptr, nullptr);
+		for (auto const& [dst, regions] : m_copies)
+			cmd.copyBuffer(*m_buffer, dst, regions);
+
+		vk::MemoryBarrier barrier{};
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead
+			| vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader
+			| vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
+			{}, barrier, nullptr, nullptr);
+		m_copies.clear();
+	}
+
+private:
+	struct BufferLess
+	{
+		bool operator()(vk::Buffer a, vk::Buffer b) const { return static_cast<VkBuffer>(a) < static_cast<VkBuffer>(b); }
+	};
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	vk::DeviceSize m_frame_size;
+	uint32_t m_frames_in_flight;
+
+	vk::UniqueBuffer m_buffer;
+	Allocation m_memory;
+	uint8_t* m_mapped = nullptr;
+
+	uint32_t m_frame_index = 0;
+	vk::DeviceSize m_head = 0;
+	std::map<vk::Buffer, std::vector<vk::BufferCopy>, BufferLess> m_copies;
+};
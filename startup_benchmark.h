@@ -0,0 +1,283 @@
+#pragma once
+
+#include "benchmark_report.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct StartupBenchmarkConfig
+{
+	uint32_t cycles = 10;
+	// frames a cycle waits for the device loss, and frames rendered once the device was recovered
+	uint64_t frames = 60;
+	std::filesystem::path output = "startup_benchmark.json";
+	SceneConfig scene;
+};
+
+// Runs cycles of initialize, render until the device is lost, diagnose, recover, render and shut down, each on
+// a new Scene. The endless loop in Fragment.frag injects the loss on the first frame. The recovered device skips
+// the workload the breadcrumbs blamed, so it renders unless the device has no breadcrumbs. Every step of
+// initialize() and recoverDevice() is timed on its own, and the driver host memory the lost device did not give
+// back is counted, which repeated cycles would accumulate.
+// The JSON output is rewritten before and after every cycle. A driver hang the watchdog ends the process on
+// leaves its cycle marked "running".
+class StartupBenchmark
+{
+public:
+	enum class Verdict
+	{
+		Running,
+		// recovered and rendered the frames after the recovery
+		Pass,
+		// the device was not lost within the frames
+		NoLoss,
+		// lost again after the recovery
+		LostAgain,
+		Hang,
+		Error
+	};
+
+	static char const* toString(Verdict verdict)
+	{
+		switch (verdict)
+		{
+		case Verdict::Running: return "running";
+		case Verdict::Pass: return "pass";
+		case Verdict::NoLoss: return "no_loss";
+		case Verdict::LostAgain: return "lost_again";
+		case Verdict::Hang: return "hang";
+		case Verdict::Error: return "error";
+		}
+		return "unknown";
+	}
+
+	explicit StartupBenchmark(StartupBenchmarkConfig config)
+		: m_config(std::move(config))
+	{
+		m_config.scene.max_frames = m_config.frames;
+		// the render steps are timed, an unfocused window must not throttle them
+		m_config.scene.background_fps = 0.0;
+	}
+
+	// the exit code: 0 if every cycle passed, 2 after a hang, 1 otherwise
+	int run()
+	{
+		for (uint32_t i = 0; i < m_config.cycles; ++i)
+		{
+			m_cycles.emplace_back();
+			write();
+			runCycle(m_cycles.back());
+			write();
+
+			auto const& cycle = m_cycles.back();
+			std::cout << "cycle " << i << ": " << toString(cycle.verdict);
+			if (!cycle.error.empty())
+				std::cout << " (" << cycle.error << ")";
+			std::cout << std::endl;
+			if (cycle.verdict == Verdict::Hang)
+			{
+				// the hung scene was leaked, its device may still block any further driver call
+				std::cout.flush();
+				std::_Exit(2);
+			}
+		}
+		auto const passed = std::all_of(m_cycles.begin(), m_cycles.end(), [](Cycle const& c) { return c.verdict == Verdict::Pass; });
+		return passed ? 0 : 1;
+	}
+
+private:
+	struct Cycle
+	{
+		Verdict verdict = Verdict::Running;
+		std::string error;
+		uint64_t peak_rss = 0;
+		vk::DeviceSize peak_device_memory = 0;
+		// driver host memory, the most the device had and what it did not free before its recovery
+		uint64_t peak_host_memory = 0;
+		uint64_t leaked_host_memory = 0;
+		// milliseconds in the order the steps ran
+		std::vector<std::pair<std::string, double>> steps;
+
+		template<typename F>
+		void time(std::string name, F&& f)
+		{
+			auto const start = std::chrono::steady_clock::now();
+			f();
+			steps.emplace_back(std::move(name), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+	};
+
+	struct Device
+	{
+		vk::PhysicalDeviceProperties props;
+		vk::PhysicalDeviceDriverProperties driver;
+	};
+
+	void runCycle(Cycle& cycle)
+	{
+		auto scene = std::make_unique<Scene>(m_config.scene);
+		auto const sample_memory = [&]
+		{
+			cycle.peak_device_memory = std::max(cycle.peak_device_memory, scene->memoryStats().reserved);
+			cycle.peak_host_memory = std::max(cycle.peak_host_memory, scene->hostMemory().stats(HostAllocator::Domain::Device).high_water);
+			cycle.leaked_host_memory = scene->leakedHostBytes();
+		};
+		try
+		{
+			auto const startup = scene->initialize();
+			for (auto const& step : startup.steps)
+				if (step.ran)
+					cycle.steps.emplace_back("initialize/" + step.name, step.duration.count());
+			cycle.steps.emplace_back("initialize", startup.wall.count());
+			if (!m_device)
+				m_device = Device{ scene->deviceProperties(), scene->driverProperties() };
+			sample_memory();
+
+			bool lost = false;
+			cycle.time("render until loss", [&]
+			{
+				try
+				{
+					scene->run();
+				}
+				catch (vk::DeviceLostError const&)
+				{
+					lost = true;
+				}
+			});
+			sample_memory();
+			if (!lost)
+			{
+				cycle.verdict = Verdict::NoLoss;
+			}
+			else
+			{
+				cycle.time("diagnose", [&] { scene->diagnoseDeviceLoss(); });
+				auto const recovery = scene->recoverDevice();
+				for (auto const& step : recovery.steps())
+					cycle.steps.emplace_back("recover/" + step.name, step.duration.count());
+				cycle.steps.emplace_back("recover", recovery.total().count());
+				sample_memory();
+
+				bool lost_again = false;
+				cycle.time("render after recovery", [&]
+				{
+					try
+					{
+						scene->run();
+					}
+					catch (vk::DeviceLostError const&)
+					{
+						lost_again = true;
+					}
+				});
+				sample_memory();
+				cycle.verdict = lost_again ? Verdict::LostAgain : Verdict::Pass;
+			}
+		}
+		catch (HangError const& e)
+		{
+			cycle.verdict = Verdict::Hang;
+			cycle.error = e.what();
+			cycle.peak_rss = peakResidentBytes();
+			// destroying the scene would wait on the hung device
+			scene.release();
+			return;
+		}
+		catch (std::exception const& e)
+		{
+			cycle.verdict = Verdict::Error;
+			cycle.error = e.what();
+		}
+		cycle.time("shutdown", [&]
+		{
+			scene->shutdown();
+			scene.reset();
+		});
+		cycle.peak_rss = peakResidentBytes();
+	}
+
+	void write() const
+	{
+		std::ofstream file(m_config.output, std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "could not write " << m_config.output.string() << std::endl;
+			return;
+		}
+
+		// per step across cycles, in the order the steps first ran
+		std::vector<std::pair<std::string, SampleSet>> steps;
+		uint64_t peak_rss = 0;
+		vk::DeviceSize peak_device_memory = 0;
+		uint64_t leaked_host_memory = 0;
+		for (auto const& cycle : m_cycles)
+		{
+			for (auto const& [name, ms] : cycle.steps)
+			{
+				auto it = std::find_if(steps.begin(), steps.end(), [&](auto const& s) { return s.first == name; });
+				if (it == steps.end())
+					it = steps.insert(steps.end(), { name, SampleSet{} });
+				it->second.add(ms);
+			}
+			peak_rss = std::max(peak_rss, cycle.peak_rss);
+			peak_device_memory = std::max(peak_device_memory, cycle.peak_device_memory);
+			leaked_host_memory += cycle.leaked_host_memory;
+		}
+
+		JsonWriter json(file);
+		json.beginObject()
+			.field("benchmark", "startup")
+			.field("cycles_requested", m_config.cycles)
+			.field("frames", m_config.frames)
+			.field("peak_rss_bytes", peak_rss)
+			.field("peak_device_memory_bytes", peak_device_memory)
+			.field("leaked_host_memory_bytes", leaked_host_memory);
+		json.key("device");
+		if (m_device)
+			writeDevice(json, m_device->props, m_device->driver);
+		else
+			json.beginObject().endObject();
+
+		json.key("steps").beginObject();
+		for (auto const& [name, samples] : steps)
+		{
+			json.key(name);
+			writeSummary(json, samples, "ms", 0.125);
+		}
+		json.endObject();
+
+		json.key("cycles").beginArray();
+		for (auto const& cycle : m_cycles)
+		{
+			json.beginObject()
+				.field("verdict", toString(cycle.verdict))
+				.field("error", cycle.error)
+				.field("peak_rss_bytes", cycle.peak_rss)
+				.field("peak_device_memory_bytes", cycle.peak_device_memory)
+				.field("peak_host_memory_bytes", cycle.peak_host_memory)
+				.field("leaked_host_memory_bytes", cycle.leaked_host_memory);
+			json.key("steps_ms").beginObject();
+			for (auto const& [name, ms] : cycle.steps)
+				json.field(name, ms);
+			json.endObject();
+			json.endObject();
+		}
+		json.endArray();
+		json.endObject();
+		file << std::endl;
+	}
+
+	StartupBenchmarkConfig m_config;
+	std::vector<Cycle> m_cycles;
+	std::optional<Device> m_device;
+};
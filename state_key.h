@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// The creation state of a Vulkan object flattened into 32-bit words, for caches that build every distinct
+// state once. Handles go in by value, so keys holding them are only meaningful while those objects live;
+// large blobs like shader code go in as a 64-bit FNV-1a hash.
+class StateKey
+{
+public:
+	struct Hash
+	{
+		size_t operator()(StateKey const& key) const { return static_cast<size_t>(key.m_hash); }
+	};
+
+	// integers, enums, vk::Flags and handles
+	template<typename T>
+	StateKey& add(T const& value)
+	{
+		if constexpr (std::is_enum_v<T> || std::is_integral_v<T>)
+			addWord64(static_cast<uint64_t>(value));
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			auto const f = static_cast<float>(value);
+			uint32_t bits;
+			std::memcpy(&bits, &f, sizeof(bits));
+			addWord(bits);
+		}
+		else
+			addFlagsOrHandle(value);
+		return *this;
+	}
+
+	StateKey& addBytes(void const* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto const* const bytes = static_cast<uint8_t const*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		addWord64(size);
+		addWord64(hash);
+		return *this;
+	}
+
+	bool operator==(StateKey const& rhs) const { return m_hash == rhs.m_hash && m_words == rhs.m_words; }
+	bool operator!=(StateKey const& rhs) const { return !(*this == rhs); }
+	bool operator<(StateKey const& rhs) const { return m_words < rhs.m_words; }
+
+	size_t size() const { return m_words.size(); }
+	uint64_t hash() const { return m_hash; }
+
+private:
+	template<typename Bits>
+	void addFlagsOrHandle(vk::Flags<Bits> const& flags)
+	{
+		addWord64(static_cast<uint64_t>(static_cast<typename vk::Flags<Bits>::MaskType>(flags)));
+	}
+
+	template<typename Handle>
+	void addFlagsOrHandle(Handle const& handle)
+	{
+		auto const value = static_cast<typename Handle::CType>(handle);
+		// dispatchable handles are pointers, non-dispatchable ones may be 64-bit integers on 32-bit targets
+		if constexpr (std::is_pointer_v<decltype(value)>)
+			addWord64(reinterpret_cast<uintptr_t>(value));
+		else
+			addWord64(static_cast<uint64_t>(value));
+	}
+
+	void addWord(uint32_t word)
+	{
+		m_words.push_back(word);
+		// FNV-1a over the words, cheap to keep current and good enough for bucket selection
+		m_hash = (m_hash ^ word) * 1099511628211ull;
+	}
+
+	void addWord64(uint64_t value)
+	{
+		addWord(static_cast<uint32_t>(value));
+		addWord(static_cast<uint32_t>(value >> 32));
+	}
+
+	std::vector<uint32_t> m_words;
+	uint64_t m_hash = 14695981039346656037ull;
+};
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Collects the submissions of a frame per queue and hands each queue's batches to the driver in one call at the
+// frame's flush point: vkQueueSubmit2KHR where VK_KHR_synchronization2 is enabled, one vkQueueSubmit with several
+// VkSubmitInfos otherwise. A batch without waits is coalesced into the previous one on its queue when that one
+// signals nothing, so back to back command buffers become a single batch.
+// Nothing queued reaches the GPU before its queue is flushed: host waits on a value a queued batch signals and
+// presents waiting on a queued binary semaphore have to flush first. Binary semaphores are only waited on after
+// the batch signaling them was flushed, queues are flushed in the order their first batch was added.
+// On a device group a batch may run on a subset of the devices, its semaphores are waited and signaled on the first
+// of them.
+// Batches are stored flat per queue and every array keeps its capacity across flushes, so once a frame's
+// submissions fit, adding and flushing them does not allocate. Flushes are serialized, adds may run meanwhile.
+class SubmitBatcher
+{
+public:
+	struct Semaphore
+	{
+		vk::Semaphore semaphore;
+		// ignored for binary semaphores
+		uint64_t value = 0;
+		// the stages that wait; signals are always made at the end of all commands
+		vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands;
+	};
+
+	SubmitBatcher(vk::DispatchLoaderDynamic const& dispatch, bool synchronization2)
+		: m_dispatch(&dispatch)
+		, m_synchronization2(synchronization2)
+	{}
+
+	SubmitBatcher(SubmitBatcher const&) = delete;
+	SubmitBatcher& operator=(SubmitBatcher const&) = delete;
+
+	bool synchronization2() const { return m_synchronization2; }
+
+	// the command buffers execute in order after the waits, the signals follow the last of them; a device_mask of
+	// 0 runs them on every device of a device group
+	void add(vk::Queue queue, vk::ArrayProxy<const vk::CommandBuffer> cmds, vk::ArrayProxy<const Semaphore> waits = nullptr, vk::ArrayProxy<const Semaphore> signals = nullptr,
+		uint32_t device_mask = 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& pending = this->pending(queue);
+		auto& queued = pending.queued;
+		if (queued.batches.empty())
+			m_order.push_back(&pending);
+		if (!queued.batches.empty() && waits.empty() && queued.batches.back().signal_count == 0 && queued.batches.back().device_mask == device_mask)
+		{
+			// the last batch's commands and semaphores are at the end of the arrays
+			auto& last = queued.batches.back();
+			queued.cmds.insert(queued.cmds.end(), cmds.begin(), cmds.end());
+			last.cmd_count += cmds.size();
+			last.first_signal = static_cast<uint32_t>(queued.semaphores.size());
+			last.signal_count = signals.size();
+			queued.semaphores.insert(queued.semaphores.end(), signals.begin(), signals.end());
+			return;
+		}
+		Batch batch{};
+		batch.first_cmd = static_cast<uint32_t>(queued.cmds.size());
+		batch.cmd_count = cmds.size();
+		queued.cmds.insert(queued.cmds.end(), cmds.begin(), cmds.end());
+		batch.first_wait = static_cast<uint32_t>(queued.semaphores.size());
+		batch.wait_count = waits.size();
+		queued.semaphores.insert(queued.semaphores.end(), waits.begin(), waits.end());
+		batch.first_signal = static_cast<uint32_t>(queued.semaphores.size());
+		batch.signal_count = signals.size();
+		queued.semaphores.insert(queued.semaphores.end(), signals.begin(), signals.end());
+		batch.device_mask = device_mask;
+		queued.batches.push_back(batch);
+	}
+
+	// submits what was added for the queue since its last flush in one call
+	void flush(vk::Queue queue)
+	{
+		std::lock_guard<std::mutex> flush_lock(m_flush_mutex);
+		Pending* flushed = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& pending : m_queues)
+				if (pending.queue == queue)
+					flushed = &pending;
+			if (!flushed || flushed->queued.batches.empty())
+				return;
+			m_order.erase(std::find(m_order.begin(), m_order.end(), flushed));
+			std::swap(flushed->queued, flushed->flushing);
+		}
+		submit(queue, flushed->flushing);
+		flushed->flushing.clear();
+	}
+
+	void flushAll()
+	{
+		std::lock_guard<std::mutex> flush_lock(m_flush_mutex);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_flush_order.swap(m_order);
+			for (auto* const pending : m_flush_order)
+				std::swap(pending->queued, pending->flushing);
+		}
+		for (auto* const pending : m_flush_order)
+		{
+			submit(pending->queue, pending->flushing);
+			pending->flushing.clear();
+		}
+		m_flush_order.clear();
+	}
+
+	// vkQueueSubmit or vkQueueSubmit2KHR calls made so far
+	uint64_t calls() const { return m_calls.load(std::memory_order_relaxed); }
+
+private:
+	// ranges of a queue's arrays
+	struct Batch
+	{
+		uint32_t first_cmd;
+		uint32_t cmd_count;
+		uint32_t first_wait;
+		uint32_t wait_count;
+		uint32_t first_signal;
+		uint32_t signal_count;
+		uint32_t device_mask;
+	};
+
+	struct Batches
+	{
+		std::vector<vk::CommandBuffer> cmds;
+		std::vector<Semaphore> semaphores;
+		std::vector<Batch> batches;
+
+		void clear()
+		{
+			cmds.clear();
+			semaphores.clear();
+			batches.clear();
+		}
+	};
+
+	struct Pending
+	{
+		vk::Queue queue;
+		// added since the last flush, and what the running flush submits
+		Batches queued;
+		Batches flushing;
+	};
+
+	// m_mutex is held
+	Pending& pending(vk::Queue queue)
+	{
+		for (auto& pending : m_queues)
+			if (pending.queue == queue)
+				return pending;
+		m_queues.push_back({ queue, {}, {} });
+		return m_queues.back();
+	}
+
+	// where a batch's semaphores are waited and signaled
+	static uint32_t deviceIndex(uint32_t device_mask)
+	{
+		uint32_t index = 0;
+		while (device_mask != 0 && !(device_mask & (1u << index)))
+			++index;
+		return index;
+	}
+
+	// m_flush_mutex is held
+	void submit(vk::Queue queue, Batches const& batches)
+	{
+		if (batches.batches.empty())
+			return;
+		m_calls.fetch_add(1, std::memory_order_relaxed);
+		if (m_synchronization2)
+			submit2(queue, batches);
+		else
+			submit1(queue, batches);
+	}
+
+	void submit2(vk::Queue queue, Batches const& batches)
+	{
+		// reserved up front, the submit infos point into them
+		m_semaphore_infos.clear();
+		m_semaphore_infos.reserve(batches.semaphores.size());
+		m_cmd_infos.clear();
+		m_cmd_infos.reserve(batches.cmds.size());
+		m_submits2.clear();
+
+		for (auto const& s : batches.semaphores)
+		{
+			vk::SemaphoreSubmitInfoKHR info{};
+			info.semaphore = s.semaphore;
+			info.value = s.value;
+			// the legacy stage bits have the same values in the 64 bit flags
+			info.stageMask = vk::PipelineStageFlags2KHR(static_cast<VkPipelineStageFlags>(s.stage));
+			m_semaphore_infos.push_back(info);
+		}
+		for (auto const cmd : batches.cmds)
+			m_cmd_infos.push_back(vk::CommandBufferSubmitInfoKHR{ cmd });
+		for (auto const& batch : batches.batches)
+		{
+			for (uint32_t i = 0; i < batch.signal_count; ++i)
+				m_semaphore_infos[batch.first_signal + i].stageMask = vk::PipelineStageFlagBits2KHR::eAllCommands;
+			if (batch.device_mask != 0)
+			{
+				for (uint32_t i = 0; i < batch.cmd_count; ++i)
+					m_cmd_infos[batch.first_cmd + i].deviceMask = batch.device_mask;
+				for (uint32_t i = 0; i < batch.wait_count; ++i)
+					m_semaphore_infos[batch.first_wait + i].deviceIndex = deviceIndex(batch.device_mask);
+				for (uint32_t i = 0; i < batch.signal_count; ++i)
+					m_semaphore_infos[batch.first_signal + i].deviceIndex = deviceIndex(batch.device_mask);
+			}
+			vk::SubmitInfo2KHR submit{};
+			submit.waitSemaphoreInfoCount = batch.wait_count;
+			submit.pWaitSemaphoreInfos = m_semaphore_infos.data() + batch.first_wait;
+			submit.commandBufferInfoCount = batch.cmd_count;
+			submit.pCommandBufferInfos = m_cmd_infos.data() + batch.first_cmd;
+			submit.signalSemaphoreInfoCount = batch.signal_count;
+			submit.pSignalSemaphoreInfos = m_semaphore_infos.data() + batch.first_signal;
+			m_submits2.push_back(submit);
+		}
+		queue.submit2KHR(m_submits2, {}, *m_dispatch);
+	}
+
+	void submit1(vk::Queue queue, Batches const& batches)
+	{
+		// the semaphore arrays are split by batch the same way as the source array
+		m_semaphores.clear();
+		m_stages.clear();
+		m_values.clear();
+		for (auto const& s : batches.semaphores)
+		{
+			m_semaphores.push_back(s.semaphore);
+			m_stages.push_back(s.stage);
+			m_values.push_back(s.value);
+		}
+		m_timeline_infos.clear();
+		m_timeline_infos.resize(batches.batches.size());
+		m_group_infos.clear();
+		m_group_infos.resize(batches.batches.size());
+		m_device_indices.assign(batches.semaphores.size(), 0);
+		m_device_masks.assign(batches.cmds.size(), 0);
+		m_submits.clear();
+		m_submits.resize(batches.batches.size());
+		for (size_t i = 0; i < batches.batches.size(); ++i)
+		{
+			auto const& batch = batches.batches[i];
+
+			auto& timeline_info = m_timeline_infos[i];
+			timeline_info.waitSemaphoreValueCount = batch.wait_count;
+			timeline_info.pWaitSemaphoreValues = m_values.data() + batch.first_wait;
+			timeline_info.signalSemaphoreValueCount = batch.signal_count;
+			timeline_info.pSignalSemaphoreValues = m_values.data() + batch.first_signal;
+			if (batch.device_mask != 0)
+			{
+				std::fill_n(m_device_masks.begin() + batch.first_cmd, batch.cmd_count, batch.device_mask);
+				std::fill_n(m_device_indices.begin() + batch.first_wait, batch.wait_count, deviceIndex(batch.device_mask));
+				std::fill_n(m_device_indices.begin() + batch.first_signal, batch.signal_count, deviceIndex(batch.device_mask));
+				auto& group_info = m_group_infos[i];
+				group_info.waitSemaphoreCount = batch.wait_count;
+				group_info.pWaitSemaphoreDeviceIndices = m_device_indices.data() + batch.first_wait;
+				group_info.commandBufferCount = batch.cmd_count;
+				group_info.pCommandBufferDeviceMasks = m_device_masks.data() + batch.first_cmd;
+				group_info.signalSemaphoreCount = batch.signal_count;
+				group_info.pSignalSemaphoreDeviceIndices = m_device_indices.data() + batch.first_signal;
+				timeline_info.pNext = &group_info;
+			}
+
+			auto& submit = m_submits[i];
+			submit.pNext = &timeline_info;
+			submit.waitSemaphoreCount = batch.wait_count;
+			submit.pWaitSemaphores = m_semaphores.data() + batch.first_wait;
+			submit.pWaitDstStageMask = m_stages.data() + batch.first_wait;
+			submit.commandBufferCount = batch.cmd_count;
+			submit.pCommandBuffers = batches.cmds.data() + batch.first_cmd;
+			submit.signalSemaphoreCount = batch.signal_count;
+			submit.pSignalSemaphores = m_semaphores.data() + batch.first_signal;
+		}
+		queue.submit(m_submits, {});
+	}
+
+	vk::DispatchLoaderDynamic const* m_dispatch;
+	bool m_synchronization2;
+
+	std::mutex m_mutex;
+	// a deque so pending queues stay where they are while others are added
+	std::deque<Pending> m_queues;
+	// queues with batches, in the order their first batch was added
+	std::vector<Pending*> m_order;
+	std::atomic<uint64_t> m_calls{ 0 };
+
+	std::mutex m_flush_mutex;
+	std::vector<Pending*> m_flush_order;
+	// scratch of the submit calls
+	std::vector<vk::SemaphoreSubmitInfoKHR> m_semaphore_infos;
+	std::vector<vk::CommandBufferSubmitInfoKHR> m_cmd_infos;
+	std::vector<vk::SubmitInfo2KHR> m_submits2;
+	std::vector<vk::Semaphore> m_semaphores;
+	std::vector<vk::PipelineStageFlags> m_stages;
+	std::vector<uint64_t> m_values;
+	std::vector<vk::TimelineSemaphoreSubmitInfo> m_timeline_infos;
+	std::vector<vk::DeviceGroupSubmitInfo> m_group_infos;
+	std::vector<uint32_t> m_device_indices;
+	std::vector<uint32_t> m_device_masks;
+	std::vector<vk::SubmitInfo> m_submits;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs named tasks once all of their dependencies finished, so independent steps overlap on the thread pool.
+// Tasks that must stay on the calling thread (GLFW window creation, or steps that block on thread pool jobs)
+// run there while it waits. Every task is timed against the start of run(). After the first exception no
+// further task starts; it is rethrown once the running tasks returned.
+class TaskGraph
+{
+public:
+	using TaskId = uint32_t;
+
+	struct Timing
+	{
+		std::string name;
+		// since run() started
+		std::chrono::duration<double, std::milli> start{};
+		std::chrono::duration<double, std::milli> duration{};
+		bool main_thread = false;
+		// false if an earlier task failed
+		bool ran = false;
+	};
+
+	struct Report
+	{
+		std::vector<Timing> steps;
+		std::chrono::duration<double, std::milli> wall{};
+
+		void print(std::ostream& os) const
+		{
+			for (auto const& step : steps)
+			{
+				os << "  " << step.name << ": ";
+				if (step.ran)
+					os << step.duration.count() << " ms, from " << step.start.count() << " ms" << (step.main_thread ? " (main thread)" : "");
+				else
+					os << "skipped";
+				os << std::endl;
+			}
+			os << "  wall: " << wall.count() << " ms" << std::endl;
+		}
+	};
+
+	TaskId add(std::string name, std::vector<TaskId> const& dependencies, std::function<void()> task, bool main_thread = false)
+	{
+		const TaskId id = static_cast<TaskId>(m_tasks.size());
+		Task entry{};
+		entry.timing.name = std::move(name);
+		entry.timing.main_thread = main_thread;
+		entry.run = std::move(task);
+		entry.waiting = static_cast<uint32_t>(dependencies.size());
+		m_tasks.push_back(std::move(entry));
+		for (auto const dependency : dependencies)
+			m_tasks.at(dependency).dependents.push_back(id);
+		return id;
+	}
+
+	// dependencies are added before their dependents, so the graph can not have cycles
+	Report run(ThreadPool& pool)
+	{
+		m_start = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (TaskId id = 0; id < m_tasks.size(); ++id)
+				if (m_tasks[id].waiting == 0)
+					launch(pool, id);
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_finished < m_tasks.size())
+		{
+			if (m_main_ready.empty())
+			{
+				m_cv.wait(lock);
+				continue;
+			}
+			const TaskId id = m_main_ready.front();
+			m_main_ready.pop_front();
+			lock.unlock();
+			execute(pool, id);
+			lock.lock();
+		}
+
+		Report report{};
+		report.wall = std::chrono::steady_clock::now() - m_start;
+		for (auto const& task : m_tasks)
+			report.steps.push_back(task.timing);
+		if (m_error)
+			std::rethrow_exception(m_error);
+		return report;
+	}
+
+private:
+	struct Task
+	{
+		Timing timing;
+		std::function<void()> run;
+		std::vector<TaskId> dependents;
+		uint32_t waiting = 0;
+	};
+
+	// m_mutex is held
+	void launch(ThreadPool& pool, TaskId id)
+	{
+		if (m_tasks[id].timing.main_thread)
+		{
+			m_main_ready.push_back(id);
+			m_cv.notify_all();
+			return;
+		}
+		// exceptions are caught in execute(), the future is never read
+		pool.submit([this, &pool, id](uint32_t /*worker*/) { execute(pool, id); });
+	}
+
+	void execute(ThreadPool& pool, TaskId id)
+	{
+		auto& task = m_tasks[id];
+		bool failed;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			failed = static_cast<bool>(m_error);
+		}
+		if (!failed)
+		{
+			auto const start = std::chrono::steady_clock::now();
+			try
+			{
+				task.run();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_error)
+					m_error = std::current_exception();
+			}
+			task.timing.start = start - m_start;
+			task.timing.duration = std::chrono::steady_clock::now() - start;
+			task.timing.ran = true;
+		}
+
+		// skipped tasks finish too, so their dependents are released and skipped in turn
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_finished;
+		for (auto const dependent : task.dependents)
+			if (--m_tasks[dependent].waiting == 0)
+				launch(pool, dependent);
+		m_cv.notify_all();
+	}
+
+	std::vector<Task> m_tasks;
+	std::chrono::steady_clock::time_point m_start;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<TaskId> m_main_ready;
+	size_t m_finished = 0;
+	std::exception_ptr m_error;
+};
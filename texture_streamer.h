@@ -0,0 +1,697 @@
+#pragma once
+
+#include "deletion_queue.h"
+#include "descriptor_allocator.h"
+#include "device_allocator.h"
+#include "ktx2.h"
+#include "upload_engine.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+struct TextureHandle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+struct TextureStreamerConfig
+{
+	// device memory all textures together may hold, 0 takes a quarter of the largest device-local heap
+	vk::DeviceSize budget = 0;
+	// mip level bytes queued for upload per update(), at least one step is always queued
+	vk::DeviceSize upload_per_frame = vk::DeviceSize(16) << 20;
+	// the levels a texture's first upload brings in: all that together stay under this size
+	vk::DeviceSize base_size = vk::DeviceSize(64) << 10;
+};
+
+// Streams KTX2 textures into the bindless table one mip level at a time. load() only maps the file; the next
+// update() uploads its smallest levels on the transfer queue, later ones add the next finer level while the
+// budget allows, highest priority first, and take the finest level back from the lowest priority ones when it
+// is exceeded; equal priorities go by when their bindless index was last asked for. A texture is sampled through a view of its resident levels only, the view and its bindless slot
+// are swapped once the transfer queue completed an upload, so sampling never waits for one.
+// With sparse residency the texture is one sparse image: the mip tail is bound at load, finer levels get their
+// memory bound when streamed in and unbound when evicted. Without it every step builds an image of the new level
+// count and uploads its levels again from the mapping, the smaller levels add a third to the level's bytes.
+// The budget counts the memory textures keep once their pending steps completed. load(), setPriority() and
+// release() may be called from any thread, update() belongs to the render thread.
+class TextureStreamer
+{
+public:
+	using Config = TextureStreamerConfig;
+
+	struct Stats
+	{
+		uint32_t textures = 0;
+		uint32_t sparse = 0;
+		uint32_t uploads_in_flight = 0;
+		vk::DeviceSize resident_bytes = 0;
+		vk::DeviceSize budget = 0;
+	};
+
+	// enabled are the device's enabled features: BCn and ASTC formats and sparse residency depend on them;
+	// sparse_queue has to support sparse binding and is only used from update()
+	TextureStreamer(vk::Device device, vk::PhysicalDevice phys_dev, vk::PhysicalDeviceFeatures const& enabled, DeviceAllocator& allocator,
+		UploadEngine& uploads, BindlessTable& bindless, vk::Queue sparse_queue, Config const& config = {})
+		: m_device(device)
+		, m_phys_dev(phys_dev)
+		, m_enabled(enabled)
+		, m_allocator(allocator)
+		, m_uploads(uploads)
+		, m_bindless(bindless)
+		, m_sparse_queue(enabled.sparseBinding && enabled.sparseResidencyImage2D ? sparse_queue : vk::Queue{})
+		, m_config(config)
+	{
+		if (m_config.budget == 0)
+		{
+			auto const& mem_props = allocator.memoryProperties();
+			for (uint32_t heap = 0; heap < mem_props.memoryHeapCount; ++heap)
+				if (mem_props.memoryHeaps[heap].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+					m_config.budget = std::max(m_config.budget, mem_props.memoryHeaps[heap].size / 4);
+		}
+
+		vk::SamplerCreateInfo sampler_ci{};
+		sampler_ci.magFilter = vk::Filter::eLinear;
+		sampler_ci.minFilter = vk::Filter::eLinear;
+		sampler_ci.mipmapMode = vk::SamplerMipmapMode::eLinear;
+		sampler_ci.addressModeU = vk::SamplerAddressMode::eRepeat;
+		sampler_ci.addressModeV = vk::SamplerAddressMode::eRepeat;
+		sampler_ci.addressModeW = vk::SamplerAddressMode::eRepeat;
+		sampler_ci.maxLod = VK_LOD_CLAMP_NONE;
+		m_sampler = device.createSamplerUnique(sampler_ci);
+
+		vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> sem_ci{ {}, { vk::SemaphoreType::eTimeline, 0 } };
+		m_bind_timeline = device.createSemaphoreUnique(sem_ci.get<vk::SemaphoreCreateInfo>());
+	}
+
+	// the GPU must be idle or lost
+	~TextureStreamer()
+	{
+		// pending unbinds just free their memory
+		m_closing = true;
+		m_retired.clear();
+		for (auto& texture : m_textures)
+			destroy(texture);
+		for (auto const& pending : m_bind_frees)
+			free(pending);
+	}
+
+	TextureStreamer(TextureStreamer const&) = delete;
+	TextureStreamer& operator=(TextureStreamer const&) = delete;
+
+	bool sparseResidency() const { return static_cast<bool>(m_sparse_queue); }
+
+	// throws if the file can not be read or its format is not supported; uploads start with the next update()
+	TextureHandle load(std::filesystem::path const& path)
+	{
+		auto file = std::make_unique<Ktx2File>(path);
+		auto const format = file->format();
+		if ((Ktx2File::isBc(format) && !m_enabled.textureCompressionBC) || (Ktx2File::isAstc(format) && !m_enabled.textureCompressionASTC_LDR))
+			throw std::runtime_error(path.string() + ": " + vk::to_string(format) + " is not enabled on the device!");
+		auto const features = m_phys_dev.getFormatProperties(format).optimalTilingFeatures;
+		if (!(features & vk::FormatFeatureFlagBits::eSampledImage) || !(features & vk::FormatFeatureFlagBits::eTransferDst))
+			throw std::runtime_error(path.string() + ": " + vk::to_string(format) + " can not be sampled on the device!");
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		uint32_t index;
+		if (!m_free.empty())
+		{
+			index = m_free.back();
+			m_free.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(m_textures.size());
+			m_textures.emplace_back();
+		}
+		auto& texture = m_textures[index];
+		texture.alive = true;
+		texture.released = false;
+		texture.priority = 1.0f;
+		texture.resident = file->levelCount();
+		texture.file = std::move(file);
+		return { index, texture.generation };
+	}
+
+	// higher priorities get their finer levels first and lose them last, 0 keeps the texture at its base levels
+	void setPriority(TextureHandle handle, float priority)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		textureOf(handle).priority = priority;
+	}
+
+	// the slot in the bindless texture array, changes whenever the resident levels do; nullopt until the base
+	// levels are uploaded. Marks the texture used in this frame.
+	std::optional<uint32_t> bindlessIndex(TextureHandle handle)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& texture = textureOf(handle);
+		texture.last_used = m_frame;
+		return texture.slot;
+	}
+
+	// lowers the budget below Config::budget while the device is short on memory, VK_WHOLE_SIZE lifts it
+	void setBudgetLimit(vk::DeviceSize limit)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget_limit = limit;
+	}
+
+	vk::DeviceSize residentBytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_resident_bytes;
+	}
+
+	// the finest resident mip level, the level count of the file while none is
+	uint32_t residentLevel(TextureHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return textureOf(handle).resident;
+	}
+
+	// its slot stays valid for the frames already recorded
+	void release(TextureHandle handle)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		textureOf(handle).released = true;
+	}
+
+	Stats stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats stats{};
+		for (auto const& texture : m_textures)
+		{
+			if (!texture.alive)
+				continue;
+			++stats.textures;
+			if (texture.sparse)
+				++stats.sparse;
+			if (texture.pending)
+				++stats.uploads_in_flight;
+		}
+		stats.resident_bytes = m_resident_bytes;
+		stats.budget = budget();
+		return stats;
+	}
+
+	// Once per frame before the upload engine's submit(). submitted is the frame serial of the last submitted
+	// frame, the one recorded next no longer uses what is replaced now; completed is the last completed one.
+	void update(uint64_t submitted, uint64_t completed)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_frame;
+		m_retired.collect(completed);
+		auto const bound = m_device.getSemaphoreCounterValue(*m_bind_timeline);
+		while (!m_bind_frees.empty() && m_bind_frees.front().value <= bound)
+		{
+			free(m_bind_frees.front());
+			m_bind_frees.pop_front();
+		}
+
+		auto const uploaded = m_device.getSemaphoreCounterValue(m_uploads.timeline());
+		for (uint32_t index = 0; index < m_textures.size(); ++index)
+		{
+			auto& texture = m_textures[index];
+			if (!texture.alive)
+				continue;
+			if (texture.pending && texture.pending->upload_value <= uploaded)
+				publish(texture, submitted);
+			if (texture.released && !texture.pending)
+			{
+				retire(texture, submitted);
+				texture = Texture{ texture.generation + 1 };
+				m_free.push_back(index);
+			}
+		}
+
+		// lowest priority first, then least recently used
+		std::vector<uint32_t> order;
+		for (uint32_t index = 0; index < m_textures.size(); ++index)
+			if (m_textures[index].alive && !m_textures[index].released)
+				order.push_back(index);
+		std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+		{
+			auto const& ta = m_textures[a];
+			auto const& tb = m_textures[b];
+			return ta.priority < tb.priority || (ta.priority == tb.priority && ta.last_used < tb.last_used);
+		});
+		auto const budget = this->budget();
+
+		vk::DeviceSize queued = 0;
+		auto const room = [&] { return queued < m_config.upload_per_frame; };
+
+		// new textures get their base levels whatever the budget says
+		for (auto const index : order)
+		{
+			auto& texture = m_textures[index];
+			if (texture.resident == texture.file->levelCount() && !texture.pending && room())
+				queued += step(texture, baseLevel(*texture.file), submitted);
+		}
+
+		auto const evictable = [&](Texture const& texture) { return !texture.pending && texture.slot && texture.resident < baseLevel(*texture.file); };
+		for (auto const index : order)
+		{
+			if (m_resident_bytes <= budget)
+				break;
+			auto& texture = m_textures[index];
+			if (evictable(texture))
+				queued += step(texture, texture.resident + 1, submitted);
+		}
+
+		for (auto it = order.rbegin(); it != order.rend() && room(); ++it)
+		{
+			auto& texture = m_textures[*it];
+			if (texture.pending || !texture.slot || texture.resident == 0 || texture.priority <= 0.0f)
+				continue;
+			auto const cost = texture.file->level(texture.resident - 1).size;
+			if (m_resident_bytes + cost > budget)
+			{
+				// one level of a texture ordered before this one makes room over the next frames
+				auto const victim = std::find_if(order.begin(), std::prev(it.base()), [&](uint32_t index)
+				{
+					return evictable(m_textures[index]);
+				});
+				if (victim != std::prev(it.base()))
+					queued += step(m_textures[*victim], m_textures[*victim].resident + 1, submitted);
+				break;
+			}
+			queued += step(texture, texture.resident - 1, submitted);
+		}
+	}
+
+private:
+	struct Pending
+	{
+		uint64_t upload_value = 0;
+		uint32_t level = 0;
+		// without sparse residency, the image with the new levels
+		vk::UniqueImage image;
+		Allocation memory;
+	};
+
+	struct Texture
+	{
+		uint32_t generation = 0;
+		bool alive = false;
+		bool released = false;
+		float priority = 1.0f;
+		uint64_t last_used = 0;
+		std::unique_ptr<Ktx2File> file;
+		bool sparse = false;
+		// levels [resident, level count) are sampled through view at slot
+		uint32_t resident = 0;
+		std::optional<uint32_t> slot;
+		vk::UniqueImageView view;
+		vk::UniqueImage image;
+		// all of image without sparse residency, its mip tail with it
+		Allocation memory;
+		// the file level image's first level holds, sparse images hold them all
+		uint32_t image_base = 0;
+		// sparse only, the first level of the mip tail, the block size and the memory bound to each finer level
+		uint32_t tail_first = 0;
+		vk::Extent3D granularity{ 1, 1, 1 };
+		std::vector<Allocation> level_memory;
+		std::optional<Pending> pending;
+	};
+
+	// freed once the bind timeline passed value, a sparse image its unbinds may still reference goes before its memory
+	struct BindFree
+	{
+		uint64_t value;
+		Allocation memory;
+		vk::Image image;
+	};
+
+	vk::DeviceSize budget() const { return std::min(m_config.budget, m_budget_limit); }
+
+	// the finest level of the ones that together stay under base_size, at least the last one
+	uint32_t baseLevel(Ktx2File const& file) const
+	{
+		auto level = file.levelCount() - 1;
+		while (level > 0 && file.levels(level - 1).size <= m_config.base_size)
+			--level;
+		return level;
+	}
+
+	Texture const& textureOf(TextureHandle handle) const
+	{
+		if (handle.index >= m_textures.size() || !m_textures[handle.index].alive || m_textures[handle.index].generation != handle.generation)
+			throw std::runtime_error("TextureHandle does not refer to a live texture!");
+		return m_textures[handle.index];
+	}
+
+	Texture& textureOf(TextureHandle handle)
+	{
+		return const_cast<Texture&>(static_cast<TextureStreamer const*>(this)->textureOf(handle));
+	}
+
+	vk::UniqueImage createImage(Ktx2File const& file, uint32_t first_level, bool sparse) const
+	{
+		vk::ImageCreateInfo img_ci{};
+		if (sparse)
+			img_ci.flags = vk::ImageCreateFlagBits::eSparseBinding | vk::ImageCreateFlagBits::eSparseResidency;
+		img_ci.imageType = vk::ImageType::e2D;
+		img_ci.format = file.format();
+		auto const extent = file.extent(first_level);
+		img_ci.extent = vk::Extent3D{ extent.width, extent.height, 1 };
+		img_ci.mipLevels = file.levelCount() - first_level;
+		img_ci.arrayLayers = 1;
+		img_ci.samples = vk::SampleCountFlagBits::e1;
+		img_ci.tiling = vk::ImageTiling::eOptimal;
+		img_ci.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+		img_ci.sharingMode = vk::SharingMode::eExclusive;
+		img_ci.initialLayout = vk::ImageLayout::eUndefined;
+		return m_device.createImageUnique(img_ci);
+	}
+
+	bool sparseSupported(vk::Format format) const
+	{
+		if (!m_sparse_queue)
+			return false;
+		auto const props = m_phys_dev.getSparseImageFormatProperties(format, vk::ImageType::e2D, vk::SampleCountFlagBits::e1,
+			vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, vk::ImageTiling::eOptimal);
+		return !props.empty();
+	}
+
+	// Moves the texture's resident levels to [level, level count): queues the uploads, the sparse binds and, for
+	// a sparse texture losing a level, swaps the view right away. Returns the bytes queued for upload.
+	vk::DeviceSize step(Texture& texture, uint32_t level, uint64_t submitted)
+	{
+		auto& file = *texture.file;
+		if (!texture.image && !texture.pending)
+		{
+			texture.sparse = sparseSupported(file.format());
+			if (texture.sparse)
+				createSparseImage(texture);
+		}
+
+		if (!texture.sparse)
+		{
+			Pending pending;
+			pending.level = level;
+			pending.image = createImage(file, level, false);
+			pending.memory = m_allocator.allocateFor(*pending.image, vk::MemoryPropertyFlagBits::eDeviceLocal, {});
+			// the image it replaces is gone once it is published
+			m_resident_bytes += pending.memory.size;
+			m_resident_bytes -= texture.memory.size;
+			pending.upload_value = m_uploads.nextValue();
+			auto const bytes = upload(*pending.image, file, level, file.levelCount(), level);
+			texture.pending = std::move(pending);
+			return bytes;
+		}
+
+		if (level > texture.resident)
+		{
+			// losing levels: sample the coarser ones from the next frame on, unbind the memory once no frame can read it
+			std::vector<Allocation> unbound;
+			for (auto l = texture.resident; l < level && l < texture.tail_first; ++l)
+			{
+				m_resident_bytes -= texture.level_memory[l].size;
+				unbound.push_back(std::exchange(texture.level_memory[l], {}));
+			}
+			auto binds = levelBinds(file, texture.resident, unbound, true);
+			Pending pending;
+			pending.level = level;
+			texture.pending = std::move(pending);
+			publish(texture, submitted);
+			if (!unbound.empty())
+			{
+				m_retired.defer(submitted, [this, image = *texture.image, binds = std::move(binds), unbound = std::move(unbound)]
+				{
+					if (!m_closing)
+						submitBind(image, binds);
+					for (auto const& alloc : unbound)
+						m_bind_frees.push_back({ m_bind_value, alloc, {} });
+				});
+			}
+			return 0;
+		}
+
+		// gaining levels: bind their memory, the transfer queue waits for the binding before it writes them
+		std::vector<Allocation> bound;
+		auto const mem_req = m_device.getImageMemoryRequirements(*texture.image);
+		for (auto l = level; l < texture.resident && l < texture.tail_first; ++l)
+		{
+			vk::MemoryRequirements level_req = mem_req;
+			level_req.size = sparseLevelSize(texture, l, mem_req.alignment);
+			texture.level_memory[l] = m_allocator.allocate(level_req, vk::MemoryPropertyFlagBits::eDeviceLocal, {}, ResourceKind::Optimal);
+			m_resident_bytes += texture.level_memory[l].size;
+			bound.push_back(texture.level_memory[l]);
+		}
+		if (!bound.empty())
+			submitBind(*texture.image, levelBinds(file, level, bound, false));
+		// the mip tail's bind as well on the first step
+		m_uploads.waitBefore(*m_bind_timeline, m_bind_value);
+		Pending pending;
+		pending.level = level;
+		pending.upload_value = m_uploads.nextValue();
+		auto const bytes = upload(*texture.image, file, level, texture.resident, 0);
+		texture.pending = std::move(pending);
+		return bytes;
+	}
+
+	void createSparseImage(Texture& texture)
+	{
+		auto& file = *texture.file;
+		texture.image = createImage(file, 0, true);
+		auto const mem_req = m_device.getImageMemoryRequirements(*texture.image);
+		auto const sparse_reqs = m_device.getImageSparseMemoryRequirements(*texture.image);
+		auto const color = std::find_if(sparse_reqs.begin(), sparse_reqs.end(), [](vk::SparseImageMemoryRequirements const& req)
+		{
+			return static_cast<bool>(req.formatProperties.aspectMask & vk::ImageAspectFlagBits::eColor);
+		});
+		if (color == sparse_reqs.end())
+			throw std::runtime_error(file.path().string() + ": sparse image without color aspect requirements!");
+		texture.tail_first = std::min(color->imageMipTailFirstLod, file.levelCount());
+		texture.level_memory.resize(file.levelCount());
+		texture.granularity = color->formatProperties.imageGranularity;
+
+		// the tail is bound for the texture's lifetime, it holds the levels every texture keeps
+		if (texture.tail_first < file.levelCount() && color->imageMipTailSize != 0)
+		{
+			vk::MemoryRequirements tail_req = mem_req;
+			tail_req.size = color->imageMipTailSize;
+			texture.memory = m_allocator.allocate(tail_req, vk::MemoryPropertyFlagBits::eDeviceLocal, {}, ResourceKind::Optimal);
+			m_resident_bytes += texture.memory.size;
+
+			vk::SparseMemoryBind bind{ color->imageMipTailOffset, color->imageMipTailSize, texture.memory.memory, texture.memory.offset };
+			vk::SparseImageOpaqueMemoryBindInfo opaque{ *texture.image, 1, &bind };
+			vk::BindSparseInfo bind_info{};
+			bind_info.imageOpaqueBindCount = 1;
+			bind_info.pImageOpaqueBinds = &opaque;
+			submitBind(bind_info);
+		}
+	}
+
+	// the memory a fully bound level below the mip tail takes, in sparse blocks of alignment bytes
+	static vk::DeviceSize sparseLevelSize(Texture const& texture, uint32_t level, vk::DeviceSize alignment)
+	{
+		auto const extent = texture.file->extent(level);
+		auto const& granularity = texture.granularity;
+		vk::DeviceSize const blocks_x = (extent.width + granularity.width - 1) / granularity.width;
+		vk::DeviceSize const blocks_y = (extent.height + granularity.height - 1) / granularity.height;
+		return blocks_x * blocks_y * alignment;
+	}
+
+	// memory[i] to level first + i, or no memory to unbind them
+	static std::vector<vk::SparseImageMemoryBind> levelBinds(Ktx2File const& file, uint32_t first, std::vector<Allocation> const& memory, bool unbind)
+	{
+		std::vector<vk::SparseImageMemoryBind> binds;
+		for (uint32_t i = 0; i < memory.size(); ++i)
+		{
+			vk::SparseImageMemoryBind bind{};
+			bind.subresource = vk::ImageSubresource{ vk::ImageAspectFlagBits::eColor, first + i, 0 };
+			// whole levels, which may end off the granularity at the level's edge
+			auto const extent = file.extent(first + i);
+			bind.extent = vk::Extent3D{ extent.width, extent.height, 1 };
+			if (!unbind)
+			{
+				bind.memory = memory[i].memory;
+				bind.memoryOffset = memory[i].offset;
+			}
+			binds.push_back(bind);
+		}
+		return binds;
+	}
+
+	void submitBind(vk::Image image, std::vector<vk::SparseImageMemoryBind> const& binds)
+	{
+		vk::SparseImageMemoryBindInfo image_binds{ image, static_cast<uint32_t>(binds.size()), binds.data() };
+		vk::BindSparseInfo bind_info{};
+		bind_info.imageBindCount = 1;
+		bind_info.pImageBinds = &image_binds;
+		submitBind(bind_info);
+	}
+
+	// binds execute in order on the sparse queue, each one signals the next value of the bind timeline
+	void submitBind(vk::BindSparseInfo bind_info)
+	{
+		auto const wait_value = m_bind_value;
+		auto const signal_value = ++m_bind_value;
+		vk::TimelineSemaphoreSubmitInfo timeline_info{};
+		timeline_info.waitSemaphoreValueCount = wait_value ? 1 : 0;
+		timeline_info.pWaitSemaphoreValues = &wait_value;
+		timeline_info.signalSemaphoreValueCount = 1;
+		timeline_info.pSignalSemaphoreValues = &signal_value;
+
+		bind_info.pNext = &timeline_info;
+		bind_info.waitSemaphoreCount = wait_value ? 1 : 0;
+		bind_info.pWaitSemaphores = &*m_bind_timeline;
+		bind_info.signalSemaphoreCount = 1;
+		bind_info.pSignalSemaphores = &*m_bind_timeline;
+		m_sparse_queue.bindSparse(bind_info, nullptr);
+	}
+
+	// uploads file levels [first, end) into image, whose first mip level is file level image_base
+	vk::DeviceSize upload(vk::Image image, Ktx2File const& file, uint32_t first, uint32_t end, uint32_t image_base)
+	{
+		auto const range = file.levels(first, end);
+		std::vector<vk::BufferImageCopy> regions;
+		for (auto level = first; level < end; ++level)
+		{
+			vk::BufferImageCopy region{};
+			region.bufferOffset = file.level(level).offset - range.offset;
+			region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level - image_base, 0, 1 };
+			auto const extent = file.extent(level);
+			region.imageExtent = vk::Extent3D{ extent.width, extent.height, 1 };
+			regions.push_back(region);
+		}
+		vk::ImageSubresourceRange const subresources{ vk::ImageAspectFlagBits::eColor, first - image_base, end - first, 0, 1 };
+		m_uploads.uploadImage(image, subresources, std::move(regions), file.data() + range.offset, range.size,
+			vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
+		return range.size;
+	}
+
+	// samples the pending levels from the next recorded frame on
+	void publish(Texture& texture, uint64_t submitted)
+	{
+		auto pending = std::move(*texture.pending);
+		texture.pending.reset();
+		if (!texture.sparse)
+		{
+			retireImage(texture, submitted);
+			texture.image = std::move(pending.image);
+			texture.memory = pending.memory;
+			texture.image_base = pending.level;
+		}
+
+		vk::ImageViewCreateInfo view_ci{};
+		view_ci.image = *texture.image;
+		view_ci.viewType = vk::ImageViewType::e2D;
+		view_ci.format = texture.file->format();
+		view_ci.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, pending.level - texture.image_base,
+			texture.file->levelCount() - pending.level, 0, 1 };
+		auto view = m_device.createImageViewUnique(view_ci);
+		auto const slot = m_bindless.addTexture(*view, *m_sampler);
+
+		retireView(texture, submitted);
+		texture.view = std::move(view);
+		texture.slot = slot;
+		texture.resident = pending.level;
+	}
+
+	void retireView(Texture& texture, uint64_t submitted)
+	{
+		if (texture.slot)
+			m_bindless.remove(BindlessTable::Textures, *texture.slot, submitted);
+		texture.slot.reset();
+		if (texture.view)
+			m_retired.retire(submitted, std::move(texture.view));
+		texture.view = {};
+	}
+
+	// without sparse residency
+	void retireImage(Texture& texture, uint64_t submitted)
+	{
+		if (texture.image)
+			m_retired.retire(submitted, std::move(texture.image));
+		texture.image = {};
+		if (texture.memory)
+			m_retired.defer(submitted, [this, memory = texture.memory] { m_allocator.free(memory); });
+		texture.memory = {};
+	}
+
+	void retire(Texture& texture, uint64_t submitted)
+	{
+		retireView(texture, submitted);
+		if (texture.sparse)
+		{
+			// freeing the memory leaves the levels unbound, the image goes with them; an unbind deferred before
+			// is submitted by then but may still run on the sparse queue, so both wait for the bind timeline too
+			auto memory = texture.level_memory;
+			memory.push_back(texture.memory);
+			for (auto const& alloc : memory)
+				m_resident_bytes -= alloc.size;
+			m_retired.defer(submitted, [this, image = texture.image.release(), memory]
+			{
+				m_bind_frees.push_back({ m_bind_value, {}, image });
+				for (auto const& alloc : memory)
+					if (alloc)
+						m_bind_frees.push_back({ m_bind_value, alloc, {} });
+			});
+			texture.image = {};
+			texture.memory = {};
+			return;
+		}
+		m_resident_bytes -= texture.memory.size;
+		retireImage(texture, submitted);
+	}
+
+	void free(BindFree const& pending)
+	{
+		if (pending.image)
+			m_device.destroyImage(pending.image);
+		if (pending.memory)
+			m_allocator.free(pending.memory);
+	}
+
+	void destroy(Texture& texture)
+	{
+		texture.view.reset();
+		texture.image.reset();
+		if (texture.pending)
+		{
+			texture.pending->image.reset();
+			m_allocator.free(texture.pending->memory);
+		}
+		for (auto const& alloc : texture.level_memory)
+			m_allocator.free(alloc);
+		m_allocator.free(texture.memory);
+	}
+
+	vk::Device m_device;
+	vk::PhysicalDevice m_phys_dev;
+	vk::PhysicalDeviceFeatures m_enabled;
+	DeviceAllocator& m_allocator;
+	UploadEngine& m_uploads;
+	BindlessTable& m_bindless;
+	vk::Queue m_sparse_queue;
+	Config m_config;
+	vk::UniqueSampler m_sampler;
+
+	vk::UniqueSemaphore m_bind_timeline;
+	uint64_t m_bind_value = 0;
+	std::deque<BindFree> m_bind_frees;
+	bool m_closing = false;
+
+	mutable std::mutex m_mutex;
+	std::vector<Texture> m_textures;
+	std::vector<uint32_t> m_free;
+	vk::DeviceSize m_resident_bytes = 0;
+	vk::DeviceSize m_budget_limit = VK_WHOLE_SIZE;
+	// counts update() calls, for the least recently used order
+	uint64_t m_frame = 0;
+	// views, images and memory the frames in flight may still use, by frame serial
+	DeletionQueue m_retired;
+};
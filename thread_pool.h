@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size worker pool, tasks get the index of the worker running them so they can use per-thread state.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(uint32_t thread_count = defaultThreadCount())
+	{
+		for (uint32_t i = 0; i < thread_count; ++i)
+			m_threads.emplace_back([this, i] { work(i); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_task_cv.notify_all();
+		for (auto& thread : m_threads)
+			thread.join();
+	}
+
+	static uint32_t defaultThreadCount()
+	{
+		// hardware_concurrency() is 0 where it is unknown
+		return std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+
+	uint32_t size() const { return static_cast<uint32_t>(m_threads.size()); }
+
+	template<typename F>
+	auto submit(F&& f) -> std::future<decltype(f(uint32_t{}))>
+	{
+		using Result = decltype(f(uint32_t{}));
+		auto task = std::make_shared<std::packaged_task<Result(uint32_t)>>(std::forward<F>(f));
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.emplace_back([task](uint32_t worker) { (*task)(worker); });
+			++m_pending;
+		}
+		m_task_cv.notify_one();
+		return result;
+	}
+
+	// blocks until every submitted task has finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle_cv.wait(lock, [this] { return m_pending == 0; });
+	}
+
+private:
+	void work(uint32_t worker)
+	{
+		while (true)
+		{
+			std::function<void(uint32_t)> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_task_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+				if (m_tasks.empty())
+					return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			task(worker);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_pending == 0)
+					m_idle_cv.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void(uint32_t)>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_task_cv;
+	std::condition_variable m_idle_cv;
+	uint32_t m_pending = 0;
+	bool m_stop = false;
+};
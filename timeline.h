@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+// Timeline semaphore of one queue. Every submission signals the next value, so a single monotonic counter
+// replaces per-submission fences: the CPU waits for values, other queues wait for values, and anything
+// retired at submitted() is safe to destroy once completed() reached it. Never has to be reset.
+class Timeline
+{
+public:
+	explicit Timeline(vk::Device device)
+		: m_device(device)
+	{
+		vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> sem_ci{ {}, { vk::SemaphoreType::eTimeline, 0 } };
+		m_semaphore = device.createSemaphoreUnique(sem_ci.get<vk::SemaphoreCreateInfo>());
+	}
+
+	Timeline(Timeline const&) = delete;
+	Timeline& operator=(Timeline const&) = delete;
+
+	vk::Semaphore semaphore() const { return *m_semaphore; }
+
+	// value the next submission signals, advance() once it was submitted
+	uint64_t next() const { return m_submitted + 1; }
+	uint64_t advance() { return ++m_submitted; }
+	uint64_t submitted() const { return m_submitted; }
+
+	// queries the driver, the cached value answers reached() without a call where possible
+	uint64_t completed()
+	{
+		m_completed = std::max(m_completed, m_device.getSemaphoreCounterValue(*m_semaphore));
+		return m_completed;
+	}
+
+	bool reached(uint64_t value)
+	{
+		return value <= m_completed || value <= completed();
+	}
+
+	// false on timeout
+	bool wait(uint64_t value, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max())
+	{
+		if (value <= m_completed)
+			return true;
+		vk::SemaphoreWaitInfo wait_info{};
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &*m_semaphore;
+		wait_info.pValues = &value;
+		if (m_device.waitSemaphores(wait_info, static_cast<uint64_t>(timeout.count())) != vk::Result::eSuccess)
+			return false;
+		m_completed = std::max(m_completed, value);
+		return true;
+	}
+
+private:
+	vk::Device m_device;
+	vk::UniqueSemaphore m_semaphore;
+	uint64_t m_submitted = 0;
+	uint64_t m_completed = 0;
+};
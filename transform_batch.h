@@ -0,0 +1,319 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_BATCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define TRANSFORM_BATCH_NEON
+#include <arm_neon.h>
+#endif
+
+#include <array>
+#include <cstddef>
+
+// column-major like GLSL, element (column c, row r) at m[4 * c + r]
+using Mat4 = std::array<float, 16>;
+
+// n matrices, one array per element; element (column c, row r) of matrix i at m[4 * c + r][i]
+struct Mat4Soa
+{
+	std::array<float*, 16> m{};
+};
+
+struct Mat4SoaConst
+{
+	std::array<float const*, 16> m{};
+
+	Mat4SoaConst() = default;
+	Mat4SoaConst(Mat4Soa const& soa)
+	{
+		for (size_t i = 0; i < 16; ++i)
+			m[i] = soa.m[i];
+	}
+};
+
+struct Vec4Soa
+{
+	float* x = nullptr;
+	float* y = nullptr;
+	float* z = nullptr;
+	float* w = nullptr;
+};
+
+struct Vec4SoaConst
+{
+	float const* x = nullptr;
+	float const* y = nullptr;
+	float const* z = nullptr;
+	float const* w = nullptr;
+};
+
+// Per element transforms on SoA arrays, each lane of a vector register works on its own object so no shuffles are
+// needed. The widest instruction set the CPU has is picked on first use: AVX2 with FMA, SSE2 and NEON, plain loops
+// otherwise. Outputs must not overlap the inputs; counts need no padding, the tail runs through the scalar kernel.
+class TransformBatch
+{
+public:
+	// the instruction set the kernels use, e.g. "avx2"
+	static char const* instructionSet() { return select().name; }
+
+	// out[i] = a[i] * b[i]
+	static void mul(Mat4Soa const& out, Mat4SoaConst const& a, Mat4SoaConst const& b, size_t count) { select().mul(out, a, b, count); }
+	// out[i] = a * b[i]
+	static void mul(Mat4Soa const& out, Mat4 const& a, Mat4SoaConst const& b, size_t count) { select().mulLeft(out, a, b, count); }
+	// out[i] = m[i] * v[i]
+	static void transform(Vec4Soa const& out, Mat4SoaConst const& m, Vec4SoaConst const& v, size_t count) { select().transform(out, m, v, count); }
+	// out[i] = translate(translation[i]) * rotate(rotation[i]) * scale(scale[i])
+	static void compose(Mat4Soa const& out, Vec4SoaConst const& translation, Vec4SoaConst const& rotation, Vec4SoaConst const& scale, size_t count)
+	{
+		select().compose(out, translation, rotation, scale, count);
+	}
+
+private:
+	// the kernels are written once against the operations of a lane type
+	struct Scalar
+	{
+		using V = float;
+		static constexpr size_t width = 1;
+		static V load(float const* p) { return *p; }
+		static void store(float* p, V v) { *p = v; }
+		static V set(float s) { return s; }
+		static V add(V a, V b) { return a + b; }
+		static V sub(V a, V b) { return a - b; }
+		static V mul(V a, V b) { return a * b; }
+		static V madd(V a, V b, V c) { return a * b + c; }
+	};
+
+#ifdef TRANSFORM_BATCH_X86
+	struct Sse
+	{
+		using V = __m128;
+		static constexpr size_t width = 4;
+		static V load(float const* p) { return _mm_loadu_ps(p); }
+		static void store(float* p, V v) { _mm_storeu_ps(p, v); }
+		static V set(float s) { return _mm_set1_ps(s); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V madd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	};
+
+	// MSVC emits AVX intrinsics without /arch:AVX2, other compilers only when the translation unit targets it
+#if defined(_MSC_VER) || defined(__AVX2__)
+#define TRANSFORM_BATCH_AVX2
+	struct Avx2
+	{
+		using V = __m256;
+		static constexpr size_t width = 8;
+		static V load(float const* p) { return _mm256_loadu_ps(p); }
+		static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+		static V set(float s) { return _mm256_set1_ps(s); }
+		static V add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V madd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+	};
+#endif
+#endif
+
+#ifdef TRANSFORM_BATCH_NEON
+	struct Neon
+	{
+		using V = float32x4_t;
+		static constexpr size_t width = 4;
+		static V load(float const* p) { return vld1q_f32(p); }
+		static void store(float* p, V v) { vst1q_f32(p, v); }
+		static V set(float s) { return vdupq_n_f32(s); }
+		static V add(V a, V b) { return vaddq_f32(a, b); }
+		static V sub(V a, V b) { return vsubq_f32(a, b); }
+		static V mul(V a, V b) { return vmulq_f32(a, b); }
+		static V madd(V a, V b, V c) { return vmlaq_f32(c, a, b); }
+	};
+#endif
+
+	// out[i] = a[i] * b[i] for i in [begin, end)
+	template<typename L>
+	static void mulKernel(Mat4Soa const& out, Mat4SoaConst const& a, Mat4SoaConst const& b, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i + L::width <= end; i += L::width)
+		{
+			typename L::V av[16], bv[16];
+			for (size_t e = 0; e < 16; ++e)
+			{
+				av[e] = L::load(a.m[e] + i);
+				bv[e] = L::load(b.m[e] + i);
+			}
+			for (size_t c = 0; c < 4; ++c)
+				for (size_t r = 0; r < 4; ++r)
+				{
+					auto v = L::mul(av[r], bv[4 * c]);
+					v = L::madd(av[4 + r], bv[4 * c + 1], v);
+					v = L::madd(av[8 + r], bv[4 * c + 2], v);
+					v = L::madd(av[12 + r], bv[4 * c + 3], v);
+					L::store(out.m[4 * c + r] + i, v);
+				}
+		}
+	}
+
+	// out[i] = m * b[i], the common matrix is broadcast once
+	template<typename L>
+	static void mulLeftKernel(Mat4Soa const& out, Mat4 const& m, Mat4SoaConst const& b, size_t begin, size_t end)
+	{
+		typename L::V mv[16];
+		for (size_t e = 0; e < 16; ++e)
+			mv[e] = L::set(m[e]);
+		for (size_t i = begin; i + L::width <= end; i += L::width)
+		{
+			typename L::V bv[16];
+			for (size_t e = 0; e < 16; ++e)
+				bv[e] = L::load(b.m[e] + i);
+			for (size_t c = 0; c < 4; ++c)
+				for (size_t r = 0; r < 4; ++r)
+				{
+					auto v = L::mul(mv[r], bv[4 * c]);
+					v = L::madd(mv[4 + r], bv[4 * c + 1], v);
+					v = L::madd(mv[8 + r], bv[4 * c + 2], v);
+					v = L::madd(mv[12 + r], bv[4 * c + 3], v);
+					L::store(out.m[4 * c + r] + i, v);
+				}
+		}
+	}
+
+	// out[i] = m[i] * v[i]
+	template<typename L>
+	static void transformKernel(Vec4Soa const& out, Mat4SoaConst const& m, Vec4SoaConst const& v, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i + L::width <= end; i += L::width)
+		{
+			auto const x = L::load(v.x + i), y = L::load(v.y + i), z = L::load(v.z + i), w = L::load(v.w + i);
+			float* const dst[4] = { out.x, out.y, out.z, out.w };
+			for (size_t r = 0; r < 4; ++r)
+			{
+				auto p = L::mul(L::load(m.m[r] + i), x);
+				p = L::madd(L::load(m.m[4 + r] + i), y, p);
+				p = L::madd(L::load(m.m[8 + r] + i), z, p);
+				p = L::madd(L::load(m.m[12 + r] + i), w, p);
+				L::store(dst[r] + i, p);
+			}
+		}
+	}
+
+	// out[i] = translate(t[i]) * rotate(q[i]) * scale(s[i]); q is a unit quaternion xyzw, t.w and s.w are unused
+	template<typename L>
+	static void composeKernel(Mat4Soa const& out, Vec4SoaConst const& t, Vec4SoaConst const& q, Vec4SoaConst const& s, size_t begin, size_t end)
+	{
+		auto const zero = L::set(0.0f), one = L::set(1.0f), two = L::set(2.0f);
+		for (size_t i = begin; i + L::width <= end; i += L::width)
+		{
+			auto const qx = L::load(q.x + i), qy = L::load(q.y + i), qz = L::load(q.z + i), qw = L::load(q.w + i);
+			auto const x2 = L::mul(qx, two), y2 = L::mul(qy, two), z2 = L::mul(qz, two);
+			auto const xx = L::mul(qx, x2), yy = L::mul(qy, y2), zz = L::mul(qz, z2);
+			auto const xy = L::mul(qx, y2), xz = L::mul(qx, z2), yz = L::mul(qy, z2);
+			auto const wx = L::mul(qw, x2), wy = L::mul(qw, y2), wz = L::mul(qw, z2);
+			auto const sx = L::load(s.x + i), sy = L::load(s.y + i), sz = L::load(s.z + i);
+
+			L::store(out.m[0] + i, L::mul(L::sub(one, L::add(yy, zz)), sx));
+			L::store(out.m[1] + i, L::mul(L::add(xy, wz), sx));
+			L::store(out.m[2] + i, L::mul(L::sub(xz, wy), sx));
+			L::store(out.m[3] + i, zero);
+			L::store(out.m[4] + i, L::mul(L::sub(xy, wz), sy));
+			L::store(out.m[5] + i, L::mul(L::sub(one, L::add(xx, zz)), sy));
+			L::store(out.m[6] + i, L::mul(L::add(yz, wx), sy));
+			L::store(out.m[7] + i, zero);
+			L::store(out.m[8] + i, L::mul(L::add(xz, wy), sz));
+			L::store(out.m[9] + i, L::mul(L::sub(yz, wx), sz));
+			L::store(out.m[10] + i, L::mul(L::sub(one, L::add(xx, yy)), sz));
+			L::store(out.m[11] + i, zero);
+			L::store(out.m[12] + i, L::load(t.x + i));
+			L::store(out.m[13] + i, L::load(t.y + i));
+			L::store(out.m[14] + i, L::load(t.z + i));
+			L::store(out.m[15] + i, one);
+		}
+	}
+
+	// the vector part up to a multiple of its width, the scalar kernel for the rest
+	template<typename L, auto ScalarKernel, auto VectorKernel, typename... Args>
+	static void run(size_t count, Args const&... args)
+	{
+		auto const vectorized = count - count % L::width;
+		VectorKernel(args..., size_t(0), vectorized);
+		ScalarKernel(args..., vectorized, count);
+	}
+
+	struct Kernels
+	{
+		char const* name;
+		void (*mul)(Mat4Soa const&, Mat4SoaConst const&, Mat4SoaConst const&, size_t);
+		void (*mulLeft)(Mat4Soa const&, Mat4 const&, Mat4SoaConst const&, size_t);
+		void (*transform)(Vec4Soa const&, Mat4SoaConst const&, Vec4SoaConst const&, size_t);
+		void (*compose)(Mat4Soa const&, Vec4SoaConst const&, Vec4SoaConst const&, Vec4SoaConst const&, size_t);
+	};
+
+	template<typename L>
+	static Kernels kernels(char const* name)
+	{
+		Kernels k{};
+		k.name = name;
+		k.mul = [](Mat4Soa const& out, Mat4SoaConst const& a, Mat4SoaConst const& b, size_t count)
+		{
+			run<L, &mulKernel<Scalar>, &mulKernel<L>>(count, out, a, b);
+		};
+		k.mulLeft = [](Mat4Soa const& out, Mat4 const& m, Mat4SoaConst const& b, size_t count)
+		{
+			run<L, &mulLeftKernel<Scalar>, &mulLeftKernel<L>>(count, out, m, b);
+		};
+		k.transform = [](Vec4Soa const& out, Mat4SoaConst const& m, Vec4SoaConst const& v, size_t count)
+		{
+			run<L, &transformKernel<Scalar>, &transformKernel<L>>(count, out, m, v);
+		};
+		k.compose = [](Mat4Soa const& out, Vec4SoaConst const& t, Vec4SoaConst const& q, Vec4SoaConst const& s, size_t count)
+		{
+			run<L, &composeKernel<Scalar>, &composeKernel<L>>(count, out, t, q, s);
+		};
+		return k;
+	}
+
+#ifdef TRANSFORM_BATCH_AVX2
+	// AVX2 and FMA, and an OS that saves the YMM registers
+	static bool hasAvx2()
+	{
+#ifdef _MSC_VER
+		int info[4]{};
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool const fma = (info[2] & (1 << 12)) != 0;
+		bool const osxsave = (info[2] & (1 << 27)) != 0;
+		if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+#endif
+
+	static Kernels const& select()
+	{
+		static Kernels const selected = []
+		{
+#ifdef TRANSFORM_BATCH_AVX2
+			if (hasAvx2())
+				return kernels<Avx2>("avx2");
+#endif
+#if defined(TRANSFORM_BATCH_X86)
+			return kernels<Sse>("sse2");
+#elif defined(TRANSFORM_BATCH_NEON)
+			return kernels<Neon>("neon");
+#else
+			return kernels<Scalar>("scalar");
+#endif
+		}();
+		return selected;
+	}
+};
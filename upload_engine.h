@@ -0,0 +1,321 @@
+#pragma once
+
+#include "device_allocator.h"
+#include "submit_batcher.h"
+#include "watchdog.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <vector>
+
+// Runs large uploads on the transfer queue. Copies are batched into one submission per submit() that signals
+// the engine's timeline semaphore; when the transfer family differs from the graphics family, buffers and images
+// are released on the transfer queue and acquired by the barriers recordAcquireBarriers() puts on the graphics queue.
+// Submissions are queued on the batcher and reach the GPU with its next flush of the transfer queue.
+class UploadEngine
+{
+public:
+	struct Wait
+	{
+		vk::Semaphore semaphore;
+		uint64_t value = 0;
+	};
+
+	UploadEngine(vk::Device device, DeviceAllocator& allocator, SubmitBatcher& batcher, Watchdog& watchdog, vk::Queue transfer_queue,
+		uint32_t transfer_family, uint32_t graphics_family)
+		: m_device(device)
+		, m_allocator(allocator)
+		, m_batcher(batcher)
+		, m_watchdog(watchdog)
+		, m_queue(transfer_queue)
+		, m_transfer_family(transfer_family)
+		, m_graphics_family(graphics_family)
+	{
+		vk::CommandPoolCreateInfo cmd_pool_ci{};
+		cmd_pool_ci.queueFamilyIndex = transfer_family;
+		cmd_pool_ci.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+		m_pool = device.createCommandPoolUnique(cmd_pool_ci);
+
+		vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> sem_ci{ {}, { vk::SemaphoreType::eTimeline, 0 } };
+		m_timeline = device.createSemaphoreUnique(sem_ci.get<vk::SemaphoreCreateInfo>());
+	}
+
+	~UploadEngine()
+	{
+		// staging memory must not be freed under running copies
+		if (m_submitted_value != 0)
+		{
+			try
+			{
+				wait(m_submitted_value);
+			}
+			catch (...)
+			{}
+		}
+		for (auto& batch : m_in_flight)
+			for (auto const& staging : batch.staging)
+				release(staging);
+		for (auto const& staging : m_recording.staging)
+			release(staging);
+	}
+
+	UploadEngine(UploadEngine const&) = delete;
+	UploadEngine& operator=(UploadEngine const&) = delete;
+
+	bool ownershipTransfer() const { return m_transfer_family != m_graphics_family; }
+	vk::Semaphore timeline() const { return *m_timeline; }
+
+	// value signaled by the next submit(), uploads recorded now are complete once the timeline reaches it
+	uint64_t nextValue() const { return m_submitted_value + 1; }
+
+	void uploadBuffer(vk::Buffer dst, vk::DeviceSize dst_offset, void const* data, vk::DeviceSize size,
+		vk::PipelineStageFlags dst_stage, vk::AccessFlags dst_access)
+	{
+		auto const cmd = recordingCommandBuffer();
+		auto const staging = stage(data, size);
+		cmd.copyBuffer(staging.buffer, dst, vk::BufferCopy{ 0, dst_offset, size });
+
+		vk::BufferMemoryBarrier barrier{};
+		barrier.buffer = dst;
+		barrier.offset = dst_offset;
+		barrier.size = size;
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		// real families only for an ownership transfer, a plain barrier ignores them
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		if (ownershipTransfer())
+		{
+			barrier.srcQueueFamilyIndex = m_transfer_family;
+			barrier.dstQueueFamilyIndex = m_graphics_family;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, barrier, nullptr);
+		}
+
+		barrier.srcAccessMask = {};
+		barrier.dstAccessMask = dst_access;
+		m_recording.buffer_acquires.push_back({ barrier, dst_stage });
+		m_recording.staging.push_back(staging);
+	}
+
+	// the next submit() waits for it, e.g. for the sparse binding of an image the uploads write
+	void waitBefore(vk::Semaphore semaphore, uint64_t value)
+	{
+		recordingCommandBuffer();
+		m_recording.waits.push_back({ semaphore, value, vk::PipelineStageFlagBits::eTransfer });
+	}
+
+	// copies regions (buffer offsets relative to data) into dst and leaves the image in final_layout
+	void uploadImage(vk::Image dst, vk::ImageSubresourceRange const& range, std::vector<vk::BufferImageCopy> regions,
+		void const* data, vk::DeviceSize size, vk::ImageLayout final_layout, vk::PipelineStageFlags dst_stage, vk::AccessFlags dst_access)
+	{
+		auto const cmd = recordingCommandBuffer();
+		auto const staging = stage(data, size);
+
+		vk::ImageMemoryBarrier to_transfer{};
+		to_transfer.image = dst;
+		to_transfer.subresourceRange = range;
+		to_transfer.oldLayout = vk::ImageLayout::eUndefined;
+		to_transfer.newLayout = vk::ImageLayout::eTransferDstOptimal;
+		to_transfer.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+		to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_transfer);
+		cmd.copyBufferToImage(staging.buffer, dst, vk::ImageLayout::eTransferDstOptimal, regions);
+
+		vk::ImageMemoryBarrier barrier{};
+		barrier.image = dst;
+		barrier.subresourceRange = range;
+		barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+		barrier.newLayout = final_layout;
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		if (ownershipTransfer())
+		{
+			// release and acquire both carry the layout transition
+			barrier.srcQueueFamilyIndex = m_transfer_family;
+			barrier.dstQueueFamilyIndex = m_graphics_family;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, barrier);
+			barrier.srcAccessMask = {};
+		}
+		barrier.dstAccessMask = dst_access;
+		m_recording.image_acquires.push_back({ barrier, dst_stage });
+		m_recording.staging.push_back(staging);
+	}
+
+	// submits everything recorded since the last call, returns the timeline value it signals
+	uint64_t submit()
+	{
+		if (!m_recording.cmd)
+			return m_submitted_value;
+
+		m_recording.cmd.end();
+		m_recording.value = ++m_submitted_value;
+
+		m_batcher.add(m_queue, { m_recording.cmd }, m_recording.waits, { { *m_timeline, m_recording.value } });
+
+		m_in_flight.push_back(std::move(m_recording));
+		m_recording = {};
+		return m_submitted_value;
+	}
+
+	// records the graphics side of all submitted uploads that were not acquired yet; the graphics submission
+	// has to wait for takeGraphicsWait() before it may execute them
+	void recordAcquireBarriers(vk::CommandBuffer cmd)
+	{
+		for (auto& batch : m_in_flight)
+		{
+			if (batch.acquired)
+				continue;
+			batch.acquired = true;
+			m_graphics_wait = std::max(m_graphics_wait, batch.value);
+
+			vk::PipelineStageFlags dst_stage{};
+			std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+			std::vector<vk::ImageMemoryBarrier> image_barriers;
+			for (auto const& acquire : batch.buffer_acquires)
+			{
+				buffer_barriers.push_back(acquire.barrier);
+				dst_stage |= acquire.dst_stage;
+			}
+			for (auto const& acquire : batch.image_acquires)
+			{
+				image_barriers.push_back(acquire.barrier);
+				dst_stage |= acquire.dst_stage;
+			}
+			if (!buffer_barriers.empty() || !image_barriers.empty())
+				cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, dst_stage, {}, nullptr, buffer_barriers, image_barriers);
+		}
+	}
+
+	bool hasPendingAcquires() const
+	{
+		for (auto const& batch : m_in_flight)
+			if (!batch.acquired)
+				return true;
+		return false;
+	}
+
+	std::optional<Wait> takeGraphicsWait()
+	{
+		if (m_graphics_wait == 0)
+			return std::nullopt;
+		Wait wait{ *m_timeline, m_graphics_wait };
+		m_graphics_wait = 0;
+		return wait;
+	}
+
+	// recycles command buffers and staging memory of completed, acquired batches
+	void collect()
+	{
+		auto const completed = m_device.getSemaphoreCounterValue(*m_timeline);
+		while (!m_in_flight.empty() && m_in_flight.front().value <= completed && m_in_flight.front().acquired)
+		{
+			auto& batch = m_in_flight.front();
+			for (auto const& staging : batch.staging)
+				release(staging);
+			m_free_cmds.push_back(batch.cmd);
+			m_in_flight.pop_front();
+		}
+	}
+
+	// bounded by the watchdog, a transfer queue that stops making progress is reported as a hang
+	void wait(uint64_t value)
+	{
+		// the batch signaling the value may still be queued
+		m_batcher.flush(m_queue);
+		m_watchdog.waitForSemaphore(m_device, *m_timeline, value);
+	}
+
+private:
+	struct Staging
+	{
+		vk::Buffer buffer;
+		Allocation memory;
+	};
+
+	struct BufferAcquire
+	{
+		vk::BufferMemoryBarrier barrier;
+		vk::PipelineStageFlags dst_stage;
+	};
+
+	struct ImageAcquire
+	{
+		vk::ImageMemoryBarrier barrier;
+		vk::PipelineStageFlags dst_stage;
+	};
+
+	struct Batch
+	{
+		vk::CommandBuffer cmd;
+		uint64_t value = 0;
+		bool acquired = false;
+		std::vector<SubmitBatcher::Semaphore> waits;
+		std::vector<Staging> staging;
+		std::vector<BufferAcquire> buffer_acquires;
+		std::vector<ImageAcquire> image_acquires;
+	};
+
+	vk::CommandBuffer recordingCommandBuffer()
+	{
+		if (m_recording.cmd)
+			return m_recording.cmd;
+
+		if (m_free_cmds.empty())
+		{
+			vk::CommandBufferAllocateInfo cmd_b_ai{};
+			cmd_b_ai.commandPool = *m_pool;
+			cmd_b_ai.commandBufferCount = 1;
+			cmd_b_ai.level = vk::CommandBufferLevel::ePrimary;
+			m_free_cmds.push_back(m_device.allocateCommandBuffers(cmd_b_ai).front());
+		}
+		m_recording.cmd = m_free_cmds.back();
+		m_free_cmds.pop_back();
+
+		vk::CommandBufferBeginInfo begin_info{};
+		begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		m_recording.cmd.begin(begin_info);
+		return m_recording.cmd;
+	}
+
+	Staging stage(void const* data, vk::DeviceSize size)
+	{
+		vk::BufferCreateInfo buf_ci{};
+		buf_ci.size = size;
+		buf_ci.usage = vk::BufferUsageFlagBits::eTransferSrc;
+		buf_ci.sharingMode = vk::SharingMode::eExclusive;
+
+		Staging staging{};
+		staging.buffer = m_device.createBuffer(buf_ci);
+		auto const host_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+		staging.memory = m_allocator.allocateFor(staging.buffer, host_flags, host_flags, AllocationStrategy::Linear);
+		std::memcpy(staging.memory.mapped, data, static_cast<size_t>(size));
+		return staging;
+	}
+
+	void release(Staging const& staging)
+	{
+		m_device.destroyBuffer(staging.buffer);
+		m_allocator.free(staging.memory);
+	}
+
+	vk::Device m_device;
+	DeviceAllocator& m_allocator;
+	SubmitBatcher& m_batcher;
+	Watchdog& m_watchdog;
+	vk::Queue m_queue;
+	uint32_t m_transfer_family;
+	uint32_t m_graphics_family;
+
+	vk::UniqueCommandPool m_pool;
+	vk::UniqueSemaphore m_timeline;
+	uint64_t m_submitted_value = 0;
+	uint64_t m_graphics_wait = 0;
+
+	Batch m_recording;
+	std::deque<Batch> m_in_flight;
+	std::vector<vk::CommandBuffer> m_free_cmds;
+};
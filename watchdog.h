@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// GpuHung: the driver still answers but submitted work never completes.
+// DriverHung: a driver call itself did not return in time.
+enum class HangKind
+{
+	GpuHung,
+	DriverHung
+};
+
+inline char const* toString(HangKind kind)
+{
+	return kind == HangKind::GpuHung ? "GPU hung" : "driver hung";
+}
+
+class HangError : public std::runtime_error
+{
+public:
+	HangError(HangKind kind, std::string const& what)
+		: std::runtime_error(std::string(toString(kind)) + ": " + what)
+		, m_kind(kind)
+	{}
+
+	HangKind kind() const { return m_kind; }
+
+private:
+	HangKind m_kind;
+};
+
+struct WatchdogConfig
+{
+	std::chrono::milliseconds device_creation_deadline{ 5000 };
+	// first fence wait timeout, doubled on every escalation
+	std::chrono::milliseconds fence_timeout{ 250 };
+	uint32_t fence_escalations = 4;
+	// extra time a bounded driver call gets to return after its own timeout expired
+	std::chrono::milliseconds driver_grace{ 1000 };
+	std::chrono::milliseconds poll_interval{ 10 };
+};
+
+class Watchdog
+{
+public:
+	// called from the monitor thread when an armed call overruns; a real driver hang never returns,
+	// so the handler has to fail over (e.g. terminate the process) rather than throw
+	using HangHandler = std::function<void(HangKind, char const* what, std::chrono::milliseconds elapsed)>;
+
+	class Guard
+	{
+	public:
+		explicit Guard(Watchdog* watchdog) : m_watchdog(watchdog) {}
+		Guard(Guard&& other) noexcept : m_watchdog(other.m_watchdog) { other.m_watchdog = nullptr; }
+		Guard(Guard const&) = delete;
+		Guard& operator=(Guard const&) = delete;
+		~Guard() { if (m_watchdog) m_watchdog->disarm(); }
+
+	private:
+		Watchdog* m_watchdog;
+	};
+
+	explicit Watchdog(WatchdogConfig const& config = {}, HangHandler handler = defaultHandler)
+		: m_config(config)
+		, m_handler(std::move(handler))
+		, m_monitor([this] { monitor(); })
+	{}
+
+	~Watchdog()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_monitor.join();
+	}
+
+	WatchdogConfig const& config() const { return m_config; }
+
+	// only one call may be armed at a time; what must be a string literal
+	Guard arm(char const* what, std::chrono::milliseconds budget)
+	{
+		m_what.store(what, std::memory_order_relaxed);
+		m_armed_at.store(now(), std::memory_order_relaxed);
+		m_deadline.store(now() + std::chrono::duration_cast<std::chrono::nanoseconds>(budget).count(), std::memory_order_release);
+		return Guard{ this };
+	}
+
+	// runs f on a detached worker so a call that never returns cannot block the caller;
+	// everything f references must outlive the worker, so capture owned copies
+	template<typename F>
+	auto runWithDeadline(char const* what, std::chrono::milliseconds deadline, F&& f) -> decltype(f())
+	{
+		using Result = decltype(f());
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+		auto result = task->get_future();
+		std::thread([task] { (*task)(); }).detach();
+		if (result.wait_for(deadline) != std::future_status::ready)
+			throw HangError(HangKind::DriverHung, std::string(what) + " did not return within " + std::to_string(deadline.count()) + " ms");
+		return result.get();
+	}
+
+	vk::UniqueDevice createDevice(vk::PhysicalDevice phys_dev, std::function<vk::UniqueDevice(vk::PhysicalDevice)> create)
+	{
+		return runWithDeadline("vkCreateDevice", m_config.device_creation_deadline,
+			[phys_dev, create = std::move(create)] { return create(phys_dev); });
+	}
+
+	// waits with escalating finite timeouts; throws HangError(GpuHung) if the fence never signals
+	// while the driver keeps answering, vk::DeviceLostError propagates as usual
+	void waitForFences(vk::Device device, vk::ArrayProxy<const vk::Fence> fences)
+	{
+		auto timeout = m_config.fence_timeout;
+		for (uint32_t attempt = 0; attempt <= m_config.fence_escalations; ++attempt)
+		{
+			auto const guard = arm("vkWaitForFences", timeout + m_config.driver_grace);
+			auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+			if (device.waitForFences(fences, true, static_cast<uint64_t>(ns)) == vk::Result::eSuccess)
+				return;
+			std::cerr << "Fence wait timed out after " << timeout.count() << " ms, escalating..." << std::endl;
+			timeout *= 2;
+		}
+		throw HangError(HangKind::GpuHung, "fence did not signal after " + std::to_string(m_config.fence_escalations) + " escalations");
+	}
+
+	// waitForFences for a timeline semaphore value
+	void waitForSemaphore(vk::Device device, vk::Semaphore semaphore, uint64_t value)
+	{
+		vk::SemaphoreWaitInfo wait_info{};
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &semaphore;
+		wait_info.pValues = &value;
+		auto timeout = m_config.fence_timeout;
+		for (uint32_t attempt = 0; attempt <= m_config.fence_escalations; ++attempt)
+		{
+			auto const guard = arm("vkWaitSemaphores", timeout + m_config.driver_grace);
+			auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+			if (device.waitSemaphores(wait_info, static_cast<uint64_t>(ns)) == vk::Result::eSuccess)
+				return;
+			std::cerr << "Timeline wait timed out after " << timeout.count() << " ms, escalating..." << std::endl;
+			timeout *= 2;
+		}
+		throw HangError(HangKind::GpuHung, "timeline value " + std::to_string(value) + " not reached after " + std::to_string(m_config.fence_escalations) + " escalations");
+	}
+
+	static void defaultHandler(HangKind kind, char const* what, std::chrono::milliseconds elapsed)
+	{
+		std::cerr << "Watchdog: " << toString(kind) << " in " << what << " after " << elapsed.count() << " ms" << std::endl;
+		std::_Exit(EXIT_FAILURE);
+	}
+
+private:
+	static int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void disarm()
+	{
+		m_deadline.store(0, std::memory_order_release);
+	}
+
+	void monitor()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_cv.wait_for(lock, m_config.poll_interval, [this] { return m_stop; }))
+		{
+			auto const deadline = m_deadline.load(std::memory_order_acquire);
+			if (deadline == 0 || now() < deadline)
+				continue;
+			auto const elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(now() - m_armed_at.load(std::memory_order_relaxed)));
+			disarm();
+			m_handler(HangKind::DriverHung, m_what.load(std::memory_order_relaxed), elapsed);
+		}
+	}
+
+	WatchdogConfig m_config;
+	HangHandler m_handler;
+
+	std::atomic<int64_t> m_deadline{ 0 };
+	std::atomic<int64_t> m_armed_at{ 0 };
+	std::atomic<char const*> m_what{ "" };
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop = false;
+	std::thread m_monitor;
+};